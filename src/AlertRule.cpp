@@ -0,0 +1,109 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: threshold alerts evaluated by the service after every sampling cycle
+//======================================================================================================================
+
+#include "AlertRule.hpp"
+
+#include "TextParsing.hpp"  // nextWord
+
+#include <cstdlib>
+#include <cmath>
+using std::string;
+using std::string_view;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// the alerts that have to last longer than a day to be raised are surely a typo
+static const float maxMinDuration_ms = 24 * 3600 * 1000;
+
+static bool parseNumber( string_view word, float & number )
+{
+	string numberStr( word );
+	char * end = nullptr;
+	number = strtof( numberStr.c_str(), &end );
+	return !numberStr.empty() && end == numberStr.c_str() + numberStr.size() && std::isfinite( number );
+}
+
+string parseAlertRule( string_view definition, AlertRule & rule )
+{
+	const string quoted = "alert rule \"" + string( definition ) + "\"";
+	string_view rest = definition;
+
+	string_view sensorID = nextWord( rest );
+	if (sensorID.empty() || sensorID.front() != '/')
+		return quoted + " must start with a sensor ID";
+	rule.sensorID = string( sensorID );
+
+	string_view comparison = nextWord( rest );
+	if (comparison != ">" && comparison != "<")
+		return quoted + " must have \">\" or \"<\" after the sensor ID";
+	rule.whenAbove = comparison == ">";
+
+	if (!parseNumber( nextWord( rest ), rule.threshold ))
+		return quoted + " must have a threshold after \"" + string( comparison ) + "\"";
+
+	rule.hysteresis = 0.0f;
+	rule.minDuration_ms = 0;
+	for (string_view option = nextWord( rest ); !option.empty(); option = nextWord( rest ))
+	{
+		float number = 0.0f;
+		if (!parseNumber( nextWord( rest ), number ) || number < 0.0f)
+			return quoted + ": \"" + string( option ) + "\" must be followed by a non-negative number";
+
+		if (option == "hysteresis")
+			rule.hysteresis = number;
+		else if (option == "for")
+		{
+			if (number > maxMinDuration_ms)
+				return quoted + ": \"for\" must be at most " + std::to_string( uint32_t( maxMinDuration_ms ) ) + " ms";
+			rule.minDuration_ms = uint32_t( number );
+		}
+		else
+			return quoted + ": unknown option \"" + string( option ) + "\", possible options are hysteresis and for";
+	}
+
+	return {};
+}
+
+bool AlertTracker::update( float value, uint64_t timestamp_us )
+{
+	const bool pastThreshold = _rule.whenAbove ? value > _rule.threshold : value < _rule.threshold;
+
+	switch (_phase)
+	{
+		case Phase::Cleared:
+			if (!pastThreshold)
+				return false;
+			_phase = Phase::Pending;
+			_pendingSince_us = timestamp_us;
+			[[fallthrough]];  // with no minimum duration it is raised right away
+
+		case Phase::Pending:
+			if (!pastThreshold)
+			{
+				_phase = Phase::Cleared;  // it didn't last long enough, nobody has been told about it
+				return false;
+			}
+			if (timestamp_us - _pendingSince_us < uint64_t( _rule.minDuration_ms ) * 1000)
+				return false;
+			_phase = Phase::Raised;
+			return true;
+
+		case Phase::Raised:
+		{
+			const bool backInRange = _rule.whenAbove
+				? value <= _rule.threshold - _rule.hysteresis
+				: value >= _rule.threshold + _rule.hysteresis;
+			if (!backInRange)
+				return false;
+			_phase = Phase::Cleared;
+			return true;
+		}
+	}
+
+	return false;
+}
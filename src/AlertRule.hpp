@@ -0,0 +1,66 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: threshold alerts evaluated by the service after every sampling cycle
+//======================================================================================================================
+
+#ifndef ALERT_RULE_INCLUDED
+#define ALERT_RULE_INCLUDED
+
+
+#include "Protocol.hpp"  // AlertState
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// One entry of the alert_rules option: "<sensor ID> > <threshold> [hysteresis <delta>] [for <milliseconds>]",
+/// or the same with "<" for the alerts raised when the value falls below the threshold.
+struct AlertRule
+{
+	std::string sensorID;
+	bool whenAbove;                ///< raised when the value is above the threshold, otherwise when it is below
+	float threshold;
+	float hysteresis = 0.0f;       ///< the alert is cleared only when the value gets this far back past the threshold
+	uint32_t minDuration_ms = 0;   ///< the value must stay past the threshold this long before the alert is raised, at most a day
+};
+
+/// Parses one entry of the alert_rules option, returns error message or empty string on success.
+std::string parseAlertRule( std::string_view definition, AlertRule & rule );
+
+/// The state of one alert rule, updated incrementally with every new sample of its sensor.
+class AlertTracker
+{
+ public:
+
+	explicit AlertTracker( const AlertRule & rule ) : _rule( rule ), _phase( Phase::Cleared ), _pendingSince_us( 0 ) {}
+
+	const AlertRule & rule() const { return _rule; }
+
+	AlertState state() const { return _phase == Phase::Raised ? AlertState::Raised : AlertState::Cleared; }
+
+	/// Feeds the rule with a new sample of its sensor, returns true if the sample has raised or cleared the alert.
+	/** Failed readings must not be passed here, the alert keeps its state while the sensor can't be read. */
+	bool update( float value, uint64_t timestamp_us );
+
+ private:
+
+	enum class Phase
+	{
+		Cleared,
+		Pending,   ///< past the threshold, but not for long enough yet
+		Raised,
+	};
+
+	AlertRule _rule;
+	Phase _phase;
+	uint64_t _pendingSince_us;
+
+};
+
+
+#endif // ALERT_RULE_INCLUDED
@@ -7,6 +7,9 @@
 
 #include "Config.hpp"
 
+#include "SensorStatistics.hpp"  // maxMedianWindow
+#include "SampleHistory.hpp"     // maxHistoryRetention_h
+
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <tchar.h>
@@ -17,6 +20,7 @@
 #include <fstream>
 #include <sstream>
 #include <cctype>
+#include <algorithm>
 using std::optional;
 using std::string;
 using std::vector;
@@ -30,6 +34,24 @@ static const char * const maxConnectedClients_str = "max_connected_clients";
 static const char * const logLevel_str = "log_level";
 static const char * const logToUDPSocket_str = "log_to_udp_socket";
 static const char * const logPort_str = "log_port";
+static const char * const minOnDemandInterval_str = "min_on_demand_interval";
+static const char * const maxOnDemandReadsPerSecond_str = "max_on_demand_reads_per_second";
+static const char * const reenumerationInterval_str = "reenumeration_interval";
+static const char * const derivedSensors_str = "derived_sensors";
+static const char * const alertRules_str = "alert_rules";
+static const char * const alertPort_str = "alert_port";
+static const char * const smoothingSamples_str = "smoothing_samples";
+static const char * const medianWindow_str = "median_window";
+static const char * const historyRetention_str = "history_retention";
+static const char * const unixSocket_str = "unix_socket";
+static const char * const udpPort_str = "udp_port";
+static const char * const maxOutputQueue_str = "max_output_queue";
+static const char * const slowClientPolicy_str = "slow_client_policy";
+static const char * const idleTimeout_str = "idle_timeout";
+static const char * const maxClientRequestRate_str = "max_client_request_rate";
+static const char * const maxClientRequestBurst_str = "max_client_request_burst";
+static const char * const overloadWatermark_str = "overload_watermark";
+static const char * const listeners_str = "listeners";
 
 static const char * const logLevels [] =
 {
@@ -39,6 +61,32 @@ static const char * const logLevels [] =
 	"debug",
 };
 
+static const char * const slowClientPolicies [] =
+{
+	"coalesce",
+	"disconnect",
+};
+
+// 1 GiB, more than that is surely a typo
+static const unsigned maxOutputQueueLimit_kB = 1024 * 1024;
+
+// a day, the clients that are quiet for longer than that have no reason to keep the connection
+static const unsigned maxIdleTimeout_s = 24 * 3600;
+
+// an hour, a sensor read on demand less often than that is practically never read on demand
+static const unsigned maxOnDemandInterval_ms = 3600 * 1000;
+
+// the hardware monitoring library cannot read the sensors anywhere near that fast anyway
+static const unsigned maxOnDemandReadsLimit = 10000;
+
+// enumerating the hardware takes seconds, doing it more often would leave no time for the sampling
+static const unsigned minReenumerationInterval_ms = 1000;
+// a day, the devices that appear later than that can wait for a restart of the service
+static const unsigned maxReenumerationInterval_ms = 24 * 3600 * 1000;
+
+// more than the server can handle anyway
+static const unsigned maxRequestLimit = 1000000;
+
 static string concatLogLevels()
 {
 	std::ostringstream oss;
@@ -341,7 +389,7 @@ static string parseList( Parser & parser, vector< string > & list )
 	return {};
 }
 
-static string parseConfig( std::istream & stream, Config & config )
+string parseConfig( std::istream & stream, Config & config )
 {
 	Parser parser( stream );
 	Token token;
@@ -419,6 +467,165 @@ static string parseConfig( std::istream & stream, Config & config )
 			config.logPort = token.intVal;
 			logPort_found = true;
 		}
+		else if (identifier == minOnDemandInterval_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal < 0 || unsigned( token.intVal ) > maxOnDemandInterval_ms)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 0 - %u ms", "min_on_demand_interval", maxOnDemandInterval_ms );
+			}
+			config.minOnDemandInterval_ms = unsigned( token.intVal );
+		}
+		else if (identifier == maxOnDemandReadsPerSecond_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal < 0 || unsigned( token.intVal ) > maxOnDemandReadsLimit)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 0 - %u", "max_on_demand_reads_per_second", maxOnDemandReadsLimit );
+			}
+			config.maxOnDemandReadsPerSecond = unsigned( token.intVal );
+		}
+		else if (identifier == reenumerationInterval_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			// 0 disables the re-enumeration
+			if (token.intVal < 0 || (token.intVal > 0 && unsigned( token.intVal ) < minReenumerationInterval_ms)
+			 || unsigned( token.intVal ) > maxReenumerationInterval_ms)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 0 (disabled) or %u - %u ms",
+					"reenumeration_interval", minReenumerationInterval_ms, maxReenumerationInterval_ms );
+			}
+			config.reenumerationInterval_ms = unsigned( token.intVal );
+		}
+		else if (identifier == derivedSensors_str)
+		{
+			string errorMessage = parseList( parser, config.derivedSensors );
+			if (!errorMessage.empty())
+			{
+				return errorMessage;
+			}
+		}
+		else if (identifier == alertRules_str)
+		{
+			string errorMessage = parseList( parser, config.alertRules );
+			if (!errorMessage.empty())
+			{
+				return errorMessage;
+			}
+		}
+		else if (identifier == alertPort_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal > UINT16_MAX)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 0 - %u", "alert_port", UINT16_MAX );
+			}
+			config.alertPort = uint16_t( token.intVal );
+		}
+		else if (identifier == smoothingSamples_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal < 1)
+			{
+				return makeParsingError( parser, "invalid %s, it must be at least 1", "smoothing_samples" );
+			}
+			config.smoothingSamples = unsigned( token.intVal );
+		}
+		else if (identifier == medianWindow_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal < 1 || unsigned( token.intVal ) > maxMedianWindow)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 1 - %u", "median_window", maxMedianWindow );
+			}
+			config.medianWindow = unsigned( token.intVal );
+		}
+		else if (identifier == historyRetention_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal < 0 || unsigned( token.intVal ) > maxHistoryRetention_h)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 0 - %u hours", "history_retention", maxHistoryRetention_h );
+			}
+			config.historyRetention_h = unsigned( token.intVal );
+		}
+		else if (identifier == unixSocket_str)
+		{
+			EXPECT_NEXT_TOKEN( String, "string" );
+			config.unixSocketPath = token.str;
+		}
+		else if (identifier == udpPort_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal > UINT16_MAX)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 0 - %u", "udp_port", UINT16_MAX );
+			}
+			config.udpPort = uint16_t( token.intVal );
+		}
+		else if (identifier == maxOutputQueue_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal < 1 || unsigned( token.intVal ) > maxOutputQueueLimit_kB)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 1 - %u kB", "max_output_queue", maxOutputQueueLimit_kB );
+			}
+			config.maxOutputQueue_kB = unsigned( token.intVal );
+		}
+		else if (identifier == slowClientPolicy_str)
+		{
+			EXPECT_NEXT_TOKEN( Identifier, "coalesce|disconnect" );
+			auto policyIter = std::find( std::begin(slowClientPolicies), std::end(slowClientPolicies), token.str );
+			if (policyIter == std::end(slowClientPolicies))
+			{
+				return makeParsingError( parser, "invalid %s, possible values are coalesce|disconnect", "slow_client_policy" );
+			}
+			config.slowClientPolicy = SlowClientPolicy( policyIter - std::begin(slowClientPolicies) );
+		}
+		else if (identifier == idleTimeout_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal < 0 || unsigned( token.intVal ) > maxIdleTimeout_s)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 0 - %u seconds", "idle_timeout", maxIdleTimeout_s );
+			}
+			config.idleTimeout_s = unsigned( token.intVal );
+		}
+		else if (identifier == maxClientRequestRate_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal < 0 || unsigned( token.intVal ) > maxRequestLimit)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 0 - %u", "max_client_request_rate", maxRequestLimit );
+			}
+			config.maxClientRequestRate = unsigned( token.intVal );
+		}
+		else if (identifier == maxClientRequestBurst_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal < 1 || unsigned( token.intVal ) > maxRequestLimit)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 1 - %u", "max_client_request_burst", maxRequestLimit );
+			}
+			config.maxClientRequestBurst = unsigned( token.intVal );
+		}
+		else if (identifier == overloadWatermark_str)
+		{
+			EXPECT_NEXT_TOKEN( Integer, "integer" );
+			if (token.intVal < 0 || unsigned( token.intVal ) > maxRequestLimit)
+			{
+				return makeParsingError( parser, "invalid %s, possible values are 0 - %u", "overload_watermark", maxRequestLimit );
+			}
+			config.overloadWatermark = unsigned( token.intVal );
+		}
+		else if (identifier == listeners_str)
+		{
+			string errorMessage = parseList( parser, config.listeners );
+			if (!errorMessage.empty())
+			{
+				return errorMessage;
+			}
+		}
 		else 
 		{
 			return makeParsingError( parser, "unknown configuration variable %s", identifier.c_str() );
@@ -443,7 +650,7 @@ static string parseConfig( std::istream & stream, Config & config )
 	return {};
 }
 
-static optional< string > getExecutableDir()
+optional< string > getExecutableDir()
 {
 	char exePath [MAX_PATH];
 	if (GetModuleFileNameA( NULL, exePath, DWORD( std::size(exePath) ) ) == 0)
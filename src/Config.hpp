@@ -13,18 +13,47 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <optional>
+#include <iosfwd>
 
 extern const char * const defaultConfigFileName;
 
+/// What to do with a client whose responses pile up because it doesn't read them.
+enum class SlowClientPolicy
+{
+	Coalesce,    ///< stop reading its requests until it catches up, then answer them with the values current at that time
+	Disconnect,  ///< close its connection
+};
+
 struct Config
 {
 	unsigned refreshInterval_ms;
-	std::vector< std::string > monitoredSensors;
+	std::vector< std::string > monitoredSensors;  ///< sensor IDs or patterns with wildcards, see SensorPattern.hpp
 	uint16_t port;
 	uint16_t maxConnectedClients;
 	unsigned logLevel;
 	bool logToUDPSocket;
 	uint16_t logPort;
+
+	// optional
+	unsigned minOnDemandInterval_ms = 100;   ///< a sensor is never read on demand more often than this
+	unsigned maxOnDemandReadsPerSecond = 20; ///< on-demand reads of all the sensors together, 0 disables them
+	unsigned reenumerationInterval_ms = 60000; ///< how often to look for connected and disconnected devices, 0 disables it
+	std::vector< std::string > derivedSensors;  ///< "<sensor ID> = <expression>", see SensorExpression.hpp
+	std::vector< std::string > alertRules;      ///< "<sensor ID> > <threshold> ...", see AlertRule.hpp
+	uint16_t alertPort = 0;  ///< local UDP port the alert events are sent to, 0 disables it
+	unsigned smoothingSamples = 10;  ///< span of the moving average of every sensor, in readings
+	unsigned medianWindow = 5;       ///< number of the last readings the median of every sensor is taken from
+	unsigned historyRetention_h = 168;  ///< how long the compressed history of every sensor is kept, 0 disables it
+	std::string unixSocketPath;  ///< path of the Unix domain socket the service listens on besides the TCP port, empty disables it
+	uint16_t udpPort = 0;  ///< UDP port on the loopback for the connectionless sensor and batch requests, 0 disables it
+	unsigned maxOutputQueue_kB = 1024;  ///< responses waiting for a single client, slowClientPolicy applies when there are more
+	SlowClientPolicy slowClientPolicy = SlowClientPolicy::Coalesce;
+	unsigned idleTimeout_s = 600;  ///< a client that neither sends requests nor reads responses for this long is disconnected, 0 disables it
+	unsigned maxClientRequestRate = 1000;  ///< requests per second a single client is served at in the long run, 0 disables the limit
+	unsigned maxClientRequestBurst = 200;  ///< requests a client can send at once above maxClientRequestRate
+	unsigned overloadWatermark = 1000;  ///< requests served in one pass of the server loop, above which only the light clients are served, 0 disables it
+	std::vector< std::string > listeners;  ///< "<port or unix:path> <critical|normal|bulk> [<request type> ...]", see Listener.hpp
 };
 
 /*enum class ConfigResult
@@ -39,4 +68,10 @@ struct Config
 
 std::string readConfig( const std::string & fileName, Config & config );
 
+/// Parses the configuration from a stream, returns error message or empty string on success.
+std::string parseConfig( std::istream & stream, Config & config );
+
+/// Directory of the running executable, where the config and the other data files are.
+std::optional< std::string > getExecutableDir();
+
 #endif // CONFIG_INCLUDED
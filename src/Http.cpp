@@ -0,0 +1,196 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: minimal HTTP/1.1 support for serving the sensor values to scrapers and scripts
+//======================================================================================================================
+
+#include "Http.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <string>
+using std::string;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// only the first 4 bytes are compared, so that we can decide as soon as we can decide about the "SENS" magic
+static const char * const httpMethods [] =
+{
+	"GET ",
+	"HEAD",
+	"POST",
+	"PUT ",
+	"DELE",
+	"OPTI",
+	"PATC",
+};
+
+bool looksLikeHttp( const uint8_t * data, size_t size )
+{
+	if (size < 4)
+		return false;
+
+	for (const char * method : httpMethods)
+		if (memcmp( data, method, 4 ) == 0)
+			return true;
+
+	return false;
+}
+
+static bool equalsIgnoreCase( const char * str, size_t len, const char * expected )
+{
+	size_t expectedLen = strlen( expected );
+	if (len != expectedLen)
+		return false;
+	for (size_t i = 0; i < len; ++i)
+		if (tolower( (unsigned char)str[i] ) != tolower( (unsigned char)expected[i] ))
+			return false;
+	return true;
+}
+
+static const char * findHeaderEnd( const char * data, size_t size )
+{
+	for (size_t i = 3; i < size; ++i)
+		if (data[i] == '\n' && data[i-1] == '\r' && data[i-2] == '\n' && data[i-3] == '\r')
+			return data + i + 1;
+	return nullptr;
+}
+
+HttpParseResult parseHttpRequest( const char * data, size_t size, HttpRequest & request, size_t & requestLength )
+{
+	const char * headerEnd = findHeaderEnd( data, size );
+	if (!headerEnd)
+		return HttpParseResult::Incomplete;
+
+	requestLength = size_t( headerEnd - data );
+
+	// request line: METHOD SP PATH SP VERSION CRLF
+	const char * lineEnd = (const char *)memchr( data, '\r', requestLength );
+	const char * methodEnd = (const char *)memchr( data, ' ', size_t( lineEnd - data ) );
+	if (!methodEnd)
+		return HttpParseResult::Invalid;
+	const char * pathEnd = (const char *)memchr( methodEnd + 1, ' ', size_t( lineEnd - methodEnd - 1 ) );
+	if (!pathEnd)
+		return HttpParseResult::Invalid;
+
+	request.method.assign( data, methodEnd );
+	request.path.assign( methodEnd + 1, pathEnd );
+	// ignore the query string, none of our resources has parameters
+	size_t queryPos = request.path.find( '?' );
+	if (queryPos != string::npos)
+		request.path.resize( queryPos );
+
+	const char * version = pathEnd + 1;
+	size_t versionLen = size_t( lineEnd - version );
+	if (versionLen == 8 && memcmp( version, "HTTP/1.1", 8 ) == 0)
+		request.keepAlive = true;   // persistent by default since 1.1
+	else if (versionLen == 8 && memcmp( version, "HTTP/1.0", 8 ) == 0)
+		request.keepAlive = false;
+	else
+		return HttpParseResult::Invalid;
+
+	// headers: we are only interested in Connection, and we reject bodies we could not skip reliably
+	const char * line = lineEnd + 2;
+	while (line < headerEnd - 2)
+	{
+		const char * end = (const char *)memchr( line, '\r', size_t( headerEnd - line ) );
+		const char * colon = (const char *)memchr( line, ':', size_t( end - line ) );
+		if (!colon)
+			return HttpParseResult::Invalid;
+
+		const char * value = colon + 1;
+		while (value < end && (*value == ' ' || *value == '\t'))
+			++value;
+
+		if (equalsIgnoreCase( line, size_t( colon - line ), "Connection" ))
+		{
+			if (equalsIgnoreCase( value, size_t( end - value ), "close" ))
+				request.keepAlive = false;
+			else if (equalsIgnoreCase( value, size_t( end - value ), "keep-alive" ))
+				request.keepAlive = true;
+		}
+		else if (equalsIgnoreCase( line, size_t( colon - line ), "Content-Length" ))
+		{
+			if (!equalsIgnoreCase( value, size_t( end - value ), "0" ))
+				return HttpParseResult::Invalid;
+		}
+		else if (equalsIgnoreCase( line, size_t( colon - line ), "Transfer-Encoding" ))
+		{
+			return HttpParseResult::Invalid;
+		}
+
+		line = end + 2;
+	}
+
+	return HttpParseResult::Complete;
+}
+
+string makeHttpResponse( unsigned statusCode, const char * statusText, const char * contentType, const string & body, const char * extraHeaders )
+{
+	char header [256];
+	int headerLen = snprintf( header, sizeof(header),
+		"HTTP/1.1 %u %s\r\n"
+		"Content-Type: %s\r\n"
+		"Content-Length: %zu\r\n"
+		"Cache-Control: no-cache\r\n"
+		"%s"
+		"\r\n",
+		statusCode, statusText, contentType, body.size(), extraHeaders
+	);
+
+	string response;
+	response.reserve( size_t( headerLen ) + body.size() );
+	response.append( header, size_t( headerLen ) );
+	response.append( body );
+	return response;
+}
+
+size_t httpHeaderLength( const string & response )
+{
+	size_t pos = response.find( "\r\n\r\n" );
+	return pos != string::npos ? pos + 4 : response.size();
+}
+
+void appendOpenMetricsEscaped( string & out, const string & str )
+{
+	for (char c : str)
+	{
+		switch (c)
+		{
+			case '\\': out += "\\\\"; break;
+			case '"':  out += "\\\""; break;
+			case '\n': out += "\\n";  break;
+			default:   out += c;      break;
+		}
+	}
+}
+
+void appendJsonEscaped( string & out, const string & str )
+{
+	for (char c : str)
+	{
+		switch (c)
+		{
+			case '\\': out += "\\\\"; break;
+			case '"':  out += "\\\""; break;
+			case '\n': out += "\\n";  break;
+			case '\r': out += "\\r";  break;
+			case '\t': out += "\\t";  break;
+			default:
+				if ((unsigned char)c < 0x20)
+				{
+					char escaped [8];
+					snprintf( escaped, sizeof(escaped), "\\u%04x", unsigned( c ) );
+					out += escaped;
+				}
+				else
+				{
+					out += c;
+				}
+				break;
+		}
+	}
+}
@@ -0,0 +1,58 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: minimal HTTP/1.1 support for serving the sensor values to scrapers and scripts
+//======================================================================================================================
+
+#ifndef HTTP_INCLUDED
+#define HTTP_INCLUDED
+
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Returns true if the first bytes received from a client look like a start of a HTTP request line.
+/** At least 4 bytes are needed to make the decision, because that's the length of the "SENS" magic. */
+bool looksLikeHttp( const uint8_t * data, size_t size );
+
+struct HttpRequest
+{
+	std::string method;
+	std::string path;
+	bool keepAlive;
+};
+
+enum class HttpParseResult
+{
+	Complete,     ///< the whole request header has been received and parsed
+	Incomplete,   ///< more data needs to be received
+	Invalid,      ///< the request is malformed
+};
+
+/// Parses a HTTP request header from the beginning of the data.
+/** On success, requestLength is set to the number of bytes the request occupies, including the terminating empty line.
+  * Request bodies are not supported, we only serve GET and HEAD. */
+HttpParseResult parseHttpRequest( const char * data, size_t size, HttpRequest & request, size_t & requestLength );
+
+/// Builds a complete HTTP response with headers and body, ready to be sent by a single send().
+/** extraHeaders are inserted as they are, each of them has to end with "\r\n". */
+std::string makeHttpResponse(
+	unsigned statusCode, const char * statusText, const char * contentType, const std::string & body, const char * extraHeaders = ""
+);
+
+/// Returns the length of the header part of a response built by makeHttpResponse(), used to answer HEAD requests.
+size_t httpHeaderLength( const std::string & response );
+
+/// Appends a string escaped for use as a label value in the OpenMetrics text format.
+void appendOpenMetricsEscaped( std::string & out, const std::string & str );
+
+/// Appends a string escaped for use inside a JSON string literal.
+void appendJsonEscaped( std::string & out, const std::string & str );
+
+
+#endif // HTTP_INCLUDED
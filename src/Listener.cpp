@@ -0,0 +1,120 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: additional listeners, each served by its own thread with its own priority and allowed requests
+//======================================================================================================================
+
+#include "Listener.hpp"
+
+#include "UnixSocket.hpp"   // unixAddressPrefix
+#include "TextParsing.hpp"  // nextWord
+
+#include <cstdlib>
+#include <iterator>
+#include <algorithm>
+using std::string;
+using std::string_view;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static const char * const requestTypeNames [requestTypeCount] =
+{
+	"sensor",
+	"batch",
+	"sample",
+	"changes",
+	"wait",
+	"fresh",
+	"list",
+	"alerts",
+	"statistic",
+	"percentile",
+	"history",
+};
+
+static const char * const priorityClassNames [] =
+{
+	"critical",
+	"normal",
+	"bulk",
+};
+
+// Only these read just the values the sampling thread has already stored, the others walk the catalog or the history,
+// or wait for something, which must not hold up the clients that need their values right away.
+static const uint32_t cachedReads =
+	1u << unsigned( RequestType::Sensor ) | 1u << unsigned( RequestType::Batch ) | 1u << unsigned( RequestType::Sample )
+	| 1u << unsigned( RequestType::Statistic ) | 1u << unsigned( RequestType::Changes );
+
+string parseListener( string_view definition, ListenerConfig & listener )
+{
+	const string quoted = "listener \"" + string( definition ) + "\"";
+	string_view rest = definition;
+
+	listener = ListenerConfig();
+
+	const string_view address = nextWord( rest );
+	const string_view prefix = unixAddressPrefix;
+	if (address.substr( 0, prefix.size() ) == prefix)
+	{
+		listener.unixSocketPath = string( address.substr( prefix.size() ) );
+		if (listener.unixSocketPath.empty())
+			return quoted + " must have a path after \"" + string( prefix ) + "\"";
+	}
+	else
+	{
+		const string portStr( address );
+		char * end = nullptr;
+		const long port = strtol( portStr.c_str(), &end, 10 );
+		if (portStr.empty() || end != portStr.c_str() + portStr.size() || port < 1 || port > UINT16_MAX)
+			return quoted + " must start with a port number or " + string( prefix ) + "<path>";
+		listener.port = uint16_t( port );
+	}
+
+	const string_view priority = nextWord( rest );
+	auto priorityIter = std::find( std::begin(priorityClassNames), std::end(priorityClassNames), priority );
+	if (priorityIter == std::end(priorityClassNames))
+		return quoted + " must have critical, normal or bulk after the address";
+	listener.priority = PriorityClass( priorityIter - std::begin(priorityClassNames) );
+
+	string_view type = nextWord( rest );
+	if (type.empty())
+	{
+		if (listener.priority == PriorityClass::Critical)
+		{
+			listener.allowedRequests = cachedReads;
+			listener.allowsHttp = false;
+		}
+		return {};
+	}
+
+	listener.allowedRequests = 0;
+	listener.allowsHttp = false;
+	for (; !type.empty(); type = nextWord( rest ))
+	{
+		auto typeIter = std::find( std::begin(requestTypeNames), std::end(requestTypeNames), type );
+		if (type == "http")
+			listener.allowsHttp = true;
+		else if (typeIter != std::end(requestTypeNames))
+			listener.allowedRequests |= 1u << unsigned( typeIter - std::begin(requestTypeNames) );
+		else
+			return quoted + ": unknown request type \"" + string( type ) + "\"";
+	}
+
+	if (listener.priority == PriorityClass::Critical && ((listener.allowedRequests & ~cachedReads) != 0 || listener.allowsHttp))
+		return quoted + ": a critical listener can serve only the sensor, batch, sample, statistic and changes requests";
+
+	return {};
+}
+
+const char * enumString( PriorityClass priority )
+{
+	switch (priority)
+	{
+		case PriorityClass::Critical: return "critical";
+		case PriorityClass::Normal:   return "normal";
+		case PriorityClass::Bulk:     return "bulk";
+		default:                      return "<invalid>";
+	}
+}
@@ -0,0 +1,64 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: additional listeners, each served by its own thread with its own priority and allowed requests
+//======================================================================================================================
+
+#ifndef LISTENER_INCLUDED
+#define LISTENER_INCLUDED
+
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Requests of the binary protocol, see Protocol.hpp.
+enum class RequestType
+{
+	Sensor,   ///< SensorRequest
+	Batch,    ///< BatchRequest
+	Sample,   ///< SampleRequest
+	Changes,  ///< ChangesRequest
+	Wait,     ///< WaitRequest
+	Fresh,    ///< FreshRequest
+	List,     ///< ListRequest
+	Alerts,   ///< AlertsRequest
+	Statistic, ///< StatisticRequest
+	Percentile, ///< PercentileRequest
+	History,  ///< HistoryRequest
+};
+constexpr unsigned requestTypeCount = 11;
+
+/// Decides the priority of the thread serving the clients of a listener.
+enum class PriorityClass
+{
+	Critical,  ///< higher than the sampling thread, only the cheap reads of the cached values are allowed
+	Normal,
+	Bulk,      ///< lower than the other threads, for the clients that can wait
+};
+
+/// One entry of the listeners option: "<port or unix:path> <critical|normal|bulk> [<request type> ...]".
+/** The request types are the names of the RequestType values in lower case, and http. Without them, a critical
+  * listener serves the sensor, batch, sample, statistic and changes requests, the other listeners serve everything. */
+struct ListenerConfig
+{
+	uint16_t port = 0;            ///< TCP port, 0 if it listens only on a Unix domain socket
+	std::string unixSocketPath;   ///< path of the Unix domain socket, empty if it listens only on a TCP port
+	PriorityClass priority = PriorityClass::Normal;
+	uint32_t allowedRequests = (1u << requestTypeCount) - 1;  ///< bit 1 << RequestType of every request type it serves
+	bool allowsHttp = true;
+
+	bool allows( RequestType type ) const  { return (allowedRequests & (1u << unsigned( type ))) != 0; }
+};
+
+/// Parses one entry of the listeners option, returns error message or empty string on success.
+std::string parseListener( std::string_view definition, ListenerConfig & listener );
+
+const char * enumString( PriorityClass priority );
+
+
+#endif // LISTENER_INCLUDED
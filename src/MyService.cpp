@@ -12,29 +12,46 @@
 
 #include "Protocol.hpp"
 #include "Config.hpp"
+#include "Http.hpp"
+#include "SensorProvider.hpp"
+#include "SensorData.hpp"
+#include "SensorCache.hpp"
+#include "SensorIndex.hpp"
+#include "SensorPattern.hpp"
+#include "SensorExpression.hpp"
+#include "AlertRule.hpp"
+#include "Listener.hpp"
+#include "SimdKernels.hpp"
+#include "ResponseEncoding.hpp"
+#include "UnixSocket.hpp"
+#include "UdpBatchSocket.hpp"
+#include "TimerWheel.hpp"
 
 #include <CppUtils-Network/Socket.hpp>
 #include <CppUtils-Essential/StringUtils.hpp>  // to_string
 using namespace own;
 
-#include "lhwm-cpp-wrapper.h"
-using SensorMap = std::invoke_result_t< decltype( LHWM::GetHardwareSensorMap ) >;
-
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <shlobj.h>
 #include <tchar.h>
 
 #include <ctime>
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <atomic>
 #include <cstdio>
+#include <cstring>
+#include <cmath>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <deque>
+#include <list>
 #include <memory>
+#include <algorithm>
 using std::string;
 using std::vector;
 using std::unordered_map;
@@ -48,30 +65,94 @@ using std::unique_ptr;
 const TCHAR * const MY_SERVICE_NAME = _T("HwMonitorService");
 
 static HANDLE g_svcStopEvent = NULL;
+/// Signaled by a server thread when it adds a sensor to g_onDemandReads.
+static HANDLE g_onDemandEvent = NULL;
 
 static std::mutex g_logMtx;
 static UdpSocket g_logSocket;
 
-static std::thread g_serverThread;
-//static std::mutex g_serverMtx;
-static TcpServerSocket g_serverSocket;
+/// Listener served by its own server thread, which has its own clients, priority and allowed requests.
+struct ServerLane
+{
+	ListenerConfig config;
+	TcpServerSocket tcpServer;    ///< not open if the lane listens only on a Unix domain socket
+	UnixServerSocket unixServer;  ///< not open if the lane listens only on a TCP port
+	// The sampling thread wakes up the server thread by sending a datagram to this socket,
+	// so that the parked requests are completed as soon as a cycle or an on-demand reading completes.
+	// It listens only on the loopback, at the port the system gives it, and the datagrams carry nothing.
+	UdpBatchSocket wakeSocket { 16, 1 };
+	uint16_t wakePort = 0;        ///< 0 if the wake-up socket could not be opened
+	std::thread thread;
+};
+/// The first lane listens on port and unix_socket and serves everything, the others come from the listeners option.
+/** The lanes don't share any clients, so a lane busy with heavy requests doesn't delay the clients of the other ones. */
+static vector< unique_ptr< ServerLane > > g_lanes;
+static UdpSocket g_wakeSender;
+/// Optional endpoint for the connectionless requests, every datagram is a request and gets a reply datagram.
+/** Served by the first lane. */
+static const size_t udpBatchSize = 64;
+static UdpBatchSocket g_udpQuerySocket( udpBatchSize, maxDatagramSize );
+/// Set when the service is stopping, the server threads check it whenever they wake up.
+static std::atomic< bool > g_stopServer( false );
 
 static Config g_config;
+/// The entries of monitored_sensors that contain wildcards, compiled once and matched at every enumeration.
+static SensorPatternMatcher g_monitoredPatterns;
+/// The sensors from derived_sensors, owned by the sampling thread, which evaluates them at the end of every cycle.
+static vector< DerivedSensor > g_derivedSensors;
 
-enum class SensorState
+/// A rule from alert_rules, owned by the sampling thread, which evaluates it after every cycle.
+struct MonitoredAlert
 {
-	Monitored,              ///< detected by the hardware monitoring library and monitored
-	RequestedButNotFound,   ///< requested to be monitored but not detected by the hardware monitoring library
-	FoundButNotMonitored,   ///< detected by the hardware monitoring library but not monitored
+	AlertTracker tracker;
+	SensorData * sensor;  ///< its entry in the current sensor map, null if it has no entry there
 };
-struct SensorData
-{
-	SensorState state;
-	std::atomic< float > value;
+static vector< MonitoredAlert > g_alerts;
 
-	SensorData( SensorState state ) : state( state ), value( 0.0f ) {}
+struct AlertEvent
+{
+	uint32_t number;   ///< 0 means no event
+	uint32_t rule;     ///< index into g_alerts
+	AlertState state;
+	float value;
+	uint64_t timestamp_us;
 };
-static unordered_map< string, SensorData > g_sensorData;
+/// Alert events, produced by the sampling thread and sent to the clients by the server threads.
+static std::mutex g_alertEventsMtx;
+static std::deque< AlertEvent > g_recentAlertEvents;  ///< the last maxAlertEvents events, for the clients that wait for them
+static vector< AlertEvent > g_lastAlertEvents;        ///< the last event of every rule, to tell which alerts are raised
+static std::atomic< uint32_t > g_lastAlertEvent( 0 );
+/// sends the alert events to the configured local UDP port
+static UdpSocket g_alertSocket;
+
+/// All the known sensors. When the set of sensors changes, the sampling thread builds a new map and replaces this pointer,
+/// a map that has been published is never modified, except for the samples inside it.
+static std::shared_ptr< SensorDataMap > g_sensorData;
+/// Every server thread's own reference to g_sensorData, taken at every iteration of its loop,
+/// so that the map cannot be destroyed while the server is using it.
+static thread_local std::shared_ptr< SensorDataMap > g_servedSensorData;
+/// g_sensorData ordered by the sensor IDs, replaced together with it.
+static std::shared_ptr< const SensorIndex > g_sensorIndex;
+/// Number of the last completed sampling cycle, 0 before the first one completes.
+static std::atomic< uint32_t > g_lastCycle( 0 );
+
+// Sensors that clients need fresher than their last sample, read by the sampling thread between its cycles,
+// so that the hardware is never accessed from two threads. A sensor stays in the set until its reading is stored,
+// so all the requests for it that come meanwhile share the one reading.
+static std::mutex g_onDemandMtx;
+static unordered_set< string > g_onDemandReads;
+
+// Complete HTTP responses (headers + body) rendered by the sampling thread once per cycle,
+// so that answering a scrape is just a single send() no matter how many scrapers there are.
+static std::shared_ptr< const string > g_httpMetricsResponse;
+static std::shared_ptr< const string > g_httpSensorsResponse;
+
+/// When the service started initializing, to measure how long it takes until it can respond.
+static std::chrono::steady_clock::time_point g_startTime;
+
+/// Requests the server thread has served since it last woke up, they all came while it was busy with the previous ones,
+/// so this is how deep the queue of the requests has been. Every server thread has its own.
+static thread_local unsigned g_requestsSinceWakeUp = 0;
 
 
 //======================================================================================================================
@@ -149,7 +230,20 @@ void reportEventAndLog( DWORD eventID, Severity severity, const TCHAR * format,
 //======================================================================================================================
 //  utils
 
-static void populateSensorDataMap( const SensorMap & sensorMap, unordered_map< string, SensorData > & sensorData )
+/// Microseconds of a monotonic clock, used to timestamp the samples.
+static uint64_t monotonicMicroseconds()
+{
+	return uint64_t( std::chrono::duration_cast< std::chrono::microseconds >(
+		std::chrono::steady_clock::now().time_since_epoch()
+	).count() );
+}
+
+static long long millisecondsSinceStart()
+{
+	return std::chrono::duration_cast< std::chrono::milliseconds >( std::chrono::steady_clock::now() - g_startTime ).count();
+}
+
+static void populateSensorDataMap( const SensorMap & sensorMap, SensorDataMap & sensorData )
 {
 	for (const auto & [deviceID, sensors] : sensorMap)
 	{
@@ -158,19 +252,247 @@ static void populateSensorDataMap( const SensorMap & sensorMap, unordered_map< s
 			// std::get<0>(sensor) - sensor display name
 			// std::get<1>(sensor) - sensor category
 			// std::get<2>(sensor) - sensor ID
-			sensorData.emplace( std::get<2>(sensor), SensorState::FoundButNotMonitored );
+			sensorData.try_emplace( std::get<2>(sensor), SensorState::FoundButNotMonitored, std::get<0>(sensor), std::get<1>(sensor) );
+		}
+	}
+}
+
+/// Marks the sensors from the config as monitored, the ones that are not in the map are added as not found.
+static void markMonitoredSensors( SensorDataMap & sensorData, bool logMissing )
+{
+	for (const string & sensorID : g_config.monitoredSensors)  // update the map with sensors we will be monitoring
+	{
+		if (isSensorPattern( sensorID ))
+		{
+			continue;  // matched below
+		}
+
+		auto sensorDataIter = sensorData.find( sensorID );
+		if (sensorDataIter != sensorData.end())
+		{
+			sensorDataIter->second.state = SensorState::Monitored;
+		}
+		else
+		{
+			if (logMissing)
+				log( Severity::Error, _T("Requested sensor %hs not found"), sensorID.c_str() );
+			sensorData.emplace( sensorID, SensorState::RequestedButNotFound );
+		}
+	}
+
+	if (g_monitoredPatterns.patternCount() > 0)
+	{
+		// a single pass over the sensors, each of them is matched against all the patterns at once
+		vector< bool > matchedPatterns( g_monitoredPatterns.patternCount(), false );
+		size_t matchedSensors = 0;
+		for (auto & kvPair : sensorData)
+		{
+			if (kvPair.second.state != SensorState::RequestedButNotFound && g_monitoredPatterns.matches( kvPair.first, &matchedPatterns ))
+			{
+				kvPair.second.state = SensorState::Monitored;
+				++matchedSensors;
+			}
+		}
+
+		size_t patternIdx = 0;
+		for (const string & entry : g_config.monitoredSensors)
+		{
+			if (!isSensorPattern( entry ))
+				continue;
+			if (logMissing && !matchedPatterns[ patternIdx ])
+				log( Severity::Warning, _T("Requested sensor pattern %hs doesn't match any sensor"), entry.c_str() );
+			++patternIdx;
+		}
+
+		log( Severity::Debug, _T("%zu sensors match the patterns in monitored_sensors"), matchedSensors );
+	}
+
+#ifdef SIMULATED_SENSORS
+	// There is no hardware to protect, so monitor everything, load generators can then request any of the sensors.
+	for (auto & kvPair : sensorData)
+	{
+		if (kvPair.second.state == SensorState::FoundButNotMonitored)
+			kvPair.second.state = SensorState::Monitored;
+	}
+#endif
+
+	for (const DerivedSensor & derived : g_derivedSensors)
+	{
+		auto inserted = sensorData.try_emplace( derived.id, SensorState::Monitored, derived.expressionText, derivedSensorCategory );
+		SensorData & data = inserted.first->second;
+		if (!inserted.second && !data.derived && data.state != SensorState::RequestedButNotFound)
+		{
+			if (logMissing)
+				log( Severity::Error, _T("Derived sensor %hs has the same ID as a hardware sensor, ignoring it"), derived.id.c_str() );
+			continue;
+		}
+		data.state = SensorState::Monitored;
+		data.name = derived.expressionText;
+		data.category = derivedSensorCategory;
+		data.derived = true;
+	}
+}
+
+/// Points the derived sensors to the sensors of a map that is about to be published and makes sure their inputs are read.
+static void linkDerivedSensors( SensorDataMap & sensorData, bool logMissing )
+{
+	vector< string > unresolved;
+	for (DerivedSensor & derived : g_derivedSensors)
+	{
+		auto outputIter = sensorData.find( derived.id );
+		derived.output = outputIter != sensorData.end() && outputIter->second.derived ? &outputIter->second : nullptr;
+
+		unresolved.clear();
+		derived.expression.link( sensorData, &unresolved );
+		for (SensorData * input : derived.expression.inputs())
+		{
+			if (input->state == SensorState::FoundButNotMonitored)
+				input->state = SensorState::Monitored;
+		}
+
+		if (logMissing)
+			for (const string & sensorID : unresolved)
+				log( Severity::Warning, _T("Derived sensor %hs refers to %hs, which doesn't match any sensor"), derived.id.c_str(), sensorID.c_str() );
+	}
+}
+
+/// Points the alert rules to the sensors of a map that is about to be published and makes sure the sensors are read.
+static void linkAlertRules( SensorDataMap & sensorData, bool logMissing )
+{
+	for (MonitoredAlert & alert : g_alerts)
+	{
+		const string & sensorID = alert.tracker.rule().sensorID;
+		auto sensorDataIter = sensorData.find( sensorID );
+		if (sensorDataIter == sensorData.end() || sensorDataIter->second.state == SensorState::RequestedButNotFound)
+		{
+			if (logMissing)
+				log( Severity::Warning, _T("Alert rule refers to sensor %hs, which was not found"), sensorID.c_str() );
+			alert.sensor = nullptr;
+			continue;
 		}
+
+		alert.sensor = &sensorDataIter->second;
+		if (alert.sensor->state == SensorState::FoundButNotMonitored)
+			alert.sensor->state = SensorState::Monitored;
+	}
+}
+
+/// Makes a new map of sensors available to the server threads.
+static void publishSensorData( const std::shared_ptr< SensorDataMap > & sensorData )
+{
+	auto sensorIndex = std::make_shared< const SensorIndex >( sensorData );
+	std::atomic_store( &g_sensorData, sensorData );
+	std::atomic_store( &g_sensorIndex, std::shared_ptr< const SensorIndex >( std::move( sensorIndex ) ) );
+}
+
+static string getSensorCachePath()
+{
+	const std::optional< string > executableDir = getExecutableDir();
+	return executableDir ? *executableDir + '\\' + defaultSensorCacheFileName : string( defaultSensorCacheFileName );
+}
+
+
+//======================================================================================================================
+//  HTTP export
+
+static const char * const openMetricsContentType = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+static const char * const jsonContentType = "application/json";
+static const char * const textContentType = "text/plain; charset=utf-8";
+
+static void appendFloat( string & out, float value )
+{
+	char buffer [32];
+	int length = snprintf( buffer, sizeof(buffer), "%g", double( value ) );
+	out.append( buffer, size_t( length ) );
+}
+
+static string renderOpenMetrics()
+{
+	string body;
+	body.reserve( 128 + g_config.monitoredSensors.size() * 128 );
+
+	body += "# TYPE hwmon_sensor gauge\n";
+	body += "# HELP hwmon_sensor Last value read from a monitored hardware sensor.\n";
+	for (const auto & [sensorID, sensorData] : *g_sensorData)
+	{
+		if (sensorData.state != SensorState::Monitored)
+			continue;
+
+		const SensorSample sample = sensorData.sample.load();
+		if (hasFailed( sample ))  // rather omit the sample than publish a wrong one
+			continue;
+
+		body += "hwmon_sensor{id=\"";
+		appendOpenMetricsEscaped( body, sensorID );
+		body += "\",name=\"";
+		appendOpenMetricsEscaped( body, sensorData.name );
+		body += "\",category=\"";
+		appendOpenMetricsEscaped( body, sensorData.category );
+		body += "\"} ";
+		appendFloat( body, sample.value );
+		body += '\n';
+	}
+	body += "# EOF\n";
+
+	return body;
+}
+
+static string renderJson()
+{
+	string body;
+	body.reserve( 32 + g_config.monitoredSensors.size() * 128 );
+
+	body += "{\"sensors\":[";
+	bool first = true;
+	for (const auto & [sensorID, sensorData] : *g_sensorData)
+	{
+		if (sensorData.state != SensorState::Monitored)
+			continue;
+
+		if (!first)
+			body += ',';
+		first = false;
+
+		body += "{\"id\":\"";
+		appendJsonEscaped( body, sensorID );
+		body += "\",\"name\":\"";
+		appendJsonEscaped( body, sensorData.name );
+		body += "\",\"category\":\"";
+		appendJsonEscaped( body, sensorData.category );
+		body += "\",\"value\":";
+		const SensorSample sample = sensorData.sample.load();
+		if (!hasFailed( sample ))
+			appendFloat( body, sample.value );
+		else
+			body += "null";
+		body += '}';
 	}
+	body += "]}\n";
+
+	return body;
+}
+
+/// Called by the sampling thread at the end of every cycle.
+static void renderHttpResponses()
+{
+	std::atomic_store( &g_httpMetricsResponse, std::shared_ptr< const string >( std::make_shared< string >(
+		makeHttpResponse( 200, "OK", openMetricsContentType, renderOpenMetrics() )
+	)));
+	std::atomic_store( &g_httpSensorsResponse, std::shared_ptr< const string >( std::make_shared< string >(
+		makeHttpResponse( 200, "OK", jsonContentType, renderJson() )
+	)));
 }
 
 
 //======================================================================================================================
 //  main service functionality
 
-static void TcpServerLoop();
+static void TcpServerLoop( ServerLane & lane );
 
 bool MyServiceInit()
 {
+	g_startTime = std::chrono::steady_clock::now();
+
 	ReportSvcStatus( SERVICE_START_PENDING, NO_ERROR, 500 );
 
 	// read configuration from a file
@@ -181,6 +503,62 @@ bool MyServiceInit()
 		return false;
 	}
 
+	for (const string & entry : g_config.monitoredSensors)
+	{
+		if (isSensorPattern( entry ))
+			g_monitoredPatterns.addPattern( entry );
+	}
+
+	g_derivedSensors.resize( g_config.derivedSensors.size() );
+	for (size_t i = 0; i < g_config.derivedSensors.size(); ++i)
+	{
+		string derivedError = parseDerivedSensor( g_config.derivedSensors[i], g_derivedSensors[i] );
+		if (!derivedError.empty())
+		{
+			reportEventAndLog( SVCEVENT_CUSTOM_ERROR, Severity::Error, _T("Failed to load config file %hs: %hs"), defaultConfigFileName, derivedError.c_str() );
+			return false;
+		}
+	}
+
+	if (g_config.alertRules.size() > maxAlertEvents)
+	{
+		reportEventAndLog( SVCEVENT_CUSTOM_ERROR, Severity::Error, _T("Failed to load config file %hs: more than %u alert rules"), defaultConfigFileName, maxAlertEvents );
+		return false;
+	}
+	for (const string & definition : g_config.alertRules)
+	{
+		AlertRule rule;
+		string alertError = parseAlertRule( definition, rule );
+		if (!alertError.empty())
+		{
+			reportEventAndLog( SVCEVENT_CUSTOM_ERROR, Severity::Error, _T("Failed to load config file %hs: %hs"), defaultConfigFileName, alertError.c_str() );
+			return false;
+		}
+		g_alerts.push_back({ AlertTracker( rule ), nullptr });
+	}
+	g_lastAlertEvents.resize( g_alerts.size(), AlertEvent{ 0, 0, AlertState::Cleared, 0.0f, 0 } );
+
+	g_lanes.push_back( std::make_unique< ServerLane >() );
+	g_lanes.front()->config.port = g_config.port;
+	g_lanes.front()->config.unixSocketPath = g_config.unixSocketPath;
+	for (const string & definition : g_config.listeners)
+	{
+		auto lane = std::make_unique< ServerLane >();
+		string listenerError = parseListener( definition, lane->config );
+		const uint16_t port = lane->config.port;
+		if (listenerError.empty() && port != 0 && std::any_of( g_lanes.begin(), g_lanes.end(),
+			[ port ]( const unique_ptr< ServerLane > & other ) { return other->config.port == port; } ))
+		{
+			listenerError = "listener \"" + definition + "\" uses a port that is already used by another listener";
+		}
+		if (!listenerError.empty())
+		{
+			reportEventAndLog( SVCEVENT_CUSTOM_ERROR, Severity::Error, _T("Failed to load config file %hs: %hs"), defaultConfigFileName, listenerError.c_str() );
+			return false;
+		}
+		g_lanes.push_back( std::move(lane) );
+	}
+
 	ReportSvcStatus( SERVICE_START_PENDING, NO_ERROR, 100 );
 
 	// open logging socket
@@ -198,6 +576,19 @@ bool MyServiceInit()
 	}
 
 	log( Severity::Info, _T("Initializing service") );
+	log( Severity::Debug, _T("Using %hs kernels for the history and the bulk responses"), enumString( activeSimdLevel() ) );
+
+	if (g_config.alertPort != 0)
+	{
+		SocketError res = g_alertSocket.open();  // open at any port, we are sending, not receiving
+		if (res != SocketError::Success)
+		{
+			log( Severity::Warning,
+				_T("Failed to open alert socket (SocketError = %hs; error code = %d), alerts will be available only via TCP"),
+				enumString( res ), int( g_alertSocket.getLastSystemError() )
+			);
+		}
+	}
 
 	// reading the hardware sensors requires admin privileges
 	if (!IsUserAnAdmin())
@@ -206,33 +597,27 @@ bool MyServiceInit()
 		//return false;
 	}
 
-	ReportSvcStatus( SERVICE_START_PENDING, NO_ERROR, 8000 );
-
-	// read information about available sensors from the hardware monitoring library
-	auto sensorInfo = LHWM::GetHardwareSensorMap();
-	if (sensorInfo.empty())
+	// Enumerating the hardware takes seconds, so start with the sensors remembered from the previous run,
+	// the sampling thread will enumerate the hardware when the server is already running.
+	auto sensorData = std::make_shared< SensorDataMap >();
+	vector< CachedSensor > cachedSensors;
+	string cacheError = loadSensorCache( getSensorCachePath(), cachedSensors );
+	if (!cacheError.empty())
 	{
-		reportEventAndLog( SVCEVENT_CUSTOM_ERROR, Severity::Error, _T("Failed to initalize sensor monitoring") );
-		return false;
+		log( Severity::Info, _T("No usable sensor cache (%hs), sensors will be available after they are enumerated"), cacheError.c_str() );
 	}
-
-	// build list of sensors that are available and that we will be monitoring
-	populateSensorDataMap( sensorInfo, g_sensorData );         // fill the map with all available sensors
-	for (const string & sensorID : g_config.monitoredSensors)  // update the map with sensors we will be monitoring
+	for (const CachedSensor & cached : cachedSensors)
 	{
-		auto sensorDataIter = g_sensorData.find( sensorID );
-		if (sensorDataIter != g_sensorData.end())
-		{
-			sensorDataIter->second.state = SensorState::Monitored;
-		}
-		else
-		{
-			log( Severity::Error, _T("Requested sensor %hs not found"), sensorID.c_str() );
-			g_sensorData.emplace( sensorID, SensorState::RequestedButNotFound );
-		}
+		auto inserted = sensorData->try_emplace( cached.id, SensorState::FoundButNotMonitored, cached.name, cached.category );
+		// cycle number and timestamp 0 tell the clients the value is not from this run
+		inserted.first->second.sample.store({ cached.value > 0.0f ? cached.value : failedReading, 0, 0 });
 	}
+	markMonitoredSensors( *sensorData, false );
+	linkDerivedSensors( *sensorData, false );
+	linkAlertRules( *sensorData, false );
+	publishSensorData( sensorData );
 
-	log( Severity::Debug, _T("Found %zu devices with sensors:\n"), sensorInfo.size() );
+	log( Severity::Debug, _T("Loaded %zu sensors from the cache"), cachedSensors.size() );
 	ReportSvcStatus( SERVICE_START_PENDING, NO_ERROR, 100 );
 
 	// Create an event. The control handler function (SvcCtrlHandler)
@@ -243,9 +628,17 @@ bool MyServiceInit()
 		reportEventAndLog( SVCEVENT_CUSTOM_ERROR, Severity::Error, _T("Failed to create stop event") );
 		return false;
 	}
+	g_onDemandEvent = CreateEvent( NULL, FALSE, FALSE, NULL );
+	if (g_onDemandEvent == NULL)
+	{
+		reportEventAndLog( SVCEVENT_CUSTOM_ERROR, Severity::Error, _T("Failed to create on-demand read event") );
+		CloseHandle( g_svcStopEvent );
+		return false;
+	}
 
 	// start the TCP server
-	SocketError openResult = g_serverSocket.open( g_config.port );
+	ServerLane & mainLane = *g_lanes.front();
+	SocketError openResult = mainLane.tcpServer.open( g_config.port );
 	if (openResult == SocketError::Success)
 	{
 		log( Severity::Debug, _T("TCP server started") );
@@ -254,203 +647,2099 @@ bool MyServiceInit()
 	{
 		reportEventAndLog( SVCEVENT_CUSTOM_ERROR, Severity::Error,
 			_T("Failed to start TCP server (SocketError = %hs; error code = %d)"),
-			enumString( openResult ), int( g_serverSocket.getLastSystemError() )
+			enumString( openResult ), int( mainLane.tcpServer.getLastSystemError() )
 		);
+		CloseHandle( g_onDemandEvent );
 		CloseHandle( g_svcStopEvent );
 		return false;
 	}
 
-	log( Severity::Info, _T("Service is initialized and running") );
-
-	return true;
-}
-
-void MyServiceRun()
-{
-	g_serverThread = std::thread( TcpServerLoop );
-
-	DWORD waitResult = 0;
-	do
+	if (!g_config.unixSocketPath.empty())
 	{
-		for (auto & kvPair : g_sensorData)
+		SocketError unixResult = mainLane.unixServer.open( g_config.unixSocketPath );
+		if (unixResult == SocketError::Success)
 		{
-			const string & sensorID = kvPair.first;
-			auto & sensorData = kvPair.second;
-
-			if (sensorData.state != SensorState::Monitored)
-			{
-				continue;
-			}
+			log( Severity::Debug, _T("Unix domain socket server started at %hs"), g_config.unixSocketPath.c_str() );
+		}
+		else
+		{
+			// the TCP server works, so the clients still have a way in, don't fail the whole service because of this
+			log( Severity::Warning, _T("Failed to start Unix domain socket server at %hs (SocketError = %hs; error code = %d)"),
+				g_config.unixSocketPath.c_str(), enumString( unixResult ), int( mainLane.unixServer.getLastSystemError() )
+			);
+		}
+	}
 
-			float value = LHWM::GetSensorValue( sensorID );
-			if (value == 0.0)
+	// The clients of an additional listener have no other way in, so they would rather see the service fail to start.
+	for (size_t i = 1; i < g_lanes.size(); ++i)
+	{
+		ServerLane & lane = *g_lanes[i];
+		SocketError listenResult = lane.config.port != 0
+			? lane.tcpServer.open( lane.config.port )
+			: lane.unixServer.open( lane.config.unixSocketPath );
+		if (listenResult != SocketError::Success)
+		{
+			reportEventAndLog( SVCEVENT_CUSTOM_ERROR, Severity::Error,
+				_T("Failed to start listener \"%hs\" (SocketError = %hs; error code = %d)"), g_config.listeners[ i - 1 ].c_str(),
+				enumString( listenResult ), int( lane.config.port != 0 ? lane.tcpServer.getLastSystemError() : lane.unixServer.getLastSystemError() )
+			);
+			// the main lane and the listeners before this one are open already, and the cleanup isn't called after a failed init
+			for (const unique_ptr< ServerLane > & openedLane : g_lanes)
 			{
-				log( Severity::Error, _T("Failed to get value from sensor %hs"), sensorID.c_str() );
+				openedLane->tcpServer.close();
+				openedLane->unixServer.close();  // this also removes the socket file
 			}
-
-			sensorData.value.store( value );
+			CloseHandle( g_onDemandEvent );
+			CloseHandle( g_svcStopEvent );
+			return false;
 		}
+		log( Severity::Debug, _T("Listener \"%hs\" started"), g_config.listeners[ i - 1 ].c_str() );
+	}
 
-		// If the SvcCtrlHandler signals to stop the service, wake up and exit immediatelly.
-		// If there is no signal, wait 2 seconds and repeat.
-		waitResult = WaitForSingleObject( g_svcStopEvent, g_config.refreshInterval_ms );
+	if (g_config.udpPort != 0)
+	{
+		SocketError udpResult = g_udpQuerySocket.open( g_config.udpPort );
+		if (udpResult == SocketError::Success)
+		{
+			log( Severity::Debug, _T("UDP query endpoint started at port %u"), unsigned( g_config.udpPort ) );
+		}
+		else
+		{
+			log( Severity::Warning, _T("Failed to open UDP query endpoint at port %u (SocketError = %hs; error code = %d)"),
+				unsigned( g_config.udpPort ), enumString( udpResult ), int( g_udpQuerySocket.getLastSystemError() )
+			);
+		}
 	}
-	while (waitResult == WAIT_TIMEOUT);
 
-	log( Severity::Debug, _T("Waiting for server thread to quit") );
+	// the port is only known to wakeServerThreads(), nothing else can take it or send to it from the outside
+	const SocketError senderResult = g_wakeSender.open();
+	for (const unique_ptr< ServerLane > & lane : g_lanes)
+	{
+		SocketError wakeResult = senderResult;
+		if (wakeResult == SocketError::Success)
+			wakeResult = lane->wakeSocket.open( 0 );
+		if (wakeResult == SocketError::Success)
+			lane->wakePort = getLocalPort( lane->wakeSocket.getSystemHandle() );
+		if (wakeResult == SocketError::Success && lane->wakePort == 0)
+			wakeResult = SocketError::Other;
+		if (wakeResult != SocketError::Success)
+		{
+			log( Severity::Warning,
+				_T("Failed to open wake-up socket (SocketError = %hs; error code = %d), waiting requests will respond with a delay"),
+				enumString( wakeResult ), int( senderResult != SocketError::Success ? g_wakeSender.getLastSystemError() : lane->wakeSocket.getLastSystemError() )
+			);
+			lane->wakeSocket.close();
+			lane->wakePort = 0;
+		}
+	}
 
-	g_serverThread.join();
+	log( Severity::Info, _T("Service is initialized and running, %lld ms after start"), millisecondsSinceStart() );
 
-	log( Severity::Info, _T("Service has stopped") );
+	return true;
 }
 
-enum class Connection
+/// Lets the server threads know that new samples are available.
+static void wakeServerThreads()
 {
-	Close,
-	Keep,
-};
-static Connection serveClient( TcpSocket & clientSocket );
+	static const uint8_t wakeUp [1] = { 0 };
+	for (const unique_ptr< ServerLane > & lane : g_lanes)
+	{
+		if (lane->wakePort != 0)
+			g_wakeSender.sendTo( { {127,0,0,1}, lane->wakePort }, make_span( wakeUp, 1 ) );
+	}
+}
 
-static void TcpServerLoop()
+/// Stores a new reading of a sensor and updates the statistics of its readings.
+static void storeSample( SensorData & sensorData, const SensorSample & sample )
 {
-	unordered_set< ASocket * > activeSockets;
-	// Keep this declared here to prevent unnecessary allocation and deallocation at every iteration.
-	std::vector< ASocket * > readySockets;
+	if (!hasFailed( sample ))  // the failed readings would spoil the statistics
+	{
+		if (!sensorData.accumulator)
+			sensorData.accumulator = std::make_unique< StatisticsAccumulator >( g_config.smoothingSamples, g_config.medianWindow );
+		sensorData.statistics.store( sensorData.accumulator->add( sample.value, sample.timestamp_us ) );
 
-	const size_t maxActiveSockets = size_t( g_config.maxConnectedClients ) + 1;
-	activeSockets.insert( &g_serverSocket );
+		if (!sensorData.percentiles)  // this thread is the only writer, so it can read it without atomic_load
+			std::atomic_store( &sensorData.percentiles, std::make_shared< PercentileHistory >() );
+		if (sample.value > 0.0f)  // the sketch covers only positive values, a derived sensor can be 0 or negative
+			sensorData.percentiles->add( sample.value, sample.timestamp_us );
 
-	bool keepRunning = true;
-	while (keepRunning)
+		if (g_config.historyRetention_h > 0)
+		{
+			if (!sensorData.history)
+				std::atomic_store( &sensorData.history, std::make_shared< SampleHistory >( uint64_t( g_config.historyRetention_h ) * 3600 * 1000 ) );
+			sensorData.history->add( sample.value, sample.timestamp_us );
+		}
+	}
+	sensorData.sample.store( sample );
+}
+
+static void evaluateDerivedSensors( uint32_t cycle )
+{
+	for (const DerivedSensor & derived : g_derivedSensors)
 	{
-		bool result = waitForAny( activeSockets, readySockets, std::chrono::seconds(2) );
-		if (!result)  // this might be an interrupt signal, or some internal error
+		if (!derived.output)
 		{
-			log( Severity::Warning, _T("select() failed (error code = %d)"), int( getLastError() ) );
-			keepRunning = false;
-			break;
+			continue;
 		}
 
-		for (ASocket * socket : readySockets)
+		// Any finite result is valid, including 0 and negative ones. An infinite one, like A / 0, would spoil
+		// the statistics for good, so it's stored as a failed reading, the same as NaN.
+		float value = derived.expression.evaluate();
+		if (!std::isfinite( value ))
 		{
-			if (TcpServerSocket * serverSocket = dynamic_cast< TcpServerSocket * >( socket ))
-			{
-				Endpoint from;
-				TcpSocket clientSocket = serverSocket->accept( from );
-				if (!clientSocket)  // means either an error or the other thread closed the socket to signal us to exit
-				{
-					log( Severity::Warning, _T("accept() failed (error code = %d)"), int( g_serverSocket.getLastSystemError() ) );
-					keepRunning = false;
-					break;
-				}
+			log( Severity::Debug, _T("Failed to compute derived sensor %hs"), derived.id.c_str() );
+			value = failedReading;
+		}
 
-				log( Severity::Debug, _T("New connection from %hs:%u at socket %u"),
-					own::to_string( from.addr ).c_str(), unsigned( from.port ), unsigned( clientSocket.getSystemHandle() ) );
+		storeSample( *derived.output, { value, cycle, monotonicMicroseconds() } );
+	}
+}
 
-				activeSockets.insert( new TcpSocket( std::move(clientSocket) ) );
+/// Sends the event to the local UDP port as a JSON object, so that a script can react to it without any client library.
+static void sendAlertToUdpSink( const AlertEvent & event )
+{
+	string json;
+	json.reserve( 160 );
+	json += "{\"event\":";
+	json += std::to_string( event.number );
+	json += ",\"rule\":";
+	json += std::to_string( event.rule );
+	json += ",\"sensor\":\"";
+	appendJsonEscaped( json, g_alerts[ event.rule ].tracker.rule().sensorID );
+	json += event.state == AlertState::Raised ? "\",\"state\":\"raised\",\"value\":" : "\",\"state\":\"cleared\",\"value\":";
+	appendFloat( json, event.value );
+	json += ",\"timestamp_us\":";
+	json += std::to_string( event.timestamp_us );
+	json += '}';
+
+	SocketError res = g_alertSocket.sendTo( { {127,0,0,1}, g_config.alertPort }, make_span( (const uint8_t *)json.data(), json.size() ) );
+	if (res != SocketError::Success)
+	{
+		log( Severity::Warning, _T("Failed to send alert event (SocketError = %hs; error code = %d)"),
+			enumString( res ), int( g_alertSocket.getLastSystemError() ) );
+	}
+}
 
-				// If we reached the maximum allowed number of clients, prevent further connections by removing the server socket.
-				if (activeSockets.size() == maxActiveSockets)
-				{
-					activeSockets.erase( serverSocket );
-				}
-			}
-			else if (TcpSocket * clientSocket = dynamic_cast< TcpSocket * >( socket ))
-			{
-				Connection decision = serveClient( *clientSocket );
+static void publishAlertEvent( AlertEvent event )
+{
+	{
+		std::unique_lock< std::mutex > lock( g_alertEventsMtx );
+		event.number = g_lastAlertEvent.load() + 1;
+		g_recentAlertEvents.push_back( event );
+		if (g_recentAlertEvents.size() > maxAlertEvents)
+			g_recentAlertEvents.pop_front();
+		g_lastAlertEvents[ event.rule ] = event;
+		g_lastAlertEvent.store( event.number );
+	}
 
-				if (decision == Connection::Close)
-				{
-					activeSockets.erase( clientSocket );
-					delete clientSocket;  // this also closes the socket in destructor
-
-					// Some client slots have been freed, re-activate the server socket.
-					if (activeSockets.size() - 1 < maxActiveSockets)
-					{
-						activeSockets.insert( &g_serverSocket );
-					}
-				}
-			}
-		}
+	const string & sensorID = g_alerts[ event.rule ].tracker.rule().sensorID;
+	if (event.state == AlertState::Raised)
+		log( Severity::Warning, _T("Alert %u raised, sensor %hs has value %g"), event.rule, sensorID.c_str(), double( event.value ) );
+	else
+		log( Severity::Info, _T("Alert %u cleared, sensor %hs has value %g"), event.rule, sensorID.c_str(), double( event.value ) );
 
-		readySockets.clear();
+	if (g_alertSocket.isOpen())
+	{
+		sendAlertToUdpSink( event );
 	}
+}
 
-	for (ASocket * socket : activeSockets)
+/// Feeds the alert rules with the samples of the cycle that has just been read, it costs the same regardless of the clients.
+static void evaluateAlerts()
+{
+	for (size_t i = 0; i < g_alerts.size(); ++i)
 	{
-		if (!dynamic_cast< TcpServerSocket * >( socket ))
+		MonitoredAlert & alert = g_alerts[i];
+		if (!alert.sensor)
+		{
+			continue;
+		}
+
+		const SensorSample sample = alert.sensor->sample.load();
+		if (hasFailed( sample ))
 		{
-			delete socket;
+			continue;  // keep the state until the sensor can be read again
+		}
+
+		if (alert.tracker.update( sample.value, sample.timestamp_us ))
+		{
+			publishAlertEvent({ 0, uint32_t( i ), alert.tracker.state(), sample.value, sample.timestamp_us });
 		}
 	}
 }
 
-static Connection serveClient( TcpSocket & clientSocket )
+static void readMonitoredSensors()
 {
-	const auto socketHandle = clientSocket.getSystemHandle();  // the internal system handle gets invalidated when connection breaks
+	const uint32_t cycle = g_lastCycle.load() + 1;
 
-	std::vector< uint8_t > requestData;
-	auto recvRes = clientSocket.receiveOnce( requestData );
-	if (recvRes != SocketError::Success)
+	for (auto & kvPair : *g_sensorData)
 	{
-		if (recvRes == SocketError::ConnectionClosed)
+		const string & sensorID = kvPair.first;
+		auto & sensorData = kvPair.second;
+
+		if (sensorData.state != SensorState::Monitored || sensorData.derived)
 		{
-			log( Severity::Debug, _T("Connection closed at socket %u"), unsigned( socketHandle ) );
+			continue;
 		}
-		else {
-			log( Severity::Debug, _T("receive() failed at socket %u (SocketError = %hs; error code = %d)"),
-				unsigned( socketHandle ), enumString( recvRes ), int( clientSocket.getLastSystemError() ) );
+
+		float value = getSensorValue( sensorID );
+		if (value <= 0.0f)
+		{
+			log( Severity::Error, _T("Failed to get value from sensor %hs"), sensorID.c_str() );
+			value = failedReading;
 		}
-		// Timeout is not possible here because this is called on when the socket is ready.
-		// Either the client disconnected or it's an error.
-		return Connection::Close;
+
+		storeSample( sensorData, { value, cycle, monotonicMicroseconds() } );
 	}
 
-	SensorRequest request;
-	if (!fromBytes( requestData, request ))
+	// all their inputs have just been read
+	evaluateDerivedSensors( cycle );
+	evaluateAlerts();
+
+	g_lastCycle.store( cycle );
+
+	renderHttpResponses();
+
+	wakeServerThreads();
+
+	if (cycle == 1)
 	{
-		log( Severity::Debug, _T("Invalid request from socket %u, disconnecting"), unsigned( socketHandle ) );
-		clientSocket.send( toByteVector( SensorResponse( ResponseCode::InvalidRequest ) ) );
-		// Might be an uninvited guest, let's not allow him to consume system resources.
-		return Connection::Close;
+		log( Severity::Info, _T("First live values read %lld ms after start"), millisecondsSinceStart() );
 	}
+}
 
-	auto sensorDataIter = g_sensorData.find( request.sensorID );
-	if (sensorDataIter == g_sensorData.end() || sensorDataIter->second.state == SensorState::RequestedButNotFound)
+static void serveOnDemandReads()
+{
+	// Keep this static to prevent unnecessary allocation and deallocation at every call.
+	static vector< string > sensorIDs;
 	{
-		log( Severity::Debug, _T("Sensor not found: %hs"), request.sensorID.c_str() );
-		clientSocket.send( toByteVector( SensorResponse( ResponseCode::SensorNotFound ) ) );
-		return Connection::Keep;
+		std::unique_lock< std::mutex > lock( g_onDemandMtx );
+		sensorIDs.assign( g_onDemandReads.begin(), g_onDemandReads.end() );
+	}
+	if (sensorIDs.empty())
+	{
+		return;
+	}
+
+	// the sample belongs to no cycle, keep the number of the last one, so that it doesn't look older than it is
+	const uint32_t lastCycle = g_lastCycle.load();
+
+	for (const string & sensorID : sensorIDs)
+	{
+		auto sensorDataIter = g_sensorData->find( sensorID );
+		if (sensorDataIter == g_sensorData->end() || sensorDataIter->second.state != SensorState::Monitored)
+		{
+			continue;  // it was in an older map the server had when it requested the read
+		}
+		if (sensorDataIter->second.derived)
+		{
+			continue;  // there is nothing to read, it will be computed again at the end of the next cycle
+		}
+
+		float value = getSensorValue( sensorID );
+		if (value <= 0.0f)
+		{
+			log( Severity::Error, _T("Failed to get value from sensor %hs"), sensorID.c_str() );
+			value = failedReading;
+		}
+
+		storeSample( sensorDataIter->second, { value, lastCycle, monotonicMicroseconds() } );
+	}
+
+	{
+		std::unique_lock< std::mutex > lock( g_onDemandMtx );
+		for (const string & sensorID : sensorIDs)
+			g_onDemandReads.erase( sensorID );
+	}
+
+	wakeServerThreads();
+}
+
+/// Reads the available sensors from the hardware monitoring library and if they differ from the known ones,
+/// replaces the map with them, keeping the last samples of the sensors that remain.
+/** The first time it is called it replaces the sensors loaded from the cache, later it picks up the devices
+  * that have been connected or disconnected meanwhile. */
+static bool enumerateSensors( bool firstTime )
+{
+	const auto startTime = std::chrono::steady_clock::now();
+
+	// read information about available sensors from the hardware monitoring library
+	auto sensorInfo = getHardwareSensorMap();
+	if (sensorInfo.empty())
+	{
+		if (firstTime)
+			reportEventAndLog( SVCEVENT_CUSTOM_ERROR, Severity::Error, _T("Failed to initalize sensor monitoring") );
+		else
+			log( Severity::Warning, _T("Failed to re-enumerate sensors, keeping the known ones") );
+		return false;
+	}
+
+	auto newSensorData = std::make_shared< SensorDataMap >();
+	populateSensorDataMap( sensorInfo, *newSensorData );  // fill the map with all available sensors
+	markMonitoredSensors( *newSensorData, firstTime );     // the missing ones have already been reported
+
+	size_t added = 0, removed = 0;
+	for (auto & [sensorID, sensorData] : *newSensorData)
+	{
+		if (sensorData.state == SensorState::RequestedButNotFound)
+			continue;
+
+		auto oldIter = g_sensorData->find( sensorID );
+		if (oldIter != g_sensorData->end() && oldIter->second.state != SensorState::RequestedButNotFound)
+		{
+			sensorData.statistics.store( oldIter->second.statistics.load() );
+			sensorData.percentiles = oldIter->second.percentiles;  // shared, the new map isn't published yet
+			sensorData.history = oldIter->second.history;
+			sensorData.sample.store( oldIter->second.sample.load() );
+			continue;
+		}
+
+		++added;
+		if (!firstTime && sensorData.state == SensorState::Monitored)
+			log( Severity::Info, _T("Requested sensor %hs has appeared, monitoring it"), sensorID.c_str() );
+		else if (!firstTime)
+			log( Severity::Debug, _T("Sensor %hs has appeared"), sensorID.c_str() );
+	}
+	for (const auto & [sensorID, sensorData] : *g_sensorData)
+	{
+		if (sensorData.state == SensorState::RequestedButNotFound)
+			continue;
+
+		auto newIter = newSensorData->find( sensorID );
+		if (newIter != newSensorData->end() && newIter->second.state != SensorState::RequestedButNotFound)
+			continue;
+
+		++removed;
+		if (!firstTime && sensorData.state == SensorState::Monitored)
+			log( Severity::Warning, _T("Monitored sensor %hs has disappeared"), sensorID.c_str() );
+		else if (!firstTime)
+			log( Severity::Debug, _T("Sensor %hs has disappeared"), sensorID.c_str() );
+	}
+
+	const long long duration_ms = std::chrono::duration_cast< std::chrono::milliseconds >( std::chrono::steady_clock::now() - startTime ).count();
+
+	if (!firstTime && added == 0 && removed == 0)
+	{
+		log( Severity::Debug, _T("Re-enumerated sensors in %lld ms, no change"), duration_ms );
+		return true;  // keep the current map, there is no reason to make the server switch
+	}
+
+	// only now that the new map is replacing the old one, the old one can be stripped of its accumulators
+	for (auto & [sensorID, sensorData] : *newSensorData)
+	{
+		auto oldIter = g_sensorData->find( sensorID );
+		if (oldIter != g_sensorData->end())
+			sensorData.accumulator = std::move( oldIter->second.accumulator );  // only this thread uses them
+	}
+
+	linkDerivedSensors( *newSensorData, firstTime );
+	linkAlertRules( *newSensorData, firstTime );
+	publishSensorData( newSensorData );
+	wakeServerThreads();  // let it switch to the new map right away
+
+	log( Severity::Info, _T("Found %zu devices with %zu sensors in %lld ms, %zu sensors added and %zu removed since %s"),
+		sensorInfo.size(), newSensorData->size(), duration_ms, added, removed, firstTime ? _T("the last run") : _T("the last enumeration")
+	);
+
+	return true;
+}
+
+void MyServiceRun()
+{
+	for (const unique_ptr< ServerLane > & lane : g_lanes)
+		lane->thread = std::thread( TcpServerLoop, std::ref( *lane ) );
+
+	// The server is already answering from the cache, now the hardware can take its time.
+	bool enumerated = enumerateSensors( true );
+	if (!enumerated)
+	{
+		MyServiceStop();
+	}
+
+	const HANDLE events [2] = { g_svcStopEvent, g_onDemandEvent };
+	auto nextCycle = std::chrono::steady_clock::now();
+	auto nextEnumeration = nextCycle + std::chrono::milliseconds( g_config.reenumerationInterval_ms );
+
+	DWORD waitResult = enumerated ? WAIT_TIMEOUT : WAIT_OBJECT_0;
+	while (waitResult == WAIT_TIMEOUT || waitResult == WAIT_OBJECT_0 + 1)
+	{
+		if (std::chrono::steady_clock::now() >= nextCycle)
+		{
+			// Devices can be connected or disconnected at any time, for example USB coolers or GPUs that come up late.
+			// This delays the cycle, but the hardware must not be accessed from two threads.
+			if (g_config.reenumerationInterval_ms != 0 && std::chrono::steady_clock::now() >= nextEnumeration)
+			{
+				enumerateSensors( false );
+				nextEnumeration = std::chrono::steady_clock::now() + std::chrono::milliseconds( g_config.reenumerationInterval_ms );
+			}
+
+			readMonitoredSensors();
+			nextCycle = std::chrono::steady_clock::now() + std::chrono::milliseconds( g_config.refreshInterval_ms );
+		}
+
+		serveOnDemandReads();
+
+		// If the SvcCtrlHandler signals to stop the service, wake up and exit immediatelly.
+		// If a server thread needs some sensors read on demand, wake up, read them and go back to sleep.
+		// Otherwise sleep until the next cycle and repeat.
+		auto untilNextCycle = std::max( std::chrono::milliseconds( 0 ),
+			std::chrono::duration_cast< std::chrono::milliseconds >( nextCycle - std::chrono::steady_clock::now() ) );
+		waitResult = WaitForMultipleObjects( 2, events, FALSE, DWORD( untilNextCycle.count() ) );
+	}
+
+	log( Severity::Debug, _T("Waiting for server threads to quit") );
+
+	for (const unique_ptr< ServerLane > & lane : g_lanes)
+		lane->thread.join();
+
+	if (enumerated)
+	{
+		string cacheError = saveSensorCache( getSensorCachePath(), *g_sensorData );
+		if (!cacheError.empty())
+			log( Severity::Warning, _T("Failed to save the sensor cache: %hs"), cacheError.c_str() );
+	}
+
+	log( Severity::Info, _T("Service has stopped") );
+}
+
+enum class Connection
+{
+	Close,
+	Keep,
+};
+
+enum class ClientProtocol
+{
+	Undecided,  ///< not enough data has been received yet to tell
+	Binary,     ///< our own protocol defined in Protocol.hpp
+	Http,       ///< plain HTTP for scrapers and scripts
+};
+
+enum class ParkedRequest
+{
+	None,
+	Wait,   ///< WaitRequest waiting for the next cycle
+	Fresh,  ///< FreshRequest waiting for an on-demand reading
+	Alerts, ///< AlertsRequest waiting for the next alert event
+};
+
+/// Connection of a client over TCP or over a Unix domain socket, the requests are served the same way for both.
+/** The socket is non-blocking, so that a client that doesn't read its responses cannot stall the server thread
+  * and all the other clients with it. What the system doesn't take right away waits in the output queue
+  * and is sent when the socket becomes writable. */
+class ClientSocket
+{
+ public:
+	virtual ~ClientSocket() = default;
+	/// Fails only if the connection is broken, the data that cannot be sent now are queued.
+	virtual SocketError send( const_byte_span data ) = 0;
+	/// Sends as much of the queued data as the system takes now.
+	virtual SocketError flush() = 0;
+	/// Number of bytes waiting in the output queue.
+	virtual size_t queuedSize() const = 0;
+	virtual SocketError receiveOnce( vector< uint8_t > & buffer ) = 0;
+	virtual socket_id getSystemHandle() const = 0;
+	virtual system_error_t getLastSystemError() const = 0;
+};
+
+/// TcpSocket and UnixSocket have the same methods, so one template implements the interface for both.
+template< typename Socket >
+class ClientSocketOf : public ClientSocket
+{
+ public:
+
+	ClientSocketOf( Socket && socket ) : _socket( std::move(socket) ), _queueStart( 0 ), _lastSystemError( 0 ) {}
+
+	SocketError send( const_byte_span data ) override
+	{
+		size_t sent = 0;
+		if (queuedSize() == 0)  // otherwise the data must not overtake those in the queue
+		{
+			SocketError result = sendAvailable( _socket.getSystemHandle(), data, sent, _lastSystemError );
+			if (result != SocketError::Success)
+				return fail( result );
+		}
+		_queue.insert( _queue.end(), data.data() + sent, data.data() + data.size() );
+		return SocketError::Success;
+	}
+
+	SocketError flush() override
+	{
+		size_t sent = 0;
+		SocketError result = sendAvailable( _socket.getSystemHandle(), make_span( _queue.data() + _queueStart, queuedSize() ), sent, _lastSystemError );
+		if (result != SocketError::Success)
+			return fail( result );
+		_queueStart += sent;
+		if (_queueStart == _queue.size())
+		{
+			_queue.clear();  // keeps the capacity for the next time
+			_queueStart = 0;
+		}
+		else if (_queueStart > _queue.size() / 2)
+		{
+			// move the rest to the front, so that the queue doesn't grow forever while it's never completely sent
+			_queue.erase( _queue.begin(), _queue.begin() + ptrdiff_t( _queueStart ) );
+			_queueStart = 0;
+		}
+		return SocketError::Success;
+	}
+
+	size_t queuedSize() const override  { return _queue.size() - _queueStart; }
+
+	SocketError receiveOnce( vector< uint8_t > & buffer ) override
+	{
+		SocketError result = _socket.receiveOnce( buffer );
+		if (result != SocketError::Success)
+			_lastSystemError = _socket.getLastSystemError();
+		return result;
+	}
+
+	socket_id getSystemHandle() const override  { return _socket.getSystemHandle(); }
+	system_error_t getLastSystemError() const override  { return _lastSystemError; }
+
+ private:
+
+	SocketError fail( SocketError result )
+	{
+		// nothing more can be sent over a broken connection
+		_queue.clear();
+		_queueStart = 0;
+		return result;
+	}
+
+	Socket _socket;
+	vector< uint8_t > _queue;  ///< the data before _queueStart have already been sent
+	size_t _queueStart;
+	system_error_t _lastSystemError;
+
+};
+
+struct ClientConnection
+{
+	unique_ptr< ClientSocket > socket;
+	const ListenerConfig & listener;  ///< the one the client has connected to, it decides which requests are served
+	ClientProtocol protocol;
+	vector< uint8_t > inBuffer;  ///< received data that don't form a complete request yet or whose turn hasn't come yet
+
+	/// A parked request is answered later, the requests that follow it must wait for it to keep the order.
+	ParkedRequest parked;
+	WaitRequest waitRequest;
+	FreshRequest freshRequest;
+	AlertsRequest alertsRequest;
+	std::chrono::steady_clock::time_point waitDeadline;
+
+	/// The connection is to be closed as soon as the rest of the output queue is sent, or when its timer expires.
+	bool closing;
+
+	/// Token bucket of the requests the client may send, see Config::maxClientRequestRate.
+	double requestTokens;
+	std::chrono::steady_clock::time_point tokensRefilled;
+	/// The client has been answered Busy, its further requests are not read until throttledUntil passes.
+	bool throttled;
+	std::chrono::steady_clock::time_point throttledUntil;
+	/// Requests the client has got an error for, without being disconnected, a client that keeps sending them is.
+	unsigned invalidRequests;
+
+	/// Expires when the client has been idle for too long, when the closing connection has run out of time,
+	/// or when the throttled client may be served again.
+	TimerWheel::Timer timer;
+	/// Position among the connections ordered from the least recently active one.
+	std::list< socket_id >::iterator recency;
+
+	ClientConnection( unique_ptr< ClientSocket > socket, const ListenerConfig & listener )
+	:
+		socket( std::move(socket) ), listener( listener ), protocol( ClientProtocol::Undecided ), parked( ParkedRequest::None ), closing( false ),
+		requestTokens( double( g_config.maxClientRequestBurst ) ), tokensRefilled( std::chrono::steady_clock::now() ),
+		throttled( false ), invalidRequests( 0 )
+	{}
+};
+
+/// The client doesn't read its responses as fast as it sends the requests, so its further requests must wait.
+static bool isBackedUp( const ClientConnection & client )
+{
+	return client.socket->queuedSize() > size_t( g_config.maxOutputQueue_kB ) * 1024;
+}
+
+// How long a closed connection keeps trying to deliver its last responses, for example the HTTP response
+// without keep-alive, before it's closed anyway.
+static const auto closingTimeout = std::chrono::seconds( 5 );
+
+// The timeouts are in seconds, so 100 ms is precise enough, and one turn of the wheel covers the closing timeout
+// as well as the common idle timeouts without going around.
+static const auto timerTick = std::chrono::milliseconds( 100 );
+static const size_t timerSlots = 8192;
+
+// Half-open connections are found within 45 s on Linux and 80 s on Windows, which sends 10 probes.
+static const auto keepAliveIdle = std::chrono::seconds( 30 );
+static const auto keepAliveInterval = std::chrono::seconds( 5 );
+
+using ConnectionMap = unordered_map< socket_id, unique_ptr< ClientConnection > >;
+
+static Connection serveClient( ClientConnection & client );
+static Connection serveReceivedRequests( ClientConnection & client );
+static void serveDatagrams();
+static std::chrono::steady_clock::time_point completeParkedWaits(
+	ConnectionMap & connections, vector< std::pair< socket_id, Connection > > & completed
+);
+
+/// Makes the sampling thread and the other server threads give way to the critical clients, and the bulk ones wait.
+static void setServerThreadPriority( PriorityClass priority )
+{
+	int threadPriority = THREAD_PRIORITY_NORMAL;
+	if (priority == PriorityClass::Critical)
+		threadPriority = THREAD_PRIORITY_HIGHEST;
+	else if (priority == PriorityClass::Bulk)
+		threadPriority = THREAD_PRIORITY_BELOW_NORMAL;
+
+	if (threadPriority != THREAD_PRIORITY_NORMAL && !SetThreadPriority( GetCurrentThread(), threadPriority ))
+		log( Severity::Warning, _T("Cannot set the priority of the %hs server thread (error code = %d)"), enumString( priority ), int( GetLastError() ) );
+}
+
+static void TcpServerLoop( ServerLane & lane )
+{
+	setServerThreadPriority( lane.config.priority );
+
+	unordered_set< socket_id > activeSockets;
+	unordered_set< socket_id > sendingSockets;  ///< those with data in their output queue
+	// these must outlive the connections, whose timers and positions they hold
+	TimerWheel timers( timerTick, timerSlots, std::chrono::steady_clock::now() );
+	std::list< socket_id > recency;  ///< the least recently active connection first
+	ConnectionMap connections;
+	// Keep these declared here to prevent unnecessary allocation and deallocation at every iteration.
+	std::vector< socket_id > readySockets;
+	std::vector< socket_id > writableSockets;
+	std::vector< std::pair< socket_id, Connection > > completed;
+
+	// The handles are taken now, because the other thread may close the server socket to make us exit.
+	const bool isMainLane = &lane == g_lanes.front().get();
+	const socket_id tcpListener = lane.tcpServer.isOpen() ? lane.tcpServer.getSystemHandle() : UnixSocket::invalidHandle;
+	const socket_id unixListener = lane.unixServer.isOpen() ? lane.unixServer.getSystemHandle() : UnixSocket::invalidHandle;
+	const socket_id wakeListener = lane.wakeSocket.isOpen() ? lane.wakeSocket.getSystemHandle() : UnixSocket::invalidHandle;
+	const socket_id udpListener = isMainLane && g_udpQuerySocket.isOpen() ? g_udpQuerySocket.getSystemHandle() : UnixSocket::invalidHandle;
+
+	// The listeners are never removed, a client waiting in the backlog would not know it's not going to be accepted.
+	for (socket_id listener : { tcpListener, unixListener, wakeListener })
+	{
+		if (listener != UnixSocket::invalidHandle)
+			activeSockets.insert( listener );
+	}
+	if (udpListener != UnixSocket::invalidHandle)
+		activeSockets.insert( udpListener );  // the datagrams don't occupy any client slots
+
+	auto closeClient = [&]( socket_id socket )
+	{
+		auto clientIter = connections.find( socket );
+		activeSockets.erase( socket );
+		sendingSockets.erase( socket );
+		recency.erase( clientIter->second->recency );
+		connections.erase( clientIter );  // this also closes the socket and cancels the timer in destructor
+	};
+
+	// Moves the client to the end of the eviction order and restarts its idle timeout.
+	auto touchClient = [&]( ClientConnection & client )
+	{
+		recency.splice( recency.end(), recency, client.recency );
+		if (g_config.idleTimeout_s != 0 && !client.closing && !client.throttled)
+			timers.schedule( client.timer, std::chrono::steady_clock::now() + std::chrono::seconds( g_config.idleTimeout_s ) );
+	};
+
+	// A client that is being closed anyway goes first, then the one that has been quiet for the longest, except the clients
+	// waiting for a parked request. They send nothing while they wait, but they are the most active of all.
+	auto chooseEvictionVictim = [&]() -> socket_id
+	{
+		auto idle = recency.end();
+		for (auto iter = recency.begin(); iter != recency.end(); ++iter)
+		{
+			const ClientConnection & client = *connections.find( *iter )->second;
+			if (client.closing)
+				return *iter;
+			if (idle == recency.end() && client.parked == ParkedRequest::None)
+				idle = iter;
+		}
+		return idle != recency.end() ? *idle : recency.front();
+	};
+
+	auto addClient = [&]( unique_ptr< ClientSocket > clientSocket )
+	{
+		const socket_id handle = clientSocket->getSystemHandle();
+		if (!setNonBlocking( handle ))
+		{
+			log( Severity::Warning, _T("Cannot switch socket %u to non-blocking mode, disconnecting"), unsigned( handle ) );
+			return;  // the socket is closed in destructor
+		}
+
+		// The slots are often held by the clients that have long stopped asking, or that don't exist anymore,
+		// so rather than leaving the new one hanging, the one that has been quiet for the longest makes room for it.
+		if (connections.size() >= size_t( g_config.maxConnectedClients ) && !recency.empty())
+		{
+			const socket_id victim = chooseEvictionVictim();
+			log( Severity::Info, _T("Reached the limit of %u clients, disconnecting the least recently active one at socket %u"),
+				unsigned( g_config.maxConnectedClients ), unsigned( victim ) );
+			closeClient( victim );
+		}
+
+		activeSockets.insert( handle );
+		ClientConnection & client = *connections.emplace( handle, std::make_unique< ClientConnection >( std::move(clientSocket), lane.config ) ).first->second;
+		client.recency = recency.insert( recency.end(), handle );
+		client.timer.key = uint64_t( handle );
+		touchClient( client );
+	};
+
+	// Decides what to wait for at the client socket, after its requests have been served or its output queue flushed.
+	auto updateClient = [&]( socket_id socket, Connection decision )
+	{
+		ClientConnection & client = *connections[ socket ];
+		if (decision == Connection::Close && !client.closing)
+		{
+			if (client.socket->queuedSize() == 0)
+			{
+				closeClient( socket );
+				return;
+			}
+			// let the client receive the last response first, for example the reason of the rejection
+			client.closing = true;
+			client.parked = ParkedRequest::None;
+			client.throttled = false;
+			client.inBuffer.clear();
+			timers.schedule( client.timer, std::chrono::steady_clock::now() + closingTimeout );
+		}
+
+		const bool backedUp = isBackedUp( client );
+		if (client.closing && client.socket->queuedSize() == 0)
+		{
+			closeClient( socket );
+			return;
+		}
+		else if (!client.closing && backedUp && g_config.slowClientPolicy == SlowClientPolicy::Disconnect)
+		{
+			log( Severity::Debug, _T("Client at socket %u doesn't read its responses, disconnecting"), unsigned( socket ) );
+			closeClient( socket );
+			return;
+		}
+
+		if (client.socket->queuedSize() > 0)
+			sendingSockets.insert( socket );
+		else
+			sendingSockets.erase( socket );
+
+		if (client.throttled)
+			timers.schedule( client.timer, client.throttledUntil );
+
+		// Not reading more from a client that is backed up or throttled makes the system tell the client to stop sending,
+		// and the requests that are already received wait until their responses can be sent.
+		if (client.closing || backedUp || client.throttled)
+			activeSockets.erase( socket );
+		else
+			activeSockets.insert( socket );
+	};
+
+	auto nearestDeadline = std::chrono::steady_clock::time_point::max();
+
+	bool keepRunning = true;
+	while (keepRunning)
+	{
+		g_servedSensorData = std::atomic_load( &g_sensorData );
+
+		auto timeout = std::chrono::milliseconds( 2000 );
+		if (nearestDeadline != std::chrono::steady_clock::time_point::max())
+		{
+			auto untilDeadline = std::chrono::duration_cast< std::chrono::milliseconds >( nearestDeadline - std::chrono::steady_clock::now() );
+			timeout = std::max( std::chrono::milliseconds( 0 ), std::min( timeout, untilDeadline + std::chrono::milliseconds( 1 ) ) );
+			if (wakeListener == UnixSocket::invalidHandle)
+				timeout = std::min( timeout, std::chrono::milliseconds( 100 ) );  // we won't be notified about a new cycle
+		}
+
+		bool result = waitForSockets( activeSockets, sendingSockets, readySockets, writableSockets, timeout );
+		if (!result)  // this might be an interrupt signal, or some internal error
+		{
+			log( Severity::Warning, _T("poll() failed (error code = %d)"), int( getLastError() ) );
+			keepRunning = false;
+			break;
+		}
+		if (g_stopServer)
+		{
+			break;
+		}
+		g_requestsSinceWakeUp = 0;
+
+		// Accepting a client can evict another one, whose handle the system can then give to the accepted one,
+		// so the ready clients must be served before the listeners.
+		std::partition( readySockets.begin(), readySockets.end(), [&]( socket_id socket )
+		{
+			return socket != tcpListener && socket != unixListener;
+		});
+
+		for (socket_id socket : readySockets)
+		{
+			if (socket == tcpListener)
+			{
+				Endpoint from;
+				TcpSocket clientSocket = lane.tcpServer.accept( from );
+				if (!clientSocket)  // means either an error or the other thread closed the socket to signal us to exit
+				{
+					log( Severity::Warning, _T("accept() failed (error code = %d)"), int( lane.tcpServer.getLastSystemError() ) );
+					keepRunning = false;
+					break;
+				}
+
+				log( Severity::Debug, _T("New connection from %hs:%u at socket %u"),
+					own::to_string( from.addr ).c_str(), unsigned( from.port ), unsigned( clientSocket.getSystemHandle() ) );
+
+				// a Unix domain socket cannot become half-open, its peer is on the same machine
+				if (!setKeepAlive( clientSocket.getSystemHandle(), keepAliveIdle, keepAliveInterval ))
+					log( Severity::Debug, _T("Cannot enable keep-alive at socket %u (error code = %d)"),
+						unsigned( clientSocket.getSystemHandle() ), int( getLastError() ) );
+
+				addClient( std::make_unique< ClientSocketOf< TcpSocket > >( std::move(clientSocket) ) );
+			}
+			else if (socket == unixListener)
+			{
+				UnixSocket clientSocket = lane.unixServer.accept();
+				if (!clientSocket)  // the TCP server can still go on, so don't exit because of this one
+				{
+					log( Severity::Warning, _T("accept() failed at Unix domain socket (error code = %d)"),
+						int( lane.unixServer.getLastSystemError() ) );
+					continue;
+				}
+
+				log( Severity::Debug, _T("New local connection at socket %u"), unsigned( clientSocket.getSystemHandle() ) );
+
+				addClient( std::make_unique< ClientSocketOf< UnixSocket > >( std::move(clientSocket) ) );
+			}
+			else if (socket == udpListener)
+			{
+				serveDatagrams();
+			}
+			else if (socket == wakeListener)
+			{
+				// just drain it, the parked requests are checked below anyway
+				lane.wakeSocket.receiveBatch();
+			}
+			else
+			{
+				ClientConnection & client = *connections[ socket ];
+				touchClient( client );
+				updateClient( socket, serveClient( client ) );
+			}
+		}
+
+		for (socket_id socket : writableSockets)
+		{
+			auto clientIter = connections.find( socket );
+			if (clientIter == connections.end())  // closed while serving its requests above
+				continue;
+			ClientConnection & client = *clientIter->second;
+
+			Connection decision = Connection::Keep;
+			const size_t queuedBefore = client.socket->queuedSize();
+			SocketError flushRes = client.socket->flush();
+			if (client.socket->queuedSize() < queuedBefore)
+				touchClient( client );  // reading the responses is an activity too
+			if (flushRes != SocketError::Success)
+			{
+				log( Severity::Debug, _T("send() failed at socket %u (SocketError = %hs; error code = %d)"),
+					unsigned( socket ), enumString( flushRes ), int( client.socket->getLastSystemError() ) );
+				decision = Connection::Close;  // client probably disconnected
+			}
+			else if (!client.closing && !client.throttled && client.parked == ParkedRequest::None && !client.inBuffer.empty() && !isBackedUp( client ))
+			{
+				// the requests that had to wait while the client was backed up, now answered with the current values
+				decision = serveReceivedRequests( client );
+			}
+			updateClient( socket, decision );
+		}
+
+		readySockets.clear();
+		writableSockets.clear();
+
+		// complete the parked requests whose sample has come or whose timeout has expired, all in one pass
+		nearestDeadline = completeParkedWaits( connections, completed );
+		for (auto [socket, decision] : completed)
+		{
+			updateClient( socket, decision );
+		}
+		completed.clear();
+
+		// the clients that have gone quiet, and those that don't read even their last responses, must not hold their slots forever
+		const auto now = std::chrono::steady_clock::now();
+		timers.advance( now, [&]( TimerWheel::Timer & timer )
+		{
+			const socket_id socket = socket_id( timer.key );
+			ClientConnection & client = *connections[ socket ];
+			if (client.closing)
+			{
+				closeClient( socket );
+			}
+			else if (client.throttled)
+			{
+				// serve the requests that have waited meanwhile, and let it send more
+				client.throttled = false;
+				touchClient( client );
+				updateClient( socket, serveReceivedRequests( client ) );
+			}
+			else if (client.parked != ParkedRequest::None)
+			{
+				// the client is waiting for us, not the other way round
+				timers.schedule( client.timer, now + std::chrono::seconds( g_config.idleTimeout_s ) );
+			}
+			else
+			{
+				log( Severity::Debug, _T("Client at socket %u has been idle for %u s, disconnecting"), unsigned( socket ), g_config.idleTimeout_s );
+				closeClient( socket );
+			}
+		});
+	}
+}
+
+// Neither a batch of maxBatchSize sensor IDs nor a HTTP request header should ever be this long.
+// If it is, the client is misbehaving.
+static const size_t maxPendingRequestSize = 64 * 1024;
+
+static Connection serveBinaryRequests( ClientConnection & client );
+static Connection serveHttpRequests( ClientConnection & client );
+
+static Connection serveClient( ClientConnection & client )
+{
+	ClientSocket & clientSocket = *client.socket;
+	const auto socketHandle = clientSocket.getSystemHandle();  // the internal system handle gets invalidated when connection breaks
+
+	// Keep this static to prevent unnecessary allocation and deallocation at every call, one per server thread.
+	static thread_local std::vector< uint8_t > receivedData;
+	auto recvRes = clientSocket.receiveOnce( receivedData );
+	if (recvRes != SocketError::Success)
+	{
+		if (recvRes == SocketError::ConnectionClosed)
+		{
+			log( Severity::Debug, _T("Connection closed at socket %u"), unsigned( socketHandle ) );
+		}
+		else {
+			log( Severity::Debug, _T("receive() failed at socket %u (SocketError = %hs; error code = %d)"),
+				unsigned( socketHandle ), enumString( recvRes ), int( clientSocket.getLastSystemError() ) );
+		}
+		// Timeout is not possible here because this is called on when the socket is ready.
+		// Either the client disconnected or it's an error.
+		return Connection::Close;
+	}
+
+	// A request might have been split into several TCP segments or several requests might have been sent at once,
+	// so collect the data and process only the complete requests.
+	client.inBuffer.insert( client.inBuffer.end(), receivedData.begin(), receivedData.end() );
+
+	return serveReceivedRequests( client );
+}
+
+static Connection serveReceivedRequests( ClientConnection & client )
+{
+	const auto socketHandle = client.socket->getSystemHandle();
+
+	if (client.protocol == ClientProtocol::Undecided)
+	{
+		if (client.inBuffer.size() < sizeof(SensorRequest::magic))
+		{
+			return Connection::Keep;  // we need at least 4 bytes to compare them with the "SENS" magic
+		}
+		if (looksLikeHttp( client.inBuffer.data(), client.inBuffer.size() ))
+		{
+			log( Severity::Debug, _T("Socket %u speaks HTTP"), unsigned( socketHandle ) );
+			client.protocol = ClientProtocol::Http;
+			if (!client.listener.allowsHttp)
+			{
+				log( Severity::Debug, _T("HTTP is not allowed at the listener of socket %u, disconnecting"), unsigned( socketHandle ) );
+				static const string forbidden = makeHttpResponse( 403, "Forbidden", textContentType, "HTTP is not served at this address.\n" );
+				client.socket->send( make_span( (const uint8_t *)forbidden.data(), forbidden.size() ) );
+				return Connection::Close;
+			}
+		}
+		else
+		{
+			client.protocol = ClientProtocol::Binary;
+		}
+	}
+
+	Connection decision = client.protocol == ClientProtocol::Http ? serveHttpRequests( client ) : serveBinaryRequests( client );
+
+	if (decision == Connection::Keep && !isBackedUp( client ) && client.inBuffer.size() > maxPendingRequestSize)
+	{
+		log( Severity::Debug, _T("Request from socket %u is too long, disconnecting"), unsigned( socketHandle ) );
+		return Connection::Close;
+	}
+
+	return decision;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//  binary protocol
+
+enum class FrameStatus
+{
+	Complete,
+	Incomplete,
+	Invalid,
+};
+
+static uint32_t readBigEndian32( const uint8_t * data )
+{
+	return uint32_t( data[0] ) << 24 | uint32_t( data[1] ) << 16 | uint32_t( data[2] ) << 8 | uint32_t( data[3] );
+}
+
+/// Finds the end of a sequence of null-terminated strings starting at offset.
+static FrameStatus skipStrings( const uint8_t * data, size_t size, size_t offset, uint32_t count, size_t & end )
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (offset >= size)
+			return FrameStatus::Incomplete;
+		const uint8_t * terminator = (const uint8_t *)memchr( data + offset, '\0', size - offset );
+		if (!terminator)
+			return FrameStatus::Incomplete;
+		offset = size_t( terminator + 1 - data );
+	}
+	end = offset;
+	return FrameStatus::Complete;
+}
+
+/// Determines the type and the length of the request at the beginning of the data, without parsing it yet.
+static FrameStatus frameRequest( const uint8_t * data, size_t size, RequestType & type, size_t & length )
+{
+	if (size < sizeof(SensorRequest::magic))
+	{
+		return FrameStatus::Incomplete;
+	}
+	else if (memcmp( data, "SENS", 4 ) == 0)
+	{
+		type = RequestType::Sensor;
+		return skipStrings( data, size, 4, 1, length );
+	}
+	else if (memcmp( data, "BTCH", 4 ) == 0)
+	{
+		if (size < 8)
+			return FrameStatus::Incomplete;
+		uint32_t count = readBigEndian32( data + 4 );
+		if (count > maxBatchSize)
+			return FrameStatus::Invalid;
+		type = RequestType::Batch;
+		return skipStrings( data, size, 8, count, length );
+	}
+	else if (memcmp( data, "READ", 4 ) == 0)
+	{
+		type = RequestType::Sample;
+		return skipStrings( data, size, 8, 1, length );
+	}
+	else if (memcmp( data, "CHNG", 4 ) == 0)
+	{
+		if (size < 12)
+			return FrameStatus::Incomplete;
+		uint32_t count = readBigEndian32( data + 8 );
+		if (count > maxBatchSize)
+			return FrameStatus::Invalid;
+		type = RequestType::Changes;
+		return skipStrings( data, size, 12, count, length );
+	}
+	else if (memcmp( data, "WAIT", 4 ) == 0)
+	{
+		if (size < 16)
+			return FrameStatus::Incomplete;
+		uint32_t count = readBigEndian32( data + 12 );
+		if (count > maxBatchSize)
+			return FrameStatus::Invalid;
+		type = RequestType::Wait;
+		return skipStrings( data, size, 16, count, length );
+	}
+	else if (memcmp( data, "FRSH", 4 ) == 0)
+	{
+		type = RequestType::Fresh;
+		return skipStrings( data, size, 8, 1, length );
+	}
+	else if (memcmp( data, "LIST", 4 ) == 0)
+	{
+		type = RequestType::List;
+		return skipStrings( data, size, 8, 2, length );
+	}
+	else if (memcmp( data, "STAT", 4 ) == 0)
+	{
+		type = RequestType::Statistic;
+		return skipStrings( data, size, 12, 1, length );
+	}
+	else if (memcmp( data, "PCTL", 4 ) == 0)
+	{
+		if (size < 12)
+			return FrameStatus::Incomplete;
+		uint32_t count = readBigEndian32( data + 8 );
+		if (count > maxPercentiles)
+			return FrameStatus::Invalid;
+		type = RequestType::Percentile;
+		return skipStrings( data, size, 12 + count * sizeof(float), 1, length );
+	}
+	else if (memcmp( data, "HIST", 4 ) == 0)
+	{
+		type = RequestType::History;
+		return skipStrings( data, size, 12, 1, length );
+	}
+	else if (memcmp( data, "ALRT", 4 ) == 0)
+	{
+		if (size < AlertsRequest::size())
+			return FrameStatus::Incomplete;
+		type = RequestType::Alerts;
+		length = AlertsRequest::size();
+		return FrameStatus::Complete;
+	}
+	else
+	{
+		return FrameStatus::Invalid;
+	}
+}
+
+/// Measures how long it takes after start until the clients get their first response.
+static void logFirstResponse()
+{
+	// any of the server threads can be the first one
+	static std::atomic< bool > firstResponseSent( false );
+	if (!firstResponseSent.exchange( true ))
+	{
+		log( Severity::Info, _T("First response sent %lld ms after start"), millisecondsSinceStart() );
+	}
+}
+
+static Connection rejectInvalidRequest( ClientSocket & clientSocket )
+{
+	log( Severity::Debug, _T("Invalid request from socket %u, disconnecting"), unsigned( clientSocket.getSystemHandle() ) );
+	clientSocket.send( toByteVector( SensorResponse( ResponseCode::InvalidRequest ) ) );
+	// Might be an uninvited guest, let's not allow him to consume system resources.
+	return Connection::Close;
+}
+
+/// The responses with many values have faster overloads in ResponseEncoding.hpp, this is for all the others.
+template< typename Response >
+static vector< uint8_t > encodeResponse( const Response & response )
+{
+	return toByteVector( response );
+}
+
+template< typename Response >
+static Connection sendResponse( ClientSocket & clientSocket, const Response & response )
+{
+	auto sendRes = clientSocket.send( encodeResponse( response ) );
+	if (sendRes != SocketError::Success)
+	{
+		log( Severity::Warning, _T("send() failed at socket %u (SocketError = %hs; error code = %d)"),
+			unsigned( clientSocket.getSystemHandle() ), enumString( sendRes ), int( clientSocket.getLastSystemError() ) );
+		return Connection::Close;  // client probably disconnected
+	}
+	logFirstResponse();
+	return Connection::Keep;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//  admission control
+
+/// More requests have come while the server was busy than it can serve without delaying everyone.
+static bool isOverloaded()
+{
+	return g_config.overloadWatermark != 0 && g_requestsSinceWakeUp >= g_config.overloadWatermark;
+}
+
+/// Decides whether the next request of the client is served now. If not, retryAfter is how long the client must wait.
+static bool admitRequest( ClientConnection & client, std::chrono::milliseconds & retryAfter )
+{
+	// the throttled client is looked at again by the timer wheel, so it can't be sooner than its next tick
+	const auto minRetryAfter = std::chrono::duration_cast< std::chrono::milliseconds >( timerTick );
+	const double burst = double( g_config.maxClientRequestBurst );
+
+	if (g_config.maxClientRequestRate != 0)
+	{
+		const auto now = std::chrono::steady_clock::now();
+		const double rate = double( g_config.maxClientRequestRate );
+		client.requestTokens = std::min( burst, client.requestTokens + rate * std::chrono::duration< double >( now - client.tokensRefilled ).count() );
+		client.tokensRefilled = now;
+		if (client.requestTokens < 1.0)
+		{
+			auto untilNextToken = std::chrono::milliseconds( int64_t( std::ceil( (1.0 - client.requestTokens) / rate * 1000.0 ) ) );
+			retryAfter = std::max( untilNextToken, minRetryAfter );
+			return false;
+		}
+	}
+
+	// In overload, the clients that have used more than half of their burst wait, so that those asking only now and then
+	// are still served in time. Without the per-client limit, there is no way to tell them apart.
+	if (isOverloaded() && (g_config.maxClientRequestRate == 0 || client.requestTokens < burst / 2))
+	{
+		retryAfter = minRetryAfter;
+		return false;
+	}
+
+	if (g_config.maxClientRequestRate != 0)
+		client.requestTokens -= 1.0;
+	++g_requestsSinceWakeUp;
+	return true;
+}
+
+/// Answers the request with Busy instead of serving it, and stops reading the client's requests until retryAfter passes.
+/** This costs the server much less than serving the request, and much less than answering all the client's
+  * further requests with Busy, because those stay in the system buffer and then the client stops sending. */
+static Connection throttleClient( ClientConnection & client, std::chrono::milliseconds retryAfter )
+{
+	log( Severity::Debug, _T("Client at socket %u is busy, throttling it for %lld ms"),
+		unsigned( client.socket->getSystemHandle() ), (long long)retryAfter.count() );
+
+	client.throttled = true;
+	client.throttledUntil = std::chrono::steady_clock::now() + retryAfter;
+
+	if (client.protocol == ClientProtocol::Http)
+	{
+		char retryAfterHeader [48];
+		snprintf( retryAfterHeader, sizeof(retryAfterHeader), "Retry-After: %lld\r\n", (long long)(retryAfter.count() + 999) / 1000 );
+		const string busy = makeHttpResponse( 503, "Service Unavailable", textContentType, "Too many requests, try again later.\n", retryAfterHeader );
+		return client.socket->send( make_span( (const uint8_t *)busy.data(), busy.size() ) ) == SocketError::Success ? Connection::Keep : Connection::Close;
+	}
+	return sendResponse( *client.socket, BusyResponse( uint32_t( retryAfter.count() ) ) );
+}
+
+// A client that gets an error for every other request is broken or probing the service, either way it shouldn't
+// hold a slot. The errors that are surely not a mistake of a working client disconnect it right away.
+static const unsigned maxInvalidRequests = 8;
+
+/// Answers a request of a type that the client's listener doesn't serve, the other requests are still served.
+static Connection rejectDisallowedRequest( ClientConnection & client )
+{
+	const auto socketHandle = client.socket->getSystemHandle();
+	log( Severity::Debug, _T("Request from socket %u is not allowed at its listener"), unsigned( socketHandle ) );
+	Connection decision = sendResponse( *client.socket, SensorResponse( ResponseCode::InvalidRequest ) );
+	if (++client.invalidRequests >= maxInvalidRequests)
+	{
+		log( Severity::Debug, _T("Socket %u keeps sending requests that are not allowed, disconnecting"), unsigned( socketHandle ) );
+		return Connection::Close;
+	}
+	return decision;
+}
+
+static Connection handleSensorRequest( ClientSocket & clientSocket, const SensorRequest & request );
+static Connection handleBatchRequest( ClientSocket & clientSocket, const BatchRequest & request );
+static Connection handleSampleRequest( ClientSocket & clientSocket, const SampleRequest & request );
+static Connection handleStatisticRequest( ClientSocket & clientSocket, const StatisticRequest & request );
+static Connection handlePercentileRequest( ClientSocket & clientSocket, const PercentileRequest & request );
+static Connection handleHistoryRequest( ClientSocket & clientSocket, const HistoryRequest & request );
+static Connection handleChangesRequest( ClientSocket & clientSocket, const ChangesRequest & request );
+static Connection handleListRequest( ClientSocket & clientSocket, const ListRequest & request );
+static Connection handleWaitRequest( ClientConnection & client, const WaitRequest & request );
+static Connection handleFreshRequest( ClientConnection & client, const FreshRequest & request );
+static Connection handleAlertsRequest( ClientConnection & client, const AlertsRequest & request );
+
+static Connection handleRequest( ClientSocket & clientSocket, RequestType type, const uint8_t * data, size_t length )
+{
+	switch (type)
+	{
+		case RequestType::Sensor:
+		{
+			SensorRequest request;
+			if (!fromBytes( make_span( data, length ), request ))
+				return rejectInvalidRequest( clientSocket );
+			return handleSensorRequest( clientSocket, request );
+		}
+		case RequestType::Batch:
+		{
+			BatchRequest request;
+			if (!fromBytes( make_span( data, length ), request ))
+				return rejectInvalidRequest( clientSocket );
+			return handleBatchRequest( clientSocket, request );
+		}
+		case RequestType::Sample:
+		{
+			SampleRequest request;
+			if (!fromBytes( make_span( data, length ), request ))
+				return rejectInvalidRequest( clientSocket );
+			return handleSampleRequest( clientSocket, request );
+		}
+		case RequestType::Statistic:
+		{
+			StatisticRequest request;
+			if (!fromBytes( make_span( data, length ), request ))
+				return rejectInvalidRequest( clientSocket );
+			return handleStatisticRequest( clientSocket, request );
+		}
+		case RequestType::Percentile:
+		{
+			PercentileRequest request;
+			if (!fromBytes( make_span( data, length ), request ))
+				return rejectInvalidRequest( clientSocket );
+			return handlePercentileRequest( clientSocket, request );
+		}
+		case RequestType::History:
+		{
+			HistoryRequest request;
+			if (!fromBytes( make_span( data, length ), request ))
+				return rejectInvalidRequest( clientSocket );
+			return handleHistoryRequest( clientSocket, request );
+		}
+		case RequestType::Changes:
+		{
+			ChangesRequest request;
+			if (!fromBytes( make_span( data, length ), request ))
+				return rejectInvalidRequest( clientSocket );
+			return handleChangesRequest( clientSocket, request );
+		}
+		case RequestType::List:
+		{
+			ListRequest request;
+			if (!fromBytes( make_span( data, length ), request ))
+				return rejectInvalidRequest( clientSocket );
+			return handleListRequest( clientSocket, request );
+		}
+		case RequestType::Wait:
+		case RequestType::Fresh:
+		case RequestType::Alerts:
+			break;  // handled by serveBinaryRequests(), because they need the whole connection
+	}
+	return rejectInvalidRequest( clientSocket );
+}
+
+static Connection serveBinaryRequests( ClientConnection & client )
+{
+	size_t processed = 0;
+	Connection decision = Connection::Keep;
+	while (decision == Connection::Keep && client.parked == ParkedRequest::None && !client.throttled && !isBackedUp( client )
+	    && processed < client.inBuffer.size())
+	{
+		const uint8_t * requestData = client.inBuffer.data() + processed;
+		size_t available = client.inBuffer.size() - processed;
+
+		RequestType requestType;
+		size_t requestLength = 0;
+		FrameStatus frameStatus = frameRequest( requestData, available, requestType, requestLength );
+		if (frameStatus == FrameStatus::Incomplete)
+		{
+			break;  // wait for the rest
+		}
+		else if (frameStatus == FrameStatus::Invalid)
+		{
+			return rejectInvalidRequest( *client.socket );
+		}
+
+		if (!client.listener.allows( requestType ))
+		{
+			decision = rejectDisallowedRequest( client );
+			processed += requestLength;
+			continue;
+		}
+
+		std::chrono::milliseconds retryAfter;
+		if (!admitRequest( client, retryAfter ))
+		{
+			decision = throttleClient( client, retryAfter );
+			processed += requestLength;  // answered, the client has to send it again
+			break;
+		}
+
+		if (requestType == RequestType::Wait)
+		{
+			WaitRequest request;
+			if (!fromBytes( make_span( requestData, requestLength ), request ))
+				return rejectInvalidRequest( *client.socket );
+			decision = handleWaitRequest( client, request );
+		}
+		else if (requestType == RequestType::Fresh)
+		{
+			FreshRequest request;
+			if (!fromBytes( make_span( requestData, requestLength ), request ))
+				return rejectInvalidRequest( *client.socket );
+			decision = handleFreshRequest( client, request );
+		}
+		else if (requestType == RequestType::Alerts)
+		{
+			AlertsRequest request;
+			if (!fromBytes( make_span( requestData, requestLength ), request ))
+				return rejectInvalidRequest( *client.socket );
+			decision = handleAlertsRequest( client, request );
+		}
+		else
+		{
+			decision = handleRequest( *client.socket, requestType, requestData, requestLength );
+		}
+		processed += requestLength;
+	}
+
+	client.inBuffer.erase( client.inBuffer.begin(), client.inBuffer.begin() + processed );
+
+	return decision;
+}
+
+/// Looks up the last sample of a sensor. The sample is valid only if the result is Success or SensorFailed.
+/** If statistics is given, the statistics of the sensor are loaded into it too. */
+static ResponseCode readSample( const string & sensorID, SensorSample & sample, SensorStatistics * statistics = nullptr )
+{
+	auto sensorDataIter = g_servedSensorData->find( sensorID );
+	if (sensorDataIter == g_servedSensorData->end() || sensorDataIter->second.state == SensorState::RequestedButNotFound)
+	{
+		return ResponseCode::SensorNotFound;
 	}
 	else if (sensorDataIter->second.state == SensorState::FoundButNotMonitored)
 	{
-		log( Severity::Debug, _T("Sensor not monitored: %hs"), request.sensorID.c_str() );
-		clientSocket.send( toByteVector( SensorResponse( ResponseCode::SensorNotMonitored ) ) );
-		return Connection::Keep;
+		return ResponseCode::SensorNotMonitored;
 	}
 
-	float value = sensorDataIter->second.value.load();
+	sample = sensorDataIter->second.sample.load();
+	if (statistics)
+		*statistics = sensorDataIter->second.statistics.load();  // after the sample, so they are at least as new
 
-	if (value <= 0.0f) // the other thread failed to retrieve temperature
+	if (hasFailed( sample )) // the other thread failed to retrieve temperature
 	{
+		return ResponseCode::SensorFailed;
+	}
+
+	return ResponseCode::Success;
+}
+
+static SensorResponse readSensor( const string & sensorID )
+{
+	SensorSample sample;
+	ResponseCode code = readSample( sensorID, sample );
+	return code == ResponseCode::Success ? SensorResponse( code, sample.value ) : SensorResponse( code );
+}
+
+static Connection handleSensorRequest( ClientSocket & clientSocket, const SensorRequest & request )
+{
+	SensorResponse response = readSensor( request.sensorID );
+
+	if (response.code == ResponseCode::SensorNotFound)
+		log( Severity::Debug, _T("Sensor not found: %hs"), request.sensorID.c_str() );
+	else if (response.code == ResponseCode::SensorNotMonitored)
+		log( Severity::Debug, _T("Sensor not monitored: %hs"), request.sensorID.c_str() );
+	else if (response.code == ResponseCode::SensorFailed)
 		log( Severity::Debug, _T("Sensor reading is not ready") );
-		clientSocket.send( toByteVector( SensorResponse( ResponseCode::SensorFailed ) ) );
-		return Connection::Keep;
+	//else
+	//	log( Severity::Debug, _T("Sending back value of sensor %hs: %f"), request.sensorID.c_str(), double(response.value) );
+
+	return sendResponse( clientSocket, response );
+}
+
+static Connection handleBatchRequest( ClientSocket & clientSocket, const BatchRequest & request )
+{
+	BatchResponse response( ResponseCode::Success );
+	response.codes.reserve( request.sensorIDs.size() );
+	response.values.reserve( request.sensorIDs.size() );
+
+	for (const string & sensorID : request.sensorIDs)
+	{
+		SensorResponse sensorResponse = readSensor( sensorID );
+		response.codes.push_back( sensorResponse.code );
+		response.values.push_back( sensorResponse.value );
+	}
+
+	return sendResponse( clientSocket, response );
+}
+
+/// The cycles are numbered from 1 again when the service restarts, so a client asking for the samples newer than a cycle
+/// that hasn't happened in this run has got its number from an earlier run. It's behind, not ahead, so it gets everything.
+/** The cycle in progress may have stored some of its samples already, their seq is one more than the last cycle. */
+static uint32_t sinceCycle( uint32_t ifNewerThan, uint32_t lastCycle )
+{
+	return ifNewerThan > lastCycle ? 0 : ifNewerThan;
+}
+
+static SampleResponse makeSampleResponse( ResponseCode code, const SensorSample & sample )
+{
+	if (code != ResponseCode::Success)
+		return SampleResponse( code );
+
+	return SampleResponse( code, sample.value, sample.seq, sample.timestamp_us );
+}
+
+static Connection handleSampleRequest( ClientSocket & clientSocket, const SampleRequest & request )
+{
+	const uint32_t ifNewerThan = sinceCycle( request.ifNewerThan, g_lastCycle.load() + 1 );
+	SensorSample sample = { 0.0f, 0, 0 };
+	ResponseCode code = readSample( request.sensorID, sample );
+
+	// a sensor that hasn't been read yet has seq 0, that's never newer
+	if ((code == ResponseCode::Success || code == ResponseCode::SensorFailed) && ifNewerThan != 0 && sample.seq <= ifNewerThan)
+		return sendResponse( clientSocket, SampleResponse( ResponseCode::NotModified ) );
+
+	return sendResponse( clientSocket, makeSampleResponse( code, sample ) );
+}
+
+static ChangesResponse collectChanges( const vector< string > & sensorIDs, uint32_t ifNewerThan )
+{
+	ChangesResponse response( ResponseCode::Success );
+	// Read this before the samples, so that a cycle in progress is reported again next time rather than missed.
+	response.seq = g_lastCycle.load();
+	ifNewerThan = sinceCycle( ifNewerThan, response.seq );
+
+	for (uint32_t i = 0; i < uint32_t( sensorIDs.size() ); ++i)
+	{
+		SensorSample sample = { 0.0f, 0, 0 };
+		ResponseCode code = readSample( sensorIDs[i], sample );
+		if (ifNewerThan != 0 && sample.seq <= ifNewerThan)
+			continue;
+
+		response.indexes.push_back( i );
+		response.codes.push_back( code );
+		response.values.push_back( code == ResponseCode::Success ? sample.value : 0.0f );
+		response.seqs.push_back( sample.seq );
+		response.timestamps_us.push_back( sample.timestamp_us );
+	}
+
+	return response;
+}
+
+static float statisticOfKind( const SensorStatistics & statistics, ValueKind kind )
+{
+	switch (kind)
+	{
+		case ValueKind::Mean:          return statistics.mean;
+		case ValueKind::StdDev:        return statistics.stdDev;
+		case ValueKind::RatePerSecond: return statistics.ratePerSecond;
+		case ValueKind::Median:        return statistics.median;
+		default:                       return 0.0f;
+	}
+}
+
+static Connection handleStatisticRequest( ClientSocket & clientSocket, const StatisticRequest & request )
+{
+	const uint32_t ifNewerThan = sinceCycle( request.ifNewerThan, g_lastCycle.load() + 1 );
+	SensorSample sample = { 0.0f, 0, 0 };
+	SensorStatistics statistics;
+	ResponseCode code = readSample( request.sensorID, sample, &statistics );
+
+	if ((code == ResponseCode::Success || code == ResponseCode::SensorFailed) && ifNewerThan != 0 && sample.seq <= ifNewerThan)
+		return sendResponse( clientSocket, SampleResponse( ResponseCode::NotModified ) );
+
+	// the values loaded from the cache have no statistics yet, the raw value is the best estimate of them then
+	if (code == ResponseCode::Success && request.kind != ValueKind::Raw && sample.timestamp_us != 0)
+		sample.value = statisticOfKind( statistics, request.kind );
+
+	return sendResponse( clientSocket, makeSampleResponse( code, sample ) );
+}
+
+static ResponseCode stateToCode( SensorState state )
+{
+	switch (state)
+	{
+		case SensorState::Monitored:            return ResponseCode::Success;
+		case SensorState::FoundButNotMonitored: return ResponseCode::SensorNotMonitored;
+		default:                                return ResponseCode::SensorNotFound;
+	}
+}
+
+/// Looks up a sensor that has to be monitored, otherwise returns null and the code to respond with.
+static const SensorData * findMonitoredSensor( const string & sensorID, ResponseCode & code )
+{
+	auto sensorDataIter = g_servedSensorData->find( sensorID );
+	if (sensorDataIter == g_servedSensorData->end())
+	{
+		code = ResponseCode::SensorNotFound;
+		return nullptr;
+	}
+	code = stateToCode( sensorDataIter->second.state );
+	return code == ResponseCode::Success ? &sensorDataIter->second : nullptr;
+}
+
+static Connection handlePercentileRequest( ClientSocket & clientSocket, const PercentileRequest & request )
+{
+	ResponseCode code;
+	const SensorData * sensorData = findMonitoredSensor( request.sensorID, code );
+	if (!sensorData)
+	{
+		return sendResponse( clientSocket, PercentileResponse( code ) );
+	}
+
+	QuantileSketch sketch;
+	if (auto percentiles = std::atomic_load( &sensorData->percentiles ))
+		percentiles->collect( request.window_s, monotonicMicroseconds(), sketch );
+	if (sketch.count() == 0)
+	{
+		return sendResponse( clientSocket, PercentileResponse( ResponseCode::SensorFailed ) );  // no successful reading in the window
+	}
+
+	PercentileResponse response( ResponseCode::Success );
+	response.sampleCount = uint32_t( std::min( sketch.count(), uint64_t( UINT32_MAX ) ) );
+	for (float percentile : request.percentiles)
+		response.values.push_back( sketch.quantile( percentile / 100.0 ) );
+
+	return sendResponse( clientSocket, response );
+}
+
+/// Decodes the readings of the range [start_us, end_us) and sums them up into the points of the response.
+static void summarizeHistory( const SampleHistory & history, uint64_t start_us, uint64_t end_us, HistoryResponse & response )
+{
+	const size_t pointCount = response.sampleCounts.size();
+	const uint64_t span_us = end_us - start_us;
+	vector< double > sums( pointCount, 0.0 );  // doubles, a week of readings would lose precision in a float
+
+	history.scan( start_us, end_us, [&]( const HistoryChunk & chunk )
+	{
+		// The readings are ordered by time, so the ones of the same point form a contiguous run,
+		// which is summarized at once by the SIMD kernel.
+		for (size_t runStart = 0; runStart < chunk.count; )
+		{
+			// the history has only milliseconds, the first one can start a bit before the window
+			const uint64_t timestamp_us = chunk.timestamps_ms[ runStart ] * 1000;
+			const uint64_t offset_us = timestamp_us > start_us ? timestamp_us - start_us : 0;
+			const size_t point = std::min( size_t( offset_us * pointCount / span_us ), pointCount - 1 );
+
+			// the first offset that belongs to the next point
+			const uint64_t pointEnd_us = start_us + ((point + 1) * span_us + pointCount - 1) / pointCount;
+			const size_t runEnd = point + 1 == pointCount ? chunk.count : size_t( std::lower_bound(
+				chunk.timestamps_ms + runStart, chunk.timestamps_ms + chunk.count, pointEnd_us,
+				[]( uint64_t timestamp_ms, uint64_t end_us ) { return timestamp_ms * 1000 < end_us; }
+			) - chunk.timestamps_ms );
+
+			const FloatSummary summary = summarizeFloats( chunk.values + runStart, runEnd - runStart );
+			if (response.sampleCounts[ point ] == 0)
+			{
+				response.mins[ point ] = summary.min;
+				response.maxs[ point ] = summary.max;
+			}
+			else
+			{
+				response.mins[ point ] = std::min( response.mins[ point ], summary.min );
+				response.maxs[ point ] = std::max( response.maxs[ point ], summary.max );
+			}
+			sums[ point ] += summary.sum;
+			response.sampleCounts[ point ] += uint32_t( runEnd - runStart );
+
+			runStart = runEnd;
+		}
+	});
+
+	for (size_t point = 0; point < pointCount; ++point)
+	{
+		if (response.sampleCounts[ point ] > 0)
+			response.means[ point ] = float( sums[ point ] / double( response.sampleCounts[ point ] ) );
+	}
+}
+
+static Connection handleHistoryRequest( ClientSocket & clientSocket, const HistoryRequest & request )
+{
+	ResponseCode code;
+	const SensorData * sensorData = findMonitoredSensor( request.sensorID, code );
+	if (!sensorData)
+	{
+		return sendResponse( clientSocket, HistoryResponse( code ) );
+	}
+
+	HistoryResponse response( ResponseCode::Success );
+	response.endTimestamp_us = monotonicMicroseconds();
+	response.sampleCounts.assign( request.pointCount, 0 );
+	response.mins.assign( request.pointCount, 0.0f );
+	response.maxs.assign( request.pointCount, 0.0f );
+	response.means.assign( request.pointCount, 0.0f );
+
+	// without the history (disabled, or no successful reading yet) all the points are empty
+	const uint64_t window_us = uint64_t( request.window_s ) * 1000000;
+	const uint64_t start_us = response.endTimestamp_us > window_us ? response.endTimestamp_us - window_us : 0;
+	if (auto history = std::atomic_load( &sensorData->history ))
+		summarizeHistory( *history, start_us, response.endTimestamp_us, response );
+
+	return sendResponse( clientSocket, response );
+}
+
+static Connection handleChangesRequest( ClientSocket & clientSocket, const ChangesRequest & request )
+{
+	ChangesResponse response = collectChanges( request.sensorIDs, request.ifNewerThan );
+
+	// after a restart of the service, the client gets all the sensors, even those without any sample in this run
+	if (response.indexes.empty() && sinceCycle( request.ifNewerThan, response.seq ) != 0)
+		return sendResponse( clientSocket, ChangesResponse( ResponseCode::NotModified ) );
+
+	return sendResponse( clientSocket, response );
+}
+
+static Connection handleListRequest( ClientSocket & clientSocket, const ListRequest & request )
+{
+	const uint32_t maxCount = request.maxCount == 0 ? maxListCount : std::min( request.maxCount, maxListCount );
+
+	// the index of the sensors is only replaced, never modified, so it can be used from this thread without locking
+	std::shared_ptr< const SensorIndex > sensorIndex = std::atomic_load( &g_sensorIndex );
+
+	ListResponse response( ResponseCode::Success );
+	sensorIndex->forEachWithPrefix( request.prefix, request.startAfter, [&]( const SensorIndex::Entry & entry )
+	{
+		if (response.ids.size() == maxCount)
+		{
+			response.hasMore = 1;
+			return false;
+		}
+		response.ids.push_back( entry.first );
+		response.names.push_back( entry.second.name );
+		response.categories.push_back( entry.second.category );
+		response.states.push_back( stateToCode( entry.second.state ) );
+		return true;
+	});
+
+	return sendResponse( clientSocket, response );
+}
+
+static Connection handleWaitRequest( ClientConnection & client, const WaitRequest & request )
+{
+	uint32_t lastCycle = g_lastCycle.load();
+
+	// the client may be behind, then it doesn't need to wait
+	if (request.ifNewerThan != 0 && lastCycle > request.ifNewerThan)
+		return sendResponse( *client.socket, collectChanges( request.sensorIDs, request.ifNewerThan ) );
+	// or it may have its number from before the service has restarted, then the cycle it waits for would come much later
+	if (request.ifNewerThan > lastCycle)
+		return sendResponse( *client.socket, collectChanges( request.sensorIDs, 0 ) );
+
+	// Park it until completeParkedWaits() finds the cycle has come. The cycles only grow within a run,
+	// so the parked ifNewerThan is never ahead of the last cycle and the wait always ends with the next one.
+	client.parked = ParkedRequest::Wait;
+	client.waitRequest = request;
+	if (client.waitRequest.ifNewerThan == 0)
+		client.waitRequest.ifNewerThan = lastCycle;
+	client.waitDeadline = std::chrono::steady_clock::now()
+		+ std::chrono::milliseconds( std::min( request.timeout_ms, maxWaitTimeout_ms ) );
+
+	return Connection::Keep;
+}
+
+static bool isFreshEnough( const SensorSample & sample, uint32_t maxAge_ms )
+{
+	// the client can't make us read the sensor more often than configured, no matter what it asks for
+	uint64_t maxAge_us = uint64_t( std::max( maxAge_ms, uint32_t( g_config.minOnDemandInterval_ms ) ) ) * 1000;
+	return sample.timestamp_us != 0 && monotonicMicroseconds() - sample.timestamp_us <= maxAge_us;
+}
+
+/// Global cap of on-demand reads, a token bucket refilled at max_on_demand_reads_per_second. Only under g_onDemandMtx.
+static bool takeOnDemandToken()
+{
+	static double tokens = double( g_config.maxOnDemandReadsPerSecond );
+	static auto lastRefill = std::chrono::steady_clock::now();
+
+	const auto now = std::chrono::steady_clock::now();
+	const double rate = double( g_config.maxOnDemandReadsPerSecond );
+	tokens = std::min( rate, tokens + rate * std::chrono::duration< double >( now - lastRefill ).count() );
+	lastRefill = now;
+
+	if (tokens < 1.0)
+		return false;
+	tokens -= 1.0;
+	return true;
+}
+
+/// Asks the sampling thread to read the sensor, unless it has been asked already. Returns false if the rate cap is hit.
+static bool requestOnDemandRead( const string & sensorID )
+{
+	std::unique_lock< std::mutex > lock( g_onDemandMtx );
+
+	if (g_onDemandReads.count( sensorID ) > 0)
+		return true;  // already on the way, share that reading
+	if (!takeOnDemandToken())
+		return false;
+
+	g_onDemandReads.insert( sensorID );
+	lock.unlock();
+
+	SetEvent( g_onDemandEvent );
+	return true;
+}
+
+static Connection handleFreshRequest( ClientConnection & client, const FreshRequest & request )
+{
+	SensorSample sample = { 0.0f, 0, 0 };
+	ResponseCode code = readSample( request.sensorID, sample );
+
+	if (code != ResponseCode::Success && code != ResponseCode::SensorFailed)
+		return sendResponse( *client.socket, SampleResponse( code ) );
+
+	if (isFreshEnough( sample, request.maxAge_ms ))
+		return sendResponse( *client.socket, makeSampleResponse( code, sample ) );
+
+	if (!requestOnDemandRead( request.sensorID ))
+	{
+		log( Severity::Debug, _T("On-demand read limit reached, sending the last sample of %hs"), request.sensorID.c_str() );
+		return sendResponse( *client.socket, makeSampleResponse( code, sample ) );
+	}
+
+	// park it until completeParkedWaits() finds the new sample
+	client.parked = ParkedRequest::Fresh;
+	client.freshRequest = request;
+	client.waitDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( maxFreshReadTime_ms );
+
+	return Connection::Keep;
+}
+
+/// Collects the alert events after afterEvent, or the raised alerts, if the client has no events to continue from.
+static AlertsResponse collectAlerts( uint32_t afterEvent )
+{
+	AlertsResponse response( ResponseCode::Success );
+
+	auto addEvent = [&response]( const AlertEvent & event )
+	{
+		response.numbers.push_back( event.number );
+		response.rules.push_back( event.rule );
+		response.states.push_back( event.state );
+		response.values.push_back( event.value );
+		response.timestamps_us.push_back( event.timestamp_us );
+		// the rules never change after the start, so they can be read while the sampling thread updates the trackers
+		response.sensorIDs.push_back( g_alerts[ event.rule ].tracker.rule().sensorID );
+	};
+
+	std::unique_lock< std::mutex > lock( g_alertEventsMtx );
+
+	response.lastEvent = g_lastAlertEvent.load();
+	const uint32_t oldestKept = g_recentAlertEvents.empty() ? response.lastEvent + 1 : g_recentAlertEvents.front().number;
+	// after a restart of the service the numbers start again from 1
+	const bool canContinue = afterEvent != 0 && afterEvent <= response.lastEvent && afterEvent + 1 >= oldestKept;
+
+	if (canContinue)
+	{
+		for (const AlertEvent & event : g_recentAlertEvents)
+			if (event.number > afterEvent)
+				addEvent( event );
+	}
+	else
+	{
+		response.isSnapshot = 1;
+		for (const AlertEvent & event : g_lastAlertEvents)
+			if (event.number != 0 && event.state == AlertState::Raised)
+				addEvent( event );
+	}
+
+	return response;
+}
+
+static Connection handleAlertsRequest( ClientConnection & client, const AlertsRequest & request )
+{
+	// the client is behind or has nothing to continue from, it doesn't need to wait
+	if (request.afterEvent != g_lastAlertEvent.load() || request.afterEvent == 0)
+		return sendResponse( *client.socket, collectAlerts( request.afterEvent ) );
+
+	// park it until completeParkedWaits() finds a new event
+	client.parked = ParkedRequest::Alerts;
+	client.alertsRequest = request;
+	client.waitDeadline = std::chrono::steady_clock::now()
+		+ std::chrono::milliseconds( std::min( request.timeout_ms, maxWaitTimeout_ms ) );
+
+	return Connection::Keep;
+}
+
+/// Answers the parked requests that can be answered and returns the deadline of the nearest one that can't.
+static std::chrono::steady_clock::time_point completeParkedWaits(
+	ConnectionMap & connections, vector< std::pair< socket_id, Connection > > & completed
+)
+{
+	const uint32_t lastCycle = g_lastCycle.load();
+	const auto now = std::chrono::steady_clock::now();
+	auto nearestDeadline = std::chrono::steady_clock::time_point::max();
+
+	for (auto & [socket, client] : connections)
+	{
+		Connection decision;
+		if (client->parked == ParkedRequest::None)
+		{
+			continue;
+		}
+		else if (client->parked == ParkedRequest::Wait && lastCycle > client->waitRequest.ifNewerThan)
+		{
+			// unlike ChangesRequest, report the completed cycle even if none of the sensors has changed
+			decision = sendResponse( *client->socket, collectChanges( client->waitRequest.sensorIDs, client->waitRequest.ifNewerThan ) );
+		}
+		else if (client->parked == ParkedRequest::Wait && now >= client->waitDeadline)
+		{
+			decision = sendResponse( *client->socket, ChangesResponse( ResponseCode::NotModified ) );
+		}
+		else if (client->parked == ParkedRequest::Fresh)
+		{
+			SensorSample sample = { 0.0f, 0, 0 };
+			ResponseCode code = readSample( client->freshRequest.sensorID, sample );
+			if (!isFreshEnough( sample, client->freshRequest.maxAge_ms ) && now < client->waitDeadline)
+			{
+				nearestDeadline = std::min( nearestDeadline, client->waitDeadline );
+				continue;
+			}
+			decision = sendResponse( *client->socket, makeSampleResponse( code, sample ) );
+		}
+		else if (client->parked == ParkedRequest::Alerts && g_lastAlertEvent.load() != client->alertsRequest.afterEvent)
+		{
+			decision = sendResponse( *client->socket, collectAlerts( client->alertsRequest.afterEvent ) );
+		}
+		else if (client->parked == ParkedRequest::Alerts && now >= client->waitDeadline)
+		{
+			decision = sendResponse( *client->socket, AlertsResponse( ResponseCode::NotModified ) );
+		}
+		else
+		{
+			nearestDeadline = std::min( nearestDeadline, client->waitDeadline );
+			continue;
+		}
+		client->parked = ParkedRequest::None;
+
+		// the client might have sent more requests after the parked one, those are processed now
+		if (decision == Connection::Keep)
+			decision = serveBinaryRequests( *client );
+		if (decision == Connection::Keep && client->parked != ParkedRequest::None)
+			nearestDeadline = std::min( nearestDeadline, client->waitDeadline );
+
+		completed.emplace_back( socket, decision );
+	}
+
+	return nearestDeadline;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//  connectionless requests
+
+/// Collects the response to a request from a datagram, so that the same handlers serve the datagrams and the connections.
+class DatagramReply : public ClientSocket
+{
+ public:
+	DatagramReply( vector< uint8_t > & reply ) : _reply( reply ) {}
+	SocketError send( const_byte_span data ) override
+	{
+		_reply.insert( _reply.end(), data.data(), data.data() + data.size() );
+		return SocketError::Success;
+	}
+	SocketError flush() override  { return SocketError::Success; }
+	size_t queuedSize() const override  { return 0; }
+	SocketError receiveOnce( vector< uint8_t > & ) override  { return SocketError::NotConnected; }
+	socket_id getSystemHandle() const override  { return g_udpQuerySocket.getSystemHandle(); }
+	system_error_t getLastSystemError() const override  { return g_udpQuerySocket.getLastSystemError(); }
+ private:
+	vector< uint8_t > & _reply;
+};
+
+// Don't let a flood of datagrams starve the connected clients, the rest is received in the next iteration of the loop.
+static const unsigned maxDatagramBatchesPerWakeUp = 4;
+
+static void serveDatagrams()
+{
+	for (unsigned batch = 0; batch < maxDatagramBatchesPerWakeUp; ++batch)
+	{
+		const size_t count = g_udpQuerySocket.receiveBatch();
+		for (size_t i = 0; i < count; ++i)
+		{
+			const_byte_span request = g_udpQuerySocket.request( i );
+			DatagramReply reply( g_udpQuerySocket.reply( i ) );
+
+			RequestType requestType = RequestType::Sensor;
+			size_t requestLength = 0;
+			FrameStatus frameStatus = g_udpQuerySocket.isTruncated( i )
+				? FrameStatus::Invalid
+				: frameRequest( request.data(), request.size(), requestType, requestLength );
+			const bool hasRequestID = frameStatus == FrameStatus::Complete && request.size() == requestLength + datagramRequestIDSize;
+			// A datagram is exactly one request, optionally followed by its ID, and only the requests that are answered
+			// right away make sense here, there is no connection to park the others on.
+			if (frameStatus != FrameStatus::Complete || (requestLength != request.size() && !hasRequestID)
+			 || (requestType != RequestType::Sensor && requestType != RequestType::Batch))
+			{
+				static const vector< uint8_t > invalidRequest = toByteVector( SensorResponse( ResponseCode::InvalidRequest ) );
+				reply.send( invalidRequest );
+			}
+			// there is no connection to keep the state of the sender in, so only the global watermark applies
+			else if (isOverloaded())
+			{
+				static const vector< uint8_t > busy = toByteVector( BusyResponse( uint32_t( std::chrono::milliseconds( timerTick ).count() ) ) );
+				reply.send( busy );
+			}
+			else
+			{
+				++g_requestsSinceWakeUp;
+				handleRequest( reply, requestType, request.data(), requestLength );
+			}
+
+			if (hasRequestID)
+			{
+				reply.send( make_span( request.data() + requestLength, datagramRequestIDSize ) );
+			}
+		}
+		g_udpQuerySocket.sendReplies();
+
+		if (count < udpBatchSize)
+			break;  // drained
 	}
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//  HTTP
+
+static Connection handleHttpRequest( ClientConnection & client, const HttpRequest & request );
+
+static Connection serveHttpRequests( ClientConnection & client )
+{
+	const auto socketHandle = client.socket->getSystemHandle();
+
+	size_t processed = 0;
+	Connection decision = Connection::Keep;
+	while (decision == Connection::Keep && !client.throttled && !isBackedUp( client ) && processed < client.inBuffer.size())
+	{
+		HttpRequest request;
+		size_t requestLength = 0;
+		HttpParseResult parseResult = parseHttpRequest(
+			(const char *)client.inBuffer.data() + processed, client.inBuffer.size() - processed, request, requestLength
+		);
+		if (parseResult == HttpParseResult::Incomplete)
+		{
+			break;  // wait for the rest
+		}
+		else if (parseResult == HttpParseResult::Invalid)
+		{
+			log( Severity::Debug, _T("Invalid HTTP request from socket %u, disconnecting"), unsigned( socketHandle ) );
+			static const string badRequest = makeHttpResponse( 400, "Bad Request", textContentType, "Malformed request.\n" );
+			client.socket->send( make_span( (const uint8_t *)badRequest.data(), badRequest.size() ) );
+			return Connection::Close;
+		}
+		processed += requestLength;
+
+		std::chrono::milliseconds retryAfter;
+		if (!admitRequest( client, retryAfter ))
+		{
+			decision = throttleClient( client, retryAfter );
+			break;
+		}
+
+		decision = handleHttpRequest( client, request );
+	}
+
+	client.inBuffer.erase( client.inBuffer.begin(), client.inBuffer.begin() + processed );
+
+	return decision;
+}
+
+static Connection handleHttpRequest( ClientConnection & client, const HttpRequest & request )
+{
+	ClientSocket & clientSocket = *client.socket;
+	const auto socketHandle = clientSocket.getSystemHandle();
+
+	static const auto methodNotAllowed = std::make_shared< const string >(
+		makeHttpResponse( 405, "Method Not Allowed", textContentType, "Only GET and HEAD are supported.\n" )
+	);
+	static const auto notFound = std::make_shared< const string >(
+		makeHttpResponse( 404, "Not Found", textContentType, "Available resources are /metrics and /sensors.\n" )
+	);
+	static const auto notReady = std::make_shared< const string >(
+		makeHttpResponse( 503, "Service Unavailable", textContentType, "Sensors have not been read yet.\n" )
+	);
+
+	std::shared_ptr< const string > response;
+	if (request.method != "GET" && request.method != "HEAD")
+		response = methodNotAllowed;
+	else if (request.path == "/metrics")
+		response = std::atomic_load( &g_httpMetricsResponse );
+	else if (request.path == "/sensors")
+		response = std::atomic_load( &g_httpSensorsResponse );
+	else
+		response = notFound;
 
-	//log( Severity::Debug, _T("Sending back value of sensor %hs: %f"), request.sensorID.c_str(), double(value) );
+	if (!response)  // the first sampling cycle has not finished yet
+		response = notReady;
 
-	SensorResponse response( ResponseCode::Success, value );
+	if ((response == methodNotAllowed || response == notFound) && ++client.invalidRequests >= maxInvalidRequests)
+	{
+		log( Severity::Debug, _T("Socket %u keeps sending invalid HTTP requests, disconnecting"), unsigned( socketHandle ) );
+		clientSocket.send( make_span( (const uint8_t *)response->data(), response->size() ) );
+		return Connection::Close;
+	}
 
-	auto sendRes = clientSocket.send( toByteVector( response ) );
+	size_t length = request.method == "HEAD" ? httpHeaderLength( *response ) : response->size();
+	auto sendRes = clientSocket.send( make_span( (const uint8_t *)response->data(), length ) );
 	if (sendRes != SocketError::Success)
 	{
 		log( Severity::Warning, _T("send() failed at socket %u (SocketError = %hs; error code = %d)"),
 			unsigned( socketHandle ), enumString( sendRes ), int( clientSocket.getLastSystemError() ) );
 		return Connection::Close;  // client probably disconnected
 	}
+	logFirstResponse();
 
-	return Connection::Keep;
+	return request.keepAlive ? Connection::Keep : Connection::Close;
 }
 
 void MyServiceStop()
@@ -460,14 +2749,27 @@ void MyServiceStop()
 	// signal the primary thread
 	SetEvent( g_svcStopEvent );
 
-	// signal the secondary thread, this should wake up the thread from sleeping in accept
-	g_serverSocket.close();
+	// signal the server threads, this should wake them up from sleeping in accept
+	g_stopServer = true;
+	for (const unique_ptr< ServerLane > & lane : g_lanes)
+		lane->tcpServer.close();
+	wakeServerThreads();
 }
 
 void MyServiceCleanup()
 {
-	g_serverSocket.close();
+	for (const unique_ptr< ServerLane > & lane : g_lanes)
+	{
+		lane->tcpServer.close();
+		lane->unixServer.close();  // this also removes the socket file
+		lane->wakeSocket.close();
+	}
+	g_udpQuerySocket.close();
+
+	g_wakeSender.close();
+	g_alertSocket.close();
 
+	CloseHandle( g_onDemandEvent );
 	CloseHandle( g_svcStopEvent );
 
 	g_logSocket.close();
@@ -14,6 +14,8 @@
 #include <cstdint>
 #include <cstring>
 #include <string>
+#include <string_view>
+#include <vector>
 
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -25,6 +27,38 @@ enum class ResponseCode : uint32_t
 	SensorNotFound,        ///< such sensor was not found
 	SensorNotMonitored,    ///< sensor is available but not monitored
 	SensorFailed,          ///< sensor is available and monitored, but reading its value has failed
+	NotModified,           ///< there is no newer sample than the one the client already has
+	Busy,                  ///< the request has not been processed, see BusyResponse
+};
+
+/// Answer to any request that the service refuses to process now, because it's overloaded or because the client
+/// sends more requests than it's allowed to. Unlike the other codes, Busy is followed by how long the client should
+/// wait before it sends the request again, which is also how long the service won't read its further requests.
+struct BusyResponse
+{
+	ResponseCode code;
+	uint32_t retryAfter_ms;
+
+	BusyResponse() {}
+	BusyResponse( uint32_t retryAfter_ms ) : code( ResponseCode::Busy ), retryAfter_ms( retryAfter_ms ) {}
+
+	static constexpr size_t size()
+	{
+		return sizeof(code) + sizeof(retryAfter_ms);
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const BusyResponse & r )
+	{
+		stream.writeBigEndian( r.code );
+		stream.writeBigEndian( r.retryAfter_ms );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, BusyResponse & r )
+	{
+		if (!stream.readBigEndian( r.code ) || r.code != ResponseCode::Busy)
+			return stream.setFailed();
+		stream.readBigEndian( r.retryAfter_ms );
+	}
 };
 
 struct SensorRequest
@@ -54,6 +88,21 @@ struct SensorRequest
 
 		stream.readString0( r.sensorID );
 	}
+
+	/// Size of the request for this sensor ID, without having to construct the request.
+	static size_t size( std::string_view sensorID )
+	{
+		return sizeof(magic) + sensorID.size() + 1;
+	}
+
+	/// Writes the same bytes as operator<<, but without copying the sensor ID into a SensorRequest first.
+	/** The buffer must have at least size( sensorID ) bytes. */
+	static void encode( std::string_view sensorID, uint8_t * buffer )
+	{
+		memcpy( buffer, "SENS", sizeof(magic) );
+		memcpy( buffer + sizeof(magic), sensorID.data(), sensorID.size() );
+		buffer[ sizeof(magic) + sensorID.size() ] = '\0';
+	}
 };
 
 struct SensorResponse
@@ -86,4 +135,1003 @@ struct SensorResponse
 };
 
 
+/// Maximum number of sensors in a single batch request.
+constexpr uint32_t maxBatchSize = 1024;
+
+/// Maximum size of a request datagram sent to the UDP endpoint, which accepts only a SensorRequest or a BatchRequest.
+/** A batch of the longest sensor IDs therefore has to be split into several datagrams. */
+constexpr uint32_t maxDatagramSize = 16 * 1024;
+
+/// A request datagram can end with a request ID of this size, which the service copies to the end of the reply,
+/// so that the client can tell the reply to this request from a late reply to an earlier one.
+constexpr uint32_t datagramRequestIDSize = 4;
+
+/// Reads multiple sensors in a single round trip.
+struct BatchRequest
+{
+	char magic [4];
+	std::vector< std::string > sensorIDs;
+
+	BatchRequest() {}
+	BatchRequest( const std::vector< std::string > & sensorIDs ) : magic{'B','T','C','H'}, sensorIDs( sensorIDs ) {}
+
+	size_t size() const
+	{
+		size_t size = sizeof(magic) + sizeof(uint32_t);
+		for (const std::string & sensorID : sensorIDs)
+			size += sensorID.size() + 1;
+		return size;
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const BatchRequest & r )
+	{
+		stream << r.magic;
+		stream.writeBigEndian( uint32_t( r.sensorIDs.size() ) );
+		for (const std::string & sensorID : r.sensorIDs)
+			stream.writeString0( sensorID );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, BatchRequest & r )
+	{
+		stream >> r.magic;
+		if (strncmp( r.magic, "BTCH", 4 ) != 0)
+			return stream.setFailed();
+
+		uint32_t count = 0;
+		if (!stream.readBigEndian( count ) || count > maxBatchSize)
+			return stream.setFailed();
+
+		r.sensorIDs.resize( count );
+		for (std::string & sensorID : r.sensorIDs)
+			stream.readString0( sensorID );
+	}
+};
+
+inline uint32_t floatToBits( float value )
+{
+	uint32_t bits;
+	memcpy( &bits, &value, sizeof(bits) );
+	return bits;
+}
+
+inline float bitsToFloat( uint32_t bits )
+{
+	float value;
+	memcpy( &value, &bits, sizeof(value) );
+	return value;
+}
+
+/// Response to BatchRequest. The per-sensor results are stored column-wise: first all the codes, then all the values.
+/** The code is either Success, in which case the arrays follow, or InvalidRequest.
+  * Unlike in SensorResponse, the values are big endian and they are present even if the sensor's code is not Success. */
+struct BatchResponse
+{
+	ResponseCode code;
+	std::vector< ResponseCode > codes;
+	std::vector< float > values;
+
+	BatchResponse() {}
+	BatchResponse( ResponseCode code ) : code( code ) {}
+
+	size_t size() const
+	{
+		size_t size = sizeof(code);
+		if (code == ResponseCode::Success)
+			size += sizeof(uint32_t) + codes.size() * (sizeof(ResponseCode) + sizeof(float));
+		return size;
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const BatchResponse & r )
+	{
+		stream.writeBigEndian( r.code );
+		if (r.code != ResponseCode::Success)
+			return;
+
+		stream.writeBigEndian( uint32_t( r.codes.size() ) );
+		for (ResponseCode code : r.codes)
+			stream.writeBigEndian( code );
+		for (float value : r.values)
+			stream.writeBigEndian( floatToBits( value ) );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, BatchResponse & r )
+	{
+		if (!stream.readBigEndian( r.code ) || r.code != ResponseCode::Success)
+			return;
+
+		uint32_t count = 0;
+		if (!stream.readBigEndian( count ) || count > maxBatchSize)
+			return stream.setFailed();
+
+		r.codes.resize( count );
+		for (ResponseCode & code : r.codes)
+			stream.readBigEndian( code );
+		r.values.resize( count );
+		for (float & value : r.values)
+		{
+			uint32_t bits = 0;
+			stream.readBigEndian( bits );
+			value = bitsToFloat( bits );
+		}
+	}
+};
+
+
+/// Reads a sensor together with the sequence number and timestamp of its sample, optionally only if it has changed.
+/** Samples are numbered by the sampling cycle that has read them, starting with 1.
+  * If ifNewerThan is not 0 and the sensor's sample is not newer, the response is just the NotModified code. */
+struct SampleRequest
+{
+	char magic [4];
+	uint32_t ifNewerThan;
+	std::string sensorID;
+
+	SampleRequest() {}
+	SampleRequest( const std::string & sensorID, uint32_t ifNewerThan = 0 )
+		: magic{'R','E','A','D'}, ifNewerThan( ifNewerThan ), sensorID( sensorID ) {}
+
+	size_t size() const
+	{
+		return sizeof(magic) + sizeof(ifNewerThan) + sensorID.size() + 1;
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const SampleRequest & r )
+	{
+		stream << r.magic;
+		stream.writeBigEndian( r.ifNewerThan );
+		stream.writeString0( r.sensorID );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, SampleRequest & r )
+	{
+		stream >> r.magic;
+		if (strncmp( r.magic, "READ", 4 ) != 0)
+			return stream.setFailed();
+
+		stream.readBigEndian( r.ifNewerThan );
+		stream.readString0( r.sensorID );
+	}
+
+	static size_t size( std::string_view sensorID )
+	{
+		return sizeof(magic) + sizeof(ifNewerThan) + sensorID.size() + 1;
+	}
+
+	/// Writes the same bytes as operator<<, but without copying the sensor ID into a SampleRequest first.
+	/** The buffer must have at least size( sensorID ) bytes. */
+	static void encode( std::string_view sensorID, uint32_t ifNewerThan, uint8_t * buffer )
+	{
+		memcpy( buffer, "READ", sizeof(magic) );
+		for (size_t i = 0; i < sizeof(ifNewerThan); ++i)
+			buffer[ sizeof(magic) + i ] = uint8_t( ifNewerThan >> (8 * (sizeof(ifNewerThan) - 1 - i)) );
+		memcpy( buffer + sizeof(magic) + sizeof(ifNewerThan), sensorID.data(), sensorID.size() );
+		buffer[ sizeof(magic) + sizeof(ifNewerThan) + sensorID.size() ] = '\0';
+	}
+};
+
+/// Response to SampleRequest. Everything is big endian, the rest follows only if the code is Success.
+struct SampleResponse
+{
+	ResponseCode code;
+	float value;
+	uint32_t seq;            ///< number of the sampling cycle that has read the value
+	uint64_t timestamp_us;   ///< when the value was read, microseconds of the server's monotonic clock
+
+	SampleResponse() {}
+	SampleResponse( ResponseCode code ) : code( code ), value( 0.0f ), seq( 0 ), timestamp_us( 0 ) {}
+	SampleResponse( ResponseCode code, float value, uint32_t seq, uint64_t timestamp_us )
+		: code( code ), value( value ), seq( seq ), timestamp_us( timestamp_us ) {}
+
+	static constexpr size_t successSize()
+	{
+		return sizeof(code) + sizeof(value) + sizeof(seq) + sizeof(timestamp_us);
+	}
+
+	size_t size() const
+	{
+		return code == ResponseCode::Success ? successSize() : sizeof(code);
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const SampleResponse & r )
+	{
+		stream.writeBigEndian( r.code );
+		if (r.code != ResponseCode::Success)
+			return;
+
+		stream.writeBigEndian( floatToBits( r.value ) );
+		stream.writeBigEndian( r.seq );
+		stream.writeBigEndian( r.timestamp_us );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, SampleResponse & r )
+	{
+		if (!stream.readBigEndian( r.code ) || r.code != ResponseCode::Success)
+			return;
+
+		uint32_t bits = 0;
+		stream.readBigEndian( bits );
+		r.value = bitsToFloat( bits );
+		stream.readBigEndian( r.seq );
+		stream.readBigEndian( r.timestamp_us );
+	}
+};
+
+/// Reads multiple sensors in a single round trip, but returns only those whose sample is newer than ifNewerThan.
+/** With ifNewerThan = 0 all the sensors are returned. Sensors that cannot be read (not found, not monitored)
+  * never get a new sample, so they are returned only then. */
+struct ChangesRequest
+{
+	char magic [4];
+	uint32_t ifNewerThan;
+	std::vector< std::string > sensorIDs;
+
+	ChangesRequest() {}
+	ChangesRequest( const std::vector< std::string > & sensorIDs, uint32_t ifNewerThan = 0 )
+		: magic{'C','H','N','G'}, ifNewerThan( ifNewerThan ), sensorIDs( sensorIDs ) {}
+
+	size_t size() const
+	{
+		size_t size = sizeof(magic) + sizeof(ifNewerThan) + sizeof(uint32_t);
+		for (const std::string & sensorID : sensorIDs)
+			size += sensorID.size() + 1;
+		return size;
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const ChangesRequest & r )
+	{
+		stream << r.magic;
+		stream.writeBigEndian( r.ifNewerThan );
+		stream.writeBigEndian( uint32_t( r.sensorIDs.size() ) );
+		for (const std::string & sensorID : r.sensorIDs)
+			stream.writeString0( sensorID );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, ChangesRequest & r )
+	{
+		stream >> r.magic;
+		if (strncmp( r.magic, "CHNG", 4 ) != 0)
+			return stream.setFailed();
+
+		uint32_t count = 0;
+		if (!stream.readBigEndian( r.ifNewerThan ) || !stream.readBigEndian( count ) || count > maxBatchSize)
+			return stream.setFailed();
+
+		r.sensorIDs.resize( count );
+		for (std::string & sensorID : r.sensorIDs)
+			stream.readString0( sensorID );
+	}
+};
+
+/// Longest time a WaitRequest can be parked on the server.
+constexpr uint32_t maxWaitTimeout_ms = 60000;
+
+/// Like ChangesRequest, but if there is no newer sample yet, the server holds the request
+/// until the next sampling cycle completes or until the timeout expires.
+/** With ifNewerThan = 0 the server waits for the cycle that follows the last completed one.
+  * The response is ChangesResponse, NotModified if the timeout has expired. */
+struct WaitRequest
+{
+	char magic [4];
+	uint32_t ifNewerThan;
+	uint32_t timeout_ms;
+	std::vector< std::string > sensorIDs;
+
+	WaitRequest() {}
+	WaitRequest( const std::vector< std::string > & sensorIDs, uint32_t ifNewerThan, uint32_t timeout_ms )
+		: magic{'W','A','I','T'}, ifNewerThan( ifNewerThan ), timeout_ms( timeout_ms ), sensorIDs( sensorIDs ) {}
+
+	size_t size() const
+	{
+		size_t size = sizeof(magic) + sizeof(ifNewerThan) + sizeof(timeout_ms) + sizeof(uint32_t);
+		for (const std::string & sensorID : sensorIDs)
+			size += sensorID.size() + 1;
+		return size;
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const WaitRequest & r )
+	{
+		stream << r.magic;
+		stream.writeBigEndian( r.ifNewerThan );
+		stream.writeBigEndian( r.timeout_ms );
+		stream.writeBigEndian( uint32_t( r.sensorIDs.size() ) );
+		for (const std::string & sensorID : r.sensorIDs)
+			stream.writeString0( sensorID );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, WaitRequest & r )
+	{
+		stream >> r.magic;
+		if (strncmp( r.magic, "WAIT", 4 ) != 0)
+			return stream.setFailed();
+
+		uint32_t count = 0;
+		if (!stream.readBigEndian( r.ifNewerThan ) || !stream.readBigEndian( r.timeout_ms ) || !stream.readBigEndian( count ) || count > maxBatchSize)
+			return stream.setFailed();
+
+		r.sensorIDs.resize( count );
+		for (std::string & sensorID : r.sensorIDs)
+			stream.readString0( sensorID );
+	}
+};
+
+/// Response to ChangesRequest and WaitRequest. The changed sensors are stored column-wise, like in BatchResponse.
+/** The code is either Success, NotModified when none of the sensors has changed, or InvalidRequest.
+  * seq is the number of the last completed sampling cycle, the client should send it as ifNewerThan next time. */
+struct ChangesResponse
+{
+	ResponseCode code;
+	uint32_t seq;
+	std::vector< uint32_t > indexes;          ///< positions of the changed sensors in the request
+	std::vector< ResponseCode > codes;
+	std::vector< float > values;
+	std::vector< uint32_t > seqs;
+	std::vector< uint64_t > timestamps_us;
+
+	ChangesResponse() {}
+	ChangesResponse( ResponseCode code ) : code( code ), seq( 0 ) {}
+
+	size_t size() const
+	{
+		size_t size = sizeof(code);
+		if (code == ResponseCode::Success)
+			size += 2 * sizeof(uint32_t) + indexes.size() * (
+				sizeof(uint32_t) + sizeof(ResponseCode) + sizeof(float) + sizeof(uint32_t) + sizeof(uint64_t)
+			);
+		return size;
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const ChangesResponse & r )
+	{
+		stream.writeBigEndian( r.code );
+		if (r.code != ResponseCode::Success)
+			return;
+
+		stream.writeBigEndian( r.seq );
+		stream.writeBigEndian( uint32_t( r.indexes.size() ) );
+		for (uint32_t index : r.indexes)
+			stream.writeBigEndian( index );
+		for (ResponseCode code : r.codes)
+			stream.writeBigEndian( code );
+		for (float value : r.values)
+			stream.writeBigEndian( floatToBits( value ) );
+		for (uint32_t seq : r.seqs)
+			stream.writeBigEndian( seq );
+		for (uint64_t timestamp : r.timestamps_us)
+			stream.writeBigEndian( timestamp );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, ChangesResponse & r )
+	{
+		if (!stream.readBigEndian( r.code ) || r.code != ResponseCode::Success)
+			return;
+
+		uint32_t count = 0;
+		if (!stream.readBigEndian( r.seq ) || !stream.readBigEndian( count ) || count > maxBatchSize)
+			return stream.setFailed();
+
+		r.indexes.resize( count );
+		for (uint32_t & index : r.indexes)
+			stream.readBigEndian( index );
+		r.codes.resize( count );
+		for (ResponseCode & code : r.codes)
+			stream.readBigEndian( code );
+		r.values.resize( count );
+		for (float & value : r.values)
+		{
+			uint32_t bits = 0;
+			stream.readBigEndian( bits );
+			value = bitsToFloat( bits );
+		}
+		r.seqs.resize( count );
+		for (uint32_t & seq : r.seqs)
+			stream.readBigEndian( seq );
+		r.timestamps_us.resize( count );
+		for (uint64_t & timestamp : r.timestamps_us)
+			stream.readBigEndian( timestamp );
+	}
+};
+
+/// If the hardware doesn't deliver an on-demand reading in this time, the server answers a FreshRequest with the last sample.
+constexpr uint32_t maxFreshReadTime_ms = 1000;
+
+/// Reads a sensor like SampleRequest, but if the last sample is older than maxAge_ms, the server reads the sensor again.
+/** The response is SampleResponse and comes after the new reading. The server limits how often a sensor can be read
+  * this way, when the limit is hit, the last sample is returned regardless of its age, so always check the timestamp.
+  * A sample read on demand keeps the cycle number of the last completed cycle. */
+struct FreshRequest
+{
+	char magic [4];
+	uint32_t maxAge_ms;
+	std::string sensorID;
+
+	FreshRequest() {}
+	FreshRequest( const std::string & sensorID, uint32_t maxAge_ms )
+		: magic{'F','R','S','H'}, maxAge_ms( maxAge_ms ), sensorID( sensorID ) {}
+
+	size_t size() const
+	{
+		return sizeof(magic) + sizeof(maxAge_ms) + sensorID.size() + 1;
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const FreshRequest & r )
+	{
+		stream << r.magic;
+		stream.writeBigEndian( r.maxAge_ms );
+		stream.writeString0( r.sensorID );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, FreshRequest & r )
+	{
+		stream >> r.magic;
+		if (strncmp( r.magic, "FRSH", 4 ) != 0)
+			return stream.setFailed();
+
+		stream.readBigEndian( r.maxAge_ms );
+		stream.readString0( r.sensorID );
+	}
+
+	static size_t size( std::string_view sensorID )
+	{
+		return sizeof(magic) + sizeof(maxAge_ms) + sensorID.size() + 1;
+	}
+
+	/// Writes the same bytes as operator<<, but without copying the sensor ID into a FreshRequest first.
+	/** The buffer must have at least size( sensorID ) bytes. */
+	static void encode( std::string_view sensorID, uint32_t maxAge_ms, uint8_t * buffer )
+	{
+		memcpy( buffer, "FRSH", sizeof(magic) );
+		for (size_t i = 0; i < sizeof(maxAge_ms); ++i)
+			buffer[ sizeof(magic) + i ] = uint8_t( maxAge_ms >> (8 * (sizeof(maxAge_ms) - 1 - i)) );
+		memcpy( buffer + sizeof(magic) + sizeof(maxAge_ms), sensorID.data(), sensorID.size() );
+		buffer[ sizeof(magic) + sizeof(maxAge_ms) + sensorID.size() ] = '\0';
+	}
+};
+
+/// Most sensors a ListResponse can contain, the rest can be listed page by page.
+constexpr uint32_t maxListCount = 1024;
+
+/// Lists the known sensors whose IDs start with a prefix, ordered by their IDs.
+/** To get the next page, send the ID of the last sensor of the previous page as startAfter.
+  * maxCount 0 or above maxListCount means maxListCount. */
+struct ListRequest
+{
+	char magic [4];
+	uint32_t maxCount;
+	std::string prefix;
+	std::string startAfter;
+
+	ListRequest() {}
+	ListRequest( const std::string & prefix, const std::string & startAfter = {}, uint32_t maxCount = maxListCount )
+		: magic{'L','I','S','T'}, maxCount( maxCount ), prefix( prefix ), startAfter( startAfter ) {}
+
+	size_t size() const
+	{
+		return sizeof(magic) + sizeof(maxCount) + prefix.size() + 1 + startAfter.size() + 1;
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const ListRequest & r )
+	{
+		stream << r.magic;
+		stream.writeBigEndian( r.maxCount );
+		stream.writeString0( r.prefix );
+		stream.writeString0( r.startAfter );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, ListRequest & r )
+	{
+		stream >> r.magic;
+		if (strncmp( r.magic, "LIST", 4 ) != 0)
+			return stream.setFailed();
+
+		stream.readBigEndian( r.maxCount );
+		stream.readString0( r.prefix );
+		stream.readString0( r.startAfter );
+	}
+};
+
+/// Response to ListRequest. The sensors are stored column-wise: all the IDs, all the names, all the categories
+/// and all the states. The state is Success for monitored sensors, SensorNotMonitored for the available ones
+/// that are not monitored and SensorNotFound for the requested ones that the hardware doesn't have.
+/** payloadSize is the number of bytes that follow it, so that the client knows how much to receive. */
+struct ListResponse
+{
+	ResponseCode code;
+	uint32_t hasMore;   ///< 1 if there are more sensors with the prefix after the last one
+	std::vector< std::string > ids;
+	std::vector< std::string > names;
+	std::vector< std::string > categories;
+	std::vector< ResponseCode > states;
+
+	ListResponse() {}
+	ListResponse( ResponseCode code ) : code( code ), hasMore( 0 ) {}
+
+	static constexpr size_t headerSize()
+	{
+		return sizeof(code) + 3 * sizeof(uint32_t);
+	}
+
+	size_t payloadSize() const
+	{
+		size_t size = states.size() * sizeof(ResponseCode);
+		for (size_t i = 0; i < ids.size(); ++i)
+			size += ids[i].size() + 1 + names[i].size() + 1 + categories[i].size() + 1;
+		return size;
+	}
+
+	size_t size() const
+	{
+		return code == ResponseCode::Success ? headerSize() + payloadSize() : sizeof(code);
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const ListResponse & r )
+	{
+		stream.writeBigEndian( r.code );
+		if (r.code != ResponseCode::Success)
+			return;
+
+		stream.writeBigEndian( uint32_t( r.ids.size() ) );
+		stream.writeBigEndian( r.hasMore );
+		stream.writeBigEndian( uint32_t( r.payloadSize() ) );
+		for (const std::string & id : r.ids)
+			stream.writeString0( id );
+		for (const std::string & name : r.names)
+			stream.writeString0( name );
+		for (const std::string & category : r.categories)
+			stream.writeString0( category );
+		for (ResponseCode state : r.states)
+			stream.writeBigEndian( state );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, ListResponse & r )
+	{
+		if (!stream.readBigEndian( r.code ) || r.code != ResponseCode::Success)
+			return;
+
+		uint32_t count = 0, payloadSize = 0;
+		if (!stream.readBigEndian( count ) || count > maxListCount || !stream.readBigEndian( r.hasMore ) || !stream.readBigEndian( payloadSize ))
+			return stream.setFailed();
+
+		r.ids.resize( count );
+		for (std::string & id : r.ids)
+			stream.readString0( id );
+		r.names.resize( count );
+		for (std::string & name : r.names)
+			stream.readString0( name );
+		r.categories.resize( count );
+		for (std::string & category : r.categories)
+			stream.readString0( category );
+		r.states.resize( count );
+		for (ResponseCode & state : r.states)
+			stream.readBigEndian( state );
+	}
+};
+
+/// Most events an AlertsResponse can contain, the server also remembers only this many of the last events.
+constexpr uint32_t maxAlertEvents = 1024;
+
+enum class AlertState : uint32_t
+{
+	Cleared = 0,   ///< the value has returned below the threshold minus the hysteresis (or above, for "<" rules)
+	Raised = 1,    ///< the value has exceeded the threshold for the required time
+};
+
+/// Waits for alert events, the changes of the state of the alert rules configured on the server.
+/** Returns the events numbered after afterEvent, if there are none yet, the server holds the request until one happens
+  * or until the timeout (at most maxWaitTimeout_ms) expires, then the response code is NotModified.
+  * With afterEvent = 0, or when the events after afterEvent are no longer remembered, the response is a snapshot
+  * of the alerts that are currently raised instead. Send lastEvent of the response as afterEvent next time. */
+struct AlertsRequest
+{
+	char magic [4];
+	uint32_t afterEvent;
+	uint32_t timeout_ms;
+
+	AlertsRequest() {}
+	AlertsRequest( uint32_t afterEvent, uint32_t timeout_ms )
+		: magic{'A','L','R','T'}, afterEvent( afterEvent ), timeout_ms( timeout_ms ) {}
+
+	static constexpr size_t size()
+	{
+		return sizeof(magic) + sizeof(afterEvent) + sizeof(timeout_ms);
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const AlertsRequest & r )
+	{
+		stream << r.magic;
+		stream.writeBigEndian( r.afterEvent );
+		stream.writeBigEndian( r.timeout_ms );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, AlertsRequest & r )
+	{
+		stream >> r.magic;
+		if (strncmp( r.magic, "ALRT", 4 ) != 0)
+			return stream.setFailed();
+
+		stream.readBigEndian( r.afterEvent );
+		stream.readBigEndian( r.timeout_ms );
+	}
+};
+
+/// Response to AlertsRequest. The events are stored column-wise, like in ListResponse, the sensor IDs go last.
+/** rules are the positions of the rules in the alert_rules option, values are the samples that have changed the state.
+  * payloadSize is the number of bytes that follow it, so that the client knows how much to receive. */
+struct AlertsResponse
+{
+	ResponseCode code;
+	uint32_t lastEvent;    ///< number of the last event that has happened, pass it as afterEvent next time
+	uint32_t isSnapshot;   ///< 1 if these are the currently raised alerts instead of the events after afterEvent
+	std::vector< uint32_t > numbers;
+	std::vector< uint32_t > rules;
+	std::vector< AlertState > states;
+	std::vector< float > values;
+	std::vector< uint64_t > timestamps_us;
+	std::vector< std::string > sensorIDs;
+
+	AlertsResponse() {}
+	AlertsResponse( ResponseCode code ) : code( code ), lastEvent( 0 ), isSnapshot( 0 ) {}
+
+	static constexpr size_t headerSize()
+	{
+		return sizeof(code) + 4 * sizeof(uint32_t);
+	}
+
+	size_t payloadSize() const
+	{
+		size_t size = numbers.size() * (
+			sizeof(uint32_t) + sizeof(uint32_t) + sizeof(AlertState) + sizeof(float) + sizeof(uint64_t)
+		);
+		for (const std::string & sensorID : sensorIDs)
+			size += sensorID.size() + 1;
+		return size;
+	}
+
+	size_t size() const
+	{
+		return code == ResponseCode::Success ? headerSize() + payloadSize() : sizeof(code);
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const AlertsResponse & r )
+	{
+		stream.writeBigEndian( r.code );
+		if (r.code != ResponseCode::Success)
+			return;
+
+		stream.writeBigEndian( r.lastEvent );
+		stream.writeBigEndian( r.isSnapshot );
+		stream.writeBigEndian( uint32_t( r.numbers.size() ) );
+		stream.writeBigEndian( uint32_t( r.payloadSize() ) );
+		for (uint32_t number : r.numbers)
+			stream.writeBigEndian( number );
+		for (uint32_t rule : r.rules)
+			stream.writeBigEndian( rule );
+		for (AlertState state : r.states)
+			stream.writeBigEndian( state );
+		for (float value : r.values)
+			stream.writeBigEndian( floatToBits( value ) );
+		for (uint64_t timestamp : r.timestamps_us)
+			stream.writeBigEndian( timestamp );
+		for (const std::string & sensorID : r.sensorIDs)
+			stream.writeString0( sensorID );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, AlertsResponse & r )
+	{
+		if (!stream.readBigEndian( r.code ) || r.code != ResponseCode::Success)
+			return;
+
+		uint32_t count = 0, payloadSize = 0;
+		if (!stream.readBigEndian( r.lastEvent ) || !stream.readBigEndian( r.isSnapshot )
+		 || !stream.readBigEndian( count ) || count > maxAlertEvents || !stream.readBigEndian( payloadSize ))
+			return stream.setFailed();
+
+		r.numbers.resize( count );
+		for (uint32_t & number : r.numbers)
+			stream.readBigEndian( number );
+		r.rules.resize( count );
+		for (uint32_t & rule : r.rules)
+			stream.readBigEndian( rule );
+		r.states.resize( count );
+		for (AlertState & state : r.states)
+			stream.readBigEndian( state );
+		r.values.resize( count );
+		for (float & value : r.values)
+		{
+			uint32_t bits = 0;
+			stream.readBigEndian( bits );
+			value = bitsToFloat( bits );
+		}
+		r.timestamps_us.resize( count );
+		for (uint64_t & timestamp : r.timestamps_us)
+			stream.readBigEndian( timestamp );
+		r.sensorIDs.resize( count );
+		for (std::string & sensorID : r.sensorIDs)
+			stream.readString0( sensorID );
+	}
+};
+
+
+/// What value of a sensor a StatisticRequest asks for. The statistics are computed by the service from every reading.
+enum class ValueKind : uint32_t
+{
+	Raw = 0,            ///< the last reading, the same as SampleRequest returns
+	Mean = 1,           ///< exponentially weighted moving average, its span is the option smoothing_samples
+	StdDev = 2,         ///< standard deviation of all the readings since the sensor has been monitored
+	RatePerSecond = 3,  ///< change between the last two readings, per second, can be negative
+	Median = 4,         ///< median of the last median_window readings, filters out single spikes
+};
+
+/// Reads a statistic of a sensor instead of its raw value, otherwise it's the same as SampleRequest.
+/** The response is SampleResponse, its cycle number and timestamp are the ones of the last reading.
+  * The code is Success even for the statistics that are 0 or negative, it depends only on the last reading. */
+struct StatisticRequest
+{
+	char magic [4];
+	ValueKind kind;
+	uint32_t ifNewerThan;
+	std::string sensorID;
+
+	StatisticRequest() {}
+	StatisticRequest( const std::string & sensorID, ValueKind kind, uint32_t ifNewerThan = 0 )
+		: magic{'S','T','A','T'}, kind( kind ), ifNewerThan( ifNewerThan ), sensorID( sensorID ) {}
+
+	size_t size() const
+	{
+		return sizeof(magic) + sizeof(kind) + sizeof(ifNewerThan) + sensorID.size() + 1;
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const StatisticRequest & r )
+	{
+		stream << r.magic;
+		stream.writeBigEndian( r.kind );
+		stream.writeBigEndian( r.ifNewerThan );
+		stream.writeString0( r.sensorID );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, StatisticRequest & r )
+	{
+		stream >> r.magic;
+		if (strncmp( r.magic, "STAT", 4 ) != 0)
+			return stream.setFailed();
+
+		if (!stream.readBigEndian( r.kind ) || uint32_t( r.kind ) > uint32_t( ValueKind::Median ))
+			return stream.setFailed();
+		stream.readBigEndian( r.ifNewerThan );
+		stream.readString0( r.sensorID );
+	}
+};
+
+
+/// Longest range a PercentileRequest can ask for, the service keeps the sketches of the readings only for this long.
+constexpr uint32_t maxPercentileWindow_s = 24 * 60 * 60;
+/// Most percentiles a single PercentileRequest can ask for.
+constexpr uint32_t maxPercentiles = 16;
+
+/// Reads percentiles of all the readings of a sensor over the last window_s seconds.
+/** The percentiles are numbers from 0 to 100, 50 is the median. They are estimated from quantile sketches kept
+  * by the service, so they are within 1 % of the exact percentiles. The window is rounded up to 5 minutes, and to whole
+  * hours at its start when it's longer than 2 hours. The response code is SensorFailed when there is no successful
+  * reading in the window. */
+struct PercentileRequest
+{
+	char magic [4];
+	uint32_t window_s;
+	std::vector< float > percentiles;
+	std::string sensorID;
+
+	PercentileRequest() {}
+	PercentileRequest( const std::string & sensorID, const std::vector< float > & percentiles, uint32_t window_s )
+		: magic{'P','C','T','L'}, window_s( window_s ), percentiles( percentiles ), sensorID( sensorID ) {}
+
+	size_t size() const
+	{
+		return sizeof(magic) + sizeof(window_s) + sizeof(uint32_t) + percentiles.size() * sizeof(float) + sensorID.size() + 1;
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const PercentileRequest & r )
+	{
+		stream << r.magic;
+		stream.writeBigEndian( r.window_s );
+		stream.writeBigEndian( uint32_t( r.percentiles.size() ) );
+		for (float percentile : r.percentiles)
+			stream.writeBigEndian( floatToBits( percentile ) );
+		stream.writeString0( r.sensorID );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, PercentileRequest & r )
+	{
+		stream >> r.magic;
+		if (strncmp( r.magic, "PCTL", 4 ) != 0)
+			return stream.setFailed();
+
+		uint32_t count = 0;
+		if (!stream.readBigEndian( r.window_s ) || r.window_s == 0 || r.window_s > maxPercentileWindow_s
+		 || !stream.readBigEndian( count ) || count == 0 || count > maxPercentiles)
+			return stream.setFailed();
+
+		r.percentiles.resize( count );
+		for (float & percentile : r.percentiles)
+		{
+			uint32_t bits = 0;
+			stream.readBigEndian( bits );
+			percentile = bitsToFloat( bits );
+			if (!(percentile >= 0.0f && percentile <= 100.0f))  // also rejects NaN
+				return stream.setFailed();
+		}
+		stream.readString0( r.sensorID );
+	}
+};
+
+/// Response to PercentileRequest, the values are in the same order as the requested percentiles.
+struct PercentileResponse
+{
+	ResponseCode code;
+	uint32_t sampleCount;   ///< number of the readings in the window the percentiles were computed from
+	std::vector< float > values;
+
+	PercentileResponse() {}
+	PercentileResponse( ResponseCode code ) : code( code ), sampleCount( 0 ) {}
+
+	static constexpr size_t headerSize()
+	{
+		return sizeof(code) + 2 * sizeof(uint32_t);
+	}
+
+	size_t size() const
+	{
+		return code == ResponseCode::Success ? headerSize() + values.size() * sizeof(float) : sizeof(code);
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const PercentileResponse & r )
+	{
+		stream.writeBigEndian( r.code );
+		if (r.code != ResponseCode::Success)
+			return;
+
+		stream.writeBigEndian( r.sampleCount );
+		stream.writeBigEndian( uint32_t( r.values.size() ) );
+		for (float value : r.values)
+			stream.writeBigEndian( floatToBits( value ) );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, PercentileResponse & r )
+	{
+		if (!stream.readBigEndian( r.code ) || r.code != ResponseCode::Success)
+			return;
+
+		uint32_t count = 0;
+		if (!stream.readBigEndian( r.sampleCount ) || !stream.readBigEndian( count ) || count > maxPercentiles)
+			return stream.setFailed();
+
+		r.values.resize( count );
+		for (float & value : r.values)
+		{
+			uint32_t bits = 0;
+			stream.readBigEndian( bits );
+			value = bitsToFloat( bits );
+		}
+	}
+};
+
+
+/// Longest range a HistoryRequest can ask for, the service can't be configured to keep the history for longer.
+constexpr uint32_t maxHistoryWindow_s = 31 * 24 * 60 * 60;
+/// Most points a single HistoryResponse can contain.
+constexpr uint32_t maxHistoryPoints = 1024;
+
+/// Reads the history of a sensor over the last window_s seconds, summarized into pointCount points.
+/** The window is divided into pointCount intervals of the same length, for each of them the response contains
+  * the number of the successful readings, their minimum, maximum and mean. How long the history is kept is configured
+  * by the option history_retention, the intervals before that have no readings. */
+struct HistoryRequest
+{
+	char magic [4];
+	uint32_t window_s;
+	uint32_t pointCount;
+	std::string sensorID;
+
+	HistoryRequest() {}
+	HistoryRequest( const std::string & sensorID, uint32_t window_s, uint32_t pointCount )
+		: magic{'H','I','S','T'}, window_s( window_s ), pointCount( pointCount ), sensorID( sensorID ) {}
+
+	size_t size() const
+	{
+		return sizeof(magic) + sizeof(window_s) + sizeof(pointCount) + sensorID.size() + 1;
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const HistoryRequest & r )
+	{
+		stream << r.magic;
+		stream.writeBigEndian( r.window_s );
+		stream.writeBigEndian( r.pointCount );
+		stream.writeString0( r.sensorID );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, HistoryRequest & r )
+	{
+		stream >> r.magic;
+		if (strncmp( r.magic, "HIST", 4 ) != 0)
+			return stream.setFailed();
+
+		if (!stream.readBigEndian( r.window_s ) || r.window_s == 0 || r.window_s > maxHistoryWindow_s
+		 || !stream.readBigEndian( r.pointCount ) || r.pointCount == 0 || r.pointCount > maxHistoryPoints)
+			return stream.setFailed();
+		stream.readString0( r.sensorID );
+	}
+};
+
+/// Response to HistoryRequest. The points are stored column-wise, the oldest interval goes first.
+/** The window ends at endTimestamp_us, a time of the service's monotonic clock, like the timestamps of the samples.
+  * The intervals without any reading have sampleCount 0 and the values 0. */
+struct HistoryResponse
+{
+	ResponseCode code;
+	uint64_t endTimestamp_us;
+	std::vector< uint32_t > sampleCounts;
+	std::vector< float > mins;
+	std::vector< float > maxs;
+	std::vector< float > means;
+
+	HistoryResponse() {}
+	HistoryResponse( ResponseCode code ) : code( code ), endTimestamp_us( 0 ) {}
+
+	static constexpr size_t headerSize()
+	{
+		return sizeof(code) + sizeof(endTimestamp_us) + sizeof(uint32_t);
+	}
+
+	static constexpr size_t pointSize()
+	{
+		return sizeof(uint32_t) + 3 * sizeof(float);
+	}
+
+	size_t size() const
+	{
+		return code == ResponseCode::Success ? headerSize() + sampleCounts.size() * pointSize() : sizeof(code);
+	}
+
+	friend void operator<<( own::BinaryOutputStream & stream, const HistoryResponse & r )
+	{
+		stream.writeBigEndian( r.code );
+		if (r.code != ResponseCode::Success)
+			return;
+
+		stream.writeBigEndian( r.endTimestamp_us );
+		stream.writeBigEndian( uint32_t( r.sampleCounts.size() ) );
+		for (uint32_t sampleCount : r.sampleCounts)
+			stream.writeBigEndian( sampleCount );
+		for (float min : r.mins)
+			stream.writeBigEndian( floatToBits( min ) );
+		for (float max : r.maxs)
+			stream.writeBigEndian( floatToBits( max ) );
+		for (float mean : r.means)
+			stream.writeBigEndian( floatToBits( mean ) );
+	}
+
+	friend void operator>>( own::BinaryInputStream & stream, HistoryResponse & r )
+	{
+		if (!stream.readBigEndian( r.code ) || r.code != ResponseCode::Success)
+			return;
+
+		uint32_t count = 0;
+		if (!stream.readBigEndian( r.endTimestamp_us ) || !stream.readBigEndian( count ) || count > maxHistoryPoints)
+			return stream.setFailed();
+
+		r.sampleCounts.resize( count );
+		for (uint32_t & sampleCount : r.sampleCounts)
+			stream.readBigEndian( sampleCount );
+		for (std::vector< float > * column : { &r.mins, &r.maxs, &r.means })
+		{
+			column->resize( count );
+			for (float & value : *column)
+			{
+				uint32_t bits = 0;
+				stream.readBigEndian( bits );
+				value = bitsToFloat( bits );
+			}
+		}
+	}
+};
+
+
 #endif // PROTOCOL_INCLUDED
@@ -0,0 +1,192 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: mergeable quantile sketches of the sensor readings over time windows
+//======================================================================================================================
+
+#include "QuantileSketch.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+using std::vector;
+
+
+//======================================================================================================================
+//  QuantileSketch
+
+static const double bucketGrowth = (1.0 + QuantileSketch::relativeAccuracy) / (1.0 - QuantileSketch::relativeAccuracy);
+static const double logBucketGrowth = std::log( bucketGrowth );
+
+int32_t QuantileSketch::bucketOf( float value )
+{
+	// bucket i holds the values in ( growth^(i-1), growth^i ]
+	return int32_t( std::ceil( std::log( double( value ) ) / logBucketGrowth ) );
+}
+
+float QuantileSketch::valueOf( int32_t bucket )
+{
+	// the point of the bucket with the same relative distance from both of its bounds
+	return float( 2.0 * std::pow( bucketGrowth, bucket ) / (bucketGrowth + 1.0) );
+}
+
+int32_t QuantileSketch::reserveBucket( int32_t bucket )
+{
+	if (_counts.empty())
+	{
+		_firstBucket = bucket;
+		_counts.assign( 1, 0 );
+		return bucket;
+	}
+
+	const int32_t lastBucket = _firstBucket + int32_t( _counts.size() ) - 1;
+	if (bucket >= _firstBucket && bucket <= lastBucket)
+	{
+		return bucket;
+	}
+
+	const int32_t newLast = std::max( lastBucket, bucket );
+	const int32_t newFirst = std::max( std::min( _firstBucket, bucket ), newLast - int32_t( maxBuckets ) + 1 );
+
+	if (newFirst == _firstBucket)
+	{
+		_counts.resize( size_t( newLast - newFirst + 1 ), 0 );  // growing upwards, the common case, amortized
+	}
+	else
+	{
+		vector< uint32_t > counts( size_t( newLast - newFirst + 1 ), 0 );
+		for (size_t i = 0; i < _counts.size(); ++i)
+			counts[ size_t( std::max( _firstBucket + int32_t(i), newFirst ) - newFirst ) ] += _counts[i];  // collapse the lowest
+		_counts.swap( counts );
+		_firstBucket = newFirst;
+	}
+
+	return std::max( bucket, newFirst );
+}
+
+void QuantileSketch::add( float value )
+{
+	if (!(value > 0.0f) || std::isinf( value ))  // also false for NaN
+	{
+		return;  // the logarithm would be infinite or NaN, and its conversion to the bucket number undefined
+	}
+
+	const int32_t bucket = reserveBucket( bucketOf( value ) );
+	_counts[ size_t( bucket - _firstBucket ) ] += 1;
+	_count += 1;
+}
+
+void QuantileSketch::merge( const QuantileSketch & other )
+{
+	if (other._counts.empty())
+	{
+		return;
+	}
+
+	// extend the range only once for all the buckets
+	reserveBucket( other._firstBucket );
+	reserveBucket( other._firstBucket + int32_t( other._counts.size() ) - 1 );
+
+	for (size_t i = 0; i < other._counts.size(); ++i)
+	{
+		const int32_t bucket = std::max( other._firstBucket + int32_t(i), _firstBucket );
+		_counts[ size_t( bucket - _firstBucket ) ] += other._counts[i];
+	}
+	_count += other._count;
+}
+
+void QuantileSketch::clear()
+{
+	_counts.clear();
+	_firstBucket = 0;
+	_count = 0;
+}
+
+float QuantileSketch::quantile( double q ) const
+{
+	if (_count == 0)
+	{
+		return std::numeric_limits< float >::quiet_NaN();
+	}
+
+	// the same value as sorted[ floor( q * (count - 1) ) ] would be
+	const double rank = std::clamp( q, 0.0, 1.0 ) * double( _count - 1 );
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i < _counts.size(); ++i)
+	{
+		cumulative += _counts[i];
+		if (double( cumulative ) > rank)
+			return valueOf( _firstBucket + int32_t(i) );
+	}
+	return valueOf( _firstBucket + int32_t( _counts.size() ) - 1 );
+}
+
+
+//======================================================================================================================
+//  PercentileHistory
+
+void PercentileHistory::add( float value, uint64_t timestamp_us )
+{
+	std::unique_lock< std::mutex > lock( _mtx );
+
+	const uint64_t fine = timestamp_us / fineWindow_us;
+	if (_lastFine != UINT64_MAX && fine / finePerCoarse != _lastFine / finePerCoarse)
+	{
+		rollUp( _lastFine / finePerCoarse );  // an hour has ended
+	}
+
+	Window & window = _fine[ fine % fineWindowCount ];
+	if (window.number != fine)
+	{
+		window.number = fine;  // reuse the window that has fallen out of the range
+		window.sketch.clear();
+	}
+	window.sketch.add( value );
+
+	_lastFine = fine;
+}
+
+void PercentileHistory::rollUp( uint64_t hour )
+{
+	Window & coarse = _coarse[ hour % coarseWindowCount ];
+	coarse.number = hour;
+	coarse.sketch.clear();
+	for (const Window & fine : _fine)
+	{
+		if (fine.number != UINT64_MAX && fine.number / finePerCoarse == hour)
+			coarse.sketch.merge( fine.sketch );
+	}
+}
+
+void PercentileHistory::collect( uint32_t window_s, uint64_t now_us, QuantileSketch & result ) const
+{
+	std::unique_lock< std::mutex > lock( _mtx );
+
+	const uint64_t nowFine = now_us / fineWindow_us;
+	const uint64_t currentHour = nowFine / finePerCoarse;
+	const uint64_t windowCount = std::max( (uint64_t( window_s ) * 1000000 + fineWindow_us - 1) / fineWindow_us, uint64_t( 1 ) );
+	const uint64_t firstFine = nowFine + 1 >= windowCount ? nowFine + 1 - windowCount : 0;
+
+	for (uint64_t fine = firstFine; fine <= nowFine; )
+	{
+		const uint64_t hour = fine / finePerCoarse;
+		const Window & fineWindow = _fine[ fine % fineWindowCount ];
+		const Window & coarseWindow = _coarse[ hour % coarseWindowCount ];
+
+		// Prefer the rollup for the whole hours in the range, and for the start of the range when the 5-minute windows
+		// of that hour are gone. The current hour hasn't been rolled up yet, and neither the last one, if no reading
+		// has come since it ended.
+		const bool wholeHour = fine % finePerCoarse == 0 && (hour + 1) * finePerCoarse - 1 <= nowFine;
+		if (hour != currentHour && coarseWindow.number == hour && (wholeHour || fineWindow.number != fine))
+		{
+			result.merge( coarseWindow.sketch );
+			fine = (hour + 1) * finePerCoarse;
+			continue;
+		}
+
+		if (fineWindow.number == fine)
+			result.merge( fineWindow.sketch );
+		++fine;
+	}
+}
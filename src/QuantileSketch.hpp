@@ -0,0 +1,95 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: mergeable quantile sketches of the sensor readings over time windows
+//======================================================================================================================
+
+#ifndef QUANTILE_SKETCH_INCLUDED
+#define QUANTILE_SKETCH_INCLUDED
+
+
+#include <cstdint>
+#include <vector>
+#include <mutex>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Approximate distribution of positive values, from which any quantile can be estimated within a relative error.
+/** The values are counted in buckets whose bounds grow geometrically (the DDSketch algorithm), so a quantile
+  * is off by at most relativeAccuracy of its value, no matter how the values are distributed. Two sketches are merged
+  * by adding up their buckets, which gives exactly the sketch of all the values of both.
+  * The memory is bounded by maxBuckets, when the values span more, the lowest buckets are merged together,
+  * which makes only the lowest quantiles less accurate. */
+class QuantileSketch
+{
+ public:
+
+	static constexpr double relativeAccuracy = 0.01;
+	static constexpr size_t maxBuckets = 1024;
+
+	/// Values that are not positive or not finite are ignored, the buckets are made of their logarithms.
+	void add( float value );
+
+	void merge( const QuantileSketch & other );
+
+	void clear();
+
+	uint64_t count() const { return _count; }
+
+	/// Estimates the value below which the fraction q of the values lies, q is between 0 and 1. NaN if it's empty.
+	float quantile( double q ) const;
+
+ private:
+
+	static int32_t bucketOf( float value );
+	static float valueOf( int32_t bucket );
+
+	/// Extends the range of the buckets to include this one, returns where its values should be counted.
+	int32_t reserveBucket( int32_t bucket );
+
+	std::vector< uint32_t > _counts;  ///< _counts[i] is the number of values in bucket _firstBucket + i
+	int32_t _firstBucket = 0;
+	uint64_t _count = 0;
+
+};
+
+/// Quantile sketches of the readings of one sensor over the last 24 hours.
+/** The readings are added to 5-minute windows, which are rolled up into hourly ones when an hour ends.
+  * A range is answered by merging the windows that cover it, the hourly ones wherever a whole hour is inside the range,
+  * so the ranges are rounded up to 5 minutes, and to whole hours at the start of the ranges longer than 2 hours.
+  * Thread-safe, the sampling thread adds the readings while the server thread collects them. */
+class PercentileHistory
+{
+ public:
+
+	static constexpr uint64_t fineWindow_us = 5ull * 60 * 1000000;
+	static constexpr uint32_t finePerCoarse = 12;
+	static constexpr uint32_t fineWindowCount = 2 * finePerCoarse;  ///< the current hour and the whole previous one
+	static constexpr uint32_t coarseWindowCount = 24;
+
+	void add( float value, uint64_t timestamp_us );
+
+	/// Merges the windows covering the last window_s seconds before now_us into the result.
+	void collect( uint32_t window_s, uint64_t now_us, QuantileSketch & result ) const;
+
+ private:
+
+	struct Window
+	{
+		uint64_t number = UINT64_MAX;  ///< timestamp divided by the length of the window, identifies which one it is now
+		QuantileSketch sketch;
+	};
+
+	void rollUp( uint64_t hour );
+
+	mutable std::mutex _mtx;
+	Window _fine [fineWindowCount];
+	Window _coarse [coarseWindowCount];
+	uint64_t _lastFine = UINT64_MAX;
+
+};
+
+
+#endif // QUANTILE_SKETCH_INCLUDED
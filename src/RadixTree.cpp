@@ -0,0 +1,152 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: compressed prefix tree of strings, for listing the sensors by a prefix of their IDs
+//======================================================================================================================
+
+#include "RadixTree.hpp"
+
+#include <algorithm>
+using std::string;
+using std::string_view;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+RadixTree::RadixTree() : _size( 0 )
+{
+	_nodes.emplace_back();
+}
+
+static size_t commonPrefixLength( string_view a, string_view b )
+{
+	size_t length = std::min( a.size(), b.size() );
+	size_t i = 0;
+	while (i < length && a[i] == b[i])
+		++i;
+	return i;
+}
+
+uint32_t RadixTree::findChild( const Node & node, char firstChar ) const
+{
+	auto iter = std::lower_bound( node.children.begin(), node.children.end(), firstChar, [this]( uint32_t childIdx, char c )
+	{
+		return (unsigned char)_nodes[ childIdx ].label[0] < (unsigned char)c;
+	});
+	if (iter != node.children.end() && _nodes[ *iter ].label[0] == firstChar)
+		return *iter;
+	return noValue;
+}
+
+void RadixTree::insert( string_view key, uint32_t value )
+{
+	uint32_t nodeIdx = 0;
+	while (true)
+	{
+		if (key.empty())
+		{
+			if (_nodes[ nodeIdx ].value == noValue)
+				++_size;
+			_nodes[ nodeIdx ].value = value;
+			return;
+		}
+
+		uint32_t childIdx = findChild( _nodes[ nodeIdx ], key[0] );
+		if (childIdx == noValue)
+		{
+			// no child shares even the first char, add the whole rest as a new leaf
+			uint32_t newIdx = uint32_t( _nodes.size() );
+			_nodes.emplace_back();
+			_nodes[ newIdx ].label.assign( key.data(), key.size() );
+			_nodes[ newIdx ].value = value;
+			++_size;
+
+			auto & children = _nodes[ nodeIdx ].children;
+			auto pos = std::lower_bound( children.begin(), children.end(), key[0], [this]( uint32_t idx, char c )
+			{
+				return (unsigned char)_nodes[ idx ].label[0] < (unsigned char)c;
+			});
+			children.insert( pos, newIdx );
+			return;
+		}
+
+		const string & label = _nodes[ childIdx ].label;
+		size_t common = commonPrefixLength( label, key );
+		if (common < label.size())
+		{
+			// split the child: the common part stays, the rest of its label moves to a new node below it
+			uint32_t splitIdx = uint32_t( _nodes.size() );
+			_nodes.emplace_back();
+			Node & child = _nodes[ childIdx ];
+			Node & split = _nodes[ splitIdx ];
+			split.label = child.label.substr( common );
+			split.children = std::move( child.children );
+			split.value = child.value;
+			child.label.resize( common );
+			child.children = { splitIdx };
+			child.value = noValue;
+		}
+
+		nodeIdx = childIdx;
+		key.remove_prefix( common );
+	}
+}
+
+uint32_t RadixTree::find( string_view key ) const
+{
+	uint32_t nodeIdx = 0;
+	while (!key.empty())
+	{
+		uint32_t childIdx = findChild( _nodes[ nodeIdx ], key[0] );
+		if (childIdx == noValue)
+			return noValue;
+
+		const string & label = _nodes[ childIdx ].label;
+		if (key.size() < label.size() || key.compare( 0, label.size(), label ) != 0)
+			return noValue;
+
+		nodeIdx = childIdx;
+		key.remove_prefix( label.size() );
+	}
+	return _nodes[ nodeIdx ].value;
+}
+
+uint32_t RadixTree::findPrefixNode( string_view prefix, string & key ) const
+{
+	uint32_t nodeIdx = 0;
+	while (!prefix.empty())
+	{
+		uint32_t childIdx = findChild( _nodes[ nodeIdx ], prefix[0] );
+		if (childIdx == noValue)
+			return noValue;
+
+		// the prefix may end in the middle of the label, then all the keys below this child have it
+		const string & label = _nodes[ childIdx ].label;
+		size_t compared = std::min( label.size(), prefix.size() );
+		if (label.compare( 0, compared, prefix.data(), compared ) != 0)
+			return noValue;
+
+		key += label;
+		nodeIdx = childIdx;
+		prefix.remove_prefix( compared );
+	}
+	return nodeIdx;
+}
+
+RadixTree::Bound RadixTree::compareToBound( string_view path, string_view startAfter )
+{
+	if (startAfter.empty())
+		return Bound::Above;
+
+	size_t compared = std::min( path.size(), startAfter.size() );
+	int cmp = path.substr( 0, compared ).compare( startAfter.substr( 0, compared ) );
+	if (cmp < 0)
+		return Bound::Below;
+	else if (cmp > 0)
+		return Bound::Above;
+	else if (path.size() > startAfter.size())
+		return Bound::Above;  // startAfter is a prefix of every key here, so they are all greater
+	else
+		return Bound::Within;
+}
@@ -0,0 +1,116 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: compressed prefix tree of strings, for listing the sensors by a prefix of their IDs
+//======================================================================================================================
+
+#ifndef RADIX_TREE_INCLUDED
+#define RADIX_TREE_INCLUDED
+
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Maps strings to numbers and visits them in lexicographic order, starting at any key.
+/** Every node holds a part of the key, so the common prefixes like "/amdcpu/0/" are stored and compared only once.
+  * The tree is built once and then only read, the nodes live in a single vector. */
+class RadixTree
+{
+ public:
+
+	static constexpr uint32_t noValue = UINT32_MAX;
+
+	RadixTree();
+
+	/// Adds the key or overwrites its value.
+	void insert( std::string_view key, uint32_t value );
+
+	/// Returns the value of the key or noValue.
+	uint32_t find( std::string_view key ) const;
+
+	/// Calls visitor( key, value ) for the keys that start with the prefix and are greater than startAfter,
+	/// in lexicographic order, until the visitor returns false.
+	/** With an empty startAfter it starts from the first key with the prefix. Skipping the keys before startAfter
+	  * costs only the length of startAfter, so the keys can be listed page by page. */
+	template< typename Visitor >
+	void forEachWithPrefix( std::string_view prefix, std::string_view startAfter, Visitor && visitor ) const
+	{
+		std::string key;
+		uint32_t nodeIdx = findPrefixNode( prefix, key );
+		if (nodeIdx == noValue)
+			return;
+
+		Bound bound = compareToBound( key, startAfter );
+		if (bound == Bound::Below)
+			return;
+
+		visit( nodeIdx, key, bound == Bound::Within ? startAfter : std::string_view(), bound == Bound::Within, visitor );
+	}
+
+	size_t size() const { return _size; }
+
+ private:
+
+	struct Node
+	{
+		std::string label;               ///< part of the key between the parent and this node
+		std::vector< uint32_t > children; ///< indexes of child nodes, ordered by the first char of their labels
+		uint32_t value = noValue;
+	};
+
+	/// How the keys in a subtree relate to the startAfter bound.
+	enum class Bound
+	{
+		Below,   ///< all the keys are less or equal, skip the whole subtree
+		Within,  ///< the path is a prefix of the bound, some keys may be less and some greater
+		Above,   ///< all the keys are greater
+	};
+
+	static Bound compareToBound( std::string_view path, std::string_view startAfter );
+
+	/// Finds the node under which all the keys with the prefix are, and its full key, which may be longer than the prefix.
+	uint32_t findPrefixNode( std::string_view prefix, std::string & key ) const;
+
+	uint32_t findChild( const Node & node, char firstChar ) const;
+
+	template< typename Visitor >
+	bool visit( uint32_t nodeIdx, std::string & key, std::string_view startAfter, bool bounded, Visitor & visitor ) const
+	{
+		const Node & node = _nodes[ nodeIdx ];
+
+		// a key that is a prefix of startAfter is not greater than it
+		if (node.value != noValue && !bounded)
+			if (!visitor( std::string_view( key ), node.value ))
+				return false;
+
+		for (uint32_t childIdx : node.children)
+		{
+			const size_t keyLength = key.size();
+			key += _nodes[ childIdx ].label;
+
+			bool keepGoing = true;
+			Bound bound = bounded ? compareToBound( key, startAfter ) : Bound::Above;
+			if (bound != Bound::Below)
+				keepGoing = visit( childIdx, key, startAfter, bound == Bound::Within, visitor );
+
+			key.resize( keyLength );
+			if (!keepGoing)
+				return false;
+		}
+
+		return true;
+	}
+
+	std::vector< Node > _nodes;  ///< [0] is the root with an empty label
+	size_t _size;
+
+};
+
+
+#endif // RADIX_TREE_INCLUDED
@@ -0,0 +1,104 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: encoding of the responses with many values, whose columns are converted to big endian in bulk
+//======================================================================================================================
+
+#include "ResponseEncoding.hpp"
+
+#include "SimdKernels.hpp"
+
+using std::vector;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static_assert( sizeof(ResponseCode) == sizeof(uint32_t) && sizeof(float) == sizeof(uint32_t), "the columns are encoded as 32-bit words" );
+
+/// Appends to a buffer that is allocated up front for the whole response.
+class ColumnWriter
+{
+ public:
+
+	ColumnWriter( vector< uint8_t > & buffer ) : _pos( buffer.data() ) {}
+
+	void write32( uint32_t word )
+	{
+		encodeBigEndian32( &word, 1, _pos );
+		_pos += sizeof(word);
+	}
+
+	void write64( uint64_t word )
+	{
+		encodeBigEndian64( &word, 1, _pos );
+		_pos += sizeof(word);
+	}
+
+	template< typename Word >
+	void writeColumn( const vector< Word > & column )
+	{
+		if constexpr (sizeof(Word) == sizeof(uint64_t))
+			encodeBigEndian64( column.data(), column.size(), _pos );
+		else
+			encodeBigEndian32( column.data(), column.size(), _pos );
+		_pos += column.size() * sizeof(Word);
+	}
+
+ private:
+
+	uint8_t * _pos;
+
+};
+
+vector< uint8_t > encodeResponse( const BatchResponse & response )
+{
+	vector< uint8_t > buffer( response.size() );
+	ColumnWriter writer( buffer );
+
+	writer.write32( uint32_t( response.code ) );
+	if (response.code == ResponseCode::Success)
+	{
+		writer.write32( uint32_t( response.codes.size() ) );
+		writer.writeColumn( response.codes );
+		writer.writeColumn( response.values );
+	}
+	return buffer;
+}
+
+vector< uint8_t > encodeResponse( const ChangesResponse & response )
+{
+	vector< uint8_t > buffer( response.size() );
+	ColumnWriter writer( buffer );
+
+	writer.write32( uint32_t( response.code ) );
+	if (response.code == ResponseCode::Success)
+	{
+		writer.write32( response.seq );
+		writer.write32( uint32_t( response.indexes.size() ) );
+		writer.writeColumn( response.indexes );
+		writer.writeColumn( response.codes );
+		writer.writeColumn( response.values );
+		writer.writeColumn( response.seqs );
+		writer.writeColumn( response.timestamps_us );
+	}
+	return buffer;
+}
+
+vector< uint8_t > encodeResponse( const HistoryResponse & response )
+{
+	vector< uint8_t > buffer( response.size() );
+	ColumnWriter writer( buffer );
+
+	writer.write32( uint32_t( response.code ) );
+	if (response.code == ResponseCode::Success)
+	{
+		writer.write64( response.endTimestamp_us );
+		writer.write32( uint32_t( response.sampleCounts.size() ) );
+		writer.writeColumn( response.sampleCounts );
+		writer.writeColumn( response.mins );
+		writer.writeColumn( response.maxs );
+		writer.writeColumn( response.means );
+	}
+	return buffer;
+}
@@ -0,0 +1,27 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: encoding of the responses with many values, whose columns are converted to big endian in bulk
+//======================================================================================================================
+
+#ifndef RESPONSE_ENCODING_INCLUDED
+#define RESPONSE_ENCODING_INCLUDED
+
+
+#include "Protocol.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+// These produce the same bytes as toByteVector( response ), but instead of converting every value on its own,
+// they convert the whole columns at once with the SIMD kernels, which matters for the responses of hundreds of sensors.
+
+std::vector< uint8_t > encodeResponse( const BatchResponse & response );
+std::vector< uint8_t > encodeResponse( const ChangesResponse & response );
+std::vector< uint8_t > encodeResponse( const HistoryResponse & response );
+
+
+#endif // RESPONSE_ENCODING_INCLUDED
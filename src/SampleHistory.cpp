@@ -0,0 +1,330 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: compressed long-term history of the readings of a sensor
+//======================================================================================================================
+
+#include "SampleHistory.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+
+//======================================================================================================================
+//  encoding
+//
+//  first reading: 64-bit timestamp, 32-bit value
+//  timestamp of the next ones, by the delta of deltas d:
+//    d = 0                 '0'
+//    d in [-64, 63]        '10'   + 7 bits
+//    d in [-256, 255]      '110'  + 9 bits
+//    d in [-2048, 2047]    '1110' + 12 bits
+//    otherwise             '1111' + 64 bits
+//  value of the next ones, by the XOR x with the previous value:
+//    x = 0                                    '0'
+//    the set bits of x fit into the window
+//    of the previous leading and trailing zeros '10' + the bits inside the window
+//    otherwise                                '11' + 5 bits of leading zeros + 5 bits of length - 1 + the bits
+
+static uint32_t floatBits( float value )
+{
+	uint32_t bits;
+	memcpy( &bits, &value, sizeof(bits) );
+	return bits;
+}
+
+static float bitsFloat( uint32_t bits )
+{
+	float value;
+	memcpy( &value, &bits, sizeof(value) );
+	return value;
+}
+
+static unsigned leadingZeros( uint32_t x )
+{
+	unsigned count = 0;
+	for (uint32_t mask = 0x80000000u; mask && !(x & mask); mask >>= 1)
+		++count;
+	return count;
+}
+
+static unsigned trailingZeros( uint32_t x )
+{
+	unsigned count = 0;
+	for (uint32_t mask = 1; mask && !(x & mask); mask <<= 1)
+		++count;
+	return count;
+}
+
+/// Sign-extends the lowest count bits.
+static int64_t signExtend( uint64_t bits, unsigned count )
+{
+	const uint64_t signBit = uint64_t( 1 ) << (count - 1);
+	return int64_t( (bits ^ signBit) - signBit );
+}
+
+void HistoryBlockWriter::writeBits( uint64_t bits, unsigned count )
+{
+	while (count > 0)
+	{
+		if (_bitCount % 8 == 0)
+			_block.bits.push_back( 0 );
+		const unsigned free = 8 - unsigned( _bitCount % 8 );
+		const unsigned n = std::min( free, count );
+		const uint8_t chunk = uint8_t( (bits >> (count - n)) & ((1u << n) - 1) );
+		_block.bits.back() |= uint8_t( chunk << (free - n) );
+		count -= n;
+		_bitCount += n;
+	}
+}
+
+void HistoryBlockWriter::append( uint64_t timestamp_ms, float value )
+{
+	const uint32_t valueBits = floatBits( value );
+
+	if (_block.sampleCount == 0)
+	{
+		writeBits( timestamp_ms, 64 );
+		writeBits( valueBits, 32 );
+		_block.firstTimestamp_ms = timestamp_ms;
+		_block.lastTimestamp_ms = timestamp_ms;
+		_block.sampleCount = 1;
+		_lastDelta = 0;
+		_lastValueBits = valueBits;
+		_lastLeading = 32;  // no window yet, the first non-zero XOR has to write its own
+		_lastTrailing = 0;
+		return;
+	}
+
+	const int64_t delta = int64_t( timestamp_ms - _block.lastTimestamp_ms );
+	const int64_t deltaOfDelta = delta - _lastDelta;
+	if (deltaOfDelta == 0)
+	{
+		writeBits( 0b0, 1 );
+	}
+	else if (deltaOfDelta >= -64 && deltaOfDelta <= 63)
+	{
+		writeBits( 0b10, 2 );
+		writeBits( uint64_t( deltaOfDelta ), 7 );
+	}
+	else if (deltaOfDelta >= -256 && deltaOfDelta <= 255)
+	{
+		writeBits( 0b110, 3 );
+		writeBits( uint64_t( deltaOfDelta ), 9 );
+	}
+	else if (deltaOfDelta >= -2048 && deltaOfDelta <= 2047)
+	{
+		writeBits( 0b1110, 4 );
+		writeBits( uint64_t( deltaOfDelta ), 12 );
+	}
+	else
+	{
+		writeBits( 0b1111, 4 );
+		writeBits( uint64_t( deltaOfDelta ), 64 );
+	}
+
+	const uint32_t xorBits = valueBits ^ _lastValueBits;
+	if (xorBits == 0)
+	{
+		writeBits( 0b0, 1 );
+	}
+	else
+	{
+		const unsigned leading = leadingZeros( xorBits );
+		const unsigned trailing = trailingZeros( xorBits );
+		if (leading >= _lastLeading && trailing >= _lastTrailing)
+		{
+			writeBits( 0b10, 2 );
+			writeBits( xorBits >> _lastTrailing, 32 - _lastLeading - _lastTrailing );
+		}
+		else
+		{
+			const unsigned length = 32 - leading - trailing;
+			writeBits( 0b11, 2 );
+			writeBits( leading, 5 );
+			writeBits( length - 1, 5 );
+			writeBits( xorBits >> trailing, length );
+			_lastLeading = leading;
+			_lastTrailing = trailing;
+		}
+	}
+
+	_block.lastTimestamp_ms = timestamp_ms;
+	_block.sampleCount += 1;
+	_lastDelta = delta;
+	_lastValueBits = valueBits;
+}
+
+HistoryBlock HistoryBlockWriter::seal()
+{
+	HistoryBlock sealed;
+	sealed.firstTimestamp_ms = _block.firstTimestamp_ms;
+	sealed.lastTimestamp_ms = _block.lastTimestamp_ms;
+	sealed.sampleCount = _block.sampleCount;
+	sealed.bits.assign( _block.bits.begin(), _block.bits.end() );  // exact size, the open one has grown with spare capacity
+
+	_block.sampleCount = 0;
+	_block.bits.clear();  // keeps the capacity for the next one
+	_bitCount = 0;
+
+	return sealed;
+}
+
+
+//======================================================================================================================
+//  decoding
+
+uint64_t HistoryBlockReader::readBits( unsigned count )
+{
+	if (count > 32)
+	{
+		const uint64_t high = readBits( count - 32 );
+		return high << 32 | readBits( 32 );
+	}
+
+	// at most 32 + 7 bits are buffered, the bits above them are garbage that gets masked out
+	while (_bufferedBits < count)
+	{
+		_buffer = _buffer << 8 | (_bytePos < _block.bits.size() ? _block.bits[ _bytePos ] : 0);
+		++_bytePos;
+		_bufferedBits += 8;
+	}
+	_bufferedBits -= count;
+	return (_buffer >> _bufferedBits) & ((uint64_t( 1 ) << count) - 1);
+}
+
+bool HistoryBlockReader::next( uint64_t & timestamp_ms, float & value )
+{
+	if (_decoded >= _block.sampleCount)
+	{
+		return false;
+	}
+
+	if (_decoded == 0)
+	{
+		_lastTimestamp = readBits( 64 );
+		_lastValueBits = uint32_t( readBits( 32 ) );
+		_lastDelta = 0;
+		_lastLeading = 32;
+		_lastTrailing = 0;
+	}
+	else
+	{
+		int64_t deltaOfDelta;
+		if (readBits( 1 ) == 0)
+			deltaOfDelta = 0;
+		else if (readBits( 1 ) == 0)
+			deltaOfDelta = signExtend( readBits( 7 ), 7 );
+		else if (readBits( 1 ) == 0)
+			deltaOfDelta = signExtend( readBits( 9 ), 9 );
+		else if (readBits( 1 ) == 0)
+			deltaOfDelta = signExtend( readBits( 12 ), 12 );
+		else
+			deltaOfDelta = int64_t( readBits( 64 ) );
+		_lastDelta += deltaOfDelta;
+		_lastTimestamp += uint64_t( _lastDelta );
+
+		if (readBits( 1 ) != 0)
+		{
+			if (readBits( 1 ) != 0)
+			{
+				_lastLeading = unsigned( readBits( 5 ) );
+				const unsigned length = unsigned( readBits( 5 ) ) + 1;
+				_lastTrailing = 32 - _lastLeading - length;
+			}
+			const uint32_t xorBits = uint32_t( readBits( 32 - _lastLeading - _lastTrailing ) ) << _lastTrailing;
+			_lastValueBits ^= xorBits;
+		}
+	}
+
+	++_decoded;
+	timestamp_ms = _lastTimestamp;
+	value = bitsFloat( _lastValueBits );
+	return true;
+}
+
+
+//======================================================================================================================
+//  SampleHistory
+
+void SampleHistory::add( float value, uint64_t timestamp_us )
+{
+	const uint64_t timestamp_ms = timestamp_us / 1000;
+
+	std::unique_lock< std::mutex > lock( _mtx );
+
+	_open.append( timestamp_ms, value );
+	if (_open.block().sampleCount < samplesPerBlock)
+	{
+		return;
+	}
+
+	auto sealed = std::make_shared< const HistoryBlock >( _open.seal() );
+	_sealedBytes += sealed->bits.size();
+	_sealed.push_back( std::move( sealed ) );
+
+	// the whole block has to be older than the retention, so the history is never shorter than asked for
+	while (!_sealed.empty() && _sealed.front()->lastTimestamp_ms + _retention_ms < timestamp_ms)
+	{
+		_sealedBytes -= _sealed.front()->bits.size();
+		_sealed.pop_front();
+	}
+}
+
+void SampleHistory::scan( uint64_t from_us, uint64_t to_us, const std::function< void ( const HistoryChunk & ) > & consumer ) const
+{
+	const uint64_t from_ms = from_us / 1000;
+	const uint64_t to_ms = to_us / 1000;
+
+	// take what's needed under the lock, so that the sampling thread isn't blocked by the decoding
+	std::vector< std::shared_ptr< const HistoryBlock > > blocks;
+	HistoryBlock open;
+	{
+		std::unique_lock< std::mutex > lock( _mtx );
+		for (const auto & block : _sealed)
+		{
+			if (block->lastTimestamp_ms >= from_ms && block->firstTimestamp_ms <= to_ms)
+				blocks.push_back( block );
+		}
+		const HistoryBlock & openBlock = _open.block();
+		if (openBlock.sampleCount > 0 && openBlock.lastTimestamp_ms >= from_ms && openBlock.firstTimestamp_ms <= to_ms)
+			open = openBlock;
+	}
+
+	HistoryChunk chunk;
+	auto decode = [&]( const HistoryBlock & block )
+	{
+		HistoryBlockReader reader( block );
+		uint64_t timestamp_ms;
+		float value;
+		while (reader.next( timestamp_ms, value ))
+		{
+			if (timestamp_ms < from_ms)
+				continue;
+			if (timestamp_ms > to_ms)
+				break;
+			chunk.timestamps_ms[ chunk.count ] = timestamp_ms;
+			chunk.values[ chunk.count ] = value;
+			if (++chunk.count == HistoryChunk::capacity)
+			{
+				consumer( chunk );
+				chunk.count = 0;
+			}
+		}
+	};
+
+	for (const auto & block : blocks)
+		decode( *block );
+	if (open.sampleCount > 0)
+		decode( open );
+
+	if (chunk.count > 0)
+		consumer( chunk );
+}
+
+size_t SampleHistory::memoryUsage() const
+{
+	std::unique_lock< std::mutex > lock( _mtx );
+	return _sealedBytes + _open.block().bits.capacity();
+}
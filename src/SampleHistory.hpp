@@ -0,0 +1,133 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: compressed long-term history of the readings of a sensor
+//======================================================================================================================
+
+#ifndef SAMPLE_HISTORY_INCLUDED
+#define SAMPLE_HISTORY_INCLUDED
+
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <functional>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Longest history the configuration can ask for.
+constexpr unsigned maxHistoryRetention_h = 31 * 24;
+
+/// Readings compressed the same way as in the Gorilla time series database: the timestamps as deltas of their deltas,
+/// the values as XOR with the previous value, storing only the bits that differ.
+/** A sensor read at a regular interval has mostly zero deltas of deltas, and a slowly changing value is mostly
+  * the same as the previous one, each of these takes a single bit. The timestamps are stored in milliseconds. */
+struct HistoryBlock
+{
+	uint64_t firstTimestamp_ms = 0;
+	uint64_t lastTimestamp_ms = 0;
+	uint32_t sampleCount = 0;
+	std::vector< uint8_t > bits;   ///< the most significant bit of a byte goes first
+};
+
+/// Appends readings to a block that is being built.
+class HistoryBlockWriter
+{
+ public:
+
+	void append( uint64_t timestamp_ms, float value );
+
+	const HistoryBlock & block() const { return _block; }
+
+	/// Returns the finished block, trimmed to the size of its data, and starts a new one.
+	HistoryBlock seal();
+
+ private:
+
+	void writeBits( uint64_t bits, unsigned count );
+
+	HistoryBlock _block;
+	size_t _bitCount = 0;
+	int64_t _lastDelta = 0;
+	uint32_t _lastValueBits = 0;
+	unsigned _lastLeading = 0;
+	unsigned _lastTrailing = 0;
+
+};
+
+/// Decodes the readings of a block one by one, without decoding the rest of it.
+class HistoryBlockReader
+{
+ public:
+
+	/** The block must outlive the reader. */
+	explicit HistoryBlockReader( const HistoryBlock & block ) : _block( block ) {}
+
+	/// Returns false when there are no more readings in the block.
+	bool next( uint64_t & timestamp_ms, float & value );
+
+ private:
+
+	uint64_t readBits( unsigned count );
+
+	const HistoryBlock & _block;
+	size_t _bytePos = 0;
+	uint64_t _buffer = 0;         ///< the bytes read ahead, so that the bits don't have to be extracted one by one
+	unsigned _bufferedBits = 0;
+	uint32_t _decoded = 0;
+	uint64_t _lastTimestamp = 0;
+	int64_t _lastDelta = 0;
+	uint32_t _lastValueBits = 0;
+	unsigned _lastLeading = 0;
+	unsigned _lastTrailing = 0;
+
+};
+
+/// Readings decoded from the history, handed over in chunks so that a whole range never has to be decoded at once.
+/** Stored column-wise, so that the values can be processed in tight loops. */
+struct HistoryChunk
+{
+	static constexpr size_t capacity = 256;
+
+	size_t count = 0;
+	uint64_t timestamps_ms [capacity];
+	float values [capacity];
+};
+
+/// Compressed history of the successful readings of one sensor.
+/** The readings are appended to an open block, which is sealed when it's full, and the sealed blocks older
+  * than the retention are dropped. Thread-safe, the sampling thread adds the readings while the server thread reads them,
+  * the readers take only shared pointers to the blocks under the lock and decode them without it. */
+class SampleHistory
+{
+ public:
+
+	static constexpr uint32_t samplesPerBlock = 4096;
+
+	explicit SampleHistory( uint64_t retention_ms ) : _retention_ms( retention_ms ) {}
+
+	void add( float value, uint64_t timestamp_us );
+
+	/// Decodes the readings from the range [from_us, to_us] in the order of time and passes them to the consumer in chunks.
+	void scan( uint64_t from_us, uint64_t to_us, const std::function< void ( const HistoryChunk & ) > & consumer ) const;
+
+	/// Bytes taken by the compressed readings.
+	size_t memoryUsage() const;
+
+ private:
+
+	const uint64_t _retention_ms;
+
+	mutable std::mutex _mtx;
+	std::deque< std::shared_ptr< const HistoryBlock > > _sealed;
+	HistoryBlockWriter _open;
+	size_t _sealedBytes = 0;
+
+};
+
+
+#endif // SAMPLE_HISTORY_INCLUDED
@@ -0,0 +1,144 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: the sensors and their last values remembered between the runs of the service
+//======================================================================================================================
+
+#include "SensorCache.hpp"
+
+#include "Protocol.hpp"  // floatToBits
+
+#include <CppUtils-Essential/BinaryStream.hpp>
+using namespace own;
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+using std::string;
+using std::vector;
+
+const char * const defaultSensorCacheFileName = "sensor_cache.bin";
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// Increment when the format changes, a cache of a different version is ignored.
+static const uint32_t cacheVersion = 1;
+
+/// Layout of the cache file, big endian like the network protocol.
+struct SensorCacheFile
+{
+	char magic [4];
+	uint32_t version;
+	vector< CachedSensor > sensors;
+
+	SensorCacheFile() : magic{'H','W','M','C'}, version( cacheVersion ) {}
+
+	size_t size() const
+	{
+		size_t size = sizeof(magic) + sizeof(version) + sizeof(uint32_t);
+		for (const CachedSensor & sensor : sensors)
+			size += sensor.id.size() + 1 + sensor.name.size() + 1 + sensor.category.size() + 1 + sizeof(uint32_t);
+		return size;
+	}
+
+	friend void operator<<( BinaryOutputStream & stream, const SensorCacheFile & f )
+	{
+		stream << f.magic;
+		stream.writeBigEndian( f.version );
+		stream.writeBigEndian( uint32_t( f.sensors.size() ) );
+		for (const CachedSensor & sensor : f.sensors)
+		{
+			stream.writeString0( sensor.id );
+			stream.writeString0( sensor.name );
+			stream.writeString0( sensor.category );
+			stream.writeBigEndian( floatToBits( sensor.value ) );
+		}
+	}
+
+	friend void operator>>( BinaryInputStream & stream, SensorCacheFile & f )
+	{
+		stream >> f.magic;
+		if (strncmp( f.magic, "HWMC", 4 ) != 0)
+			return stream.setFailed();
+
+		uint32_t count = 0;
+		if (!stream.readBigEndian( f.version ) || f.version != cacheVersion || !stream.readBigEndian( count ))
+			return stream.setFailed();
+
+		// don't trust the count, a damaged file could make us allocate gigabytes
+		for (uint32_t i = 0; i < count && !stream.hasFailed(); ++i)
+		{
+			CachedSensor sensor;
+			uint32_t bits = 0;
+			stream.readString0( sensor.id );
+			stream.readString0( sensor.name );
+			stream.readString0( sensor.category );
+			stream.readBigEndian( bits );
+			sensor.value = bitsToFloat( bits );
+			f.sensors.push_back( std::move( sensor ) );
+		}
+	}
+};
+
+string saveSensorCache( const string & filePath, const SensorDataMap & sensorData )
+{
+	SensorCacheFile cache;
+	cache.sensors.reserve( sensorData.size() );
+	for (const auto & [sensorID, data] : sensorData)
+	{
+		if (data.state == SensorState::RequestedButNotFound)
+			continue;  // it will be requested again from the config
+		if (data.derived)
+			continue;  // it will be defined again by the config
+		const SensorSample sample = data.sample.load();
+		cache.sensors.push_back({ sensorID, data.name, data.category, hasFailed( sample ) ? 0.0f : sample.value });
+	}
+
+	vector< uint8_t > bytes = toByteVector( cache );
+
+	// write it aside first and then replace the old one, so that a crash while writing doesn't leave a broken cache
+	string tempPath = filePath + ".tmp";
+	{
+		std::ofstream file( tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+		if (!file.is_open())
+		{
+			return "cannot open " + tempPath + " for writing";
+		}
+		file.write( (const char *)bytes.data(), std::streamsize( bytes.size() ) );
+		if (!file.good())
+		{
+			return "cannot write into " + tempPath;
+		}
+	}
+	std::remove( filePath.c_str() );
+	if (std::rename( tempPath.c_str(), filePath.c_str() ) != 0)
+	{
+		return "cannot rename " + tempPath + " to " + filePath;
+	}
+
+	return {};
+}
+
+string loadSensorCache( const string & filePath, vector< CachedSensor > & sensors )
+{
+	std::ifstream file( filePath.c_str(), std::ios::in | std::ios::binary );
+	if (!file.is_open())
+	{
+		return "cannot open " + filePath;
+	}
+
+	vector< uint8_t > bytes( (std::istreambuf_iterator< char >( file )), std::istreambuf_iterator< char >() );
+
+	SensorCacheFile cache;
+	if (!fromBytes( make_span( bytes.data(), bytes.size() ), cache ))
+	{
+		return filePath + " is damaged or has an old format";
+	}
+
+	sensors = std::move( cache.sensors );
+	return {};
+}
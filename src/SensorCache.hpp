@@ -0,0 +1,41 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: the sensors and their last values remembered between the runs of the service
+//======================================================================================================================
+
+#ifndef SENSOR_CACHE_INCLUDED
+#define SENSOR_CACHE_INCLUDED
+
+
+#include "SensorData.hpp"
+
+#include <string>
+#include <vector>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// Enumerating the hardware takes seconds, so the service starts with the sensors from the previous run
+// and enumerates the hardware after it is already serving the clients.
+
+extern const char * const defaultSensorCacheFileName;
+
+/// One sensor as it was known at the end of the previous run.
+struct CachedSensor
+{
+	std::string id;
+	std::string name;
+	std::string category;
+	float value;   ///< the last value read, 0 if the reading had failed or the sensor wasn't monitored
+};
+
+/// Saves the sensors that have been found by the hardware monitoring library, returns error message or empty string on success.
+std::string saveSensorCache( const std::string & filePath, const SensorDataMap & sensorData );
+
+/// Loads the sensors saved by the previous run, returns error message or empty string on success.
+std::string loadSensorCache( const std::string & filePath, std::vector< CachedSensor > & sensors );
+
+
+#endif // SENSOR_CACHE_INCLUDED
@@ -0,0 +1,73 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: in-memory table of the known sensors and their last values
+//======================================================================================================================
+
+#ifndef SENSOR_DATA_INCLUDED
+#define SENSOR_DATA_INCLUDED
+
+
+#include "SensorStatistics.hpp"
+#include "QuantileSketch.hpp"
+#include "SampleHistory.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <cmath>
+#include <limits>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+enum class SensorState
+{
+	Monitored,              ///< detected by the hardware monitoring library and monitored
+	RequestedButNotFound,   ///< requested to be monitored but not detected by the hardware monitoring library
+	FoundButNotMonitored,   ///< detected by the hardware monitoring library but not monitored
+};
+
+/// One reading of a sensor. Stored as a whole, so that the readers never see a value with a wrong sequence number.
+struct SensorSample
+{
+	float value;             ///< failedReading if the reading has failed, a derived sensor can be 0 or negative
+	uint32_t seq;            ///< number of the sampling cycle that has read it, 0 if it hasn't been read yet
+	uint64_t timestamp_us;   ///< when it was read, microseconds of a monotonic clock
+};
+
+/// Value of a failed reading. NaN rather than 0, because a value computed from other sensors can be anything.
+/** The hardware monitoring library returns 0 on failure, the sampling converts that to this. */
+const float failedReading = std::numeric_limits< float >::quiet_NaN();
+
+inline bool hasFailed( const SensorSample & sample )
+{
+	return std::isnan( sample.value );
+}
+
+struct SensorData
+{
+	SensorState state;
+	std::string name;       ///< display name given by the hardware monitoring library
+	std::string category;   ///< category given by the hardware monitoring library (Temperature, Load, Fan, ...)
+	std::atomic< SensorSample > sample;
+	std::atomic< SensorStatistics > statistics;  ///< updated before the sample, so it's never older than the sample
+	std::unique_ptr< StatisticsAccumulator > accumulator;  ///< only for the sampling thread, created by the first reading
+	std::shared_ptr< PercentileHistory > percentiles;  ///< created by the first reading, use std::atomic_load/atomic_store
+	std::shared_ptr< SampleHistory > history;  ///< created by the first reading if enabled, use std::atomic_load/atomic_store
+	bool derived = false;   ///< computed by the service from other sensors, see SensorExpression.hpp
+
+	SensorData( SensorState state )
+		: state( state ), sample( SensorSample{ 0.0f, 0, 0 } ), statistics( SensorStatistics{ 0.0f, 0.0f, 0.0f, 0.0f } ) {}
+	SensorData( SensorState state, const std::string & name, const std::string & category )
+		: state( state ), name( name ), category( category ), sample( SensorSample{ 0.0f, 0, 0 } ), statistics( SensorStatistics{ 0.0f, 0.0f, 0.0f, 0.0f } ) {}
+};
+
+/// sensor ID -> sensor data
+using SensorDataMap = std::unordered_map< std::string, SensorData >;
+
+
+#endif // SENSOR_DATA_INCLUDED
@@ -0,0 +1,415 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: derived sensors computed by the service from the values of other sensors
+//======================================================================================================================
+
+#include "SensorExpression.hpp"
+
+#include "SensorPattern.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <algorithm>
+using std::string;
+using std::string_view;
+using std::vector;
+
+const char * const derivedSensorCategory = "Derived";
+
+static const float notAvailable = std::numeric_limits< float >::quiet_NaN();
+
+
+//======================================================================================================================
+//  compilation
+
+static bool isSensorIDChar( char c )
+{
+	return isalnum( (unsigned char)c ) || string_view( "/-_.:{}*?" ).find( c ) != string_view::npos;
+}
+
+/// Recursive descent parser emitting the instructions as it goes, each of the functions parses one rule of the grammar.
+struct SensorExpression::Compiler
+{
+	SensorExpression & expr;
+	string_view text;
+	size_t pos = 0;
+	string error;
+
+	Compiler( SensorExpression & expr, string_view text ) : expr( expr ), text( text ) {}
+
+	char peek()
+	{
+		while (pos < text.size() && isspace( (unsigned char)text[ pos ] ))
+			++pos;
+		return pos < text.size() ? text[ pos ] : '\0';
+	}
+
+	bool fail( const string & message )
+	{
+		if (error.empty())
+			error = message + " at position " + std::to_string( pos + 1 );
+		return false;
+	}
+
+	void emit( OpCode opCode, uint32_t operand = 0 )
+	{
+		expr._code.push_back({ opCode, operand });
+	}
+
+	string_view readSensorID()
+	{
+		size_t start = pos;
+		while (pos < text.size() && isSensorIDChar( text[ pos ] ))
+			++pos;
+		return text.substr( start, pos - start );
+	}
+
+	uint32_t addReference( string_view sensorID )
+	{
+		expr._refs.push_back({ string( sensorID ), isSensorPattern( sensorID ), 0, 0 });
+		return uint32_t( expr._refs.size() - 1 );
+	}
+
+	bool parseExpression()
+	{
+		if (!parseTerm())
+			return false;
+		for (char op = peek(); op == '+' || op == '-'; op = peek())
+		{
+			++pos;
+			if (!parseTerm())
+				return false;
+			emit( op == '+' ? OpCode::Add : OpCode::Subtract );
+		}
+		return true;
+	}
+
+	bool parseTerm()
+	{
+		if (!parseFactor())
+			return false;
+		for (char op = peek(); op == '*' || op == '/'; op = peek())
+		{
+			++pos;
+			if (!parseFactor())
+				return false;
+			emit( op == '*' ? OpCode::Multiply : OpCode::Divide );
+		}
+		return true;
+	}
+
+	bool parseFactor()
+	{
+		char c = peek();
+		if (c == '\0')
+		{
+			return fail( "unexpected end of expression" );
+		}
+		else if (c == '-')
+		{
+			++pos;
+			if (!parseFactor())
+				return false;
+			emit( OpCode::Negate );
+			return true;
+		}
+		else if (c == '(')
+		{
+			++pos;
+			if (!parseExpression())
+				return false;
+			if (peek() != ')')
+				return fail( "expected \")\"" );
+			++pos;
+			return true;
+		}
+		else if (isdigit( (unsigned char)c ) || c == '.')
+		{
+			return parseNumber();
+		}
+		else if (c == '/')
+		{
+			string_view sensorID = readSensorID();
+			if (isSensorPattern( sensorID ))
+				return fail( "pattern " + string( sensorID ) + " can only be an argument of min, max, avg or sum" );
+			emit( OpCode::PushSensor, addReference( sensorID ) );
+			return true;
+		}
+		else if (isalpha( (unsigned char)c ))
+		{
+			return parseFunctionCall();
+		}
+		else
+		{
+			return fail( string( "unexpected character \"" ) + c + "\"" );
+		}
+	}
+
+	bool parseNumber()
+	{
+		size_t start = pos;
+		while (pos < text.size() && (isdigit( (unsigned char)text[ pos ] ) || text[ pos ] == '.'))
+			++pos;
+		string numberStr( text.substr( start, pos - start ) );
+		char * end = nullptr;
+		float value = strtof( numberStr.c_str(), &end );
+		if (end != numberStr.c_str() + numberStr.size())
+			return fail( "invalid number " + numberStr );
+
+		expr._constants.push_back( value );
+		emit( OpCode::PushConstant, uint32_t( expr._constants.size() - 1 ) );
+		return true;
+	}
+
+	bool parseFunctionCall()
+	{
+		size_t start = pos;
+		while (pos < text.size() && isalpha( (unsigned char)text[ pos ] ))
+			++pos;
+		string_view name = text.substr( start, pos - start );
+
+		OpCode opCode;
+		if (name == "min")
+			opCode = OpCode::Min;
+		else if (name == "max")
+			opCode = OpCode::Max;
+		else if (name == "avg")
+			opCode = OpCode::Avg;
+		else if (name == "sum")
+			opCode = OpCode::Sum;
+		else if (name == "abs")
+			opCode = OpCode::Abs;
+		else
+			return fail( "unknown function " + string( name ) );
+
+		if (peek() != '(')
+			return fail( "expected \"(\" after " + string( name ) );
+		++pos;
+
+		if (opCode == OpCode::Abs)
+		{
+			if (!parseExpression())
+				return false;
+		}
+		else
+		{
+			emit( OpCode::BeginArgs );
+			while (true)
+			{
+				if (!parseAggregateArgument())
+					return false;
+				if (peek() != ',')
+					break;
+				++pos;
+			}
+		}
+
+		if (peek() != ')')
+			return fail( "expected \")\"" );
+		++pos;
+
+		emit( opCode );
+		return true;
+	}
+
+	/// Same as an expression, except it can also be a lone pattern.
+	bool parseAggregateArgument()
+	{
+		if (peek() == '/')
+		{
+			size_t start = pos;
+			string_view sensorID = readSensorID();
+			char next = peek();
+			if (isSensorPattern( sensorID ) && (next == ',' || next == ')'))
+			{
+				emit( OpCode::PushSensors, addReference( sensorID ) );
+				return true;
+			}
+			pos = start;  // it's a part of a larger expression, parse it again as such
+		}
+		return parseExpression();
+	}
+};
+
+string SensorExpression::compile( string_view text )
+{
+	_code.clear();
+	_constants.clear();
+	_refs.clear();
+	_inputs.clear();
+
+	Compiler compiler( *this, text );
+	if (compiler.parseExpression() && compiler.peek() != '\0')
+	{
+		compiler.fail( string( "unexpected character \"" ) + compiler.peek() + "\"" );
+	}
+	return compiler.error;
+}
+
+string parseDerivedSensor( string_view definition, DerivedSensor & derived )
+{
+	size_t assignmentPos = definition.find( '=' );
+	if (assignmentPos == string_view::npos)
+	{
+		return "derived sensor \"" + string( definition ) + "\" is missing \"=\"";
+	}
+
+	string_view id = definition.substr( 0, assignmentPos );
+	while (!id.empty() && isspace( (unsigned char)id.front() ))
+		id.remove_prefix( 1 );
+	while (!id.empty() && isspace( (unsigned char)id.back() ))
+		id.remove_suffix( 1 );
+	if (id.empty() || id.front() != '/' || !std::all_of( id.begin(), id.end(), isSensorIDChar ) || isSensorPattern( id ))
+	{
+		return "invalid ID of derived sensor \"" + string( id ) + "\", it must start with \"/\" and cannot contain wildcards";
+	}
+
+	string_view expressionText = definition.substr( assignmentPos + 1 );
+	while (!expressionText.empty() && isspace( (unsigned char)expressionText.front() ))
+		expressionText.remove_prefix( 1 );
+
+	string error = derived.expression.compile( expressionText );
+	if (!error.empty())
+	{
+		return "derived sensor " + string( id ) + ": " + error;
+	}
+
+	derived.id = string( id );
+	derived.expressionText = string( expressionText );
+	return {};
+}
+
+
+//======================================================================================================================
+//  linking and evaluation
+
+void SensorExpression::link( SensorDataMap & sensorData, vector< string > * unresolved )
+{
+	_inputs.clear();
+
+	for (Reference & ref : _refs)
+	{
+		ref.firstInput = uint32_t( _inputs.size() );
+
+		if (!ref.isPattern)
+		{
+			auto sensorDataIter = sensorData.find( ref.id );
+			if (sensorDataIter != sensorData.end() && sensorDataIter->second.state != SensorState::RequestedButNotFound)
+				_inputs.push_back( &sensorDataIter->second );
+		}
+		else
+		{
+			SensorPatternMatcher matcher;
+			matcher.addPattern( ref.id );
+			for (auto & kvPair : sensorData)
+			{
+				if (kvPair.second.state != SensorState::RequestedButNotFound && matcher.matches( kvPair.first ))
+					_inputs.push_back( &kvPair.second );
+			}
+		}
+
+		ref.inputCount = uint32_t( _inputs.size() ) - ref.firstInput;
+		if (ref.inputCount == 0 && unresolved)
+			unresolved->push_back( ref.id );
+	}
+}
+
+static float valueOf( const SensorData * sensor )
+{
+	const SensorSample sample = sensor->sample.load();
+	return hasFailed( sample ) ? notAvailable : sample.value;
+}
+
+float SensorExpression::evaluate() const
+{
+	_stack.clear();
+	_argStarts.clear();
+
+	for (const Instruction & instr : _code)
+	{
+		switch (instr.opCode)
+		{
+			case OpCode::PushConstant:
+				_stack.push_back( _constants[ instr.operand ] );
+				break;
+			case OpCode::PushSensor:
+			{
+				const Reference & ref = _refs[ instr.operand ];
+				_stack.push_back( ref.inputCount > 0 ? valueOf( _inputs[ ref.firstInput ] ) : notAvailable );
+				break;
+			}
+			case OpCode::PushSensors:
+			{
+				const Reference & ref = _refs[ instr.operand ];
+				for (uint32_t i = ref.firstInput; i < ref.firstInput + ref.inputCount; ++i)
+					_stack.push_back( valueOf( _inputs[i] ) );
+				break;
+			}
+			case OpCode::BeginArgs:
+				_argStarts.push_back( uint32_t( _stack.size() ) );
+				break;
+			case OpCode::Negate:
+				_stack.back() = -_stack.back();
+				break;
+			case OpCode::Abs:
+				_stack.back() = std::fabs( _stack.back() );
+				break;
+			case OpCode::Add:
+			case OpCode::Subtract:
+			case OpCode::Multiply:
+			case OpCode::Divide:
+			{
+				float right = _stack.back();
+				_stack.pop_back();
+				float & left = _stack.back();
+				switch (instr.opCode)
+				{
+					case OpCode::Add:      left += right; break;
+					case OpCode::Subtract: left -= right; break;
+					case OpCode::Multiply: left *= right; break;
+					default:               left /= right; break;
+				}
+				break;
+			}
+			case OpCode::Min:
+			case OpCode::Max:
+			case OpCode::Avg:
+			case OpCode::Sum:
+			{
+				const uint32_t argStart = _argStarts.back();
+				_argStarts.pop_back();
+
+				float result = notAvailable;
+				uint32_t count = 0;
+				for (uint32_t i = argStart; i < _stack.size(); ++i)
+				{
+					const float arg = _stack[i];
+					if (std::isnan( arg ))
+						continue;  // leave out the failed ones
+					if (count == 0)
+						result = arg;
+					else if (instr.opCode == OpCode::Min)
+						result = std::min( result, arg );
+					else if (instr.opCode == OpCode::Max)
+						result = std::max( result, arg );
+					else
+						result += arg;
+					++count;
+				}
+				if (instr.opCode == OpCode::Avg && count > 0)
+					result /= float( count );
+
+				_stack.resize( argStart );
+				_stack.push_back( result );
+				break;
+			}
+		}
+	}
+
+	const float result = _stack.back();
+	return std::isfinite( result ) ? result : notAvailable;
+}
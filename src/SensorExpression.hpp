@@ -0,0 +1,113 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: derived sensors computed by the service from the values of other sensors
+//======================================================================================================================
+
+#ifndef SENSOR_EXPRESSION_INCLUDED
+#define SENSOR_EXPRESSION_INCLUDED
+
+
+#include "SensorData.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+extern const char * const derivedSensorCategory;
+
+/// Formula over the values of other sensors, compiled into instructions of a small stack machine.
+/** The syntax:
+  *   expression := term { ('+' | '-') term }
+  *   term       := factor { ('*' | '/') factor }
+  *   factor     := number | sensor ID | '-' factor | '(' expression ')' | function '(' arguments ')'
+  * A sensor ID starts with '/' and consists of letters, digits and the characters / - _ . : { } * ?,
+  * so an operator following a sensor ID has to be separated from it by a space.
+  * Functions min, max, avg and sum take any number of arguments, an argument can also be a pattern of sensor IDs
+  * (see SensorPattern.hpp) standing for all the sensors it matches. The arguments whose reading has failed are left out,
+  * so that one broken drive doesn't break the average of all the others. Function abs takes one argument.
+  * Everywhere else a failed reading makes the whole result fail. */
+class SensorExpression
+{
+ public:
+
+	/// Parses the formula, returns error message or empty string on success.
+	std::string compile( std::string_view text );
+
+	/// Resolves the sensor IDs and patterns to the sensors of a map. Has to be done again whenever the map is replaced.
+	/** The IDs and patterns that don't refer to any sensor are appended to unresolved, if given. */
+	void link( SensorDataMap & sensorData, std::vector< std::string > * unresolved = nullptr );
+
+	/// The sensors the formula reads, valid after link().
+	const std::vector< SensorData * > & inputs() const { return _inputs; }
+
+	/// Computes the value from the last samples of the linked sensors, NaN if any of the needed readings has failed.
+	/** Not thread-safe, it reuses internal buffers so that it doesn't allocate. */
+	float evaluate() const;
+
+ private:
+
+	enum class OpCode : uint8_t
+	{
+		PushConstant,   ///< operand: index into _constants
+		PushSensor,     ///< operand: index into _refs, a single sensor
+		PushSensors,    ///< operand: index into _refs, all the sensors matching a pattern
+		BeginArgs,      ///< remembers where the arguments of the next aggregate function start
+		Negate,
+		Add,
+		Subtract,
+		Multiply,
+		Divide,
+		Abs,
+		Min,
+		Max,
+		Avg,
+		Sum,
+	};
+
+	struct Instruction
+	{
+		OpCode opCode;
+		uint32_t operand;
+	};
+
+	/// A sensor ID or a pattern written in the formula.
+	struct Reference
+	{
+		std::string id;
+		bool isPattern;
+		uint32_t firstInput;  ///< the sensors it resolved to are _inputs[ firstInput ... firstInput + inputCount )
+		uint32_t inputCount;
+	};
+
+	struct Compiler;
+
+	std::vector< Instruction > _code;
+	std::vector< float > _constants;
+	std::vector< Reference > _refs;
+	std::vector< SensorData * > _inputs;
+
+	mutable std::vector< float > _stack;
+	mutable std::vector< uint32_t > _argStarts;
+
+};
+
+/// A sensor defined in the derived_sensors option as "<sensor ID> = <expression>".
+struct DerivedSensor
+{
+	std::string id;
+	std::string expressionText;
+	SensorExpression expression;
+	SensorData * output = nullptr;  ///< its entry in the current sensor map, null if it has no entry there
+};
+
+/// Parses one entry of the derived_sensors option, returns error message or empty string on success.
+std::string parseDerivedSensor( std::string_view definition, DerivedSensor & derived );
+
+
+#endif // SENSOR_EXPRESSION_INCLUDED
@@ -0,0 +1,21 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: the sensor table ordered by the sensor IDs, for browsing the sensors by a prefix
+//======================================================================================================================
+
+#include "SensorIndex.hpp"
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+SensorIndex::SensorIndex( std::shared_ptr< const SensorDataMap > sensorData ) : _sensorData( std::move( sensorData ) )
+{
+	_entries.reserve( _sensorData->size() );
+	for (const Entry & entry : *_sensorData)
+	{
+		_tree.insert( entry.first, uint32_t( _entries.size() ) );
+		_entries.push_back( &entry );
+	}
+}
@@ -0,0 +1,54 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: the sensor table ordered by the sensor IDs, for browsing the sensors by a prefix
+//======================================================================================================================
+
+#ifndef SENSOR_INDEX_INCLUDED
+#define SENSOR_INDEX_INCLUDED
+
+
+#include "SensorData.hpp"
+#include "RadixTree.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Index of all the sensors of one SensorDataMap, built whenever the set of sensors changes.
+class SensorIndex
+{
+ public:
+
+	using Entry = SensorDataMap::value_type;
+
+	SensorIndex( std::shared_ptr< const SensorDataMap > sensorData );
+
+	/// Calls visitor( const Entry & ) for the sensors whose ID starts with the prefix and is greater than startAfter,
+	/// ordered by their IDs, until the visitor returns false.
+	template< typename Visitor >
+	void forEachWithPrefix( std::string_view prefix, std::string_view startAfter, Visitor && visitor ) const
+	{
+		_tree.forEachWithPrefix( prefix, startAfter, [&]( std::string_view, uint32_t entryIdx )
+		{
+			return visitor( *_entries[ entryIdx ] );
+		});
+	}
+
+	size_t size() const { return _entries.size(); }
+
+ private:
+
+	std::shared_ptr< const SensorDataMap > _sensorData;  ///< keeps the entries alive
+	std::vector< const Entry * > _entries;
+	RadixTree _tree;
+
+};
+
+
+#endif // SENSOR_INDEX_INCLUDED
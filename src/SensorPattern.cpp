@@ -0,0 +1,139 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: wildcard patterns of sensor IDs in the monitored_sensors option
+//======================================================================================================================
+
+#include "SensorPattern.hpp"
+
+using std::string_view;
+using std::vector;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+bool isSensorPattern( string_view entry )
+{
+	return entry.find_first_of( "*?" ) != string_view::npos;
+}
+
+SensorPatternMatcher::SensorPatternMatcher() : _patternCount( 0 ), _step( 0 )
+{
+	_nodes.emplace_back();
+}
+
+uint32_t SensorPatternMatcher::addChild( uint32_t nodeIdx, char c )
+{
+	if (c == '?')
+	{
+		if (_nodes[ nodeIdx ].anyCharChild == noNode)
+		{
+			_nodes[ nodeIdx ].anyCharChild = uint32_t( _nodes.size() );
+			_nodes.emplace_back();
+		}
+		return _nodes[ nodeIdx ].anyCharChild;
+	}
+	else if (c == '*')
+	{
+		if (_nodes[ nodeIdx ].starChild == noNode)
+		{
+			_nodes[ nodeIdx ].starChild = uint32_t( _nodes.size() );
+			_nodes.emplace_back();
+			_nodes.back().isStar = true;
+		}
+		return _nodes[ nodeIdx ].starChild;
+	}
+	else
+	{
+		for (const auto & [childChar, childIdx] : _nodes[ nodeIdx ].children)
+			if (childChar == c)
+				return childIdx;
+
+		uint32_t childIdx = uint32_t( _nodes.size() );
+		_nodes[ nodeIdx ].children.emplace_back( c, childIdx );
+		_nodes.emplace_back();
+		return childIdx;
+	}
+}
+
+void SensorPatternMatcher::addPattern( string_view pattern )
+{
+	uint32_t nodeIdx = 0;
+	char prevChar = '\0';
+	for (char c : pattern)
+	{
+		if (c == '*' && prevChar == '*')
+			continue;  // "**" is the same as "*"
+		nodeIdx = addChild( nodeIdx, c );
+		prevChar = c;
+	}
+	_nodes[ nodeIdx ].patterns.push_back( uint32_t( _patternCount++ ) );
+}
+
+void SensorPatternMatcher::addState( uint32_t nodeIdx, vector< uint32_t > & states ) const
+{
+	if (_inSetSince[ nodeIdx ] == _step)
+		return;
+	_inSetSince[ nodeIdx ] = _step;
+	states.push_back( nodeIdx );
+
+	// '*' can match nothing, so whoever is at this node is also at its star child
+	if (_nodes[ nodeIdx ].starChild != noNode)
+		addState( _nodes[ nodeIdx ].starChild, states );
+}
+
+bool SensorPatternMatcher::matches( string_view sensorID, vector< bool > * matchedPatterns ) const
+{
+	if (_inSetSince.size() != _nodes.size())
+	{
+		_inSetSince.assign( _nodes.size(), 0 );
+		_step = 0;
+	}
+
+	_current.clear();
+	++_step;
+	addState( 0, _current );
+
+	for (char c : sensorID)
+	{
+		_next.clear();
+		++_step;
+		for (uint32_t nodeIdx : _current)
+		{
+			const Node & node = _nodes[ nodeIdx ];
+			if (c != '/')
+			{
+				if (node.isStar)
+					addState( nodeIdx, _next );
+				if (node.anyCharChild != noNode)
+					addState( node.anyCharChild, _next );
+			}
+			for (const auto & [childChar, childIdx] : node.children)
+			{
+				if (childChar == c)
+				{
+					addState( childIdx, _next );
+					break;
+				}
+			}
+		}
+		_current.swap( _next );
+
+		if (_current.empty())
+			return false;  // none of the patterns can match anymore
+	}
+
+	bool matched = false;
+	for (uint32_t nodeIdx : _current)
+	{
+		for (uint32_t patternIdx : _nodes[ nodeIdx ].patterns)
+		{
+			matched = true;
+			if (!matchedPatterns)
+				return true;
+			(*matchedPatterns)[ patternIdx ] = true;
+		}
+	}
+	return matched;
+}
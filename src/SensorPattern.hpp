@@ -0,0 +1,71 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: wildcard patterns of sensor IDs in the monitored_sensors option
+//======================================================================================================================
+
+#ifndef SENSOR_PATTERN_INCLUDED
+#define SENSOR_PATTERN_INCLUDED
+
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <utility>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Returns true if the monitored_sensors entry contains wildcards and has to be matched against the sensor IDs.
+bool isSensorPattern( std::string_view entry );
+
+/// Glob patterns of sensor IDs compiled into one trie, so that a sensor ID is matched against all of them in one pass.
+/** '*' matches any number of characters except '/', '?' matches one character except '/',
+  * so a wildcard never crosses a level of the ID (a part between two slashes).
+  * The patterns share the nodes of their common beginnings, which is most of them, because the IDs are hierarchical.
+  * Not thread-safe, the matching reuses internal buffers so that it doesn't allocate. */
+class SensorPatternMatcher
+{
+ public:
+
+	SensorPatternMatcher();
+
+	/// Adds a pattern, its index is the number of the patterns added before it.
+	void addPattern( std::string_view pattern );
+
+	size_t patternCount() const { return _patternCount; }
+
+	/// Returns true if the sensor ID matches at least one of the patterns.
+	/** If matchedPatterns is given, it must have patternCount() elements and the ones of the matching patterns are set. */
+	bool matches( std::string_view sensorID, std::vector< bool > * matchedPatterns = nullptr ) const;
+
+ private:
+
+	static constexpr uint32_t noNode = UINT32_MAX;
+
+	struct Node
+	{
+		std::vector< std::pair< char, uint32_t > > children;  ///< literal characters
+		uint32_t anyCharChild = noNode;   ///< '?'
+		uint32_t starChild = noNode;      ///< '*', this child has isStar set
+		bool isStar = false;              ///< the node loops on itself for every character except '/'
+		std::vector< uint32_t > patterns; ///< patterns that end here
+	};
+
+	uint32_t addChild( uint32_t nodeIdx, char c );
+	void addState( uint32_t nodeIdx, std::vector< uint32_t > & states ) const;
+
+	std::vector< Node > _nodes;  ///< [0] is the root
+	size_t _patternCount;
+
+	// the set of the trie nodes that match the characters read so far, double-buffered
+	mutable std::vector< uint32_t > _current;
+	mutable std::vector< uint32_t > _next;
+	mutable std::vector< uint32_t > _inSetSince;  ///< per node, the step in which it was added, to avoid duplicates
+	mutable uint32_t _step;
+
+};
+
+
+#endif // SENSOR_PATTERN_INCLUDED
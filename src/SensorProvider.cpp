@@ -0,0 +1,133 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: source of the sensor readings - either the real hardware or a simulation
+//======================================================================================================================
+
+#include "SensorProvider.hpp"
+
+#include <string>
+using std::string;
+
+
+#ifndef SIMULATED_SENSORS
+//======================================================================================================================
+//  LibreHardwareMonitor
+
+#include "lhwm-cpp-wrapper.h"
+
+SensorMap getHardwareSensorMap()
+{
+	SensorMap sensorMap;
+	for (const auto & [deviceID, sensors] : LHWM::GetHardwareSensorMap())
+	{
+		sensorMap[ deviceID ].assign( sensors.begin(), sensors.end() );
+	}
+	return sensorMap;
+}
+
+float getSensorValue( const string & sensorID )
+{
+	return LHWM::GetSensorValue( sensorID );
+}
+
+
+#else // SIMULATED_SENSORS
+//======================================================================================================================
+//  simulation
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <functional>  // hash
+
+// can be overriden by environment variables of the same name
+static const unsigned defaultSimulatedSensors = 256;
+static const unsigned defaultSimulatedReadTime_us = 0;
+static const unsigned defaultSimulatedHotplugPeriod_s = 0;
+
+static const unsigned sensorsPerDevice = 16;
+
+static unsigned getEnvNumber( const char * name, unsigned defaultValue )
+{
+	const char * value = getenv( name );
+	return value ? unsigned( strtoul( value, nullptr, 10 ) ) : defaultValue;
+}
+
+/// Simulates a device that is connected for one period and disconnected for the next one, like a USB cooler.
+static bool isHotplugDeviceConnected()
+{
+	static const unsigned period_s = getEnvNumber( "HWMON_SIMULATED_HOTPLUG_S", defaultSimulatedHotplugPeriod_s );
+	static const auto startTime = std::chrono::steady_clock::now();
+	if (period_s == 0)
+	{
+		return false;
+	}
+
+	auto elapsed_s = std::chrono::duration_cast< std::chrono::seconds >( std::chrono::steady_clock::now() - startTime ).count();
+	return (elapsed_s / period_s) % 2 == 1;
+}
+
+static const char * const hotplugDevicePrefix = "/simulated-hotplug/";
+
+SensorMap getHardwareSensorMap()
+{
+	const unsigned sensorCount = getEnvNumber( "HWMON_SIMULATED_SENSORS", defaultSimulatedSensors );
+
+	SensorMap sensorMap;
+	for (unsigned i = 0; i < sensorCount; ++i)
+	{
+		unsigned deviceIdx = i / sensorsPerDevice;
+		unsigned sensorIdx = i % sensorsPerDevice;
+
+		char deviceID [32];
+		snprintf( deviceID, sizeof(deviceID), "/simulated/%u", deviceIdx );
+		char sensorID [64];
+		snprintf( sensorID, sizeof(sensorID), "/simulated/%u/temperature/%u", deviceIdx, sensorIdx );
+		char sensorName [32];
+		snprintf( sensorName, sizeof(sensorName), "Core #%u", sensorIdx );
+
+		sensorMap[ deviceID ].emplace_back( sensorName, "Temperature", sensorID );
+	}
+
+	if (isHotplugDeviceConnected())
+	{
+		for (unsigned sensorIdx = 0; sensorIdx < 4; ++sensorIdx)
+		{
+			char sensorID [64];
+			snprintf( sensorID, sizeof(sensorID), "%s0/temperature/%u", hotplugDevicePrefix, sensorIdx );
+			char sensorName [32];
+			snprintf( sensorName, sizeof(sensorName), "Liquid #%u", sensorIdx );
+
+			sensorMap[ string( hotplugDevicePrefix ) + '0' ].emplace_back( sensorName, "Temperature", sensorID );
+		}
+	}
+
+	return sensorMap;
+}
+
+float getSensorValue( const string & sensorID )
+{
+	static const unsigned readTime_us = getEnvNumber( "HWMON_SIMULATED_READ_US", defaultSimulatedReadTime_us );
+	if (readTime_us > 0)
+	{
+		std::this_thread::sleep_for( std::chrono::microseconds( readTime_us ) );
+	}
+
+	if (sensorID.compare( 0, strlen( hotplugDevicePrefix ), hotplugDevicePrefix ) == 0 && !isHotplugDeviceConnected())
+	{
+		return 0.0f;  // reading a disconnected device fails
+	}
+
+	// slow sine wave around 50 degrees, each sensor with a different phase
+	size_t phase = std::hash< string >()( sensorID ) % 1000;
+	double time_s = std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	return float( 50.0 + 10.0 * sin( time_s / 30.0 + double( phase ) ) );
+}
+
+
+#endif // SIMULATED_SENSORS
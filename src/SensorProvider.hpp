@@ -0,0 +1,35 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: source of the sensor readings - either the real hardware or a simulation
+//======================================================================================================================
+
+#ifndef SENSOR_PROVIDER_INCLUDED
+#define SENSOR_PROVIDER_INCLUDED
+
+
+#include <map>
+#include <vector>
+#include <string>
+#include <tuple>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// When built with SIMULATED_SENSORS defined, the service doesn't touch the hardware at all and instead generates
+// a configurable number of fake sensors. This is meant for benchmarking the service on loopback.
+
+/// display name, category, sensor ID
+using SensorInfo = std::tuple< std::string, std::string, std::string >;
+/// device ID -> sensors of the device
+using SensorMap = std::map< std::string, std::vector< SensorInfo > >;
+
+/// Enumerates all available sensors. Returns empty map on failure.
+SensorMap getHardwareSensorMap();
+
+/// Reads the current value of a sensor. Returns 0 on failure.
+float getSensorValue( const std::string & sensorID );
+
+
+#endif // SENSOR_PROVIDER_INCLUDED
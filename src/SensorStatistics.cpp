@@ -0,0 +1,59 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: statistics of the readings of a sensor maintained incrementally by the sampling thread
+//======================================================================================================================
+
+#include "SensorStatistics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+StatisticsAccumulator::StatisticsAccumulator( unsigned smoothingSamples, unsigned medianWindow )
+:
+	_alpha( 2.0f / float( std::max( smoothingSamples, 1u ) + 1 ) ),
+	_medianWindow( std::clamp( medianWindow, 1u, maxMedianWindow ) ),
+	_count( 0 ),
+	_mean( 0.0f ),
+	_welfordMean( 0.0 ),
+	_welfordM2( 0.0 ),
+	_lastValue( 0.0f ),
+	_lastTimestamp_us( 0 ),
+	_ratePerSecond( 0.0f ),
+	_window{},
+	_windowPos( 0 )
+{}
+
+SensorStatistics StatisticsAccumulator::add( float value, uint64_t timestamp_us )
+{
+	++_count;
+
+	// exponentially weighted moving average, the first reading starts it
+	_mean = _count == 1 ? value : _mean + _alpha * (value - _mean);
+
+	// Welford's algorithm, numerically stable unlike the sum of squares
+	const double delta = double( value ) - _welfordMean;
+	_welfordMean += delta / double( _count );
+	_welfordM2 += delta * (double( value ) - _welfordMean);
+	const float stdDev = _count > 1 ? float( std::sqrt( _welfordM2 / double( _count - 1 ) ) ) : 0.0f;
+
+	// two readings with the same timestamp would divide by zero, keep the previous rate then
+	if (_count > 1 && timestamp_us > _lastTimestamp_us)
+		_ratePerSecond = (value - _lastValue) * 1e6f / float( timestamp_us - _lastTimestamp_us );
+	_lastValue = value;
+	_lastTimestamp_us = timestamp_us;
+
+	_window[ _windowPos ] = value;
+	_windowPos = (_windowPos + 1) % _medianWindow;
+	const unsigned filled = unsigned( std::min( _count, uint64_t( _medianWindow ) ) );
+	float sorted [maxMedianWindow];
+	std::copy( _window, _window + filled, sorted );
+	std::nth_element( sorted, sorted + filled / 2, sorted + filled );
+	const float median = sorted[ filled / 2 ];
+
+	return { _mean, stdDev, _ratePerSecond, median };
+}
@@ -0,0 +1,60 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: statistics of the readings of a sensor maintained incrementally by the sampling thread
+//======================================================================================================================
+
+#ifndef SENSOR_STATISTICS_INCLUDED
+#define SENSOR_STATISTICS_INCLUDED
+
+
+#include <cstdint>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Longest median filter the configuration can ask for.
+constexpr unsigned maxMedianWindow = 31;
+
+/// Values computed from the readings of a sensor, published together, like SensorSample.
+struct SensorStatistics
+{
+	float mean;            ///< exponentially weighted moving average
+	float stdDev;          ///< standard deviation of all the readings since the sensor has been monitored
+	float ratePerSecond;   ///< change between the last two readings, per second
+	float median;          ///< median of the last few readings
+};
+
+/// Updates the statistics of one sensor with every new reading, in constant time and without allocating.
+class StatisticsAccumulator
+{
+ public:
+
+	/** smoothingSamples is the span of the moving average, its weight of a new reading is 2 / (smoothingSamples + 1),
+	  * medianWindow is the number of the last readings the median is taken from, at most maxMedianWindow. */
+	StatisticsAccumulator( unsigned smoothingSamples, unsigned medianWindow );
+
+	/// Adds a successful reading and returns the updated statistics.
+	SensorStatistics add( float value, uint64_t timestamp_us );
+
+ private:
+
+	float _alpha;
+	unsigned _medianWindow;
+
+	uint64_t _count;
+	float _mean;
+	double _welfordMean;   ///< doubles, so that the running sums don't lose precision after millions of readings
+	double _welfordM2;
+	float _lastValue;
+	uint64_t _lastTimestamp_us;
+	float _ratePerSecond;
+
+	float _window [maxMedianWindow];  ///< circular buffer of the last readings
+	unsigned _windowPos;
+
+};
+
+
+#endif // SENSOR_STATISTICS_INCLUDED
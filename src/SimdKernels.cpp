@@ -0,0 +1,335 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: vectorized loops over arrays of values, with the instruction set selected at runtime
+//======================================================================================================================
+
+#include "SimdKernels.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define SIMD_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define SIMD_TARGET( isa )  // MSVC allows the intrinsics of any instruction set without a compiler flag
+	#else
+		#include <cpuid.h>
+		#define SIMD_TARGET( isa ) __attribute__(( target( isa ) ))
+	#endif
+#endif
+
+
+//======================================================================================================================
+//  scalar
+
+static FloatSummary summarizeFloats_Scalar( const float * values, size_t count )
+{
+	FloatSummary summary = { values[0], values[0], 0.0 };
+	for (size_t i = 0; i < count; ++i)
+	{
+		summary.min = std::min( summary.min, values[i] );
+		summary.max = std::max( summary.max, values[i] );
+		summary.sum += double( values[i] );
+	}
+	return summary;
+}
+
+static void encodeBigEndian32_Scalar( const void * words, size_t count, uint8_t * output )
+{
+	const uint8_t * input = static_cast< const uint8_t * >( words );
+	for (size_t i = 0; i < count; ++i, input += 4, output += 4)
+	{
+		uint32_t word;
+		memcpy( &word, input, sizeof(word) );
+		output[0] = uint8_t( word >> 24 );
+		output[1] = uint8_t( word >> 16 );
+		output[2] = uint8_t( word >> 8 );
+		output[3] = uint8_t( word );
+	}
+}
+
+static void encodeBigEndian64_Scalar( const void * words, size_t count, uint8_t * output )
+{
+	const uint8_t * input = static_cast< const uint8_t * >( words );
+	for (size_t i = 0; i < count; ++i, input += 8, output += 8)
+	{
+		uint64_t word;
+		memcpy( &word, input, sizeof(word) );
+		for (unsigned byte = 0; byte < 8; ++byte)
+			output[ byte ] = uint8_t( word >> (56 - 8 * byte) );
+	}
+}
+
+
+#ifdef SIMD_X86
+
+//======================================================================================================================
+//  SSE4.1
+
+SIMD_TARGET( "sse4.1" )
+static FloatSummary summarizeFloats_SSE41( const float * values, size_t count )
+{
+	__m128 min = _mm_set1_ps( values[0] );
+	__m128 max = min;
+	__m128d sumLow = _mm_setzero_pd();
+	__m128d sumHigh = _mm_setzero_pd();
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 v = _mm_loadu_ps( values + i );
+		min = _mm_min_ps( min, v );
+		max = _mm_max_ps( max, v );
+		sumLow = _mm_add_pd( sumLow, _mm_cvtps_pd( v ) );
+		sumHigh = _mm_add_pd( sumHigh, _mm_cvtps_pd( _mm_movehl_ps( v, v ) ) );
+	}
+
+	float mins [4], maxs [4];
+	double sums [2];
+	_mm_storeu_ps( mins, min );
+	_mm_storeu_ps( maxs, max );
+	_mm_storeu_pd( sums, _mm_add_pd( sumLow, sumHigh ) );
+
+	FloatSummary summary = { *std::min_element( mins, mins + 4 ), *std::max_element( maxs, maxs + 4 ), sums[0] + sums[1] };
+	for (; i < count; ++i)
+	{
+		summary.min = std::min( summary.min, values[i] );
+		summary.max = std::max( summary.max, values[i] );
+		summary.sum += double( values[i] );
+	}
+	return summary;
+}
+
+SIMD_TARGET( "sse4.1" )
+static void encodeBigEndian32_SSE41( const void * words, size_t count, uint8_t * output )
+{
+	const uint8_t * input = static_cast< const uint8_t * >( words );
+	const __m128i swap = _mm_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i v = _mm_loadu_si128( reinterpret_cast< const __m128i * >( input + i * 4 ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( output + i * 4 ), _mm_shuffle_epi8( v, swap ) );
+	}
+	encodeBigEndian32_Scalar( input + i * 4, count - i, output + i * 4 );
+}
+
+SIMD_TARGET( "sse4.1" )
+static void encodeBigEndian64_SSE41( const void * words, size_t count, uint8_t * output )
+{
+	const uint8_t * input = static_cast< const uint8_t * >( words );
+	const __m128i swap = _mm_setr_epi8( 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 );
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		const __m128i v = _mm_loadu_si128( reinterpret_cast< const __m128i * >( input + i * 8 ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( output + i * 8 ), _mm_shuffle_epi8( v, swap ) );
+	}
+	encodeBigEndian64_Scalar( input + i * 8, count - i, output + i * 8 );
+}
+
+
+//======================================================================================================================
+//  AVX2
+
+SIMD_TARGET( "avx2" )
+static FloatSummary summarizeFloats_AVX2( const float * values, size_t count )
+{
+	__m256 min = _mm256_set1_ps( values[0] );
+	__m256 max = min;
+	__m256d sumLow = _mm256_setzero_pd();
+	__m256d sumHigh = _mm256_setzero_pd();
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256 v = _mm256_loadu_ps( values + i );
+		min = _mm256_min_ps( min, v );
+		max = _mm256_max_ps( max, v );
+		sumLow = _mm256_add_pd( sumLow, _mm256_cvtps_pd( _mm256_castps256_ps128( v ) ) );
+		sumHigh = _mm256_add_pd( sumHigh, _mm256_cvtps_pd( _mm256_extractf128_ps( v, 1 ) ) );
+	}
+
+	float mins [8], maxs [8];
+	double sums [4];
+	_mm256_storeu_ps( mins, min );
+	_mm256_storeu_ps( maxs, max );
+	_mm256_storeu_pd( sums, _mm256_add_pd( sumLow, sumHigh ) );
+
+	FloatSummary summary = { *std::min_element( mins, mins + 8 ), *std::max_element( maxs, maxs + 8 ), (sums[0] + sums[1]) + (sums[2] + sums[3]) };
+	for (; i < count; ++i)
+	{
+		summary.min = std::min( summary.min, values[i] );
+		summary.max = std::max( summary.max, values[i] );
+		summary.sum += double( values[i] );
+	}
+	return summary;
+}
+
+SIMD_TARGET( "avx2" )
+static void encodeBigEndian32_AVX2( const void * words, size_t count, uint8_t * output )
+{
+	const uint8_t * input = static_cast< const uint8_t * >( words );
+	// the shuffle works within each 128-bit half, which is fine, no word crosses them
+	const __m256i swap = _mm256_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+	);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i v = _mm256_loadu_si256( reinterpret_cast< const __m256i * >( input + i * 4 ) );
+		_mm256_storeu_si256( reinterpret_cast< __m256i * >( output + i * 4 ), _mm256_shuffle_epi8( v, swap ) );
+	}
+	encodeBigEndian32_Scalar( input + i * 4, count - i, output + i * 4 );
+}
+
+SIMD_TARGET( "avx2" )
+static void encodeBigEndian64_AVX2( const void * words, size_t count, uint8_t * output )
+{
+	const uint8_t * input = static_cast< const uint8_t * >( words );
+	const __m256i swap = _mm256_setr_epi8(
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+	);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m256i v = _mm256_loadu_si256( reinterpret_cast< const __m256i * >( input + i * 8 ) );
+		_mm256_storeu_si256( reinterpret_cast< __m256i * >( output + i * 8 ), _mm256_shuffle_epi8( v, swap ) );
+	}
+	encodeBigEndian64_Scalar( input + i * 8, count - i, output + i * 8 );
+}
+
+
+//======================================================================================================================
+//  detection
+
+static void cpuid( int info [4], int leaf, int subleaf )
+{
+ #ifdef _MSC_VER
+	__cpuidex( info, leaf, subleaf );
+ #else
+	unsigned regs [4] = { 0, 0, 0, 0 };
+	__cpuid_count( unsigned( leaf ), unsigned( subleaf ), regs[0], regs[1], regs[2], regs[3] );
+	memcpy( info, regs, sizeof(regs) );
+ #endif
+}
+
+/// Which register states the OS saves on a context switch.
+static uint64_t enabledRegisterStates()
+{
+ #ifdef _MSC_VER
+	return _xgetbv( 0 );
+ #else
+	uint32_t low, high;
+	__asm__ volatile ( "xgetbv" : "=a"( low ), "=d"( high ) : "c"( 0 ) );
+	return uint64_t( high ) << 32 | low;
+ #endif
+}
+
+SimdLevel detectSimdLevel()
+{
+	int info [4];
+	cpuid( info, 0, 0 );
+	const int maxLeaf = info[0];
+
+	cpuid( info, 1, 0 );
+	const bool sse41 = (info[2] & (1 << 19)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!sse41)
+	{
+		return SimdLevel::Scalar;
+	}
+
+	// AVX registers are usable only if the OS saves them, otherwise the instructions fault
+	if (maxLeaf >= 7 && osxsave && avx && (enabledRegisterStates() & 0x6) == 0x6)
+	{
+		cpuid( info, 7, 0 );
+		if (info[1] & (1 << 5))
+			return SimdLevel::AVX2;
+	}
+	return SimdLevel::SSE41;
+}
+
+#else // SIMD_X86
+
+SimdLevel detectSimdLevel()
+{
+	return SimdLevel::Scalar;
+}
+
+#endif // SIMD_X86
+
+
+//======================================================================================================================
+//  dispatch
+
+struct Kernels
+{
+	SimdLevel level;
+	FloatSummary (* summarizeFloats)( const float * values, size_t count );
+	void (* encodeBigEndian32)( const void * words, size_t count, uint8_t * output );
+	void (* encodeBigEndian64)( const void * words, size_t count, uint8_t * output );
+};
+
+static Kernels kernelsFor( SimdLevel level )
+{
+ #ifdef SIMD_X86
+	switch (level)
+	{
+		case SimdLevel::AVX2:
+			return { level, summarizeFloats_AVX2, encodeBigEndian32_AVX2, encodeBigEndian64_AVX2 };
+		case SimdLevel::SSE41:
+			return { level, summarizeFloats_SSE41, encodeBigEndian32_SSE41, encodeBigEndian64_SSE41 };
+		default:
+			break;
+	}
+ #endif
+	return { SimdLevel::Scalar, summarizeFloats_Scalar, encodeBigEndian32_Scalar, encodeBigEndian64_Scalar };
+}
+
+static const SimdLevel g_detectedLevel = detectSimdLevel();
+static Kernels g_kernels = kernelsFor( g_detectedLevel );
+
+const char * enumString( SimdLevel level )
+{
+	switch (level)
+	{
+		case SimdLevel::Scalar: return "scalar";
+		case SimdLevel::SSE41:  return "sse4.1";
+		case SimdLevel::AVX2:   return "avx2";
+		default:                return "<invalid>";
+	}
+}
+
+SimdLevel activeSimdLevel()
+{
+	return g_kernels.level;
+}
+
+SimdLevel setSimdLevel( SimdLevel level )
+{
+	g_kernels = kernelsFor( std::min( level, g_detectedLevel ) );
+	return g_kernels.level;
+}
+
+FloatSummary summarizeFloats( const float * values, size_t count )
+{
+	return g_kernels.summarizeFloats( values, count );
+}
+
+void encodeBigEndian32( const void * words, size_t count, uint8_t * output )
+{
+	g_kernels.encodeBigEndian32( words, count, output );
+}
+
+void encodeBigEndian64( const void * words, size_t count, uint8_t * output )
+{
+	g_kernels.encodeBigEndian64( words, count, output );
+}
@@ -0,0 +1,54 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: vectorized loops over arrays of values, with the instruction set selected at runtime
+//======================================================================================================================
+
+#ifndef SIMD_KERNELS_INCLUDED
+#define SIMD_KERNELS_INCLUDED
+
+
+#include <cstdint>
+#include <cstddef>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+enum class SimdLevel
+{
+	Scalar,   ///< plain C++, works everywhere
+	SSE41,    ///< 4 floats at once
+	AVX2,     ///< 8 floats at once
+};
+const char * enumString( SimdLevel level );
+
+/// The best instruction set the CPU and the OS support.
+SimdLevel detectSimdLevel();
+
+/// The instruction set the kernels currently use, the detected one by default.
+SimdLevel activeSimdLevel();
+
+/// Switches the kernels to another instruction set, at most to the detected one. Returns the one that is active now.
+/** Meant for the benchmarks and for comparing the results, not thread-safe. */
+SimdLevel setSimdLevel( SimdLevel level );
+
+struct FloatSummary
+{
+	float min;
+	float max;
+	double sum;   ///< double, so that the sum of many readings doesn't lose precision
+};
+
+/// Minimum, maximum and sum of the values, count must not be 0 and the values must not be NaN.
+/** The sum is computed in a different order by every instruction set, so it can differ in the last bits. */
+FloatSummary summarizeFloats( const float * values, size_t count );
+
+/// Writes count 32-bit words (integers, or floats as their bits) to the output in big endian, as the protocol needs.
+void encodeBigEndian32( const void * words, size_t count, uint8_t * output );
+
+/// Writes count 64-bit words to the output in big endian.
+void encodeBigEndian64( const void * words, size_t count, uint8_t * output );
+
+
+#endif // SIMD_KERNELS_INCLUDED
@@ -0,0 +1,26 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: helpers for parsing the short definitions inside the config options
+//======================================================================================================================
+
+#include "TextParsing.hpp"
+
+#include <cctype>
+using std::string_view;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+string_view nextWord( string_view & text )
+{
+	while (!text.empty() && isspace( (unsigned char)text.front() ))
+		text.remove_prefix( 1 );
+	size_t length = 0;
+	while (length < text.size() && !isspace( (unsigned char)text[ length ] ))
+		++length;
+	string_view word = text.substr( 0, length );
+	text.remove_prefix( length );
+	return word;
+}
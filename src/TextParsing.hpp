@@ -0,0 +1,21 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: helpers for parsing the short definitions inside the config options
+//======================================================================================================================
+
+#ifndef TEXT_PARSING_INCLUDED
+#define TEXT_PARSING_INCLUDED
+
+
+#include <string_view>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Skips the leading whitespace, then cuts the next word off the text and returns it, empty if there is none left.
+std::string_view nextWord( std::string_view & text );
+
+
+#endif // TEXT_PARSING_INCLUDED
@@ -0,0 +1,85 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: hashed timer wheel, for the timeouts of many connections that are moved on every request
+//======================================================================================================================
+
+#include "TimerWheel.hpp"
+
+#include <algorithm>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+void TimerWheel::Timer::unlink() noexcept
+{
+	if (_prev)
+	{
+		_prev->_next = _next;
+		_next->_prev = _prev;
+		_prev = nullptr;
+		_next = nullptr;
+	}
+}
+
+TimerWheel::TimerWheel( std::chrono::milliseconds tick, size_t slotCount, Clock::time_point start )
+:
+	_start( start ),
+	_tick( std::max( Clock::duration( tick ), Clock::duration( 1 ) ) ),
+	_currentTick( 0 ),
+	_slots( std::max< size_t >( slotCount, 1 ) )
+{
+	// empty circular lists
+	for (Timer & head : _slots)
+	{
+		head._prev = &head;
+		head._next = &head;
+	}
+}
+
+TimerWheel::~TimerWheel() noexcept
+{
+	// the timers can outlive the wheel, they must not try to unlink from it then
+	for (Timer & head : _slots)
+	{
+		while (head._next != &head)
+			head._next->unlink();
+		head._prev = nullptr;
+		head._next = nullptr;
+	}
+}
+
+uint64_t TimerWheel::toTick( Clock::time_point time ) const noexcept
+{
+	return time > _start ? uint64_t( (time - _start) / _tick ) : 0;
+}
+
+void TimerWheel::schedule( Timer & timer, Clock::time_point deadline ) noexcept
+{
+	timer.unlink();
+
+	// Rounded up, so that the timer never expires before its deadline, and never into a tick that's being visited.
+	uint64_t expiryTick = deadline > _start ? uint64_t( (deadline - _start + _tick - Clock::duration( 1 )) / _tick ) : 0;
+	expiryTick = std::max( expiryTick, _currentTick + 1 );
+	timer._expiryTick = expiryTick;
+
+	Timer & head = _slots[ expiryTick % _slots.size() ];
+	timer._prev = head._prev;
+	timer._next = &head;
+	head._prev->_next = &timer;
+	head._prev = &timer;
+}
+
+TimerWheel::Timer * TimerWheel::takeExpired( Timer & head, uint64_t throughTick ) noexcept
+{
+	for (Timer * timer = head._next; timer != &head; timer = timer->_next)
+	{
+		if (timer->_expiryTick <= throughTick)
+		{
+			timer->unlink();
+			return timer;
+		}
+	}
+	return nullptr;
+}
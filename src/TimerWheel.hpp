@@ -0,0 +1,111 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: hashed timer wheel, for the timeouts of many connections that are moved on every request
+//======================================================================================================================
+
+#ifndef TIMER_WHEEL_INCLUDED
+#define TIMER_WHEEL_INCLUDED
+
+
+#include <cstdint>
+#include <vector>
+#include <chrono>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Timeouts that are scheduled, moved and cancelled in constant time, no matter how many of them there are.
+/** The time is divided into ticks and every timer is linked into the slot of the tick it expires at, modulo the number
+  * of slots. Advancing the time visits only the slots of the ticks that have passed. A timer that expires more than
+  * a whole turn of the wheel ahead stays in its slot and is skipped until its turn comes.
+  * The timers are embedded in the objects they belong to, so scheduling them never allocates. */
+class TimerWheel
+{
+ public:
+
+	using Clock = std::chrono::steady_clock;
+
+	/// Member of the object whose timeout it is. Cancels itself when destroyed.
+	class Timer
+	{
+	 public:
+
+		/// Arbitrary value that identifies the owner of the timer when it expires.
+		uint64_t key;
+
+		Timer() noexcept : key( 0 ), _prev( nullptr ), _next( nullptr ), _expiryTick( 0 ) {}
+		~Timer() noexcept  { unlink(); }
+
+		// the neighbours point to its address
+		Timer( const Timer & other ) = delete;
+		Timer & operator=( const Timer & other ) = delete;
+
+		bool isScheduled() const noexcept  { return _prev != nullptr; }
+
+	 private:
+
+		friend class TimerWheel;
+
+		void unlink() noexcept;
+
+		Timer * _prev;
+		Timer * _next;
+		uint64_t _expiryTick;
+
+	};
+
+	/// tick is the precision of the timeouts, one turn of the wheel takes slotCount ticks
+	TimerWheel( std::chrono::milliseconds tick, size_t slotCount, Clock::time_point start );
+	~TimerWheel() noexcept;
+
+	TimerWheel( const TimerWheel & other ) = delete;
+	TimerWheel & operator=( const TimerWheel & other ) = delete;
+
+	/// Schedules the timer to expire at the deadline, or moves it there if it's already scheduled.
+	/** A deadline that has already passed expires at the next tick. */
+	void schedule( Timer & timer, Clock::time_point deadline ) noexcept;
+
+	void cancel( Timer & timer ) noexcept  { timer.unlink(); }
+
+	/// Calls onExpired( timer ) for every timer whose deadline has passed, the timer is no longer scheduled then.
+	/** onExpired can schedule or cancel any timers, including the expired one and the other expired ones. */
+	template< typename Func >
+	void advance( Clock::time_point now, Func && onExpired )
+	{
+		const uint64_t nowTick = toTick( now );
+		// after a long pause, every slot is visited only once
+		if (nowTick >= _currentTick + _slots.size())
+			_currentTick = nowTick - _slots.size() + 1;
+
+		for (; _currentTick <= nowTick; ++_currentTick)
+		{
+			Timer & head = _slots[ _currentTick % _slots.size() ];
+			// Expired timers are taken one by one, because onExpired can change the slot in any way.
+			while (Timer * expired = takeExpired( head, nowTick ))
+			{
+				onExpired( *expired );
+			}
+			if (_currentTick == nowTick)
+				break;  // the current tick is not over yet, it will be visited again
+		}
+	}
+
+ private:
+
+	/// Number of the tick the time falls into.
+	uint64_t toTick( Clock::time_point time ) const noexcept;
+
+	/// Unlinks and returns the first timer of the slot that has expired by the given tick, or null.
+	Timer * takeExpired( Timer & head, uint64_t throughTick ) noexcept;
+
+	Clock::time_point _start;
+	Clock::duration _tick;
+	uint64_t _currentTick;
+	std::vector< Timer > _slots;  ///< heads of the circular lists of timers, they are not timers themselves
+
+};
+
+
+#endif // TIMER_WHEEL_INCLUDED
@@ -0,0 +1,376 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: UDP socket receiving and answering many request datagrams per system call
+//======================================================================================================================
+
+#include "UdpBatchSocket.hpp"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	using socket_t = SOCKET;
+	static const socket_t invalidSocket = INVALID_SOCKET;
+#else
+	#include <sys/socket.h>  // recvmmsg and sendmmsg need _GNU_SOURCE, which g++ defines by default
+	#include <netinet/in.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+	using socket_t = int;
+	static const socket_t invalidSocket = -1;
+#endif
+
+#include <cstring>
+#include <algorithm>
+using std::vector;
+using own::SocketError;
+using own::socket_id;
+using own::system_error_t;
+
+// Bursts of requests shouldn't be dropped just because the server thread was busy for a moment.
+static const int receiveBufferSize = 1024 * 1024;
+
+
+//======================================================================================================================
+//  platform
+
+static bool initNetworking() noexcept
+{
+#ifdef _WIN32
+	// done once for the whole process and never cleaned up, CppUtils-Network does the same for its own sockets
+	static const bool initialized = []()
+	{
+		WSADATA wsaData;
+		return WSAStartup( MAKEWORD(2, 2), &wsaData ) == 0;
+	}();
+	return initialized;
+#else
+	return true;
+#endif
+}
+
+static void closeSocket( socket_t sock ) noexcept
+{
+#ifdef _WIN32
+	closesocket( sock );
+#else
+	::close( sock );
+#endif
+}
+
+static bool setNonBlocking( socket_t sock ) noexcept
+{
+#ifdef _WIN32
+	u_long enabled = 1;
+	return ioctlsocket( sock, FIONBIO, &enabled ) == 0;
+#else
+	int flags = fcntl( sock, F_GETFL, 0 );
+	return flags >= 0 && fcntl( sock, F_SETFL, flags | O_NONBLOCK ) == 0;
+#endif
+}
+
+static system_error_t lastSocketError() noexcept
+{
+#ifdef _WIN32
+	return system_error_t( WSAGetLastError() );
+#else
+	return system_error_t( errno );
+#endif
+}
+
+static bool isWouldBlock( system_error_t error ) noexcept
+{
+#ifdef _WIN32
+	return error == WSAEWOULDBLOCK;
+#else
+	return error == EWOULDBLOCK || error == EAGAIN;
+#endif
+}
+
+
+//======================================================================================================================
+//  UdpBatchSocket
+
+struct UdpBatchSocket::Buffers
+{
+	socket_t sock = invalidSocket;
+	size_t maxDatagramSize;
+
+	size_t count = 0;  ///< number of datagrams in the last received batch
+	vector< vector< uint8_t > > requests;  ///< each of them maxDatagramSize large, the received length is in requestLengths
+	vector< size_t > requestLengths;
+	vector< uint8_t > truncated;
+	vector< sockaddr_in > peers;
+	vector< vector< uint8_t > > replies;
+
+#ifdef __linux__
+	vector< iovec > receiveVectors;
+	vector< mmsghdr > receiveMessages;
+	vector< iovec > sendVectors;
+	vector< mmsghdr > sendMessages;
+#endif
+
+	Buffers( size_t batchSize, size_t maxDatagramSize )
+	:
+		maxDatagramSize( maxDatagramSize ),
+		requests( batchSize, vector< uint8_t >( maxDatagramSize ) ),
+		requestLengths( batchSize, 0 ),
+		truncated( batchSize, 0 ),
+		peers( batchSize ),
+		replies( batchSize )
+	{
+	#ifdef __linux__
+		receiveVectors.resize( batchSize );
+		receiveMessages.resize( batchSize );
+		sendVectors.resize( batchSize );
+		sendMessages.resize( batchSize );
+		// these pointers never change, only the lengths need to be reset before every receive
+		for (size_t i = 0; i < batchSize; ++i)
+		{
+			receiveVectors[i].iov_base = requests[i].data();
+			receiveVectors[i].iov_len = maxDatagramSize;
+			memset( &receiveMessages[i], 0, sizeof(mmsghdr) );
+			receiveMessages[i].msg_hdr.msg_name = &peers[i];
+			receiveMessages[i].msg_hdr.msg_iov = &receiveVectors[i];
+			receiveMessages[i].msg_hdr.msg_iovlen = 1;
+		}
+	#endif
+	}
+};
+
+UdpBatchSocket::UdpBatchSocket( size_t batchSize, size_t maxDatagramSize ) noexcept
+:
+	_batchSize( batchSize ),
+	_maxDatagramSize( maxDatagramSize ),
+	_lastSystemError( 0 )
+{}
+
+UdpBatchSocket::~UdpBatchSocket() noexcept
+{
+	close();
+}
+
+SocketError UdpBatchSocket::open( uint16_t port )
+{
+	if (isOpen())
+	{
+		return SocketError::AlreadyConnected;
+	}
+	if (!initNetworking())
+	{
+		_lastSystemError = lastSocketError();
+		return SocketError::NetworkingInitFailed;
+	}
+
+	socket_t sock = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if (sock == invalidSocket)
+	{
+		_lastSystemError = lastSocketError();
+		return SocketError::Other;
+	}
+
+	sockaddr_in addr;
+	memset( &addr, 0, sizeof(addr) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( port );
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	if (::bind( sock, (const sockaddr *)&addr, sizeof(addr) ) != 0 || !setNonBlocking( sock ))
+	{
+		_lastSystemError = lastSocketError();
+		closeSocket( sock );
+		return SocketError::Other;
+	}
+	// not critical, the default is only smaller
+	setsockopt( sock, SOL_SOCKET, SO_RCVBUF, (const char *)&receiveBufferSize, sizeof(receiveBufferSize) );
+
+	if (!_buffers)
+		_buffers.reset( new Buffers( _batchSize, _maxDatagramSize ) );
+	_buffers->sock = sock;
+	return SocketError::Success;
+}
+
+void UdpBatchSocket::close() noexcept
+{
+	if (!isOpen())
+	{
+		return;
+	}
+
+	closeSocket( _buffers->sock );
+	_buffers->sock = invalidSocket;
+	_buffers->count = 0;
+}
+
+bool UdpBatchSocket::isOpen() const noexcept
+{
+	return _buffers && _buffers->sock != invalidSocket;
+}
+
+socket_id UdpBatchSocket::getSystemHandle() const noexcept
+{
+	return isOpen() ? socket_id( _buffers->sock ) : socket_id( invalidSocket );
+}
+
+own::const_byte_span UdpBatchSocket::request( size_t i ) const noexcept
+{
+	return own::const_byte_span( _buffers->requests[i].data(), _buffers->requestLengths[i] );
+}
+
+bool UdpBatchSocket::isTruncated( size_t i ) const noexcept
+{
+	return _buffers->truncated[i] != 0;
+}
+
+vector< uint8_t > & UdpBatchSocket::reply( size_t i ) noexcept
+{
+	return _buffers->replies[i];
+}
+
+#ifdef __linux__
+
+size_t UdpBatchSocket::receiveBatch() noexcept
+{
+	if (!isOpen())
+	{
+		return 0;
+	}
+	Buffers & b = *_buffers;
+	b.count = 0;
+
+	for (mmsghdr & message : b.receiveMessages)
+	{
+		message.msg_hdr.msg_namelen = sizeof(sockaddr_in);  // the kernel overwrites it with the actual length
+		message.msg_hdr.msg_flags = 0;
+	}
+
+	int received = recvmmsg( b.sock, b.receiveMessages.data(), unsigned( b.receiveMessages.size() ), MSG_DONTWAIT, nullptr );
+	if (received < 0)
+	{
+		_lastSystemError = lastSocketError();
+		return 0;  // nothing waiting, or an error that the next receive will most likely report again
+	}
+
+	b.count = size_t( received );
+	for (size_t i = 0; i < b.count; ++i)
+	{
+		b.requestLengths[i] = std::min( size_t( b.receiveMessages[i].msg_len ), b.maxDatagramSize );
+		b.truncated[i] = (b.receiveMessages[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+		b.replies[i].clear();
+	}
+	return b.count;
+}
+
+size_t UdpBatchSocket::sendReplies() noexcept
+{
+	if (!isOpen())
+	{
+		return 0;
+	}
+	Buffers & b = *_buffers;
+
+	size_t messageCount = 0;
+	for (size_t i = 0; i < b.count; ++i)
+	{
+		if (b.replies[i].empty())
+			continue;
+		b.sendVectors[ messageCount ].iov_base = b.replies[i].data();
+		b.sendVectors[ messageCount ].iov_len = b.replies[i].size();
+		mmsghdr & message = b.sendMessages[ messageCount ];
+		memset( &message, 0, sizeof(message) );
+		message.msg_hdr.msg_name = &b.peers[i];
+		message.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		message.msg_hdr.msg_iov = &b.sendVectors[ messageCount ];
+		message.msg_hdr.msg_iovlen = 1;
+		++messageCount;
+	}
+
+	// sendmmsg stops at the first datagram that fails, continue after it
+	size_t sentTotal = 0;
+	size_t next = 0;
+	while (next < messageCount)
+	{
+		int sent = sendmmsg( b.sock, b.sendMessages.data() + next, unsigned( messageCount - next ), MSG_DONTWAIT );
+		if (sent < 0)
+		{
+			_lastSystemError = lastSocketError();
+			if (isWouldBlock( _lastSystemError ))
+				break;  // the system buffer is full, the rest is lost
+			++next;  // skip the one that failed, for example its sender has an invalid address
+			continue;
+		}
+		sentTotal += size_t( sent );
+		next += size_t( sent );
+	}
+	return sentTotal;
+}
+
+#else // not __linux__
+
+size_t UdpBatchSocket::receiveBatch() noexcept
+{
+	if (!isOpen())
+	{
+		return 0;
+	}
+	Buffers & b = *_buffers;
+	b.count = 0;
+
+	while (b.count < b.requests.size())
+	{
+		const size_t i = b.count;
+		socklen_t peerLength = sizeof(sockaddr_in);
+		auto received = recvfrom( b.sock, (char *)b.requests[i].data(), int( b.maxDatagramSize ), 0, (sockaddr *)&b.peers[i], &peerLength );
+		bool isTruncated = false;
+		if (received < 0)
+		{
+			_lastSystemError = lastSocketError();
+		#ifdef _WIN32
+			if (_lastSystemError == WSAECONNRESET)
+				continue;  // a previous reply was rejected by its receiver, Windows reports it at the next receive
+			else if (_lastSystemError != WSAEMSGSIZE)
+				break;  // nothing more waiting, or an error
+			// the buffer has been filled and the rest of the datagram discarded
+			received = int( b.maxDatagramSize );
+			isTruncated = true;
+		#else
+			break;  // nothing more waiting, or an error
+		#endif
+		}
+		b.requestLengths[i] = size_t( received );
+		b.truncated[i] = isTruncated;
+		b.replies[i].clear();
+		++b.count;
+	}
+	return b.count;
+}
+
+size_t UdpBatchSocket::sendReplies() noexcept
+{
+	if (!isOpen())
+	{
+		return 0;
+	}
+	Buffers & b = *_buffers;
+
+	size_t sentTotal = 0;
+	for (size_t i = 0; i < b.count; ++i)
+	{
+		if (b.replies[i].empty())
+			continue;
+		auto sent = sendto( b.sock, (const char *)b.replies[i].data(), int( b.replies[i].size() ), 0, (const sockaddr *)&b.peers[i], sizeof(sockaddr_in) );
+		if (sent < 0)
+		{
+			_lastSystemError = lastSocketError();
+			if (isWouldBlock( _lastSystemError ))
+				break;  // the system buffer is full, the rest is lost
+			continue;
+		}
+		++sentTotal;
+	}
+	return sentTotal;
+}
+
+#endif // __linux__
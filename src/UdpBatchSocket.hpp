@@ -0,0 +1,74 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: UDP socket receiving and answering many request datagrams per system call
+//======================================================================================================================
+
+#ifndef UDP_BATCH_SOCKET_INCLUDED
+#define UDP_BATCH_SOCKET_INCLUDED
+
+
+#include <CppUtils-Network/Socket.hpp>  // SocketError, socket_id, system_error_t
+#include <CppUtils-Essential/Span.hpp>
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Non-blocking UDP socket for the connectionless queries, every datagram is a request answered by one reply datagram.
+/** On Linux a whole batch of datagrams is received by one recvmmsg and the replies are sent by one sendmmsg,
+  * elsewhere they are received and sent one by one, but still all at once without returning to the event loop.
+  * All the buffers are allocated when the socket is opened, receiving and sending the datagrams doesn't allocate. */
+class UdpBatchSocket
+{
+ public:
+
+	/// batchSize is the maximum number of datagrams received at once, larger datagrams than maxDatagramSize are truncated
+	UdpBatchSocket( size_t batchSize, size_t maxDatagramSize ) noexcept;
+	~UdpBatchSocket() noexcept;
+
+	UdpBatchSocket( const UdpBatchSocket & other ) = delete;
+	UdpBatchSocket & operator=( const UdpBatchSocket & other ) = delete;
+
+	/// Binds the socket to the port on the loopback interface.
+	/** The reply can be much larger than the request and UDP doesn't verify the sender's address,
+	  * so exposing this to the network would make the service an amplifier of spoofed traffic. */
+	own::SocketError open( uint16_t port );
+	void close() noexcept;
+	bool isOpen() const noexcept;
+
+	/// Receives the datagrams that are waiting, at most batchSize of them, without blocking. Returns their number.
+	/** The previous batch and its replies are discarded. */
+	size_t receiveBatch() noexcept;
+
+	/// The i-th datagram of the last received batch.
+	own::const_byte_span request( size_t i ) const noexcept;
+	/// The datagram didn't fit into maxDatagramSize, so its end has been cut off.
+	bool isTruncated( size_t i ) const noexcept;
+	/// Reply to the i-th datagram, it's sent to its sender by sendReplies(), unless it's left empty.
+	std::vector< uint8_t > & reply( size_t i ) noexcept;
+
+	/// Sends the replies of the last received batch. Returns the number of replies that were sent, the others
+	/// didn't fit into the system buffer, but that's no different from the datagrams being lost on their way.
+	size_t sendReplies() noexcept;
+
+	own::socket_id getSystemHandle() const noexcept;
+	own::system_error_t getLastSystemError() const noexcept  { return _lastSystemError; }
+
+ private:
+
+	size_t _batchSize;
+	size_t _maxDatagramSize;
+	// a pointer so that we don't have to include the system socket headers here
+	struct Buffers;
+	std::unique_ptr< Buffers > _buffers;
+	own::system_error_t _lastSystemError;
+
+};
+
+
+#endif // UDP_BATCH_SOCKET_INCLUDED
@@ -0,0 +1,554 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: stream sockets in the AF_UNIX family, for the clients running on the same machine
+//======================================================================================================================
+
+#include "UnixSocket.hpp"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	#include <afunix.h>
+	#include <mstcpip.h>  // SIO_KEEPALIVE_VALS
+	using socket_t = SOCKET;
+#else
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>  // TCP_KEEPIDLE
+	#include <poll.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+	using socket_t = int;
+#endif
+
+#ifdef MSG_NOSIGNAL
+	static const int sendFlags = MSG_NOSIGNAL;  // report a broken connection by return value, not by SIGPIPE
+#else
+	static const int sendFlags = 0;
+#endif
+
+#include <cstdio>   // remove
+#include <cstring>
+#include <utility>
+#include <algorithm>
+using std::string;
+using std::vector;
+using own::SocketError;
+using own::socket_id;
+using own::system_error_t;
+
+const char * const unixAddressPrefix = "unix:";
+
+const socket_id UnixSocket::invalidHandle = socket_id( ~socket_id( 0 ) );
+
+// Receiving into a vector needs some size, a request or a response is rarely more than a few hundred bytes.
+static const size_t receiveChunkSize = 16 * 1024;
+
+
+//======================================================================================================================
+//  platform
+
+static bool initNetworking() noexcept
+{
+#ifdef _WIN32
+	// done once for the whole process and never cleaned up, CppUtils-Network does the same for its own sockets
+	static const bool initialized = []()
+	{
+		WSADATA wsaData;
+		return WSAStartup( MAKEWORD(2, 2), &wsaData ) == 0;
+	}();
+	return initialized;
+#else
+	return true;
+#endif
+}
+
+static socket_t toSystem( socket_id handle ) noexcept
+{
+	return socket_t( handle );
+}
+
+static void closeSocket( socket_id handle ) noexcept
+{
+#ifdef _WIN32
+	closesocket( toSystem( handle ) );
+#else
+	close( toSystem( handle ) );
+#endif
+}
+
+static system_error_t lastSocketError() noexcept
+{
+#ifdef _WIN32
+	return system_error_t( WSAGetLastError() );
+#else
+	return system_error_t( errno );
+#endif
+}
+
+static bool isTimeout( system_error_t error ) noexcept
+{
+#ifdef _WIN32
+	return error == WSAETIMEDOUT;
+#else
+	return error == EAGAIN || error == EWOULDBLOCK;  // that's how an expired SO_RCVTIMEO is reported
+#endif
+}
+
+static bool isWouldBlock( system_error_t error ) noexcept
+{
+#ifdef _WIN32
+	return error == WSAEWOULDBLOCK;
+#else
+	return error == EAGAIN || error == EWOULDBLOCK;
+#endif
+}
+
+static bool isConnectionBroken( system_error_t error ) noexcept
+{
+#ifdef _WIN32
+	return error == WSAECONNRESET || error == WSAECONNABORTED || error == WSAESHUTDOWN;
+#else
+	return error == ECONNRESET || error == EPIPE;
+#endif
+}
+
+static system_error_t pathTooLongError() noexcept
+{
+#ifdef _WIN32
+	return WSAENAMETOOLONG;
+#else
+	return ENAMETOOLONG;
+#endif
+}
+
+static system_error_t pathInUseError() noexcept
+{
+#ifdef _WIN32
+	return WSAEADDRINUSE;
+#else
+	return EADDRINUSE;
+#endif
+}
+
+static bool makeAddress( const string & path, sockaddr_un & addr ) noexcept
+{
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	if (path.empty() || path.size() >= sizeof(addr.sun_path))  // needs to be null-terminated
+		return false;
+	memcpy( addr.sun_path, path.data(), path.size() );
+	return true;
+}
+
+static socket_id openSocket() noexcept
+{
+	socket_t sock = socket( AF_UNIX, SOCK_STREAM, 0 );
+#ifdef _WIN32
+	return sock == INVALID_SOCKET ? UnixSocket::invalidHandle : socket_id( sock );
+#else
+	return sock < 0 ? UnixSocket::invalidHandle : socket_id( sock );
+#endif
+}
+
+
+//======================================================================================================================
+//  UnixSocket
+
+UnixSocket::UnixSocket() noexcept : _handle( invalidHandle ), _lastSystemError( 0 ) {}
+
+UnixSocket::~UnixSocket() noexcept
+{
+	disconnect();
+}
+
+UnixSocket::UnixSocket( UnixSocket && other ) noexcept
+:
+	_handle( std::exchange( other._handle, invalidHandle ) ),
+	_lastSystemError( other._lastSystemError )
+{}
+
+UnixSocket & UnixSocket::operator=( UnixSocket && other ) noexcept
+{
+	if (this != &other)
+	{
+		disconnect();
+		_handle = std::exchange( other._handle, invalidHandle );
+		_lastSystemError = other._lastSystemError;
+	}
+	return *this;
+}
+
+SocketError UnixSocket::connect( const string & path ) noexcept
+{
+	if (isConnected())
+	{
+		return SocketError::AlreadyConnected;
+	}
+	if (!initNetworking())
+	{
+		_lastSystemError = lastSocketError();
+		return SocketError::NetworkingInitFailed;
+	}
+
+	sockaddr_un addr;
+	if (!makeAddress( path, addr ))
+	{
+		_lastSystemError = pathTooLongError();
+		return SocketError::HostNotResolved;  // the closest thing to an unusable address
+	}
+
+	socket_id handle = openSocket();
+	if (handle == invalidHandle)
+	{
+		_lastSystemError = lastSocketError();
+		return SocketError::Other;
+	}
+
+	if (::connect( toSystem( handle ), (const sockaddr *)&addr, sizeof(addr) ) != 0)
+	{
+		_lastSystemError = lastSocketError();
+		closeSocket( handle );
+		return SocketError::ConnectFailed;
+	}
+
+	_handle = handle;
+	return SocketError::Success;
+}
+
+SocketError UnixSocket::disconnect() noexcept
+{
+	if (!isConnected())
+	{
+		return SocketError::NotConnected;
+	}
+
+	closeSocket( _handle );
+	_handle = invalidHandle;
+	return SocketError::Success;
+}
+
+bool UnixSocket::setTimeout( std::chrono::milliseconds timeout ) noexcept
+{
+	if (!isConnected())
+	{
+		return false;
+	}
+
+#ifdef _WIN32
+	DWORD value = DWORD( timeout.count() );
+#else
+	timeval value;
+	value.tv_sec = long( timeout.count() / 1000 );
+	value.tv_usec = long( timeout.count() % 1000 ) * 1000;
+#endif
+	if (setsockopt( toSystem( _handle ), SOL_SOCKET, SO_RCVTIMEO, (const char *)&value, sizeof(value) ) != 0
+	 || setsockopt( toSystem( _handle ), SOL_SOCKET, SO_SNDTIMEO, (const char *)&value, sizeof(value) ) != 0)
+	{
+		_lastSystemError = lastSocketError();
+		return false;
+	}
+	return true;
+}
+
+SocketError UnixSocket::send( own::const_byte_span data ) noexcept
+{
+	if (!isConnected())
+	{
+		return SocketError::NotConnected;
+	}
+
+	size_t sentTotal = 0;
+	while (sentTotal < data.size())
+	{
+		int chunkSize = int( std::min( data.size() - sentTotal, size_t( 1 << 30 ) ) );
+		auto sent = ::send( toSystem( _handle ), (const char *)data.data() + sentTotal, chunkSize, sendFlags );
+		if (sent < 0)
+		{
+			_lastSystemError = lastSocketError();
+			if (isTimeout( _lastSystemError ))
+				return SocketError::Timeout;
+			else if (isConnectionBroken( _lastSystemError ))
+				return SocketError::ConnectionClosed;
+			else
+				return SocketError::Other;
+		}
+		sentTotal += size_t( sent );
+	}
+	return SocketError::Success;
+}
+
+SocketError UnixSocket::receiveOnce( vector< uint8_t > & buffer ) noexcept
+{
+	buffer.resize( receiveChunkSize );
+	size_t received = 0;
+	SocketError result = receiveOnce( own::make_span( buffer.data(), buffer.size() ), received );
+	buffer.resize( received );
+	return result;
+}
+
+SocketError UnixSocket::receiveOnce( own::byte_span buffer, size_t & received ) noexcept
+{
+	received = 0;
+	if (!isConnected())
+	{
+		return SocketError::NotConnected;
+	}
+
+	int chunkSize = int( std::min( buffer.size(), size_t( 1 << 30 ) ) );
+	auto result = ::recv( toSystem( _handle ), (char *)buffer.data(), chunkSize, 0 );
+	if (result == 0)
+	{
+		return SocketError::ConnectionClosed;
+	}
+	else if (result < 0)
+	{
+		_lastSystemError = lastSocketError();
+		if (isTimeout( _lastSystemError ))
+			return SocketError::Timeout;
+		else if (isConnectionBroken( _lastSystemError ))
+			return SocketError::ConnectionClosed;
+		else
+			return SocketError::Other;
+	}
+	received = size_t( result );
+	return SocketError::Success;
+}
+
+
+//======================================================================================================================
+//  UnixServerSocket
+
+UnixServerSocket::UnixServerSocket() noexcept : _handle( UnixSocket::invalidHandle ), _lastSystemError( 0 ) {}
+
+UnixServerSocket::~UnixServerSocket() noexcept
+{
+	close();
+}
+
+SocketError UnixServerSocket::open( const string & path ) noexcept
+{
+	if (isOpen())
+	{
+		return SocketError::AlreadyConnected;
+	}
+	if (!initNetworking())
+	{
+		_lastSystemError = lastSocketError();
+		return SocketError::NetworkingInitFailed;
+	}
+
+	sockaddr_un addr;
+	if (!makeAddress( path, addr ))
+	{
+		_lastSystemError = pathTooLongError();
+		return SocketError::Other;
+	}
+
+	// The file of a socket outlives the socket, so there might be one left from a previous run that didn't end cleanly.
+	// Remove it, but not if someone is still listening on it, that would silently steal the path from the other server.
+	{
+		UnixSocket probe;
+		if (probe.connect( path ) == SocketError::Success)
+		{
+			_lastSystemError = pathInUseError();
+			return SocketError::Other;
+		}
+		std::remove( path.c_str() );
+	}
+
+	socket_id handle = openSocket();
+	if (handle == UnixSocket::invalidHandle)
+	{
+		_lastSystemError = lastSocketError();
+		return SocketError::Other;
+	}
+
+	if (::bind( toSystem( handle ), (const sockaddr *)&addr, sizeof(addr) ) != 0
+	 || ::listen( toSystem( handle ), SOMAXCONN ) != 0)
+	{
+		_lastSystemError = lastSocketError();
+		closeSocket( handle );
+		return SocketError::Other;
+	}
+
+	_handle = handle;
+	_path = path;
+	return SocketError::Success;
+}
+
+void UnixServerSocket::close() noexcept
+{
+	if (!isOpen())
+	{
+		return;
+	}
+
+	closeSocket( _handle );
+	_handle = UnixSocket::invalidHandle;
+	std::remove( _path.c_str() );
+	_path.clear();
+}
+
+UnixSocket UnixServerSocket::accept() noexcept
+{
+	if (!isOpen())
+	{
+		return UnixSocket();
+	}
+
+	socket_t clientSock = ::accept( toSystem( _handle ), nullptr, nullptr );
+#ifdef _WIN32
+	if (clientSock == INVALID_SOCKET)
+#else
+	if (clientSock < 0)
+#endif
+	{
+		_lastSystemError = lastSocketError();
+		return UnixSocket();
+	}
+
+	return UnixSocket( socket_id( clientSock ) );
+}
+
+
+//======================================================================================================================
+//  operations on the handles of any sockets
+
+bool waitForReadable( const std::unordered_set< socket_id > & sockets, vector< socket_id > & readySockets, std::chrono::milliseconds timeout ) noexcept
+{
+	static const std::unordered_set< socket_id > noSockets;
+	thread_local vector< socket_id > noneWritable;
+	return waitForSockets( sockets, noSockets, readySockets, noneWritable, timeout );
+}
+
+bool waitForSockets(
+	const std::unordered_set< socket_id > & readSockets, const std::unordered_set< socket_id > & writeSockets,
+	vector< socket_id > & readable, vector< socket_id > & writable, std::chrono::milliseconds timeout
+) noexcept
+{
+	readable.clear();
+	writable.clear();
+
+	// Keep this static to prevent unnecessary allocation and deallocation at every call.
+	thread_local vector< pollfd > pollFds;
+	pollFds.clear();
+	auto addPollFd = [&]( socket_id handle, short events )
+	{
+		pollfd pollFd;
+		pollFd.fd = toSystem( handle );
+		pollFd.events = events;
+		pollFd.revents = 0;
+		pollFds.push_back( pollFd );
+	};
+	for (socket_id handle : readSockets)
+	{
+		addPollFd( handle, short( writeSockets.count( handle ) ? POLLIN | POLLOUT : POLLIN ) );
+	}
+	for (socket_id handle : writeSockets)
+	{
+		if (!readSockets.count( handle ))
+			addPollFd( handle, POLLOUT );
+	}
+
+#ifdef _WIN32
+	int result = WSAPoll( pollFds.data(), ULONG( pollFds.size() ), int( timeout.count() ) );
+#else
+	int result = ::poll( pollFds.data(), nfds_t( pollFds.size() ), int( timeout.count() ) );
+	if (result < 0 && errno == EINTR)
+		return true;  // a signal, the caller will just loop again
+#endif
+	if (result < 0)
+	{
+		return false;
+	}
+
+	const short failures = POLLERR | POLLHUP | POLLNVAL;
+	for (const pollfd & pollFd : pollFds)
+	{
+		// the errors and hang-ups count as ready too, the following receive, accept or send will report them
+		if ((pollFd.events & POLLIN) && (pollFd.revents & (POLLIN | failures)))
+			readable.push_back( socket_id( pollFd.fd ) );
+		if ((pollFd.events & POLLOUT) && (pollFd.revents & (POLLOUT | failures)))
+			writable.push_back( socket_id( pollFd.fd ) );
+	}
+	return true;
+}
+
+bool setNonBlocking( socket_id handle ) noexcept
+{
+#ifdef _WIN32
+	u_long enabled = 1;
+	return ioctlsocket( toSystem( handle ), FIONBIO, &enabled ) == 0;
+#else
+	int flags = fcntl( toSystem( handle ), F_GETFL, 0 );
+	return flags >= 0 && fcntl( toSystem( handle ), F_SETFL, flags | O_NONBLOCK ) == 0;
+#endif
+}
+
+bool setKeepAlive( socket_id handle, std::chrono::seconds idle, std::chrono::seconds interval ) noexcept
+{
+#ifdef _WIN32
+	// the number of probes is fixed to 10 since Windows Vista
+	tcp_keepalive settings;
+	settings.onoff = 1;
+	settings.keepalivetime = ULONG( std::chrono::milliseconds( idle ).count() );
+	settings.keepaliveinterval = ULONG( std::chrono::milliseconds( interval ).count() );
+	DWORD returned = 0;
+	return WSAIoctl( toSystem( handle ), SIO_KEEPALIVE_VALS, &settings, sizeof(settings), nullptr, 0, &returned, nullptr, nullptr ) == 0;
+#else
+	int enabled = 1;
+	if (setsockopt( toSystem( handle ), SOL_SOCKET, SO_KEEPALIVE, &enabled, sizeof(enabled) ) != 0)
+		return false;
+  #ifdef TCP_KEEPIDLE
+	int idle_s = int( idle.count() );
+	int interval_s = int( interval.count() );
+	int probes = 3;
+	return setsockopt( toSystem( handle ), IPPROTO_TCP, TCP_KEEPIDLE, &idle_s, sizeof(idle_s) ) == 0
+	    && setsockopt( toSystem( handle ), IPPROTO_TCP, TCP_KEEPINTVL, &interval_s, sizeof(interval_s) ) == 0
+	    && setsockopt( toSystem( handle ), IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes) ) == 0;
+  #else
+	return true;  // probing with the system defaults, which start after hours
+  #endif
+#endif
+}
+
+uint16_t getLocalPort( socket_id handle ) noexcept
+{
+	sockaddr_storage addr;
+	socklen_t addrLength = sizeof(addr);
+	if (getsockname( toSystem( handle ), (sockaddr *)&addr, &addrLength ) != 0)
+		return 0;
+	if (addr.ss_family == AF_INET)
+		return ntohs( ((const sockaddr_in *)&addr)->sin_port );
+	if (addr.ss_family == AF_INET6)
+		return ntohs( ((const sockaddr_in6 *)&addr)->sin6_port );
+	return 0;
+}
+
+SocketError sendAvailable( socket_id handle, own::const_byte_span data, size_t & sent, system_error_t & error ) noexcept
+{
+	sent = 0;
+	while (sent < data.size())
+	{
+		int chunkSize = int( std::min( data.size() - sent, size_t( 1 << 30 ) ) );
+		auto result = ::send( toSystem( handle ), (const char *)data.data() + sent, chunkSize, sendFlags );
+		if (result < 0)
+		{
+			error = lastSocketError();
+			if (isWouldBlock( error ))
+				return SocketError::Success;  // the system buffer is full, the rest has to wait
+			else if (isConnectionBroken( error ))
+				return SocketError::ConnectionClosed;
+			else
+				return SocketError::Other;
+		}
+		sent += size_t( result );
+	}
+	return SocketError::Success;
+}
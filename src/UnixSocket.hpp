@@ -0,0 +1,138 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: stream sockets in the AF_UNIX family, for the clients running on the same machine
+//======================================================================================================================
+
+#ifndef UNIX_SOCKET_INCLUDED
+#define UNIX_SOCKET_INCLUDED
+
+
+#include <CppUtils-Network/Socket.hpp>  // SocketError, socket_id, system_error_t
+#include <CppUtils-Essential/Span.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <chrono>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Prefix of an address that denotes a path of a Unix domain socket instead of a host name.
+extern const char * const unixAddressPrefix;
+
+/// Connected stream socket in the AF_UNIX family. The methods mirror those of own::TcpSocket,
+/// so that the code serving or using a connection doesn't need to care which of the two it is.
+/** Windows supports AF_UNIX since Windows 10 version 1803. The socket is a file in the file system,
+  * its access rights decide who can connect, which is the only access control this transport has. */
+class UnixSocket
+{
+ public:
+
+	UnixSocket() noexcept;
+	~UnixSocket() noexcept;
+
+	UnixSocket( const UnixSocket & other ) = delete;
+	UnixSocket( UnixSocket && other ) noexcept;
+	UnixSocket & operator=( const UnixSocket & other ) = delete;
+	UnixSocket & operator=( UnixSocket && other ) noexcept;
+
+	own::SocketError connect( const std::string & path ) noexcept;
+	own::SocketError disconnect() noexcept;
+	bool isConnected() const noexcept  { return _handle != invalidHandle; }
+	explicit operator bool() const noexcept  { return isConnected(); }
+
+	/// Applies to both sending and receiving, zero means no timeout.
+	bool setTimeout( std::chrono::milliseconds timeout ) noexcept;
+
+	/// Sends all of the data, blocks until they are all written into the system buffer.
+	own::SocketError send( own::const_byte_span data ) noexcept;
+	/// Receives whatever is available, at least 1 byte, and resizes the buffer to the received size.
+	own::SocketError receiveOnce( std::vector< uint8_t > & buffer ) noexcept;
+	/// Receives whatever is available, at most buffer.size() bytes.
+	own::SocketError receiveOnce( own::byte_span buffer, size_t & received ) noexcept;
+
+	own::socket_id getSystemHandle() const noexcept  { return _handle; }
+	own::system_error_t getLastSystemError() const noexcept  { return _lastSystemError; }
+
+	static const own::socket_id invalidHandle;
+
+ private:
+
+	friend class UnixServerSocket;
+	explicit UnixSocket( own::socket_id handle ) noexcept : _handle( handle ), _lastSystemError( 0 ) {}
+
+	own::socket_id _handle;
+	own::system_error_t _lastSystemError;
+
+};
+
+/// Listening stream socket in the AF_UNIX family, bound to a path in the file system.
+class UnixServerSocket
+{
+ public:
+
+	UnixServerSocket() noexcept;
+	~UnixServerSocket() noexcept;
+
+	UnixServerSocket( const UnixServerSocket & other ) = delete;
+	UnixServerSocket & operator=( const UnixServerSocket & other ) = delete;
+
+	/// Binds the socket to the path and starts listening. A file left at the path by a previous run is removed first.
+	own::SocketError open( const std::string & path ) noexcept;
+	/// Stops listening and removes the socket file.
+	void close() noexcept;
+	bool isOpen() const noexcept  { return _handle != UnixSocket::invalidHandle; }
+
+	/// Returns an invalid socket if the accept has failed.
+	UnixSocket accept() noexcept;
+
+	const std::string & path() const noexcept  { return _path; }
+	own::socket_id getSystemHandle() const noexcept  { return _handle; }
+	own::system_error_t getLastSystemError() const noexcept  { return _lastSystemError; }
+
+ private:
+
+	own::socket_id _handle;
+	std::string _path;
+	own::system_error_t _lastSystemError;
+
+};
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Same as own::waitForAny, except it takes the system handles, so that it can wait for the sockets of CppUtils
+/// together with the UnixSockets. Returns false if the wait has failed, readySockets is empty on timeout.
+bool waitForReadable(
+	const std::unordered_set< own::socket_id > & sockets, std::vector< own::socket_id > & readySockets, std::chrono::milliseconds timeout
+) noexcept;
+
+/// Same as waitForReadable, and in addition waits until one of writeSockets can take more data to send.
+/** A socket can be in both sets. The errors and hang-ups count as ready in both directions,
+  * the following receive or send will report them. */
+bool waitForSockets(
+	const std::unordered_set< own::socket_id > & readSockets, const std::unordered_set< own::socket_id > & writeSockets,
+	std::vector< own::socket_id > & readable, std::vector< own::socket_id > & writable, std::chrono::milliseconds timeout
+) noexcept;
+
+/// Switches a connected socket of any kind to the non-blocking mode, where send and receive never wait.
+bool setNonBlocking( own::socket_id handle ) noexcept;
+
+/// Makes the system probe a TCP connection that has been silent for the given time, so that a peer that has vanished
+/// without closing it, for example by a power loss or a pulled cable, turns into an error of the socket.
+bool setKeepAlive( own::socket_id handle, std::chrono::seconds idle, std::chrono::seconds interval ) noexcept;
+
+/// Returns the port the system has bound a TCP or UDP socket to, or 0 if it's not bound or it's not an IP socket.
+uint16_t getLocalPort( own::socket_id handle ) noexcept;
+
+/// Sends as much of the data as the system takes right away, without waiting for the rest.
+/** Returns Success even if nothing could be sent, sent is then 0. Any other result means the connection is broken,
+  * error is then the system error code. */
+own::SocketError sendAvailable( own::socket_id handle, own::const_byte_span data, size_t & sent, own::system_error_t & error ) noexcept;
+
+
+#endif // UNIX_SOCKET_INCLUDED
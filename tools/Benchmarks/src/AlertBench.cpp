@@ -0,0 +1,67 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: benchmarks of evaluating the alert rules after a sampling cycle
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include "AlertRule.hpp"
+
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+void runAlertBenchmarks( BenchmarkRunner & runner )
+{
+	runner.run( "alerts/parse_rule", [&]()
+	{
+		AlertRule rule;
+		doNotOptimize( parseAlertRule( "/amdcpu/0/temperature/2 > 85 hysteresis 5 for 10000", rule ) );
+	});
+
+	// what the sampling thread does after every cycle, the cost doesn't depend on how many clients wait for the alerts
+	vector< AlertTracker > trackers;
+	for (int i = 0; i < 1000; ++i)
+	{
+		AlertRule rule;
+		parseAlertRule( "/lpc/nct6798d/temperature/" + std::to_string( i ) + " > 80 hysteresis 5 for 2000", rule );
+		trackers.emplace_back( rule );
+	}
+
+	uint64_t timestamp_us = 0;
+	runner.run( "alerts/evaluate_cycle/1000", [&]()
+	{
+		// a slow oscillation across the threshold, so that some of the rules change the state
+		timestamp_us += 1000000;
+		size_t changed = 0;
+		for (size_t i = 0; i < trackers.size(); ++i)
+		{
+			float value = 70.0f + float( (timestamp_us / 1000000 + i) % 20 );
+			changed += trackers[i].update( value, timestamp_us ) ? 1 : 0;
+		}
+		doNotOptimize( changed );
+	});
+
+	AlertsResponse response( ResponseCode::Success );
+	response.lastEvent = 100;
+	response.isSnapshot = 0;
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		response.numbers.push_back( 85 + i );
+		response.rules.push_back( i );
+		response.states.push_back( i % 2 ? AlertState::Raised : AlertState::Cleared );
+		response.values.push_back( 85.5f );
+		response.timestamps_us.push_back( 123456789 );
+		response.sensorIDs.push_back( "/lpc/nct6798d/temperature/" + std::to_string( i ) );
+	}
+	runner.run( "alerts/encode_response/16", [&]()
+	{
+		doNotOptimize( own::toByteVector( response ) );
+	});
+}
@@ -0,0 +1,207 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: minimal microbenchmark harness measuring time and heap allocations per operation
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+using std::string;
+
+using Clock = std::chrono::steady_clock;
+
+
+//======================================================================================================================
+//  allocation counting
+
+// Counted per thread, so that helper threads (like the fake server of the client benchmarks)
+// don't pollute the numbers of the code being measured.
+static thread_local uint64_t g_allocationCount = 0;
+
+uint64_t allocationCount()
+{
+	return g_allocationCount;
+}
+
+void * operator new( size_t size )
+{
+	++g_allocationCount;
+	if (void * ptr = malloc( size ? size : 1 ))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void * operator new[]( size_t size )
+{
+	return operator new( size );
+}
+
+void operator delete( void * ptr ) noexcept
+{
+	free( ptr );
+}
+
+void operator delete[]( void * ptr ) noexcept
+{
+	free( ptr );
+}
+
+void operator delete( void * ptr, size_t ) noexcept
+{
+	free( ptr );
+}
+
+void operator delete[]( void * ptr, size_t ) noexcept
+{
+	free( ptr );
+}
+
+
+//======================================================================================================================
+//  runner
+
+static const void * volatile g_sink = nullptr;
+
+void escape( const void * ptr )
+{
+	g_sink = ptr;
+}
+
+bool BenchmarkRunner::isSelected( const string & name ) const
+{
+	return _filter.empty() || name.find( _filter ) != string::npos;
+}
+
+void BenchmarkRunner::run( const string & name, const std::function< void () > & operation )
+{
+	if (!isSelected( name ))
+		return;
+
+	// warm up the caches and let lazily initialized things initialize
+	for (int i = 0; i < 10; ++i)
+		operation();
+
+	// grow the batch size until a single batch takes long enough to make the clock resolution irrelevant
+	uint64_t batchSize = 1;
+	uint64_t iterations = 0;
+	uint64_t allocations = 0;
+	Clock::duration elapsed( 0 );
+	while (elapsed < _minTime)
+	{
+		uint64_t allocsBefore = allocationCount();
+		auto start = Clock::now();
+		for (uint64_t i = 0; i < batchSize; ++i)
+			operation();
+		auto batchTime = Clock::now() - start;
+		allocations += allocationCount() - allocsBefore;
+
+		iterations += batchSize;
+		elapsed += batchTime;
+		if (batchTime < _minTime / 10)
+			batchSize *= 2;
+	}
+
+	record({ name, iterations,
+		double( std::chrono::duration_cast< std::chrono::nanoseconds >( elapsed ).count() ) / double( iterations ),
+		double( allocations ) / double( iterations )
+	});
+}
+
+void BenchmarkRunner::record( const BenchmarkResult & result )
+{
+	if (!isSelected( result.name ))
+		return;
+
+	_results.push_back( result );
+	fprintf( stderr, "%-56s %12.1f ns/op %10.2f allocs/op %12llu iterations\n",
+		result.name.c_str(), result.nsPerOp, result.allocsPerOp, (unsigned long long)result.iterations );
+	fflush( stderr );
+}
+
+void BenchmarkRunner::check( const string & name, bool passed, const string & details )
+{
+	if (!isSelected( name ))
+		return;
+
+	if (!passed)
+		++_failedChecks;
+	fprintf( stderr, "%-56s %-6s %s\n", name.c_str(), passed ? "ok" : "FAILED", details.c_str() );
+	fflush( stderr );
+}
+
+void BenchmarkRunner::printTable() const
+{
+	printf( "\n%-56s %15s %17s\n", "benchmark", "ns/op", "allocs/op" );
+	for (const BenchmarkResult & result : _results)
+		printf( "%-56s %15.1f %17.2f\n", result.name.c_str(), result.nsPerOp, result.allocsPerOp );
+}
+
+void BenchmarkRunner::printJson() const
+{
+	printf( "[\n" );
+	for (size_t i = 0; i < _results.size(); ++i)
+	{
+		const BenchmarkResult & result = _results[i];
+		printf( "  { \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f }%s\n",
+			result.name.c_str(), (unsigned long long)result.iterations, result.nsPerOp, result.allocsPerOp,
+			i + 1 < _results.size() ? "," : "" );
+	}
+	printf( "]\n" );
+}
+
+
+//======================================================================================================================
+
+int main( int argc, char * argv [] )
+{
+	string filter;
+	bool json = false;
+	unsigned minTime_ms = 300;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp( argv[i], "--json" ) == 0)
+			json = true;
+		else if (strcmp( argv[i], "--min-time" ) == 0 && i + 1 < argc)
+			minTime_ms = unsigned( atoi( argv[++i] ) );
+		else if (strcmp( argv[i], "--filter" ) == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else
+		{
+			printf( "Usage: benchmarks [--filter <substring>] [--min-time <ms>] [--json]\n" );
+			return 1;
+		}
+	}
+
+	BenchmarkRunner runner( filter, std::chrono::milliseconds( minTime_ms ) );
+
+	runProtocolBenchmarks( runner );
+	runConfigBenchmarks( runner );
+	runLookupBenchmarks( runner );
+	runPatternBenchmarks( runner );
+	runExpressionBenchmarks( runner );
+	runAlertBenchmarks( runner );
+	runStatisticsBenchmarks( runner );
+	runPercentileBenchmarks( runner );
+	runHistoryBenchmarks( runner );
+	runSimdBenchmarks( runner );
+	runClientBenchmarks( runner );
+
+	if (json)
+		runner.printJson();
+	else
+		runner.printTable();
+
+	if (!runner.allChecksPassed())
+	{
+		fprintf( stderr, "\nSome of the checks have FAILED\n" );
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,106 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: minimal microbenchmark harness measuring time and heap allocations per operation
+//======================================================================================================================
+
+#ifndef BENCHMARK_INCLUDED
+#define BENCHMARK_INCLUDED
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Number of heap allocations made by the calling thread so far. Counted by the replaced global operator new.
+uint64_t allocationCount();
+
+/// Opaque function in another translation unit, the compiler must assume it reads the pointed object.
+void escape( const void * ptr );
+
+/// Prevents the compiler from optimizing away a computation whose result is otherwise unused.
+template< typename T >
+inline void doNotOptimize( const T & value )
+{
+	escape( &value );
+}
+
+/// Deterministic pseudo-random numbers, so that every run measures and checks the same values.
+struct Noise
+{
+	uint32_t state = 12345;
+
+	uint32_t nextBits()
+	{
+		state = state * 1664525 + 1013904223;
+		return state;
+	}
+
+	float next()  ///< uniform in [0, 1)
+	{
+		return float( nextBits() >> 8 ) / float( 1 << 24 );
+	}
+};
+
+struct BenchmarkResult
+{
+	std::string name;
+	uint64_t iterations;
+	double nsPerOp;
+	double allocsPerOp;
+};
+
+class BenchmarkRunner
+{
+ public:
+
+	BenchmarkRunner( const std::string & filter, std::chrono::milliseconds minTime ) : _filter( filter ), _minTime( minTime ) {}
+
+	/// Runs the operation repeatedly until the minimum time elapses and records the averages.
+	/** Benchmarks whose name doesn't contain the filter are skipped. */
+	void run( const std::string & name, const std::function< void () > & operation );
+
+	/// Records a custom measurement that doesn't fit the run() pattern, for example a whole batch processed at once.
+	void record( const BenchmarkResult & result );
+
+	bool isSelected( const std::string & name ) const;
+
+	/// Records the outcome of a correctness check made alongside the benchmarks, a failed one fails the whole run.
+	/** Skipped by the filter just like the benchmarks. */
+	void check( const std::string & name, bool passed, const std::string & details );
+
+	bool allChecksPassed() const { return _failedChecks == 0; }
+
+	void printTable() const;
+	void printJson() const;
+
+ private:
+
+	std::string _filter;
+	std::chrono::milliseconds _minTime;
+	std::vector< BenchmarkResult > _results;
+	unsigned _failedChecks = 0;
+
+};
+
+// every group of benchmarks lives in its own file
+void runProtocolBenchmarks( BenchmarkRunner & runner );
+void runConfigBenchmarks( BenchmarkRunner & runner );
+void runLookupBenchmarks( BenchmarkRunner & runner );
+void runPatternBenchmarks( BenchmarkRunner & runner );
+void runExpressionBenchmarks( BenchmarkRunner & runner );
+void runAlertBenchmarks( BenchmarkRunner & runner );
+void runStatisticsBenchmarks( BenchmarkRunner & runner );
+void runPercentileBenchmarks( BenchmarkRunner & runner );
+void runHistoryBenchmarks( BenchmarkRunner & runner );
+void runSimdBenchmarks( BenchmarkRunner & runner );
+void runClientBenchmarks( BenchmarkRunner & runner );
+
+
+#endif // BENCHMARK_INCLUDED
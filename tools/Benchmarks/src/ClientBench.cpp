@@ -0,0 +1,499 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: benchmarks of the request path of the C++ client against a fake in-process server
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include "Protocol.hpp"
+#include "UnixSocket.hpp"
+#include "UdpBatchSocket.hpp"
+#include <HwMonitorClient.hpp>
+#include <HwMonitorUdpClient.hpp>
+#include <HwMonitorMirror.hpp>
+
+#include <CppUtils-Network/Socket.hpp>
+using own::TcpServerSocket;
+using own::TcpSocket;
+using own::UdpSocket;
+using own::SocketError;
+using own::Endpoint;
+using own::socket_id;
+#include <CppUtils-Essential/BinaryStream.hpp>
+using own::toByteVector;
+#include <CppUtils-Essential/ContainerUtils.hpp>
+using own::make_span;
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+using std::string;
+using std::vector;
+
+using Clock = std::chrono::steady_clock;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static const uint16_t fakeServerPort = 27748;
+static const uint16_t fakeUdpServerPort = 27749;
+static const uint16_t fakeMirrorServerPort = 27750;
+static const char * const fakeServerPath = "hwmon-benchmark.sock";  // in the working directory
+
+static const string sensorID = "/lpc/nct6798d/0/temperature/3";
+
+// so that the request is received and answered by the fake server in one piece
+static const unsigned requestsPerBurst = 64;
+static const unsigned burstCount = 2000;
+// a new connection for every request, the way a script that reads a sensor now and then would do it
+static const unsigned oneShotCount = 2000;
+// calls of the request path whose heap allocations are counted
+static const unsigned allocationCheckCalls = 1000;
+// the same as the service
+static const size_t udpBatchSize = 64;
+// how long the fake server holds a wait request, as if the sampling cycle were this short
+static const std::chrono::milliseconds fakeCycle( 10 );
+
+static TcpSocket acceptClient( TcpServerSocket & server )
+{
+	Endpoint clientEndpoint;
+	return server.accept( clientEndpoint );
+}
+
+static UnixSocket acceptClient( UnixServerSocket & server )
+{
+	return server.accept();
+}
+
+static SocketError connectRaw( TcpSocket & socket )
+{
+	return socket.connect( "127.0.0.1", fakeServerPort );
+}
+
+static SocketError connectRaw( UnixSocket & socket )
+{
+	return socket.connect( fakeServerPath );
+}
+
+/// Runs the given number of iterations at once and records the time per iteration,
+/// for the benchmarks whose iterations are not independent, like those that need the fake server to expect them.
+template< typename Func >
+static void recordFixedCount( BenchmarkRunner & runner, const string & name, uint64_t iterations, Func && func )
+{
+	uint64_t allocsBefore = allocationCount();
+	auto start = Clock::now();
+	for (uint64_t i = 0; i < iterations; ++i)
+		func();
+	const auto elapsed = Clock::now() - start;
+	const uint64_t allocations = allocationCount() - allocsBefore;
+
+	runner.record({ name, iterations,
+		double( std::chrono::duration_cast< std::chrono::nanoseconds >( elapsed ).count() ) / double( iterations ),
+		double( allocations ) / double( iterations )
+	});
+}
+
+/// Makes the given number of calls after one call that lets the client grow its reused buffers, and checks that none
+/// of them allocates on the heap and all of them succeed, so that a regression fails the run rather than hides in the table.
+template< typename Func >
+static void checkNoAllocations( BenchmarkRunner & runner, const string & name, unsigned calls, Func && func )
+{
+	if (!runner.isSelected( name ))
+		return;
+
+	func();
+	unsigned failures = 0;
+	const uint64_t allocsBefore = allocationCount();
+	for (unsigned i = 0; i < calls; ++i)
+		failures += func().status != hwmon::RequestStatus::Success;
+	const uint64_t allocations = allocationCount() - allocsBefore;
+
+	runner.check( name, allocations == 0 && failures == 0,
+		std::to_string( allocations ) + " allocations and " + std::to_string( failures ) + " failures in " + std::to_string( calls ) + " calls" );
+}
+
+/// Fails the allocation checks of a transport that couldn't be benchmarked, a check that hasn't run must not pass silently.
+static void failSkippedChecks( BenchmarkRunner & runner, const string & prefix, const string & reason )
+{
+	for (const char * request : { "string", "prepared" })
+		runner.check( prefix + "requestSensorReading/" + request + "/noAllocations", false, "skipped, " + reason );
+}
+
+/// Answers every request with the same value, serves the given number of clients one after another,
+/// each until it disconnects.
+template< typename ServerSocket >
+static void serveFakeResponses( ServerSocket & server, unsigned clientCount )
+{
+	const vector< uint8_t > response = toByteVector( SensorResponse( ResponseCode::Success, 42.0f ) );
+
+	for (unsigned i = 0; i < clientCount; ++i)
+	{
+		auto client = acceptClient( server );
+		if (!client)
+			return;
+
+		// every request ends with exactly one null character, so counting them works even if a request is split
+		vector< uint8_t > received;
+		vector< uint8_t > responses;
+		while (client.receiveOnce( received ) == SocketError::Success)
+		{
+			auto requestCount = std::count( received.begin(), received.end(), uint8_t(0) );
+			responses.clear();
+			for (ptrdiff_t j = 0; j < requestCount; ++j)
+				responses.insert( responses.end(), response.begin(), response.end() );
+			client.send( make_span( responses.data(), responses.size() ) );
+		}
+	}
+}
+
+/// Round trips of the client and bursts of pipelined requests over a raw socket of the same kind.
+template< typename ServerSocket, typename Socket >
+static void benchmarkTransport( BenchmarkRunner & runner, const string & transport, ServerSocket & server, const string & host )
+{
+	const string prefix = "client/" + transport + "/";
+	const string oneShotName = prefix + "oneShot";
+	const bool oneShotSelected = runner.isSelected( oneShotName );
+
+	// the client first, then the raw socket, then the one-shot clients
+	std::thread serverThread( serveFakeResponses< ServerSocket >, std::ref( server ), 2 + (oneShotSelected ? oneShotCount : 0) );
+
+	hwmon::Client client;
+	if (client.connect( host, fakeServerPort ) != hwmon::ConnectStatus::Success)
+	{
+		failSkippedChecks( runner, prefix, "cannot connect to the fake server" );
+		server.close();
+		serverThread.join();
+		return;
+	}
+
+	// The round trip is what a client pays for every request, the difference between the transports shows here.
+	// The other interesting column is allocs/op, which must be 0 for the prepared request
+	// and for repeated reads by string_view, the noAllocations checks below fail the run otherwise.
+	runner.run( prefix + "requestSensorReading/string", [&]()
+	{
+		hwmon::SensorReadResult result = client.requestSensorReading( sensorID );
+		doNotOptimize( result );
+	});
+
+	const hwmon::PreparedRequest prepared( sensorID );
+	runner.run( prefix + "requestSensorReading/prepared", [&]()
+	{
+		hwmon::SensorReadResult result = client.requestSensorReading( prepared );
+		doNotOptimize( result );
+	});
+
+	checkNoAllocations( runner, prefix + "requestSensorReading/string/noAllocations", allocationCheckCalls, [&]()
+	{
+		return client.requestSensorReading( sensorID );
+	});
+	checkNoAllocations( runner, prefix + "requestSensorReading/prepared/noAllocations", allocationCheckCalls, [&]()
+	{
+		return client.requestSensorReading( prepared );
+	});
+
+	client.disconnect();
+
+	// Many requests in flight at once, limited by the throughput of the transport rather than by its latency.
+	Socket socket;
+	if (connectRaw( socket ) != SocketError::Success)
+	{
+		fprintf( stderr, "%s throughput benchmark skipped, cannot connect to the fake server\n", transport.c_str() );
+		server.close();
+		serverThread.join();
+		return;
+	}
+	const string burstName = prefix + "pipelined/" + std::to_string( requestsPerBurst );
+	if (runner.isSelected( burstName ))
+	{
+		vector< uint8_t > requests;
+		for (unsigned i = 0; i < requestsPerBurst; ++i)
+			requests.insert( requests.end(), prepared.bytes().begin(), prepared.bytes().end() );
+		vector< uint8_t > responses( requestsPerBurst * SensorResponse::size() );
+
+		bool failed = false;
+		uint64_t allocsBefore = allocationCount();
+		auto start = Clock::now();
+		for (unsigned burst = 0; burst < burstCount && !failed; ++burst)
+		{
+			failed = socket.send( make_span( requests.data(), requests.size() ) ) != SocketError::Success;
+			for (size_t receivedTotal = 0; receivedTotal < responses.size() && !failed; )
+			{
+				size_t received = 0;
+				failed = socket.receiveOnce( make_span( responses.data() + receivedTotal, responses.size() - receivedTotal ), received )
+				         != SocketError::Success;
+				receivedTotal += received;
+			}
+		}
+		const auto elapsed = Clock::now() - start;
+		const uint64_t allocations = allocationCount() - allocsBefore;
+
+		if (failed)
+		{
+			fprintf( stderr, "%s throughput benchmark failed, the fake server stopped answering\n", transport.c_str() );
+		}
+		else
+		{
+			// per request, so that it can be compared with the round trips above
+			const uint64_t requestCount = uint64_t( burstCount ) * requestsPerBurst;
+			runner.record({ burstName, requestCount,
+				double( std::chrono::duration_cast< std::chrono::nanoseconds >( elapsed ).count() ) / double( requestCount ),
+				double( allocations ) / double( requestCount )
+			});
+		}
+	}
+	socket.disconnect();
+
+	// Connecting costs more than the request itself, this is what the connectionless requests save.
+	if (oneShotSelected)
+	{
+		recordFixedCount( runner, oneShotName, oneShotCount, [&]()
+		{
+			hwmon::Client oneShotClient;
+			oneShotClient.connect( host, fakeServerPort );
+			hwmon::SensorReadResult result = oneShotClient.requestSensorReading( prepared );
+			doNotOptimize( result );
+		});
+	}
+
+	serverThread.join();
+}
+
+/// Answers every datagram with the same value, in batches like the service does, until stopped.
+/** Like the service, it copies the request ID that follows the request to the end of the reply. */
+static void serveFakeDatagrams( UdpBatchSocket & server, const std::atomic< bool > & stop )
+{
+	const vector< uint8_t > response = toByteVector( SensorResponse( ResponseCode::Success, 42.0f ) );
+	const size_t requestSize = SensorRequest::size( sensorID );
+
+	while (!stop)
+	{
+		vector< socket_id > readable;
+		if (!waitForReadable( { server.getSystemHandle() }, readable, std::chrono::milliseconds( 100 ) ))
+			continue;
+		for (size_t count = udpBatchSize; count == udpBatchSize; )
+		{
+			count = server.receiveBatch();
+			for (size_t i = 0; i < count; ++i)
+			{
+				const own::const_byte_span request = server.request( i );
+				vector< uint8_t > & reply = server.reply( i );
+				reply = response;
+				if (request.size() == requestSize + datagramRequestIDSize)
+					reply.insert( reply.end(), request.data() + requestSize, request.data() + request.size() );
+			}
+			server.sendReplies();
+		}
+	}
+}
+
+/// Round trips of the connectionless client and bursts of datagrams sent before their replies are received.
+static void benchmarkDatagrams( BenchmarkRunner & runner, UdpBatchSocket & server )
+{
+	std::atomic< bool > stop( false );
+	std::thread serverThread( serveFakeDatagrams, std::ref( server ), std::cref( stop ) );
+
+	hwmon::UdpClient client;
+	if (client.open( "127.0.0.1", fakeUdpServerPort ) == hwmon::ConnectStatus::Success)
+	{
+		// no connection to set up, but the system still has to route every datagram separately
+		runner.run( "client/udp/requestSensorReading/string", [&]()
+		{
+			hwmon::SensorReadResult result = client.requestSensorReading( sensorID );
+			doNotOptimize( result );
+		});
+
+		const hwmon::PreparedRequest prepared( sensorID );
+		runner.run( "client/udp/requestSensorReading/prepared", [&]()
+		{
+			hwmon::SensorReadResult result = client.requestSensorReading( prepared );
+			doNotOptimize( result );
+		});
+
+		checkNoAllocations( runner, "client/udp/requestSensorReading/string/noAllocations", allocationCheckCalls, [&]()
+		{
+			return client.requestSensorReading( sensorID );
+		});
+		checkNoAllocations( runner, "client/udp/requestSensorReading/prepared/noAllocations", allocationCheckCalls, [&]()
+		{
+			return client.requestSensorReading( prepared );
+		});
+
+		client.close();
+
+		// compare with client/tcp/oneShot, there is nothing to set up here
+		runner.run( "client/udp/oneShot", [&]()
+		{
+			hwmon::UdpClient oneShotClient;
+			oneShotClient.open( "127.0.0.1", fakeUdpServerPort );
+			hwmon::SensorReadResult result = oneShotClient.requestSensorReading( prepared );
+			doNotOptimize( result );
+		});
+
+		// Compare with client/tcp/pipelined, here the server receives and answers up to udpBatchSize requests
+		// per system call instead of reading them from one stream.
+		const string burstName = "client/udp/pipelined/" + std::to_string( requestsPerBurst );
+		UdpSocket socket;
+		if (runner.isSelected( burstName ) && socket.open() == SocketError::Success)
+		{
+			const Endpoint serverEndpoint = { {127,0,0,1}, fakeUdpServerPort };
+			uint8_t response [SensorResponse::size()];
+
+			bool failed = false;
+			uint64_t allocsBefore = allocationCount();
+			auto start = Clock::now();
+			for (unsigned burst = 0; burst < burstCount && !failed; ++burst)
+			{
+				for (unsigned i = 0; i < requestsPerBurst && !failed; ++i)
+					failed = socket.sendTo( serverEndpoint, make_span( prepared.bytes().data(), prepared.bytes().size() ) ) != SocketError::Success;
+				for (unsigned i = 0; i < requestsPerBurst && !failed; ++i)
+				{
+					Endpoint from;
+					size_t received = 0;
+					// the loopback doesn't lose datagrams unless a buffer overflows, which 64 small ones can't do
+					failed = socket.recvFrom( from, make_span( response, sizeof(response) ), received ) != SocketError::Success;
+				}
+			}
+			const auto elapsed = Clock::now() - start;
+			const uint64_t allocations = allocationCount() - allocsBefore;
+			socket.close();
+
+			if (failed)
+			{
+				fprintf( stderr, "udp throughput benchmark failed, the fake server stopped answering\n" );
+			}
+			else
+			{
+				const uint64_t requestCount = uint64_t( burstCount ) * requestsPerBurst;
+				runner.record({ burstName, requestCount,
+					double( std::chrono::duration_cast< std::chrono::nanoseconds >( elapsed ).count() ) / double( requestCount ),
+					double( allocations ) / double( requestCount )
+				});
+			}
+		}
+	}
+	else
+	{
+		failSkippedChecks( runner, "client/udp/", "cannot open the client socket" );
+	}
+
+	stop = true;
+	serverThread.join();
+}
+
+/// Answers every changes or wait request of one client with a new sample of the first sensor, the wait requests
+/// only after fakeCycle, like the service at the end of its sampling cycle. Serves until the client disconnects.
+static void serveFakeCycles( TcpServerSocket & server )
+{
+	auto client = acceptClient( server );
+	if (!client)
+		return;
+
+	// the mirror sends the next request only after it gets the response, so every one is received in one piece
+	vector< uint8_t > received;
+	for (uint32_t seq = 1; client.receiveOnce( received ) == SocketError::Success; ++seq)
+	{
+		if (received.size() >= 4 && memcmp( received.data(), "WAIT", 4 ) == 0)
+			std::this_thread::sleep_for( fakeCycle );
+
+		ChangesResponse response( ResponseCode::Success );
+		response.seq = seq;
+		response.indexes = { 0 };
+		response.codes = { ResponseCode::Success };
+		response.values = { 42.0f };
+		response.seqs = { seq };
+		response.timestamps_us = { uint64_t( std::chrono::duration_cast< std::chrono::microseconds >( Clock::now().time_since_epoch() ).count() ) };
+		const vector< uint8_t > bytes = toByteVector( response );
+		client.send( make_span( bytes.data(), bytes.size() ) );
+	}
+}
+
+/// Reads of the local copy kept in sync by the mirror, compare them with client/tcp/requestSensorReading.
+static void benchmarkMirror( BenchmarkRunner & runner, TcpServerSocket & server )
+{
+	std::thread serverThread( serveFakeCycles, std::ref( server ) );
+
+	hwmon::Mirror mirror({ sensorID });
+	mirror.start( "127.0.0.1", fakeMirrorServerPort );
+	const auto deadline = Clock::now() + std::chrono::seconds( 2 );
+	while (mirror.lastCycle() == 0 && Clock::now() < deadline)
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+
+	const size_t index = mirror.indexOf( sensorID );
+	const hwmon::MirroredValue synced = mirror.read( index );
+	runner.check( "client/mirror/synced", synced.status == hwmon::RequestStatus::Success && synced.sensorValue == 42.0f,
+		string( "status " ) + enumString( synced.status ) + ", age " + std::to_string( synced.age.count() ) + " us" );
+
+	// Only a few atomic loads and a look at the clock, the background thread keeps writing the same value meanwhile.
+	runner.run( "client/mirror/read/index", [&]()
+	{
+		hwmon::MirroredValue value = mirror.read( index );
+		doNotOptimize( value );
+	});
+
+	runner.run( "client/mirror/read/id", [&]()
+	{
+		hwmon::MirroredValue value = mirror.read( std::string_view( sensorID ) );
+		doNotOptimize( value );
+	});
+
+	mirror.stop();
+	server.close();
+	serverThread.join();
+}
+
+void runClientBenchmarks( BenchmarkRunner & runner )
+{
+	if (!runner.isSelected( "client/" ))
+		return;
+
+	TcpServerSocket tcpServer;
+	if (tcpServer.open( fakeServerPort ) == SocketError::Success)
+	{
+		benchmarkTransport< TcpServerSocket, TcpSocket >( runner, "tcp", tcpServer, "127.0.0.1" );
+		tcpServer.close();
+	}
+	else
+	{
+		failSkippedChecks( runner, "client/tcp/", "cannot open port " + std::to_string( fakeServerPort ) );
+	}
+
+	UnixServerSocket unixServer;
+	if (unixServer.open( fakeServerPath ) == SocketError::Success)
+	{
+		benchmarkTransport< UnixServerSocket, UnixSocket >( runner, "unix", unixServer, string( unixAddressPrefix ) + fakeServerPath );
+		unixServer.close();
+	}
+	else
+	{
+		failSkippedChecks( runner, "client/unix/", string( "cannot open " ) + fakeServerPath
+			+ " (error code = " + std::to_string( int( unixServer.getLastSystemError() ) ) + ")" );
+	}
+
+	UdpBatchSocket udpServer( udpBatchSize, maxDatagramSize );
+	if (udpServer.open( fakeUdpServerPort ) == SocketError::Success)
+	{
+		benchmarkDatagrams( runner, udpServer );
+		udpServer.close();
+	}
+	else
+	{
+		failSkippedChecks( runner, "client/udp/", "cannot open port " + std::to_string( fakeUdpServerPort ) );
+	}
+
+	TcpServerSocket mirrorServer;
+	if (mirrorServer.open( fakeMirrorServerPort ) == SocketError::Success)
+	{
+		benchmarkMirror( runner, mirrorServer );
+	}
+	else
+	{
+		runner.check( "client/mirror/synced", false, "skipped, cannot open port " + std::to_string( fakeMirrorServerPort ) );
+	}
+}
@@ -0,0 +1,57 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: benchmarks of the configuration parser
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include "Config.hpp"
+
+#include <string>
+#include <sstream>
+#include <cstdio>
+using std::string;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static string makeConfigText( size_t sensorCount )
+{
+	std::ostringstream oss;
+	oss << "refresh_interval = 2000\n";
+	oss << "monitored_sensors = \n[\n";
+	for (size_t i = 0; i < sensorCount; ++i)
+	{
+		oss << "\t\"/lpc/nct6798d/" << i / 16 << "/temperature/" << i % 16 << '"' << (i + 1 < sensorCount ? "," : "") << '\n';
+	}
+	oss << "]\n";
+	oss << "port = 17748\n";
+	oss << "max_connected_clients = 10\n";
+	oss << "log_level = debug\n";
+	oss << "log_to_udp_socket = true\n";
+	oss << "log_port = 28524\n";
+	return oss.str();
+}
+
+void runConfigBenchmarks( BenchmarkRunner & runner )
+{
+	for (size_t sensorCount : { 2, 100, 10000 })
+	{
+		const string text = makeConfigText( sensorCount );
+		const string name = "config/parseConfig/" + std::to_string( sensorCount ) + "_sensors";
+
+		runner.run( name, [&]()
+		{
+			std::istringstream stream( text );
+			Config config;
+			string error = parseConfig( stream, config );
+			if (!error.empty())
+			{
+				fprintf( stderr, "%s: %s\n", name.c_str(), error.c_str() );
+			}
+			doNotOptimize( config );
+		});
+	}
+}
@@ -0,0 +1,58 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: benchmarks of compiling and evaluating the formulas of derived sensors
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include "SensorExpression.hpp"
+
+#include <string>
+using std::string;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static void addSensor( SensorDataMap & sensorData, const string & sensorID, float value )
+{
+	auto inserted = sensorData.try_emplace( sensorID, SensorState::Monitored );
+	inserted.first->second.sample.store({ value, 1, 1 });
+}
+
+void runExpressionBenchmarks( BenchmarkRunner & runner )
+{
+	// a workstation with a 16-core CPU, 8 drives and a GPU
+	SensorDataMap sensorData;
+	for (int i = 0; i < 16; ++i)
+		addSensor( sensorData, "/amdcpu/0/temperature/" + std::to_string( i ), 40.0f + float( i ) );
+	for (int i = 0; i < 8; ++i)
+		addSensor( sensorData, "/hdd/" + std::to_string( i ) + "/temperature/0", 30.0f + float( i ) );
+	addSensor( sensorData, "/gpu-nvidia/0/temperature/0", 65.0f );
+	addSensor( sensorData, "/lpc/nct6798d/temperature/1", 28.0f );
+
+	static const struct { const char * name; const char * text; } formulas [] =
+	{
+		{ "hottest_core",  "max(/amdcpu/0/temperature/*)" },
+		{ "avg_drives",    "avg(/hdd/*/temperature/0)" },
+		{ "gpu_over_room", "/gpu-nvidia/0/temperature/0 - /lpc/nct6798d/temperature/1" },
+	};
+
+	for (const auto & formula : formulas)
+	{
+		runner.run( string( "derived/compile/" ) + formula.name, [&]()
+		{
+			SensorExpression expression;
+			doNotOptimize( expression.compile( formula.text ) );
+		});
+
+		SensorExpression expression;
+		expression.compile( formula.text );
+		expression.link( sensorData );
+		runner.run( string( "derived/evaluate/" ) + formula.name, [&]()
+		{
+			doNotOptimize( expression.evaluate() );
+		});
+	}
+}
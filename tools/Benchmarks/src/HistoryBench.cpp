@@ -0,0 +1,150 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: compression ratio and throughput of the compressed history of the sensors
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include "SampleHistory.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+using Clock = std::chrono::steady_clock;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+struct TraceSample
+{
+	uint64_t timestamp_us;
+	float value;
+};
+
+/// A day of readings every 100 ms with a few milliseconds of scheduling jitter, shaped like the sensors of a real PC.
+static vector< TraceSample > generateTrace( const string & kind )
+{
+	const size_t count = 24 * 3600 * 10;
+	Noise noise;
+	vector< TraceSample > trace;
+	trace.reserve( count );
+
+	float level = kind == "temperature" ? 45.0f : kind == "fan" ? 1200.0f : 1.2f;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const uint64_t timestamp_us = 1000000 + i * 100000 + uint64_t( noise.next() * 3000.0f );
+		float value;
+		if (kind == "temperature")  // slowly drifting in the 1/8 degree steps the CPUs report
+		{
+			const float step = noise.next();
+			if (step < 0.03f && level > 30.0f)
+				level -= 0.125f;
+			else if (step > 0.97f && level < 90.0f)
+				level += 0.125f;
+			value = level;
+		}
+		else if (kind == "fan")     // whole RPM jumping around the target speed
+		{
+			value = std::round( level + 40.0f * (noise.next() - 0.5f) );
+		}
+		else if (kind == "voltage") // a few levels of the voltage regulator
+		{
+			if (noise.next() < 0.05f)
+				level = 1.0f + 0.0125f * std::floor( noise.next() * 32.0f );
+			value = level;
+		}
+		else                        // load as a noisy percentage, the worst case, every reading is different
+		{
+			value = 100.0f * noise.next();
+		}
+		trace.push_back({ timestamp_us, value });
+	}
+	return trace;
+}
+
+void runHistoryBenchmarks( BenchmarkRunner & runner )
+{
+	for (const char * kind : { "temperature", "fan", "voltage", "load" })
+	{
+		const string compressionName = string( "history/compression/" ) + kind;
+		const string decodeName = string( "history/decode/" ) + kind;
+		if (!runner.isSelected( compressionName ) && !runner.isSelected( decodeName ))
+			continue;
+
+		const vector< TraceSample > trace = generateTrace( kind );
+		SampleHistory history( 24 * 3600 * 1000 );
+		for (const TraceSample & sample : trace)
+			history.add( sample.value, sample.timestamp_us );
+
+		// the history must give back exactly what it was given, only the timestamps are rounded to milliseconds
+		size_t decoded = 0;
+		bool exact = true;
+		history.scan( 0, UINT64_MAX, [&]( const HistoryChunk & chunk )
+		{
+			for (size_t i = 0; i < chunk.count && decoded < trace.size(); ++i, ++decoded)
+			{
+				exact = exact && chunk.timestamps_ms[i] == trace[ decoded ].timestamp_us / 1000
+				              && memcmp( &chunk.values[i], &trace[ decoded ].value, sizeof(float) ) == 0;
+			}
+		});
+		exact = exact && decoded == trace.size();
+
+		// compared with a timestamp and a value, each in 8 bytes, as a naive history would store them
+		const double bytesPerSample = double( history.memoryUsage() ) / double( trace.size() );
+		const double allowedBytesPerSample = strcmp( kind, "temperature" ) == 0 ? 1.5 : strcmp( kind, "load" ) == 0 ? 6.0 : 3.0;
+		char details [128];
+		snprintf( details, sizeof(details), "%.2f bytes/sample, %.1fx smaller than raw, %.1f MB per week%s",
+			bytesPerSample, 16.0 / bytesPerSample, bytesPerSample * 7 * 24 * 3600 * 10 / 1e6, exact ? "" : ", DECODED DIFFERENTLY" );
+		runner.check( compressionName, exact && bytesPerSample <= allowedBytesPerSample, details );
+
+		if (runner.isSelected( decodeName ))
+		{
+			// streaming the whole day through a consumer that only sums it up, per decoded reading
+			const int repetitions = 5;
+			double sum = 0.0;
+			uint64_t allocsBefore = allocationCount();
+			auto start = Clock::now();
+			for (int r = 0; r < repetitions; ++r)
+			{
+				history.scan( 0, UINT64_MAX, [&]( const HistoryChunk & chunk )
+				{
+					for (size_t i = 0; i < chunk.count; ++i)
+						sum += chunk.values[i];
+				});
+			}
+			const auto elapsed = Clock::now() - start;
+			const uint64_t allocations = allocationCount() - allocsBefore;
+			doNotOptimize( sum );
+
+			const uint64_t samples = uint64_t( repetitions ) * trace.size();
+			runner.record({ decodeName, samples,
+				double( std::chrono::duration_cast< std::chrono::nanoseconds >( elapsed ).count() ) / double( samples ),
+				double( allocations ) / double( samples )
+			});
+		}
+	}
+
+	{
+		const vector< TraceSample > trace = generateTrace( "temperature" );
+		SampleHistory history( 3600 * 1000 );  // short, so that the benchmark also drops the old blocks
+		size_t i = 0;
+		uint64_t offset_us = 0;
+		runner.run( "history/add", [&]()
+		{
+			const TraceSample & sample = trace[ i++ ];
+			history.add( sample.value, sample.timestamp_us + offset_us );
+			if (i == trace.size())
+			{
+				i = 0;
+				offset_us += trace.back().timestamp_us;
+			}
+		});
+	}
+}
@@ -0,0 +1,104 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: benchmarks of looking up sensors in the service's sensor table
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include "SensorData.hpp"
+#include "SensorIndex.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+using std::string;
+using std::vector;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+void runLookupBenchmarks( BenchmarkRunner & runner )
+{
+	for (size_t sensorCount : { 100, 10000 })
+	{
+		for (bool longIDs : { false, true })
+		{
+			// the same shape as the IDs from LHWM, optionally with a long hardware identifier in the middle
+			const string infix = longIDs ? "/SAMSUNG_MZVL21T0HCLR-00B00_S676NF0R123456_" + string( 100, 'x' ) : "";
+
+			SensorDataMap sensorData;
+			vector< string > presentIDs;
+			vector< string > missingIDs;
+			for (size_t i = 0; i < sensorCount; ++i)
+			{
+				string sensorID = "/lpc/nct6798d" + infix + "/" + std::to_string( i / 16 ) + "/temperature/" + std::to_string( i % 16 );
+				sensorData.try_emplace( sensorID, SensorState::Monitored, "Temperature #" + std::to_string( i ), "Temperature" );
+				presentIDs.push_back( sensorID );
+				missingIDs.push_back( sensorID + "/missing" );
+			}
+
+			const string suffix = std::to_string( sensorCount ) + (longIDs ? "/long_ids" : "/short_ids");
+
+			size_t idx = 0;
+			runner.run( "lookup/hit/" + suffix, [&]()
+			{
+				auto iter = sensorData.find( presentIDs[ idx++ % presentIDs.size() ] );
+				SensorSample sample = iter->second.sample.load();
+				doNotOptimize( sample );
+			});
+
+			idx = 0;
+			runner.run( "lookup/miss/" + suffix, [&]()
+			{
+				bool found = sensorData.find( missingIDs[ idx++ % missingIDs.size() ] ) != sensorData.end();
+				doNotOptimize( found );
+			});
+		}
+	}
+
+	// browsing the catalog page by page, like a UI would
+	for (size_t sensorCount : { 1000, 50000 })
+	{
+		auto sensorData = std::make_shared< SensorDataMap >();
+		for (size_t i = 0; i < sensorCount; ++i)
+		{
+			string sensorID = "/lpc/nct6798d/" + std::to_string( i / 16 ) + "/temperature/" + std::to_string( i % 16 );
+			sensorData->try_emplace( sensorID, SensorState::Monitored, "Temperature #" + std::to_string( i ), "Temperature" );
+		}
+
+		const string suffix = std::to_string( sensorCount );
+
+		runner.run( "catalog/build_index/" + suffix, [&]()
+		{
+			SensorIndex index( sensorData );
+			doNotOptimize( index );
+		});
+
+		SensorIndex index( sensorData );
+
+		// pages of 100 sensors, each one starting where the previous one ended
+		string startAfter;
+		runner.run( "catalog/list_page_100/" + suffix, [&]()
+		{
+			size_t listed = 0;
+			const string * last = nullptr;
+			index.forEachWithPrefix( "/lpc/nct6798d/", startAfter, [&]( const SensorIndex::Entry & entry )
+			{
+				last = &entry.first;
+				return ++listed < 100;
+			});
+			startAfter = last ? *last : string();
+		});
+
+		size_t device = 0;
+		runner.run( "catalog/list_device/" + suffix, [&]()
+		{
+			string prefix = "/lpc/nct6798d/" + std::to_string( device++ % (sensorCount / 16) ) + "/";
+			size_t listed = 0;
+			index.forEachWithPrefix( prefix, {}, [&]( const SensorIndex::Entry & ) { ++listed; return true; } );
+			doNotOptimize( listed );
+		});
+	}
+}
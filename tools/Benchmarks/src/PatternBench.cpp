@@ -0,0 +1,131 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: benchmarks of resolving the wildcard patterns of monitored_sensors against the sensor catalog
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include "SensorPattern.hpp"
+
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// the textbook recursive glob, with the same rules as SensorPatternMatcher, as the baseline to compare with
+static bool globMatches( const char * pattern, const char * str )
+{
+	if (*pattern == '\0')
+		return *str == '\0';
+	if (*pattern == '*')
+		return globMatches( pattern + 1, str ) || (*str != '\0' && *str != '/' && globMatches( pattern, str + 1 ));
+	if (*str == '\0')
+		return false;
+	if (*pattern == '?')
+		return *str != '/' && globMatches( pattern + 1, str + 1 );
+	return *pattern == *str && globMatches( pattern + 1, str + 1 );
+}
+
+static const char * const vendors [] = { "amdcpu", "intelcpu", "gpu-nvidia", "gpu-amd", "lpc/nct6798d", "nvme", "hdd", "ram" };
+static const char * const categories [] = { "temperature", "load", "clock", "fan", "voltage", "power", "data", "control" };
+
+void runPatternBenchmarks( BenchmarkRunner & runner )
+{
+	// a fleet-wide catalog: every vendor with many devices and every category
+	vector< string > sensorIDs;
+	for (size_t i = 0; sensorIDs.size() < 50000; ++i)
+	{
+		sensorIDs.push_back(
+			string( "/" ) + vendors[ i % std::size(vendors) ] + "/" + std::to_string( (i / 64) % 100 )
+			+ "/" + categories[ (i / 8) % std::size(categories) ] + "/" + std::to_string( i % 8 )
+		);
+	}
+
+	// the kind of patterns one would write to cover different machines with one settings.txt
+	vector< string > patterns;
+	for (size_t i = 0; patterns.size() < 100; ++i)
+	{
+		const string vendor = vendors[ i % std::size(vendors) ];
+		const string category = categories[ (i / std::size(vendors)) % std::size(categories) ];
+		switch (i % 4)
+		{
+			case 0: patterns.push_back( "/" + vendor + "/*/" + category + "/*" ); break;
+			case 1: patterns.push_back( "/" + vendor + "/" + std::to_string( i % 10 ) + "/" + category + "/?" ); break;
+			case 2: patterns.push_back( "/" + vendor.substr( 0, 3 ) + "*/*/" + category + "/" + std::to_string( i % 8 ) ); break;
+			case 3: patterns.push_back( "/" + vendor + "/1?/*/*" ); break;
+		}
+	}
+
+	SensorPatternMatcher matcher;
+	for (const string & pattern : patterns)
+		matcher.addPattern( pattern );
+
+	// the trie must agree with the naive glob on every pattern for every sensor, not only on the totals
+	if (runner.isSelected( "patterns/trieMatchesGlob" ))
+	{
+		size_t mismatches = 0;
+		size_t matchedCount = 0;
+		vector< bool > trieMatched( patterns.size() );
+		vector< bool > trieMatchedAll( patterns.size() ), globMatchedAll( patterns.size() );
+		for (const string & sensorID : sensorIDs)
+		{
+			trieMatched.assign( patterns.size(), false );
+			const bool trieAny = matcher.matches( sensorID, &trieMatched );
+			bool globAny = false;
+			for (size_t i = 0; i < patterns.size(); ++i)
+			{
+				const bool globMatched = globMatches( patterns[i].c_str(), sensorID.c_str() );
+				mismatches += globMatched != trieMatched[i] ? 1 : 0;
+				globAny = globAny || globMatched;
+				trieMatchedAll[i] = trieMatchedAll[i] || trieMatched[i];
+				globMatchedAll[i] = globMatchedAll[i] || globMatched;
+			}
+			mismatches += trieAny != globAny ? 1 : 0;
+			matchedCount += globAny ? 1 : 0;
+		}
+		const bool passed = mismatches == 0 && trieMatchedAll == globMatchedAll;
+		runner.check( "patterns/trieMatchesGlob", passed,
+			std::to_string( mismatches ) + " mismatches, " + std::to_string( matchedCount ) + " of " + std::to_string( sensorIDs.size() ) + " sensors matched" );
+	}
+
+	runner.run( "patterns/compile/100", [&]()
+	{
+		SensorPatternMatcher compiled;
+		for (const string & pattern : patterns)
+			compiled.addPattern( pattern );
+		doNotOptimize( compiled );
+	});
+
+	vector< bool > matchedPatterns( patterns.size() );
+	runner.run( "patterns/resolve_trie/100x50000", [&]()
+	{
+		size_t matched = 0;
+		for (const string & sensorID : sensorIDs)
+			matched += matcher.matches( sensorID, &matchedPatterns ) ? 1 : 0;
+		doNotOptimize( matched );
+	});
+
+	runner.run( "patterns/resolve_naive/100x50000", [&]()
+	{
+		size_t matched = 0;
+		for (const string & sensorID : sensorIDs)
+		{
+			bool any = false;
+			for (size_t i = 0; i < patterns.size(); ++i)
+			{
+				if (globMatches( patterns[i].c_str(), sensorID.c_str() ))
+				{
+					matchedPatterns[i] = true;
+					any = true;
+				}
+			}
+			matched += any ? 1 : 0;
+		}
+		doNotOptimize( matched );
+	});
+}
@@ -0,0 +1,175 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: benchmarks and accuracy checks of the quantile sketches behind the percentile requests
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include "QuantileSketch.hpp"
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+using std::string;
+using std::vector;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static const uint64_t second_us = 1000000;
+
+static vector< float > generateReadings( const string & distribution, size_t count )
+{
+	Noise noise;
+	vector< float > readings;
+	readings.reserve( count );
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (distribution == "uniform")        // temperature wandering between 30 and 90 degrees
+			readings.push_back( 30.0f + 60.0f * noise.next() );
+		else if (distribution == "normal")    // load around 50 %, the sum of uniform numbers is close to normal
+			readings.push_back( 50.0f + 10.0f * (noise.next() + noise.next() + noise.next() + noise.next() - 2.0f) );
+		else if (distribution == "bimodal")   // fan switching between idle and full speed
+			readings.push_back( noise.next() < 0.8f ? 800.0f + 50.0f * noise.next() : 2400.0f + 100.0f * noise.next() );
+		else                                  // power with rare spikes two orders of magnitude higher
+			readings.push_back( noise.next() < 0.01f ? 2000.0f + 8000.0f * noise.next() : 15.0f + 10.0f * noise.next() );
+	}
+	return readings;
+}
+
+/// The same rank as QuantileSketch::quantile() uses.
+static float exactQuantile( const vector< float > & sorted, double q )
+{
+	return sorted[ size_t( q * double( sorted.size() - 1 ) ) ];
+}
+
+static const double checkedQuantiles [] = { 0.0, 0.01, 0.05, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99, 0.999, 1.0 };
+
+/// Compares the quantiles of the sketch against the exact ones, returns the largest relative error.
+static double maxRelativeError( const QuantileSketch & sketch, vector< float > readings )
+{
+	std::sort( readings.begin(), readings.end() );
+	double maxError = 0.0;
+	for (double q : checkedQuantiles)
+	{
+		const double exact = exactQuantile( readings, q );
+		maxError = std::max( maxError, std::fabs( sketch.quantile( q ) - exact ) / exact );
+	}
+	return maxError;
+}
+
+static string formatError( double error )
+{
+	char buffer [64];
+	snprintf( buffer, sizeof(buffer), "max relative error %.4f %%", error * 100.0 );
+	return buffer;
+}
+
+static void checkAccuracy( BenchmarkRunner & runner )
+{
+	// a little slack for the float rounding of the bucket boundaries
+	const double allowedError = QuantileSketch::relativeAccuracy * 1.0001;
+
+	for (const char * distribution : { "uniform", "normal", "bimodal", "spiky" })
+	{
+		vector< float > readings = generateReadings( distribution, 100000 );
+
+		QuantileSketch sketch;
+		for (float reading : readings)
+			sketch.add( reading );
+		double error = maxRelativeError( sketch, readings );
+		runner.check( string( "percentiles/accuracy/" ) + distribution, error <= allowedError, formatError( error ) );
+
+		// sketches of 24 parts merged together must give the same estimates as a single sketch of all of them
+		vector< QuantileSketch > parts( 24 );
+		for (size_t i = 0; i < readings.size(); ++i)
+			parts[ i * parts.size() / readings.size() ].add( readings[i] );
+		QuantileSketch merged;
+		for (const QuantileSketch & part : parts)
+			merged.merge( part );
+		bool same = merged.count() == sketch.count();
+		for (double q : checkedQuantiles)
+			same = same && merged.quantile( q ) == sketch.quantile( q );
+		runner.check( string( "percentiles/merge/" ) + distribution, same, same ? "same as unmerged" : "differs from unmerged" );
+	}
+
+	// the values the sketch cannot hold must be left out without affecting the others
+	{
+		const float invalidValues [] = { 0.0f, -0.0f, -40.0f, INFINITY, -INFINITY, NAN };
+		vector< float > readings = generateReadings( "uniform", 10000 );
+
+		QuantileSketch valid, mixed;
+		for (size_t i = 0; i < readings.size(); ++i)
+		{
+			valid.add( readings[i] );
+			mixed.add( readings[i] );
+			mixed.add( invalidValues[ i % std::size( invalidValues ) ] );
+		}
+		bool same = mixed.count() == valid.count();
+		for (double q : checkedQuantiles)
+			same = same && mixed.quantile( q ) == valid.quantile( q );
+		double error = maxRelativeError( mixed, readings );
+		runner.check( "percentiles/invalidValues", same && error <= allowedError,
+			std::to_string( mixed.count() ) + " of " + std::to_string( readings.size() ) + " readings counted, " + formatError( error ) );
+	}
+
+	// a day of readings every 2 seconds, the windows and the rollups must cover exactly the readings in the requested range
+	vector< float > readings = generateReadings( "normal", 24 * 3600 / 2 );
+	PercentileHistory history;
+	const uint64_t start_us = 1000 * 3600 * second_us;  // some whole hour
+	for (size_t i = 0; i < readings.size(); ++i)
+		history.add( readings[i], start_us + i * 2 * second_us );
+	const uint64_t now_us = start_us + readings.size() * 2 * second_us - 1;
+
+	for (uint32_t window_s : { 300u, 3600u, 6 * 3600u, 24 * 3600u })
+	{
+		QuantileSketch sketch;
+		history.collect( window_s, now_us, sketch );
+		vector< float > inWindow( readings.end() - ptrdiff_t( window_s / 2 ), readings.end() );
+		double error = maxRelativeError( sketch, inWindow );
+		bool passed = sketch.count() == inWindow.size() && error <= allowedError;
+		runner.check( "percentiles/history/window_" + std::to_string( window_s ) + "s", passed,
+			std::to_string( sketch.count() ) + " of " + std::to_string( inWindow.size() ) + " readings, " + formatError( error ) );
+	}
+}
+
+void runPercentileBenchmarks( BenchmarkRunner & runner )
+{
+	checkAccuracy( runner );
+
+	vector< float > readings = generateReadings( "normal", 4096 );
+
+	{
+		// a reading every second, so the windows roll over and the hours get rolled up during the benchmark too
+		PercentileHistory history;
+		size_t i = 0;
+		uint64_t timestamp_us = 0;
+		runner.run( "percentiles/add", [&]()
+		{
+			timestamp_us += second_us;
+			history.add( readings[ i++ % readings.size() ], timestamp_us );
+		});
+	}
+
+	PercentileHistory history;
+	const uint64_t end_us = 24 * 3600 * second_us;
+	for (uint64_t timestamp_us = 0; timestamp_us < end_us; timestamp_us += second_us)
+		history.add( readings[ (timestamp_us / second_us) % readings.size() ], timestamp_us );
+
+	for (uint32_t window_s : { 300u, 3600u, 24 * 3600u })
+	{
+		runner.run( "percentiles/query/window_" + std::to_string( window_s ) + "s", [&]()
+		{
+			QuantileSketch sketch;
+			history.collect( window_s, end_us - 1, sketch );
+			doNotOptimize( sketch.quantile( 0.5 ) );
+			doNotOptimize( sketch.quantile( 0.95 ) );
+			doNotOptimize( sketch.quantile( 0.99 ) );
+		});
+	}
+}
@@ -0,0 +1,142 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: benchmarks of the network protocol encoding and decoding
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include "Protocol.hpp"
+
+#include <CppUtils-Essential/BinaryStream.hpp>
+using own::BinaryOutputStream;
+using own::toByteVector;
+using own::fromBytes;
+
+#include <string>
+#include <vector>
+#include <array>
+using std::string;
+using std::vector;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static const string shortSensorID = "/amdcpu/0/temperature/2";
+// LHWM IDs of some devices contain long hardware identifiers
+static const string longSensorID = "/nvme/SAMSUNG_MZVL21T0HCLR-00B00_S676NF0R123456_1A2B3C4D5E6F7A8B/temperature/"
+                                   + string( 120, 'x' ) + "/0";
+
+static vector< string > makeSensorIDs( size_t count )
+{
+	vector< string > sensorIDs;
+	sensorIDs.reserve( count );
+	for (size_t i = 0; i < count; ++i)
+		sensorIDs.push_back( "/lpc/nct6798d/" + std::to_string( i / 16 ) + "/temperature/" + std::to_string( i % 16 ) );
+	return sensorIDs;
+}
+
+void runProtocolBenchmarks( BenchmarkRunner & runner )
+{
+	// request encoding, the way the clients do it
+	for (const string * sensorID : { &shortSensorID, &longSensorID })
+	{
+		const char * suffix = sensorID == &shortSensorID ? "short" : "long";
+
+		runner.run( string("protocol/SensorRequest/construct+toByteVector/") + suffix, [&]()
+		{
+			vector< uint8_t > bytes = toByteVector( SensorRequest( *sensorID ) );
+			doNotOptimize( bytes );
+		});
+
+		const SensorRequest request( *sensorID );
+		runner.run( string("protocol/SensorRequest/toByteVector/") + suffix, [&]()
+		{
+			vector< uint8_t > bytes = toByteVector( request );
+			doNotOptimize( bytes );
+		});
+
+		vector< uint8_t > buffer( request.size() );
+		runner.run( string("protocol/SensorRequest/BinaryOutputStream/") + suffix, [&]()
+		{
+			BinaryOutputStream stream( buffer );
+			stream << request;
+			doNotOptimize( buffer );
+		});
+
+		// request decoding, the way the server does it
+		const vector< uint8_t > encoded = toByteVector( request );
+		runner.run( string("protocol/SensorRequest/fromBytes/") + suffix, [&]()
+		{
+			SensorRequest decoded;
+			bool ok = fromBytes( encoded, decoded );
+			doNotOptimize( ok );
+			doNotOptimize( decoded );
+		});
+	}
+
+	// response encoding on the server and decoding on the client
+	{
+		const SensorResponse response( ResponseCode::Success, 47.25f );
+		runner.run( "protocol/SensorResponse/toByteVector", [&]()
+		{
+			vector< uint8_t > bytes = toByteVector( response );
+			doNotOptimize( bytes );
+		});
+
+		std::array< uint8_t, SensorResponse::size() > buffer;
+		runner.run( "protocol/SensorResponse/BinaryOutputStream", [&]()
+		{
+			BinaryOutputStream stream( buffer );
+			stream << response;
+			doNotOptimize( buffer );
+		});
+
+		const vector< uint8_t > encoded = toByteVector( response );
+		runner.run( "protocol/SensorResponse/fromBytes", [&]()
+		{
+			SensorResponse decoded;
+			bool ok = fromBytes( encoded, decoded );
+			doNotOptimize( ok );
+			doNotOptimize( decoded );
+		});
+	}
+
+	// batches
+	for (size_t batchSize : { 16, 256, 1024 })
+	{
+		const string suffix = std::to_string( batchSize );
+
+		const BatchRequest request( makeSensorIDs( batchSize ) );
+		const vector< uint8_t > encodedRequest = toByteVector( request );
+		runner.run( "protocol/BatchRequest/fromBytes/" + suffix, [&]()
+		{
+			BatchRequest decoded;
+			bool ok = fromBytes( encodedRequest, decoded );
+			doNotOptimize( ok );
+			doNotOptimize( decoded );
+		});
+
+		BatchResponse response( ResponseCode::Success );
+		for (size_t i = 0; i < batchSize; ++i)
+		{
+			response.codes.push_back( ResponseCode::Success );
+			response.values.push_back( 30.0f + float( i ) * 0.125f );
+		}
+		runner.run( "protocol/BatchResponse/toByteVector/" + suffix, [&]()
+		{
+			vector< uint8_t > bytes = toByteVector( response );
+			doNotOptimize( bytes );
+		});
+
+		const vector< uint8_t > encodedResponse = toByteVector( response );
+		runner.run( "protocol/BatchResponse/fromBytes/" + suffix, [&]()
+		{
+			BatchResponse decoded;
+			bool ok = fromBytes( encodedResponse, decoded );
+			doNotOptimize( ok );
+			doNotOptimize( decoded );
+		});
+	}
+}
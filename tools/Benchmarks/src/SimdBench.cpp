@@ -0,0 +1,235 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: benchmarks and equivalence checks of the SIMD kernels and the bulk encoding of the responses
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include "SimdKernels.hpp"
+#include "ResponseEncoding.hpp"
+#include "Protocol.hpp"
+
+#include <CppUtils-Essential/BinaryStream.hpp>
+using own::toByteVector;
+
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Floats of all magnitudes and signs, including the infinities and the denormals, but no NaN.
+static float anyFloat( Noise & noise )
+{
+	uint32_t bits = noise.nextBits() ^ (noise.nextBits() >> 16);
+	if ((bits & 0x7F800000) == 0x7F800000)
+		bits &= 0xFF800000;  // NaN turned into infinity
+	float value;
+	memcpy( &value, &bits, sizeof(value) );
+	return value;
+}
+
+static const SimdLevel allLevels [] = { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2 };
+
+/// Runs the kernels of every supported instruction set on every length up to a few vectors and every misalignment
+/// and compares them against the scalar ones.
+static void checkKernels( BenchmarkRunner & runner )
+{
+	const SimdLevel detected = detectSimdLevel();
+	Noise noise;
+
+	const size_t maxCount = 200;
+	const size_t maxOffset = 8;
+	vector< float > floats( maxCount + maxOffset );
+	vector< uint64_t > words( maxCount + maxOffset );
+	vector< uint8_t > expected( (maxCount + maxOffset) * 8 ), actual( (maxCount + maxOffset) * 8 );
+
+	for (SimdLevel level : allLevels)
+	{
+		if (level == SimdLevel::Scalar || level > detected)
+			continue;
+
+		const string name = string( "simd/equivalence/" ) + enumString( level );
+		if (!runner.isSelected( name ))
+			continue;
+
+		size_t cases = 0, failures = 0;
+		for (int round = 0; round < 20; ++round)
+		{
+			for (float & value : floats)
+				value = anyFloat( noise );
+			for (uint64_t & word : words)
+				word = uint64_t( noise.nextBits() ) << 32 | noise.nextBits();
+			if (round % 2 == 1)  // realistic readings too, where the sums don't overflow to infinity
+				for (float & value : floats)
+					value = 20.0f + float( noise.nextBits() % 100000 ) / 1000.0f;
+
+			for (size_t offset = 0; offset < maxOffset; ++offset)
+			{
+				for (size_t count = 0; count <= maxCount; ++count)
+				{
+					++cases;
+					bool ok = true;
+
+					if (count > 0)
+					{
+						setSimdLevel( SimdLevel::Scalar );
+						const FloatSummary scalar = summarizeFloats( floats.data() + offset, count );
+						setSimdLevel( level );
+						const FloatSummary vectorized = summarizeFloats( floats.data() + offset, count );
+						// only the sum depends on the order of the additions
+						const bool sameSum = scalar.sum == vectorized.sum || (std::isnan( scalar.sum ) && std::isnan( vectorized.sum )) || (std::isfinite( scalar.sum )
+							&& std::fabs( scalar.sum - vectorized.sum ) <= 1e-12 * std::max( std::fabs( scalar.sum ), 1e-300 ));
+						ok = ok && scalar.min == vectorized.min && scalar.max == vectorized.max && sameSum;
+					}
+
+					for (unsigned wordSize : { 4u, 8u })
+					{
+						const uint8_t * input = reinterpret_cast< const uint8_t * >( words.data() ) + offset;
+						setSimdLevel( SimdLevel::Scalar );
+						wordSize == 4 ? encodeBigEndian32( input, count, expected.data() + offset ) : encodeBigEndian64( input, count, expected.data() + offset );
+						setSimdLevel( level );
+						wordSize == 4 ? encodeBigEndian32( input, count, actual.data() + offset ) : encodeBigEndian64( input, count, actual.data() + offset );
+						ok = ok && memcmp( expected.data() + offset, actual.data() + offset, count * wordSize ) == 0;
+					}
+
+					if (!ok)
+						++failures;
+				}
+			}
+		}
+		setSimdLevel( detected );
+
+		runner.check( name, failures == 0, std::to_string( failures ) + " of " + std::to_string( cases ) + " cases differ from scalar" );
+	}
+}
+
+static BatchResponse makeBatchResponse( size_t count )
+{
+	BatchResponse response( ResponseCode::Success );
+	for (size_t i = 0; i < count; ++i)
+	{
+		response.codes.push_back( i % 17 == 0 ? ResponseCode::SensorFailed : ResponseCode::Success );
+		response.values.push_back( 30.0f + float( i ) * 0.125f );
+	}
+	return response;
+}
+
+static ChangesResponse makeChangesResponse( size_t count )
+{
+	ChangesResponse response( ResponseCode::Success );
+	response.seq = 12345;
+	for (size_t i = 0; i < count; ++i)
+	{
+		response.indexes.push_back( uint32_t( i * 2 ) );
+		response.codes.push_back( ResponseCode::Success );
+		response.values.push_back( 30.0f + float( i ) * 0.125f );
+		response.seqs.push_back( 12345 );
+		response.timestamps_us.push_back( 1234567890123ull + i );
+	}
+	return response;
+}
+
+static HistoryResponse makeHistoryResponse( size_t count )
+{
+	HistoryResponse response( ResponseCode::Success );
+	response.endTimestamp_us = 1234567890123ull;
+	for (size_t i = 0; i < count; ++i)
+	{
+		response.sampleCounts.push_back( uint32_t( i ) );
+		response.mins.push_back( 30.0f + float( i ) );
+		response.maxs.push_back( 40.0f + float( i ) );
+		response.means.push_back( 35.0f + float( i ) );
+	}
+	return response;
+}
+
+/// The bulk encoding must produce exactly the bytes of the generic one, with every instruction set.
+static void checkResponseEncoding( BenchmarkRunner & runner )
+{
+	const SimdLevel detected = detectSimdLevel();
+	for (SimdLevel level : allLevels)
+	{
+		if (level > detected)
+			continue;
+
+		const string name = string( "simd/encodeResponse/equivalence/" ) + enumString( level );
+		if (!runner.isSelected( name ))
+			continue;
+
+		setSimdLevel( level );
+		size_t failures = 0;
+		for (size_t count : { size_t( 0 ), size_t( 1 ), size_t( 3 ), size_t( 7 ), size_t( 8 ), size_t( 9 ), size_t( 100 ), size_t( maxBatchSize ) })
+		{
+			failures += encodeResponse( makeBatchResponse( count ) ) != toByteVector( makeBatchResponse( count ) );
+			failures += encodeResponse( makeChangesResponse( count ) ) != toByteVector( makeChangesResponse( count ) );
+			failures += encodeResponse( makeHistoryResponse( count ) ) != toByteVector( makeHistoryResponse( count ) );
+		}
+		failures += encodeResponse( BatchResponse( ResponseCode::InvalidRequest ) ) != toByteVector( BatchResponse( ResponseCode::InvalidRequest ) );
+		failures += encodeResponse( ChangesResponse( ResponseCode::NotModified ) ) != toByteVector( ChangesResponse( ResponseCode::NotModified ) );
+		failures += encodeResponse( HistoryResponse( ResponseCode::SensorNotFound ) ) != toByteVector( HistoryResponse( ResponseCode::SensorNotFound ) );
+		setSimdLevel( detected );
+
+		runner.check( name, failures == 0, std::to_string( failures ) + " responses differ from toByteVector" );
+	}
+}
+
+void runSimdBenchmarks( BenchmarkRunner & runner )
+{
+	checkKernels( runner );
+	checkResponseEncoding( runner );
+
+	const SimdLevel detected = detectSimdLevel();
+	Noise noise;
+	vector< float > values( 4096 );
+	for (float & value : values)
+		value = 20.0f + float( noise.nextBits() % 100000 ) / 1000.0f;
+	vector< uint8_t > output( values.size() * sizeof(float) );
+
+	for (SimdLevel level : allLevels)
+	{
+		if (level > detected)
+			continue;
+		setSimdLevel( level );
+
+		for (size_t count : { size_t( 256 ), size_t( 4096 ) })
+		{
+			const string suffix = string( enumString( level ) ) + "/" + std::to_string( count );
+			runner.run( "simd/summarizeFloats/" + suffix, [&]()
+			{
+				doNotOptimize( summarizeFloats( values.data(), count ) );
+			});
+			runner.run( "simd/encodeBigEndian32/" + suffix, [&]()
+			{
+				encodeBigEndian32( values.data(), count, output.data() );
+				doNotOptimize( output );
+			});
+		}
+
+		for (size_t count : { size_t( 100 ), size_t( maxBatchSize ) })
+		{
+			const BatchResponse response = makeBatchResponse( count );
+			runner.run( "simd/BatchResponse/encodeResponse/" + string( enumString( level ) ) + "/" + std::to_string( count ), [&]()
+			{
+				doNotOptimize( encodeResponse( response ) );
+			});
+		}
+	}
+	setSimdLevel( detected );
+
+	// the generic encoding the bulk one replaces, for comparison
+	for (size_t count : { size_t( 100 ), size_t( maxBatchSize ) })
+	{
+		const BatchResponse response = makeBatchResponse( count );
+		runner.run( "simd/BatchResponse/toByteVector/" + std::to_string( count ), [&]()
+		{
+			doNotOptimize( toByteVector( response ) );
+		});
+	}
+}
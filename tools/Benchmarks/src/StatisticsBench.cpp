@@ -0,0 +1,39 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: benchmarks of updating the statistics of the sensors with new readings
+//======================================================================================================================
+
+#include "Benchmark.hpp"
+
+#include "SensorStatistics.hpp"
+
+#include <vector>
+using std::vector;
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+void runStatisticsBenchmarks( BenchmarkRunner & runner )
+{
+	// a noisy fan, a few hundred RPM around the mean with an occasional spike
+	vector< float > readings;
+	Noise noise;
+	for (int i = 0; i < 4096; ++i)
+	{
+		readings.push_back( 1200.0f + float( noise.nextBits() >> 24 ) + (i % 97 == 0 ? 5000.0f : 0.0f) );
+	}
+
+	for (unsigned medianWindow : { 1u, 5u, maxMedianWindow })
+	{
+		StatisticsAccumulator accumulator( 10, medianWindow );
+		size_t i = 0;
+		uint64_t timestamp_us = 0;
+		runner.run( "statistics/add/median_" + std::to_string( medianWindow ), [&]()
+		{
+			timestamp_us += 1000000;
+			doNotOptimize( accumulator.add( readings[ i++ % readings.size() ], timestamp_us ) );
+		});
+	}
+}
@@ -0,0 +1,210 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: non-blocking network client driving many connections and requests from a single event loop
+//======================================================================================================================
+
+#ifndef HWMON_ASYNC_CLIENT_INCLUDED
+#define HWMON_ASYNC_CLIENT_INCLUDED
+
+
+#include "HwMonitorClient.hpp"  // ConnectStatus, RequestStatus, SensorReadResult
+
+#include <string>      // host
+#include <string_view> // sensor ID
+#include <memory>      // unique_ptr<Impl>
+#include <chrono>      // timeout
+#include <functional>  // callbacks
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+	#include <coroutine>
+	#include <exception>
+	#define HWMON_HAS_COROUTINES
+#endif
+
+
+namespace hwmon {
+
+
+//======================================================================================================================
+/// Asynchronous HwMonitorService network client.
+/** Unlike Client, none of the methods ever blocks (except resolving a host name, use numeric addresses to avoid that).
+  * Any number of connections can be opened and any number of requests can be outstanding on each of them,
+  * the requests are pipelined and their replies are matched in order.
+  *
+  * The results are delivered via callbacks, which are always invoked from inside poll() or run(), never directly
+  * from the method that started the operation. The callbacks may start new operations or close connections.
+  * The client is not thread-safe, all its methods and the callbacks must run in the same thread.
+  *
+  * When the service is overloaded, a request fails with Busy and the service doesn't read any further requests
+  * of that connection for a while (100 ms or more), so slow down before sending the failed ones again. */
+
+class AsyncClient
+{
+
+ public:
+
+	using ConnectionID = uint32_t;
+	static constexpr ConnectionID invalidConnection = 0;
+
+	using ConnectCallback = std::function< void ( ConnectStatus status ) >;
+	using SensorReadCallback = std::function< void ( const SensorReadResult & result ) >;
+
+	AsyncClient() noexcept;
+
+	/// Closes all connections. Callbacks of operations that didn't finish yet are destroyed without being invoked.
+	~AsyncClient() noexcept;
+
+	// The connections cannot be shared.
+	AsyncClient( const AsyncClient & other ) = delete;
+
+	// defined in the cpp, where the Impl is complete
+	AsyncClient( AsyncClient && other ) noexcept;
+	AsyncClient & operator=( AsyncClient && other ) noexcept;
+
+	/// Starts connecting to the service and returns an ID of the new connection.
+	/** Requests can be issued right away, they will be sent as soon as the connection is established. */
+	ConnectionID connect( const std::string & host, uint16_t port, ConnectCallback callback ) noexcept;
+
+	/// Closes the connection. Callbacks of the requests that are still waiting for a reply will get ConnectionClosed.
+	bool disconnect( ConnectionID connection ) noexcept;
+
+	bool isConnected( ConnectionID connection ) const noexcept;
+
+	/// Sets the time limit for establishing a connection and for a reply to a request, 500 ms by default.
+	/** Applies to the operations started after this call. */
+	void setTimeout( std::chrono::milliseconds timeout ) noexcept;
+
+	void requestSensorReading( ConnectionID connection, std::string_view sensorID, SensorReadCallback callback ) noexcept;
+
+	/// Same as above, except the request doesn't need to be encoded again.
+	void requestSensorReading( ConnectionID connection, const PreparedRequest & request, SensorReadCallback callback ) noexcept;
+
+	/// Waits at most maxWait for network events, processes them and invokes callbacks of finished operations.
+	/** Returns the number of callbacks that have been invoked. */
+	size_t poll( std::chrono::milliseconds maxWait ) noexcept;
+
+	/// Keeps calling poll() until all the started operations have finished.
+	void run() noexcept;
+
+	/// Number of operations whose callbacks have not been invoked yet.
+	size_t pendingOperations() const noexcept;
+
+	/// Returns the system error code that caused the last failure.
+	system_error_t getLastSystemError() const noexcept;
+
+	/// Converts the numeric value of the last system error to a user-friendly string.
+	std::string getLastSystemErrorStr() const noexcept;
+
+ private:
+
+	// a pointer so that we don't have to include the system socket headers here
+	struct Impl;
+	std::unique_ptr< Impl > _impl;
+
+};
+
+
+#ifdef HWMON_HAS_COROUTINES
+
+//======================================================================================================================
+//  C++20 coroutine support, available when the code using this library is compiled as C++20
+
+/// Awaitable returned by connectAsync(), resumes the coroutine with the ConnectStatus.
+class ConnectAwaitable
+{
+ public:
+
+	ConnectAwaitable( AsyncClient & client, std::string host, uint16_t port )
+		: _client( client ), _host( std::move( host ) ), _port( port ) {}
+
+	bool await_ready() const noexcept { return false; }
+
+	void await_suspend( std::coroutine_handle<> coroutine )
+	{
+		_connection = _client.connect( _host, _port, [this, coroutine]( ConnectStatus status )
+		{
+			_status = status;
+			coroutine.resume();
+		});
+	}
+
+	/// Returns the ID of the new connection, or AsyncClient::invalidConnection if it has failed.
+	AsyncClient::ConnectionID await_resume() const noexcept
+	{
+		return _status == ConnectStatus::Success ? _connection : AsyncClient::invalidConnection;
+	}
+
+ private:
+
+	AsyncClient & _client;
+	std::string _host;
+	uint16_t _port;
+	AsyncClient::ConnectionID _connection = AsyncClient::invalidConnection;
+	ConnectStatus _status = ConnectStatus::UnexpectedError;
+};
+
+/// Awaitable returned by readSensorAsync(), resumes the coroutine with the SensorReadResult.
+class SensorReadAwaitable
+{
+ public:
+
+	SensorReadAwaitable( AsyncClient & client, AsyncClient::ConnectionID connection, std::string sensorID )
+		: _client( client ), _connection( connection ), _sensorID( std::move( sensorID ) ) {}
+
+	bool await_ready() const noexcept { return false; }
+
+	void await_suspend( std::coroutine_handle<> coroutine )
+	{
+		_client.requestSensorReading( _connection, _sensorID, [this, coroutine]( const SensorReadResult & result )
+		{
+			_result = result;
+			coroutine.resume();
+		});
+	}
+
+	SensorReadResult await_resume() const noexcept { return _result; }
+
+ private:
+
+	AsyncClient & _client;
+	AsyncClient::ConnectionID _connection;
+	std::string _sensorID;
+	SensorReadResult _result = { RequestStatus::UnexpectedError, 0.0f };
+};
+
+inline ConnectAwaitable connectAsync( AsyncClient & client, std::string host, uint16_t port = defaultPort )
+{
+	return ConnectAwaitable( client, std::move( host ), port );
+}
+
+inline SensorReadAwaitable readSensorAsync( AsyncClient & client, AsyncClient::ConnectionID connection, std::string sensorID )
+{
+	return SensorReadAwaitable( client, connection, std::move( sensorID ) );
+}
+
+/// Minimal coroutine return type for coroutines that nobody waits for, they run until they finish and then clean up.
+/** If you already use a coroutine library, its task types work with the awaitables above as well. */
+struct DetachedTask
+{
+	struct promise_type
+	{
+		DetachedTask get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+#endif // HWMON_HAS_COROUTINES
+
+
+//======================================================================================================================
+
+
+} // namespace hwmon
+
+
+#endif // HWMON_ASYNC_CLIENT_INCLUDED
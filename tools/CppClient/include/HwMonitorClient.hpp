@@ -11,14 +11,11 @@
 
 #include "SystemErrorType.hpp"
 
-#include <string>  // system error str
-#include <memory>  // unique_ptr<Socket>
-#include <chrono>  // timeout
-
-namespace own {
-	class TcpSocket;
-}
-
+#include <string>       // system error str
+#include <string_view>  // sensor ID
+#include <vector>       // buffers
+#include <memory>       // unique_ptr<Socket>
+#include <chrono>       // timeout
 
 namespace hwmon {
 
@@ -54,6 +51,8 @@ enum class RequestStatus
 	SensorNotFound,     ///< Such sensor was not found.
 	SensorNotMonitored, ///< Sensor is available but not monitored.
 	SensorFailed,       ///< Sensor is available and monitored, but reading its value has failed.
+	NotModified,        ///< There is no newer sample than the one given in the request.
+	Busy,               ///< The service is overloaded or you send too many requests. Send it again after getRetryAfter().
 	UnexpectedError,    ///< Internal error of this library. This should not happen unless there is a mistake in the code, please create a github issue.
 };
 const char * enumString( RequestStatus status ) noexcept;
@@ -65,6 +64,123 @@ struct SensorReadResult
 	float sensorValue;     ///< output of a successfull request
 };
 
+/// Result and output of a sample read request
+struct SampleReadResult
+{
+	RequestStatus status;    ///< whether the request suceeded or why it didn't, NotModified if there is no newer sample
+	float sensorValue;       ///< output of a successfull request
+	uint32_t seq;            ///< number of the sampling cycle that has read the value, pass it to the next request
+	uint64_t timestamp_us;   ///< when the value was read, microseconds of the service's monotonic clock
+};
+
+/// What value of a sensor to read, the statistics are computed by the service from every reading of the sensor
+enum class ValueKind : uint32_t
+{
+	Raw = 0,            ///< the last reading
+	Mean = 1,           ///< exponentially weighted moving average, its span is configured in the service
+	StdDev = 2,         ///< standard deviation of all the readings since the sensor has been monitored
+	RatePerSecond = 3,  ///< change between the last two readings, per second, can be negative
+	Median = 4,         ///< median of the last few readings, filters out single spikes
+};
+
+/// Result and output of a percentile request
+struct PercentilesResult
+{
+	RequestStatus status;    ///< whether the request suceeded or why it didn't, SensorFailed if there is no reading in the window
+	uint32_t sampleCount;    ///< number of the readings the percentiles were computed from
+	std::vector< float > values;  ///< in the same order as the requested percentiles
+};
+
+/// Summary of the readings of a sensor over one interval of its history
+struct HistoryPoint
+{
+	uint32_t sampleCount;    ///< number of the successful readings in the interval, 0 means the values are not valid
+	float min;
+	float max;
+	float mean;
+};
+
+/// Result and output of a history request
+struct HistoryResult
+{
+	RequestStatus status;    ///< whether the request suceeded or why it didn't
+	uint64_t endTimestamp_us;  ///< end of the last interval, microseconds of the service's monotonic clock
+	std::vector< HistoryPoint > points;  ///< the oldest interval first
+};
+
+/// One of the sensors returned by requestChangedSensors()
+struct ChangedSensor
+{
+	uint32_t index;          ///< position of the sensor in the requested list
+	RequestStatus status;    ///< whether this sensor could be read
+	float sensorValue;
+	uint32_t seq;
+	uint64_t timestamp_us;
+};
+
+/// Result and output of a request for changed sensors
+struct ChangedSensorsResult
+{
+	RequestStatus status;    ///< whether the request suceeded or why it didn't, NotModified if none of the sensors has changed
+	uint32_t seq;            ///< number of the last completed sampling cycle, pass it to the next request
+	std::vector< ChangedSensor > sensors;
+};
+
+/// One of the sensors returned by listSensors()
+struct ListedSensor
+{
+	std::string id;
+	std::string name;        ///< display name given by the hardware monitoring library
+	std::string category;    ///< Temperature, Load, Fan, ...
+	RequestStatus state;     ///< Success if it's monitored, SensorNotMonitored or SensorNotFound if it's requested but missing
+};
+
+/// Result and output of a request for the list of sensors
+struct SensorListResult
+{
+	RequestStatus status;    ///< whether the request suceeded or why it didn't
+	std::vector< ListedSensor > sensors;
+	bool hasMore;            ///< there are more sensors, pass the ID of the last one as startAfter to get them
+};
+
+/// A change of the state of one of the alert rules configured in the service
+struct AlertEvent
+{
+	uint32_t number;         ///< events are numbered from 1 since the start of the service
+	uint32_t rule;           ///< position of the rule in the alert_rules option
+	bool raised;             ///< true if the alert has been raised, false if it has been cleared
+	float sensorValue;       ///< the value that has changed the state
+	uint64_t timestamp_us;   ///< when the value was read, microseconds of the service's monotonic clock
+	std::string sensorID;
+};
+
+/// Result and output of a request for alert events
+struct AlertsResult
+{
+	RequestStatus status;    ///< whether the request suceeded or why it didn't, NotModified if no event has happened
+	uint32_t lastEvent;      ///< number of the last event, pass it to the next request
+	bool isSnapshot;         ///< the events are the alerts raised right now, not the ones that happened after afterEvent
+	std::vector< AlertEvent > events;
+};
+
+
+/// Request for a sensor encoded in advance.
+/** Use this when you read the same sensor repeatedly, the encoding is then done only once. */
+class PreparedRequest
+{
+ public:
+
+	PreparedRequest() noexcept {}
+	explicit PreparedRequest( std::string_view sensorID );
+
+	const std::vector< uint8_t > & bytes() const noexcept { return _bytes; }
+
+ private:
+
+	std::vector< uint8_t > _bytes;
+
+};
+
 
 //======================================================================================================================
 /// HwMonitorService network client.
@@ -87,13 +203,80 @@ class Client
 
 	bool isConnected() const noexcept;
 
+	/// Connects over TCP, or over a Unix domain socket if the host is "unix:<path>", in which case the port is ignored.
+	/** The Unix domain socket skips the whole TCP/IP stack, so it's the faster way for the clients on the same machine,
+	  * but the service has to be configured to listen on it (option unix_socket). */
 	ConnectStatus connect( const std::string & host, uint16_t port = defaultPort ) noexcept;
 
 	bool disconnect() noexcept;
 
 	bool setTimeout( std::chrono::milliseconds timeout ) noexcept;
 
-	SensorReadResult requestSensorReading( const std::string & sensorID ) noexcept;
+	/// When the service answers that it's busy, wait for as long as it asks and send the request again,
+	/// at most maxRetries times, then the request fails with Busy. By default it fails right away.
+	/** The service then doesn't read any of your requests until that time passes, so there is no point in sending
+	  * them sooner. Remember that the request can then take much longer than the timeout. */
+	void setBusyRetries( unsigned maxRetries ) noexcept  { _busyRetries = maxRetries; }
+
+	/// How long the service has asked to wait, after the last request that has failed with Busy.
+	std::chrono::milliseconds getRetryAfter() const noexcept  { return _retryAfter; }
+
+	SensorReadResult requestSensorReading( std::string_view sensorID ) noexcept;
+
+	/// Same as above, except the request doesn't need to be encoded again.
+	/** In a loop reading prepared requests, the client doesn't allocate any memory after the first iteration. */
+	SensorReadResult requestSensorReading( const PreparedRequest & request ) noexcept;
+
+	/// Reads the sensor value together with its sequence number and timestamp.
+	/** If ifNewerThan is not 0 and the service doesn't have a newer sample, the status is NotModified.
+	  * The service numbers its cycles from 1 again when it restarts. If ifNewerThan is higher than any cycle of its
+	  * current run, it knows the number is from an earlier run and returns the sample as if ifNewerThan were 0.
+	  * Once the new run has passed the old number, every sample is newer than it anyway. */
+	SampleReadResult requestSample( std::string_view sensorID, uint32_t ifNewerThan = 0 ) noexcept;
+
+	/// Same as above, but reads a statistic of the sensor values instead of the last value.
+	/** The seq and timestamp are the ones of the last reading the statistic includes. */
+	SampleReadResult requestSample( std::string_view sensorID, ValueKind kind, uint32_t ifNewerThan = 0 ) noexcept;
+
+	/// Reads percentiles (0 to 100, 50 is the median) of all the sensor values read in the last window (at most 24 hours).
+	/** The service estimates them within 1 % of the exact values. The window is rounded up to 5 minutes, and longer
+	  * windows to whole hours. At most 16 percentiles can be requested at once. */
+	PercentilesResult requestPercentiles( std::string_view sensorID, const std::vector< float > & percentiles, std::chrono::seconds window ) noexcept;
+
+	/// Reads the history of the sensor over the last window, divided into pointCount intervals (at most 1024)
+	/// of the same length, each of them summarized by the minimum, the maximum and the mean of the readings.
+	/** How long the history is kept is configured in the service, a week by default. */
+	HistoryResult requestHistory( std::string_view sensorID, std::chrono::seconds window, uint32_t pointCount ) noexcept;
+
+	/// Reads the sensor value that is at most maxAge old. If the service's last sample is older, it reads the sensor again.
+	/** The service limits how often it reads a sensor on demand, if the limit is hit, you get the last sample anyway,
+	  * so check the timestamp if the age matters. This can take up to a second longer than the other requests. */
+	SampleReadResult requestFreshSample( std::string_view sensorID, std::chrono::milliseconds maxAge ) noexcept;
+
+	/// Reads many sensors at once, but returns only those that have a newer sample than ifNewerThan.
+	/** Use 0 for the first request and the seq from the previous result for the next ones. After a restart
+	  * of the service, a seq from before it works too, you get all the sensors, see requestSample(). */
+	ChangedSensorsResult requestChangedSensors( const std::vector< std::string > & sensorIDs, uint32_t ifNewerThan = 0 ) noexcept;
+
+	/// Same as requestChangedSensors(), but if none of the sensors has a newer sample yet, the service holds the request
+	/// until its next sampling cycle completes, or until the timeout (at most 60 s) expires, then the status is NotModified.
+	/** With ifNewerThan = 0 it waits for the next cycle. Calling this in a loop, passing the seq of the previous result,
+	  * gives you every new sample exactly once, as soon as the service has it. */
+	ChangedSensorsResult waitForChangedSensors(
+		const std::vector< std::string > & sensorIDs, uint32_t ifNewerThan, std::chrono::milliseconds timeout
+	) noexcept;
+
+	/// Lists the sensors the service knows, whose IDs start with the prefix, ordered by their IDs.
+	/** At most maxCount are returned (0 means as many as the service allows), to get the next page,
+	  * call it again with the ID of the last returned sensor as startAfter. */
+	SensorListResult listSensors( std::string_view prefix, std::string_view startAfter = {}, uint32_t maxCount = 0 ) noexcept;
+
+	/// Waits until one of the alerts configured in the service is raised or cleared, or until the timeout (at most 60 s)
+	/// expires, then the status is NotModified.
+	/** Call it with afterEvent = 0 first, you get the alerts that are raised right now, and then in a loop, passing
+	  * the lastEvent of the previous result, to get every event as soon as the service evaluates it. If you fall too far
+	  * behind, or the service restarts, you get the raised alerts again, with isSnapshot set. */
+	AlertsResult waitForAlerts( uint32_t afterEvent, std::chrono::milliseconds timeout ) noexcept;
 
 	/// Returns the system error code that caused the last failure.
 	system_error_t getLastSystemError() const noexcept;
@@ -103,8 +286,32 @@ class Client
 
  private:
 
-	// a pointer so that we don't have to include the TcpSocket and all its OS dependancies here
-	std::unique_ptr< own::TcpSocket > _socket;
+	SensorReadResult exchange( const uint8_t * requestData, size_t requestSize ) noexcept;
+	RequestStatus sendRequest( const uint8_t * requestData, size_t requestSize ) noexcept;
+	/// Receives exactly the given number of bytes into the response buffer at the given offset.
+	RequestStatus receiveResponse( size_t offset, size_t size ) noexcept;
+	/// Receives the response code to the beginning of the response buffer.
+	/** If it's Busy, receives the rest of the BusyResponse and sends the request again, if the retries allow it. */
+	RequestStatus receiveResponseCode() noexcept;
+	void receiveSample( SampleReadResult & result ) noexcept;
+	void receiveChanges( ChangedSensorsResult & result, size_t maxCount ) noexcept;
+	/// Receives a response whose header ends with the size of the rest, returns the total size in responseSize.
+	RequestStatus receiveSizedResponse( size_t headerSize, size_t maxPayloadSize, size_t & responseSize ) noexcept;
+
+	// a pointer so that we don't have to include the sockets and all their OS dependancies here
+	class Transport;
+	std::unique_ptr< Transport > _socket;
+	std::chrono::milliseconds _timeout;
+	unsigned _busyRetries;
+	std::chrono::milliseconds _retryAfter;
+
+	// the last request sent, to be sent again when the service is busy
+	const uint8_t * _lastRequestData;
+	size_t _lastRequestSize;
+
+	// reused by all requests, so that we don't allocate new ones every time
+	std::vector< uint8_t > _requestBuffer;
+	std::vector< uint8_t > _responseBuffer;
 
 };
 
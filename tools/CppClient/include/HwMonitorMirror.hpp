@@ -0,0 +1,115 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: local copy of a set of sensors, kept up to date by a background thread
+//======================================================================================================================
+
+#ifndef HWMON_MIRROR_INCLUDED
+#define HWMON_MIRROR_INCLUDED
+
+
+#include "HwMonitorClient.hpp"  // RequestStatus, defaultPort
+
+#include <string>       // host, sensor IDs
+#include <string_view>  // sensor ID
+#include <vector>       // sensor IDs
+#include <memory>       // unique_ptr<Impl>
+#include <chrono>       // age, backoff
+
+
+namespace hwmon {
+
+
+//======================================================================================================================
+
+/// Last known value of one of the mirrored sensors
+struct MirroredValue
+{
+	RequestStatus status;        ///< how the service has read the sensor, NotConnected if nothing has been received yet
+	float sensorValue;           ///< valid only if the status is Success
+	uint32_t seq;                ///< number of the sampling cycle that has read the value
+	std::chrono::microseconds age;  ///< how long ago the service has read the value, max() if it's not known
+};
+
+/// Copy of the values of a fixed set of sensors, kept in sync with the service by a background thread.
+/** The thread owns one connection and asks for the sensors that have changed, the service answers as soon as
+  * its sampling cycle completes, so the copy is updated once per cycle with a single request, no matter how many
+  * threads read it and how often. Reading a value is just a few atomic loads, it never blocks, never allocates
+  * and never touches the network, so any number of threads can read any sensor at any rate.
+  *
+  * When the connection fails, the values stay as they were and only their age grows, while the thread connects again,
+  * waiting longer after each failed attempt. Check the age, if the reader cares how fresh the value is.
+  *
+  * The age is measured from the moment the service has read the sensor. The service timestamps are converted
+  * to the local clock using the fastest response seen on the current connection, so the age is accurate to within
+  * the network latency. The values the service has loaded from its cache after a restart have an unknown age.
+  *
+  * A critical listener of the service doesn't serve the wait request, there the mirror asks for the changes
+  * every 100 ms instead. */
+class Mirror
+{
+
+ public:
+
+	/// The set of sensors cannot be changed later, the positions in this list are the indexes for read().
+	explicit Mirror( std::vector< std::string > sensorIDs );
+
+	/// Stops the background thread.
+	~Mirror() noexcept;
+
+	// The background thread refers to the internal state, not to this object.
+	Mirror( const Mirror & other ) = delete;
+
+	// defined in the cpp, where the Impl is complete
+	Mirror( Mirror && other ) noexcept;
+	Mirror & operator=( Mirror && other ) noexcept;
+
+	/// Starts the background thread, which connects to the service and keeps the values in sync until stop().
+	/** The host and port have the same meaning as in Client::connect(). Returns false if it's already running
+	  * or the thread cannot be started, connection failures are not reported here, the thread keeps trying. */
+	bool start( const std::string & host, uint16_t port = defaultPort ) noexcept;
+
+	/// Stops the background thread and disconnects. The values stay available. Usually takes less than 250 ms.
+	void stop() noexcept;
+
+	/// How long to wait before connecting again after the first failure, and the longest wait after many of them.
+	/** The wait doubles after every failed attempt, 100 ms to 10 s by default. Applies to the next failure. */
+	void setReconnectBackoff( std::chrono::milliseconds first, std::chrono::milliseconds max ) noexcept;
+
+	/// Whether the background thread is connected right now.
+	bool isConnected() const noexcept;
+
+	/// Number of the last sampling cycle of the service the values are synced with, 0 if none yet.
+	uint32_t lastCycle() const noexcept;
+
+	size_t sensorCount() const noexcept;
+
+	/// Position of the sensor in the list given to the constructor, or npos if it's not there.
+	size_t indexOf( std::string_view sensorID ) const noexcept;
+
+	static constexpr size_t npos = size_t(-1);
+
+	/// Returns the last known value of the sensor at the given position. Thread-safe and lock-free.
+	MirroredValue read( size_t index ) const noexcept;
+
+	/// Same as above, but finds the position first. Use indexOf() once and then read by index in hot loops.
+	/** If the sensor is not mirrored, the status is SensorNotMonitored. */
+	MirroredValue read( std::string_view sensorID ) const noexcept;
+
+ private:
+
+	// a pointer so that the background thread can keep it when the Mirror is moved
+	struct Impl;
+	std::unique_ptr< Impl > _impl;
+
+};
+
+
+//======================================================================================================================
+
+
+} // namespace hwmon
+
+
+#endif // HWMON_MIRROR_INCLUDED
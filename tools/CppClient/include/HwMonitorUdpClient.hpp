@@ -0,0 +1,100 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: connectionless client sending the requests to the UDP endpoint of the HwMonitorService
+//======================================================================================================================
+
+#ifndef HWMON_UDP_CLIENT_INCLUDED
+#define HWMON_UDP_CLIENT_INCLUDED
+
+
+#include "HwMonitorClient.hpp"  // ConnectStatus, RequestStatus, SensorReadResult, PreparedRequest
+
+#include <string>       // host, sensor IDs
+#include <string_view>  // sensor ID
+#include <vector>       // batch
+#include <memory>       // unique_ptr<Impl>
+#include <chrono>       // timeout
+
+
+namespace hwmon {
+
+
+//======================================================================================================================
+
+/// Result and output of a request for many sensors at once
+struct BatchReadResult
+{
+	RequestStatus status;    ///< whether the request suceeded or why it didn't
+	std::vector< SensorReadResult > sensors;  ///< in the same order as the requested sensor IDs
+};
+
+/// HwMonitorService client that sends every request in its own datagram, without any connection.
+/** Use this for occasional reads, where setting up a connection would cost more than the read itself, or when
+  * there are more readers than the service's max_connected_clients. The service has to be configured to listen
+  * for the datagrams (option udp_port), and only on the loopback, so this works only on the same machine.
+  * A datagram can get lost, so if no reply comes in the timeout, the request is sent again, up to the given number
+  * of retries. Every request carries an ID that the service copies into the reply, so a late reply to an earlier
+  * request is never taken for the reply to the current one. The service answers only the sensor requests
+  * and the batch requests this way. */
+class UdpClient
+{
+
+ public:
+
+	UdpClient() noexcept;
+
+	~UdpClient() noexcept;
+
+	// The socket cannot be shared.
+	UdpClient( const UdpClient & other ) = delete;
+
+	// defined in the cpp, where the Impl is complete
+	UdpClient( UdpClient && other ) noexcept;
+	UdpClient & operator=( UdpClient && other ) noexcept;
+
+	/// Resolves the address of the service and prepares the socket, nothing is sent yet.
+	/** Because there is no connection, ConnectFailed is never returned, an unreachable service shows as NoReply
+	  * or ReceiveError of the requests. */
+	ConnectStatus open( const std::string & host, uint16_t port ) noexcept;
+
+	void close() noexcept;
+
+	bool isOpen() const noexcept;
+
+	/// How long to wait for each reply before sending the request again (100 ms by default),
+	/// and how many times to send it again (2 by default), before the request fails with NoReply.
+	void setRetryPolicy( std::chrono::milliseconds timeout, unsigned retries ) noexcept;
+
+	SensorReadResult requestSensorReading( std::string_view sensorID ) noexcept;
+
+	/// Same as above, except the request doesn't need to be encoded again.
+	SensorReadResult requestSensorReading( const PreparedRequest & request ) noexcept;
+
+	/// Reads many sensors in one datagram. The encoded request and its ID must fit into 16 KiB, otherwise it fails
+	/// with SendRequestFailed and the sensors have to be split into more requests.
+	BatchReadResult requestSensorReadings( const std::vector< std::string > & sensorIDs ) noexcept;
+
+	/// Returns the system error code that caused the last failure.
+	system_error_t getLastSystemError() const noexcept;
+
+	/// Converts the numeric value of the last system error to a user-friendly string.
+	std::string getLastSystemErrorStr() const noexcept;
+
+ private:
+
+	// a pointer so that we don't have to include the system socket headers here
+	struct Impl;
+	std::unique_ptr< Impl > _impl;
+
+};
+
+
+//======================================================================================================================
+
+
+} // namespace hwmon
+
+
+#endif // HWMON_UDP_CLIENT_INCLUDED
@@ -0,0 +1,59 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: internal helpers shared by the synchronous and asynchronous client
+//======================================================================================================================
+
+#ifndef HWMON_CLIENT_UTILS_INCLUDED
+#define HWMON_CLIENT_UTILS_INCLUDED
+
+
+#include <HwMonitorClient.hpp>
+
+#include "../../../src/Protocol.hpp"
+
+
+namespace hwmon {
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Converts the status code of the server's response to the status reported to the library user.
+inline RequestStatus toRequestStatus( ResponseCode code ) noexcept
+{
+	switch (code)
+	{
+		case ResponseCode::Success:             return RequestStatus::Success;
+		case ResponseCode::SensorNotFound:      return RequestStatus::SensorNotFound;
+		case ResponseCode::SensorNotMonitored:  return RequestStatus::SensorNotMonitored;
+		case ResponseCode::SensorFailed:        return RequestStatus::SensorFailed;
+		case ResponseCode::NotModified:         return RequestStatus::NotModified;
+		case ResponseCode::Busy:                return RequestStatus::Busy;
+		// we have sent a request the server didn't understand, that's our fault
+		case ResponseCode::InvalidRequest:      return RequestStatus::UnexpectedError;
+		default:                                return RequestStatus::InvalidReply;
+	}
+}
+
+
+/// Decodes a big endian 32-bit field of a response, before the whole response is received.
+inline uint32_t bigEndian32At( const uint8_t * data ) noexcept
+{
+	return uint32_t(data[0]) << 24 | uint32_t(data[1]) << 16 | uint32_t(data[2]) << 8 | uint32_t(data[3]);
+}
+
+/// Decodes the big endian status code at the beginning of a response, before the whole response is received.
+inline ResponseCode responseCodeAt( const uint8_t * data ) noexcept
+{
+	return ResponseCode( bigEndian32At( data ) );
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+
+} // namespace hwmon
+
+
+#endif // HWMON_CLIENT_UTILS_INCLUDED
@@ -0,0 +1,692 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: non-blocking network client driving many connections and requests from a single event loop
+//======================================================================================================================
+
+#include <HwMonitorAsyncClient.hpp>
+#include <CppUtils-Essential/Essential.hpp>
+
+#include "../../../src/Protocol.hpp"
+#include "ClientUtils.hpp"
+
+#include <CppUtils-Network/SystemErrorInfo.hpp>
+using own::getErrorString;
+
+#include <CppUtils-Essential/BinaryStream.hpp>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	using socket_t = SOCKET;
+	static const socket_t invalidSocket = INVALID_SOCKET;
+#else
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <netdb.h>
+	#include <poll.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+	using socket_t = int;
+	static const socket_t invalidSocket = -1;
+#endif
+
+#ifdef MSG_NOSIGNAL
+	static const int sendFlags = MSG_NOSIGNAL;  // report a broken connection by return value, not by SIGPIPE
+#else
+	static const int sendFlags = 0;
+#endif
+
+#include <cstring>
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+using std::chrono::milliseconds;
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+
+namespace hwmon {
+
+
+//======================================================================================================================
+//  platform
+
+static bool initNetworking() noexcept
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	return WSAStartup( MAKEWORD(2, 2), &wsaData ) == 0;
+#else
+	return true;
+#endif
+}
+
+static void cleanupNetworking() noexcept
+{
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+static void closeSocket( socket_t sock ) noexcept
+{
+#ifdef _WIN32
+	closesocket( sock );
+#else
+	close( sock );
+#endif
+}
+
+static bool setNonBlocking( socket_t sock ) noexcept
+{
+#ifdef _WIN32
+	u_long enabled = 1;
+	return ioctlsocket( sock, FIONBIO, &enabled ) == 0;
+#else
+	int flags = fcntl( sock, F_GETFL, 0 );
+	return flags >= 0 && fcntl( sock, F_SETFL, flags | O_NONBLOCK ) == 0;
+#endif
+}
+
+static system_error_t lastSocketError() noexcept
+{
+#ifdef _WIN32
+	return system_error_t( WSAGetLastError() );
+#else
+	return errno;
+#endif
+}
+
+static bool isWouldBlock( system_error_t error ) noexcept
+{
+#ifdef _WIN32
+	return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+#else
+	return error == EWOULDBLOCK || error == EAGAIN || error == EINPROGRESS;
+#endif
+}
+
+static system_error_t timeoutError() noexcept
+{
+#ifdef _WIN32
+	return WSAETIMEDOUT;
+#else
+	return ETIMEDOUT;
+#endif
+}
+
+static int pollSockets( pollfd * fds, size_t count, int timeout_ms ) noexcept
+{
+#ifdef _WIN32
+	return WSAPoll( fds, ULONG( count ), timeout_ms );
+#else
+	return ::poll( fds, nfds_t( count ), timeout_ms );
+#endif
+}
+
+static system_error_t pendingConnectError( socket_t sock ) noexcept
+{
+	int error = 0;
+	socklen_t length = sizeof(error);
+	if (getsockopt( sock, SOL_SOCKET, SO_ERROR, (char *)&error, &length ) != 0)
+		return lastSocketError();
+	return system_error_t( error );
+}
+
+
+//======================================================================================================================
+//  internal state
+
+enum class ConnectionState
+{
+	Connecting,
+	Connected,
+	Closed,
+};
+
+struct PendingRequest
+{
+	AsyncClient::SensorReadCallback callback;
+	Clock::time_point deadline;
+	bool expired = false;  ///< already completed with NoReply, its reply may still arrive
+};
+
+struct Connection
+{
+	AsyncClient::ConnectionID id;
+	socket_t sock = invalidSocket;
+	ConnectionState state = ConnectionState::Connecting;
+
+	AsyncClient::ConnectCallback connectCallback;
+	Clock::time_point connectDeadline;
+
+	vector< uint8_t > outBuffer;   ///< encoded requests that have not been sent yet
+	size_t outOffset = 0;          ///< how much of the outBuffer has already been sent
+	vector< uint8_t > inBuffer;    ///< received bytes that don't form a complete response yet
+
+	/// Requests waiting for a reply, in the order they were sent, because the server replies in the same order.
+	std::deque< PendingRequest > pending;
+	/// Number of requests in the pending queue that have already been completed with NoReply.
+	/** Their replies may still arrive, so they need to stay in the queue to keep the replies matched. The timeout
+	  * can be changed between the requests, so a newer request can expire before an older one. */
+	size_t expiredCount = 0;
+	/// No request expires before this, but it may be earlier than the real nearest deadline,
+	/// when the request it belonged to has been answered since, then the queue is just scanned once more.
+	Clock::time_point nearestDeadline = Clock::time_point::max();
+};
+
+/// A finished operation whose callback is waiting to be invoked.
+struct Completion
+{
+	AsyncClient::ConnectCallback connectCallback;
+	ConnectStatus connectStatus;
+	AsyncClient::SensorReadCallback sensorReadCallback;
+	SensorReadResult sensorReadResult;
+};
+
+struct AsyncClient::Impl
+{
+	bool networkingInitialized = false;
+	milliseconds timeout = milliseconds( 500 );
+	ConnectionID lastConnectionID = invalidConnection;
+	std::unordered_map< ConnectionID, std::unique_ptr< Connection > > connections;
+	vector< Completion > completions;
+	system_error_t lastSystemError = 0;
+
+	// reused between poll() calls
+	vector< Completion > finished;
+	vector< pollfd > pollFds;
+	vector< Connection * > polledConnections;
+
+	Connection * findConnection( ConnectionID id ) const
+	{
+		auto iter = connections.find( id );
+		return iter != connections.end() ? iter->second.get() : nullptr;
+	}
+
+	void completeConnect( Connection & conn, ConnectStatus status )
+	{
+		if (conn.connectCallback)
+		{
+			completions.push_back({ std::move( conn.connectCallback ), status, nullptr, {} });
+			conn.connectCallback = nullptr;
+		}
+	}
+
+	void completeRequest( SensorReadCallback && callback, RequestStatus status, float value = 0.0f )
+	{
+		completions.push_back({ nullptr, ConnectStatus::Success, std::move( callback ), { status, value } });
+	}
+
+	/// Closes the socket and fails all the operations that were waiting for it.
+	void closeConnection( Connection & conn, ConnectStatus connectStatus, RequestStatus requestStatus )
+	{
+		if (conn.sock != invalidSocket)
+		{
+			closeSocket( conn.sock );
+			conn.sock = invalidSocket;
+		}
+		conn.state = ConnectionState::Closed;
+
+		completeConnect( conn, connectStatus );
+		for (PendingRequest & request : conn.pending)
+			if (!request.expired)
+				completeRequest( std::move( request.callback ), requestStatus );
+		conn.pending.clear();
+		conn.expiredCount = 0;
+		conn.nearestDeadline = Clock::time_point::max();
+		conn.outBuffer.clear();
+		conn.outOffset = 0;
+		conn.inBuffer.clear();
+	}
+
+	void failConnection( Connection & conn, ConnectStatus connectStatus, RequestStatus requestStatus )
+	{
+		lastSystemError = lastSocketError();
+		closeConnection( conn, connectStatus, requestStatus );
+	}
+
+	/// Sends as much of the output buffer as the socket accepts without blocking.
+	void flush( Connection & conn )
+	{
+		while (conn.outOffset < conn.outBuffer.size())
+		{
+			int sent = send( conn.sock, (const char *)conn.outBuffer.data() + conn.outOffset,
+			                 int( conn.outBuffer.size() - conn.outOffset ), sendFlags );
+			if (sent < 0)
+			{
+				if (!isWouldBlock( lastSocketError() ))
+					failConnection( conn, ConnectStatus::OtherSystemError, RequestStatus::SendRequestFailed );
+				return;
+			}
+			conn.outOffset += size_t( sent );
+		}
+		conn.outBuffer.clear();
+		conn.outOffset = 0;
+	}
+
+	void finishConnecting( Connection & conn )
+	{
+		system_error_t error = pendingConnectError( conn.sock );
+		if (error != 0)
+		{
+			lastSystemError = error;
+			closeConnection( conn, ConnectStatus::ConnectFailed, RequestStatus::NotConnected );
+			return;
+		}
+
+		conn.state = ConnectionState::Connected;
+		completeConnect( conn, ConnectStatus::Success );
+		flush( conn );  // requests issued while connecting
+	}
+
+	/// Matches the complete responses in the input buffer with the oldest pending requests.
+	void processResponses( Connection & conn )
+	{
+		size_t offset = 0;
+		while (conn.inBuffer.size() - offset >= sizeof(ResponseCode))
+		{
+			// the response is longer only if it carries a value, or the time to wait when the service is busy
+			const uint8_t * data = conn.inBuffer.data() + offset;
+			ResponseCode code = responseCodeAt( data );
+			size_t responseSize = code == ResponseCode::Success ? SensorResponse::size()
+			                    : code == ResponseCode::Busy ? BusyResponse::size()
+			                    : sizeof(ResponseCode);
+			if (conn.inBuffer.size() - offset < responseSize)
+				break;
+
+			if (conn.pending.empty())
+			{
+				// the server sends something we didn't ask for
+				closeConnection( conn, ConnectStatus::Success, RequestStatus::InvalidReply );
+				return;
+			}
+
+			// the time to wait after Busy is of no use here, see the AsyncClient class description
+			SensorResponse response( code );
+			bool parsed = code == ResponseCode::Busy || own::fromBytes( own::make_span( data, responseSize ), response );
+			offset += responseSize;
+
+			PendingRequest request = std::move( conn.pending.front() );
+			conn.pending.pop_front();
+			if (request.expired)
+			{
+				// already reported as NoReply, just drop the late reply
+				--conn.expiredCount;
+				continue;
+			}
+
+			if (!parsed)
+				completeRequest( std::move( request.callback ), RequestStatus::InvalidReply );
+			else if (response.code != ResponseCode::Success)
+				completeRequest( std::move( request.callback ), toRequestStatus( response.code ) );
+			else
+				completeRequest( std::move( request.callback ), RequestStatus::Success, response.value );
+		}
+		conn.inBuffer.erase( conn.inBuffer.begin(), conn.inBuffer.begin() + ptrdiff_t( offset ) );
+	}
+
+	void receive( Connection & conn )
+	{
+		uint8_t buffer [4096];
+		while (true)
+		{
+			int received = recv( conn.sock, (char *)buffer, sizeof(buffer), 0 );
+			if (received > 0)
+			{
+				conn.inBuffer.insert( conn.inBuffer.end(), buffer, buffer + received );
+				if (size_t( received ) < sizeof(buffer))
+					break;
+			}
+			else if (received == 0)
+			{
+				closeConnection( conn, ConnectStatus::Success, RequestStatus::ConnectionClosed );
+				return;
+			}
+			else
+			{
+				if (!isWouldBlock( lastSocketError() ))
+					failConnection( conn, ConnectStatus::Success, RequestStatus::ReceiveError );
+				break;
+			}
+		}
+		if (conn.state != ConnectionState::Closed)
+			processResponses( conn );
+	}
+
+	/// Completes the operations whose deadline has passed and returns the nearest deadline that hasn't.
+	Clock::time_point expireTimeouts( Clock::time_point now )
+	{
+		Clock::time_point nearestDeadline = Clock::time_point::max();
+		for (auto & [id, connPtr] : connections)
+		{
+			Connection & conn = *connPtr;
+			if (conn.state == ConnectionState::Connecting)
+			{
+				if (conn.connectDeadline <= now)
+				{
+					lastSystemError = timeoutError();
+					closeConnection( conn, ConnectStatus::ConnectFailed, RequestStatus::NotConnected );
+					continue;
+				}
+				nearestDeadline = std::min( nearestDeadline, conn.connectDeadline );
+			}
+			if (conn.nearestDeadline <= now)
+			{
+				conn.nearestDeadline = Clock::time_point::max();
+				for (PendingRequest & request : conn.pending)
+				{
+					if (request.expired)
+						continue;
+					if (request.deadline <= now)
+					{
+						completeRequest( std::move( request.callback ), RequestStatus::NoReply );
+						request.expired = true;
+						++conn.expiredCount;
+					}
+					else
+					{
+						conn.nearestDeadline = std::min( conn.nearestDeadline, request.deadline );
+					}
+				}
+			}
+			nearestDeadline = std::min( nearestDeadline, conn.nearestDeadline );
+		}
+		return nearestDeadline;
+	}
+
+	/// Registers a request whose bytes have just been appended to the output buffer.
+	void enqueueRequest( Connection & conn, size_t unsentBefore, SensorReadCallback && callback )
+	{
+		const Clock::time_point deadline = Clock::now() + timeout;
+		conn.pending.push_back({ std::move( callback ), deadline });
+		conn.nearestDeadline = std::min( conn.nearestDeadline, deadline );
+
+		// try to send it right away, if the socket is full, poll() will send it when it becomes writable
+		if (conn.state == ConnectionState::Connected && unsentBefore == 0)
+			flush( conn );
+	}
+
+	size_t invokeCompletions()
+	{
+		size_t invoked = 0;
+		// the callbacks may start new operations that end up in the completions immediately
+		while (!completions.empty())
+		{
+			finished.swap( completions );
+			for (Completion & completion : finished)
+			{
+				if (completion.connectCallback)
+					completion.connectCallback( completion.connectStatus );
+				else if (completion.sensorReadCallback)
+					completion.sensorReadCallback( completion.sensorReadResult );
+				++invoked;
+			}
+			finished.clear();  // keeps the capacity for the next time
+		}
+		return invoked;
+	}
+
+	void removeClosedConnections()
+	{
+		for (auto iter = connections.begin(); iter != connections.end(); )
+		{
+			if (iter->second->state == ConnectionState::Closed)
+				iter = connections.erase( iter );
+			else
+				++iter;
+		}
+	}
+};
+
+
+//======================================================================================================================
+//  AsyncClient: main API
+
+AsyncClient::AsyncClient() noexcept : _impl( new Impl )
+{
+	_impl->networkingInitialized = initNetworking();
+}
+
+AsyncClient::~AsyncClient() noexcept
+{
+	if (!_impl)  // moved from
+		return;
+
+	for (auto & [id, conn] : _impl->connections)
+		if (conn->sock != invalidSocket)
+			closeSocket( conn->sock );
+
+	if (_impl->networkingInitialized)
+		cleanupNetworking();
+}
+
+AsyncClient::AsyncClient( AsyncClient && other ) noexcept = default;
+AsyncClient & AsyncClient::operator=( AsyncClient && other ) noexcept = default;
+
+AsyncClient::ConnectionID AsyncClient::connect( const std::string & host, uint16_t port, ConnectCallback callback ) noexcept
+{
+	Impl & impl = *_impl;
+
+	auto conn = std::make_unique< Connection >();
+	conn->id = ++impl.lastConnectionID;
+	conn->connectCallback = std::move( callback );
+	conn->connectDeadline = Clock::now() + impl.timeout;
+	Connection & newConn = *conn;
+	impl.connections.emplace( conn->id, std::move( conn ) );
+
+	if (!impl.networkingInitialized)
+	{
+		impl.lastSystemError = lastSocketError();
+		impl.closeConnection( newConn, ConnectStatus::NetworkingInitFailed, RequestStatus::NotConnected );
+		return newConn.id;
+	}
+
+	addrinfo hints;
+	memset( &hints, 0, sizeof(hints) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	addrinfo * addresses = nullptr;
+	if (getaddrinfo( host.c_str(), std::to_string( port ).c_str(), &hints, &addresses ) != 0 || !addresses)
+	{
+		impl.lastSystemError = lastSocketError();
+		impl.closeConnection( newConn, ConnectStatus::HostNotResolved, RequestStatus::NotConnected );
+		return newConn.id;
+	}
+
+	// try only the first address, iterating them would require waiting for each of them
+	newConn.sock = socket( addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol );
+	if (newConn.sock == invalidSocket || !setNonBlocking( newConn.sock ))
+	{
+		freeaddrinfo( addresses );
+		impl.failConnection( newConn, ConnectStatus::OtherSystemError, RequestStatus::NotConnected );
+		return newConn.id;
+	}
+
+	// requests are small and latency matters more than the number of packets
+	int noDelay = 1;
+	setsockopt( newConn.sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay) );
+
+	int connectRes = ::connect( newConn.sock, addresses->ai_addr, socklen_t( addresses->ai_addrlen ) );
+	freeaddrinfo( addresses );
+	if (connectRes != 0 && !isWouldBlock( lastSocketError() ))
+	{
+		impl.failConnection( newConn, ConnectStatus::ConnectFailed, RequestStatus::NotConnected );
+		return newConn.id;
+	}
+
+	// even if the connect has finished immediately, the callback must not be invoked until poll()
+	return newConn.id;
+}
+
+bool AsyncClient::disconnect( ConnectionID connection ) noexcept
+{
+	Connection * conn = _impl->findConnection( connection );
+	if (!conn || conn->state == ConnectionState::Closed)
+		return false;
+
+	_impl->closeConnection( *conn, ConnectStatus::ConnectFailed, RequestStatus::ConnectionClosed );
+	return true;
+}
+
+bool AsyncClient::isConnected( ConnectionID connection ) const noexcept
+{
+	Connection * conn = _impl->findConnection( connection );
+	return conn && conn->state == ConnectionState::Connected;
+}
+
+void AsyncClient::setTimeout( std::chrono::milliseconds timeout ) noexcept
+{
+	_impl->timeout = timeout;
+}
+
+void AsyncClient::requestSensorReading( ConnectionID connection, std::string_view sensorID, SensorReadCallback callback ) noexcept
+{
+	Connection * conn = _impl->findConnection( connection );
+	if (!conn || conn->state == ConnectionState::Closed)
+	{
+		_impl->completeRequest( std::move( callback ), RequestStatus::NotConnected );
+		return;
+	}
+
+	// encode directly behind the requests that have not been sent yet
+	size_t oldSize = conn->outBuffer.size();
+	conn->outBuffer.resize( oldSize + SensorRequest::size( sensorID ) );
+	SensorRequest::encode( sensorID, conn->outBuffer.data() + oldSize );
+
+	_impl->enqueueRequest( *conn, oldSize, std::move( callback ) );
+}
+
+void AsyncClient::requestSensorReading( ConnectionID connection, const PreparedRequest & request, SensorReadCallback callback ) noexcept
+{
+	Connection * conn = _impl->findConnection( connection );
+	if (!conn || conn->state == ConnectionState::Closed)
+	{
+		_impl->completeRequest( std::move( callback ), RequestStatus::NotConnected );
+		return;
+	}
+
+	size_t oldSize = conn->outBuffer.size();
+	conn->outBuffer.insert( conn->outBuffer.end(), request.bytes().begin(), request.bytes().end() );
+
+	_impl->enqueueRequest( *conn, oldSize, std::move( callback ) );
+}
+
+size_t AsyncClient::poll( std::chrono::milliseconds maxWait ) noexcept
+{
+	Impl & impl = *_impl;
+
+	// operations that failed immediately are reported without waiting
+	if (!impl.completions.empty())
+		maxWait = milliseconds( 0 );
+
+	Clock::time_point now = Clock::now();
+	Clock::time_point nearestDeadline = impl.expireTimeouts( now );
+	if (!impl.completions.empty())
+		maxWait = milliseconds( 0 );
+	else if (nearestDeadline != Clock::time_point::max())
+		maxWait = std::min( maxWait, std::chrono::duration_cast< milliseconds >( nearestDeadline - now ) + milliseconds( 1 ) );
+
+	impl.pollFds.clear();
+	impl.polledConnections.clear();
+	for (auto & [id, conn] : impl.connections)
+	{
+		if (conn->state == ConnectionState::Closed)
+			continue;
+
+		pollfd pfd;
+		pfd.fd = conn->sock;
+		pfd.revents = 0;
+		if (conn->state == ConnectionState::Connecting)
+			pfd.events = POLLOUT;
+		else
+			pfd.events = short( POLLIN | (conn->outBuffer.empty() ? 0 : POLLOUT) );
+		impl.pollFds.push_back( pfd );
+		impl.polledConnections.push_back( conn.get() );
+	}
+
+	if (!impl.pollFds.empty())
+	{
+		int ready = pollSockets( impl.pollFds.data(), impl.pollFds.size(), int( maxWait.count() ) );
+		if (ready < 0)
+		{
+			impl.lastSystemError = lastSocketError();
+		}
+		for (size_t i = 0; ready > 0 && i < impl.pollFds.size(); ++i)
+		{
+			const pollfd & pfd = impl.pollFds[i];
+			Connection & conn = *impl.polledConnections[i];
+			if (pfd.revents == 0 || conn.state == ConnectionState::Closed)
+				continue;
+
+			if (conn.state == ConnectionState::Connecting)
+			{
+				impl.finishConnecting( conn );
+				continue;
+			}
+			if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+				impl.receive( conn );
+			if (conn.state == ConnectionState::Connected && (pfd.revents & POLLOUT))
+				impl.flush( conn );
+		}
+	}
+	else if (maxWait.count() > 0 && impl.completions.empty())
+	{
+		// nothing to wait for, but the caller may rely on poll() to pace his loop
+		std::this_thread::sleep_for( maxWait );
+	}
+
+	impl.expireTimeouts( Clock::now() );
+
+	size_t invoked = impl.invokeCompletions();
+	impl.removeClosedConnections();
+	return invoked;
+}
+
+void AsyncClient::run() noexcept
+{
+	while (pendingOperations() > 0)
+	{
+		poll( milliseconds( 1000 ) );
+	}
+}
+
+size_t AsyncClient::pendingOperations() const noexcept
+{
+	size_t count = _impl->completions.size();
+	for (auto & [id, conn] : _impl->connections)
+	{
+		if (conn->connectCallback)
+			++count;
+		count += conn->pending.size() - conn->expiredCount;
+	}
+	return count;
+}
+
+system_error_t AsyncClient::getLastSystemError() const noexcept
+{
+	return _impl->lastSystemError;
+}
+
+string AsyncClient::getLastSystemErrorStr() const noexcept
+{
+	return getErrorString( getLastSystemError() );
+}
+
+
+//======================================================================================================================
+
+
+} // namespace hwmon
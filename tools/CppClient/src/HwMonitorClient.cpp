@@ -9,6 +9,8 @@
 #include <CppUtils-Essential/Essential.hpp>
 
 #include "../../../src/Protocol.hpp"
+#include "ClientUtils.hpp"
+#include "../../../src/UnixSocket.hpp"
 
 #include <CppUtils-Network/Socket.hpp>
 using own::TcpSocket;
@@ -27,6 +29,7 @@ using own::make_span;
 using fut::make_unique;
 #include <CppUtils-Essential/CriticalError.hpp>
 
+#include <cstring>
 #include <string>
 using std::string;
 #include <vector>
@@ -35,6 +38,7 @@ using std::vector;
 using std::array;
 #include <chrono>
 using std::chrono::milliseconds;
+#include <thread>
 
 
 namespace hwmon {
@@ -81,6 +85,8 @@ const char * enumString( RequestStatus status ) noexcept
 		"Such sensor was not found.",
 		"Sensor is available but not monitored.",
 		"Sensor is available and monitored, but reading its value has failed.",
+		"There is no newer sample than the one given in the request.",
+		"The service is busy, send the request again later.",
 		"Internal error of this library. Please create a github issue.",
 	};
 	static_assert( size_t(RequestStatus::UnexpectedError) + 1 == fut::size(RequestStatusStr), "update the RequestStatusStr" );
@@ -96,10 +102,69 @@ const char * enumString( RequestStatus status ) noexcept
 }
 
 
+//======================================================================================================================
+//  PreparedRequest
+
+PreparedRequest::PreparedRequest( std::string_view sensorID ) : _bytes( SensorRequest::size( sensorID ) )
+{
+	SensorRequest::encode( sensorID, _bytes.data() );
+}
+
+
+//======================================================================================================================
+//  Client: transport
+
+/// The connection to the service, either over TCP or over a Unix domain socket, both sockets have the same methods.
+class Client::Transport
+{
+ public:
+
+	SocketError connect( const std::string & host, uint16_t port ) noexcept
+	{
+		if (isConnected())
+		{
+			return SocketError::AlreadyConnected;
+		}
+		const size_t prefixLength = strlen( unixAddressPrefix );
+		_overUnixSocket = host.compare( 0, prefixLength, unixAddressPrefix ) == 0;
+		return _overUnixSocket ? _unixSocket.connect( host.substr( prefixLength ) ) : _tcpSocket.connect( host, port );
+	}
+
+	SocketError disconnect() noexcept  { return _overUnixSocket ? _unixSocket.disconnect() : _tcpSocket.disconnect(); }
+	bool isConnected() const noexcept  { return _overUnixSocket ? _unixSocket.isConnected() : _tcpSocket.isConnected(); }
+	bool setTimeout( milliseconds timeout ) noexcept  { return _overUnixSocket ? _unixSocket.setTimeout( timeout ) : _tcpSocket.setTimeout( timeout ); }
+
+	SocketError send( own::const_byte_span data ) noexcept
+	{
+		return _overUnixSocket ? _unixSocket.send( data ) : _tcpSocket.send( data );
+	}
+	SocketError receiveOnce( own::byte_span buffer, size_t & received ) noexcept
+	{
+		return _overUnixSocket ? _unixSocket.receiveOnce( buffer, received ) : _tcpSocket.receiveOnce( buffer, received );
+	}
+
+	system_error_t getLastSystemError() const noexcept
+	{
+		return _overUnixSocket ? _unixSocket.getLastSystemError() : _tcpSocket.getLastSystemError();
+	}
+
+ private:
+
+	TcpSocket _tcpSocket;
+	UnixSocket _unixSocket;
+	bool _overUnixSocket = false;
+
+};
+
+
 //======================================================================================================================
 //  Client: main API
 
-Client::Client(  ) noexcept : _socket( new TcpSocket ) {}
+Client::Client(  ) noexcept
+:
+	_socket( new Transport ), _timeout( 500 ), _busyRetries( 0 ), _retryAfter( 0 ),
+	_lastRequestData( nullptr ), _lastRequestSize( 0 ), _responseBuffer( SensorResponse::size() )
+{}
 
 Client::~Client() noexcept {}
 
@@ -124,7 +189,8 @@ ConnectStatus Client::connect( const std::string & host, uint16_t port ) noexcep
 	}
 
 	// rather set some default timeout for recv operations, user can always override this
-	_socket->setTimeout( milliseconds( 500 ) );
+	_timeout = milliseconds( 500 );
+	_socket->setTimeout( _timeout );
 
 	return ConnectStatus::Success;
 }
@@ -152,70 +218,583 @@ bool Client::setTimeout( std::chrono::milliseconds timeout ) noexcept
 		return false;
 	}
 
-	return _socket->setTimeout( timeout );
+	if (!_socket->setTimeout( timeout ))
+	{
+		return false;
+	}
+
+	_timeout = timeout;
+	return true;
 }
 
-SensorReadResult Client::requestSensorReading( const std::string & sensorID ) noexcept
+SensorReadResult Client::requestSensorReading( std::string_view sensorID ) noexcept
 {
-	if (!_socket->isConnected())
+	// the buffer only grows when a longer ID comes, so reading the same sensors again doesn't allocate
+	_requestBuffer.resize( SensorRequest::size( sensorID ) );
+	SensorRequest::encode( sensorID, _requestBuffer.data() );
+
+	return exchange( _requestBuffer.data(), _requestBuffer.size() );
+}
+
+SensorReadResult Client::requestSensorReading( const PreparedRequest & request ) noexcept
+{
+	return exchange( request.bytes().data(), request.bytes().size() );
+}
+
+SensorReadResult Client::exchange( const uint8_t * requestData, size_t requestSize ) noexcept
+{
+	RequestStatus status = sendRequest( requestData, requestSize );
+	if (status != RequestStatus::Success)
 	{
-		return { RequestStatus::NotConnected, 0 };
+		return { status, 0.0f };
 	}
 
-	SensorReadResult result = { RequestStatus::UnexpectedError, 0.0f };
+	// The length of the response depends on the status code in the first 4 bytes,
+	// so receive only up to the expected length, directly into the buffer that lives as long as the client.
+	size_t responseSize = sizeof(ResponseCode);
+	status = receiveResponseCode();
+	if (status == RequestStatus::Success && responseCodeAt( _responseBuffer.data() ) == ResponseCode::Success)
+	{
+		responseSize = SensorResponse::size();
+		status = receiveResponse( sizeof(ResponseCode), responseSize - sizeof(ResponseCode) );
+	}
+	if (status != RequestStatus::Success)
+	{
+		return { status, 0.0f };
+	}
 
-	vector< uint8_t > requestData = own::toByteVector( SensorRequest( sensorID ) );
+	SensorResponse response;
+	if (!own::fromBytes( make_span( _responseBuffer.data(), responseSize ), response ))
+	{
+		return { RequestStatus::InvalidReply, 0.0f };
+	}
 
-	auto sendRes = _socket->send( requestData );
-	if (sendRes != SocketError::Success)
+	if (response.code != ResponseCode::Success)
+	{
+		return { toRequestStatus( response.code ), 0.0f };
+	}
+
+	return { RequestStatus::Success, response.value };
+}
+
+SampleReadResult Client::requestSample( std::string_view sensorID, uint32_t ifNewerThan ) noexcept
+{
+	SampleReadResult result = { RequestStatus::UnexpectedError, 0.0f, 0, 0 };
+
+	_requestBuffer.resize( SampleRequest::size( sensorID ) );
+	SampleRequest::encode( sensorID, ifNewerThan, _requestBuffer.data() );
+
+	result.status = sendRequest( _requestBuffer.data(), _requestBuffer.size() );
+	if (result.status != RequestStatus::Success)
 	{
-		result.status = RequestStatus::SendRequestFailed;
 		return result;
 	}
 
-	std::vector< uint8_t > responseData;
-	SocketError headerStatus = _socket->receiveOnce( responseData );
-	if (headerStatus != SocketError::Success)
+	receiveSample( result );
+	return result;
+}
+
+SampleReadResult Client::requestSample( std::string_view sensorID, ValueKind kind, uint32_t ifNewerThan ) noexcept
+{
+	SampleReadResult result = { RequestStatus::UnexpectedError, 0.0f, 0, 0 };
+
+	StatisticRequest request( std::string( sensorID ), ::ValueKind( kind ), ifNewerThan );
+	_requestBuffer.resize( request.size() );
+	BinaryOutputStream stream( make_span( _requestBuffer.data(), _requestBuffer.size() ) );
+	stream << request;
+
+	result.status = sendRequest( _requestBuffer.data(), _requestBuffer.size() );
+	if (result.status != RequestStatus::Success)
 	{
-		if (headerStatus == SocketError::ConnectionClosed)
-			result.status = RequestStatus::ConnectionClosed;
-		else if (headerStatus == SocketError::Timeout)
-			result.status = RequestStatus::NoReply;
-		else
-			result.status = RequestStatus::ReceiveError;
 		return result;
 	}
-	else if (responseData.size() < 4)
+
+	receiveSample( result );
+	return result;
+}
+
+PercentilesResult Client::requestPercentiles( std::string_view sensorID, const std::vector< float > & percentiles, std::chrono::seconds window ) noexcept
+{
+	PercentilesResult result = { RequestStatus::UnexpectedError, 0, {} };
+
+	if (percentiles.empty() || percentiles.size() > maxPercentiles || window.count() <= 0 || uint64_t( window.count() ) > maxPercentileWindow_s)
+	{
+		return result;
+	}
+
+	PercentileRequest request( std::string( sensorID ), percentiles, uint32_t( window.count() ) );
+	_requestBuffer.resize( request.size() );
+	BinaryOutputStream stream( make_span( _requestBuffer.data(), _requestBuffer.size() ) );
+	stream << request;
+
+	result.status = sendRequest( _requestBuffer.data(), _requestBuffer.size() );
+	if (result.status != RequestStatus::Success)
+	{
+		return result;
+	}
+
+	// code, then the sample count and the number of values, which has to match the request
+	size_t responseSize = sizeof(ResponseCode);
+	result.status = receiveResponseCode();
+	if (result.status == RequestStatus::Success && responseCodeAt( _responseBuffer.data() ) == ResponseCode::Success)
+	{
+		result.status = receiveResponse( sizeof(ResponseCode), PercentileResponse::headerSize() - sizeof(ResponseCode) );
+		if (result.status == RequestStatus::Success)
+		{
+			if (bigEndian32At( _responseBuffer.data() + PercentileResponse::headerSize() - sizeof(uint32_t) ) != percentiles.size())
+			{
+				result.status = RequestStatus::InvalidReply;
+				return result;
+			}
+			responseSize = PercentileResponse::headerSize() + percentiles.size() * sizeof(float);
+			result.status = receiveResponse( PercentileResponse::headerSize(), responseSize - PercentileResponse::headerSize() );
+		}
+	}
+	if (result.status != RequestStatus::Success)
+	{
+		return result;
+	}
+
+	PercentileResponse response;
+	if (!own::fromBytes( make_span( _responseBuffer.data(), responseSize ), response ))
 	{
 		result.status = RequestStatus::InvalidReply;
 		return result;
 	}
 
-	SensorResponse response;
-	if (!own::fromBytes( responseData, response ))
+	result.status = toRequestStatus( response.code );
+	if (response.code == ResponseCode::Success)
+	{
+		result.sampleCount = response.sampleCount;
+		result.values = std::move( response.values );
+	}
+	return result;
+}
+
+HistoryResult Client::requestHistory( std::string_view sensorID, std::chrono::seconds window, uint32_t pointCount ) noexcept
+{
+	HistoryResult result = { RequestStatus::UnexpectedError, 0, {} };
+
+	if (pointCount == 0 || pointCount > maxHistoryPoints || window.count() <= 0 || uint64_t( window.count() ) > maxHistoryWindow_s)
+	{
+		return result;
+	}
+
+	HistoryRequest request( std::string( sensorID ), uint32_t( window.count() ), pointCount );
+	_requestBuffer.resize( request.size() );
+	BinaryOutputStream stream( make_span( _requestBuffer.data(), _requestBuffer.size() ) );
+	stream << request;
+
+	result.status = sendRequest( _requestBuffer.data(), _requestBuffer.size() );
+	if (result.status != RequestStatus::Success)
+	{
+		return result;
+	}
+
+	// code, then the end timestamp and the number of points, which has to match the request
+	size_t responseSize = sizeof(ResponseCode);
+	result.status = receiveResponseCode();
+	if (result.status == RequestStatus::Success && responseCodeAt( _responseBuffer.data() ) == ResponseCode::Success)
+	{
+		result.status = receiveResponse( sizeof(ResponseCode), HistoryResponse::headerSize() - sizeof(ResponseCode) );
+		if (result.status == RequestStatus::Success)
+		{
+			if (bigEndian32At( _responseBuffer.data() + HistoryResponse::headerSize() - sizeof(uint32_t) ) != pointCount)
+			{
+				result.status = RequestStatus::InvalidReply;
+				return result;
+			}
+			responseSize = HistoryResponse::headerSize() + pointCount * HistoryResponse::pointSize();
+			result.status = receiveResponse( HistoryResponse::headerSize(), responseSize - HistoryResponse::headerSize() );
+		}
+	}
+	if (result.status != RequestStatus::Success)
+	{
+		return result;
+	}
+
+	HistoryResponse response;
+	if (!own::fromBytes( make_span( _responseBuffer.data(), responseSize ), response ))
 	{
 		result.status = RequestStatus::InvalidReply;
 		return result;
 	}
 
-	if (response.code != ResponseCode::Success)
+	result.status = toRequestStatus( response.code );
+	if (response.code == ResponseCode::Success)
+	{
+		result.endTimestamp_us = response.endTimestamp_us;
+		result.points.resize( response.sampleCounts.size() );
+		for (size_t i = 0; i < response.sampleCounts.size(); ++i)
+			result.points[i] = { response.sampleCounts[i], response.mins[i], response.maxs[i], response.means[i] };
+	}
+	return result;
+}
+
+SampleReadResult Client::requestFreshSample( std::string_view sensorID, std::chrono::milliseconds maxAge ) noexcept
+{
+	SampleReadResult result = { RequestStatus::UnexpectedError, 0.0f, 0, 0 };
+
+	if (maxAge.count() < 0 || uint64_t( maxAge.count() ) > UINT32_MAX)
+	{
+		return result;
+	}
+
+	_requestBuffer.resize( FreshRequest::size( sensorID ) );
+	FreshRequest::encode( sensorID, uint32_t( maxAge.count() ), _requestBuffer.data() );
+
+	result.status = sendRequest( _requestBuffer.data(), _requestBuffer.size() );
+	if (result.status != RequestStatus::Success)
+	{
+		return result;
+	}
+
+	// the server may need to read the hardware first, give it the time it's allowed to take
+	_socket->setTimeout( std::chrono::milliseconds( maxFreshReadTime_ms ) + _timeout );
+	receiveSample( result );
+	_socket->setTimeout( _timeout );
+
+	return result;
+}
+
+void Client::receiveSample( SampleReadResult & result ) noexcept
+{
+	size_t responseSize = sizeof(ResponseCode);
+
+	result.status = receiveResponseCode();
+	if (result.status == RequestStatus::Success && responseCodeAt( _responseBuffer.data() ) == ResponseCode::Success)
+	{
+		responseSize = SampleResponse::successSize();
+		result.status = receiveResponse( sizeof(ResponseCode), responseSize - sizeof(ResponseCode) );
+	}
+	if (result.status != RequestStatus::Success)
+	{
+		return;
+	}
+
+	SampleResponse response;
+	if (!own::fromBytes( make_span( _responseBuffer.data(), responseSize ), response ))
+	{
+		result.status = RequestStatus::InvalidReply;
+		return;
+	}
+
+	result.status = toRequestStatus( response.code );
+	if (response.code == ResponseCode::Success)
+	{
+		result.sensorValue = response.value;
+		result.seq = response.seq;
+		result.timestamp_us = response.timestamp_us;
+	}
+}
+
+ChangedSensorsResult Client::requestChangedSensors( const std::vector< std::string > & sensorIDs, uint32_t ifNewerThan ) noexcept
+{
+	ChangedSensorsResult result = { RequestStatus::UnexpectedError, 0, {} };
+
+	if (sensorIDs.size() > maxBatchSize)
+	{
+		return result;
+	}
+
+	ChangesRequest request( sensorIDs, ifNewerThan );
+	_requestBuffer.resize( request.size() );
+	BinaryOutputStream stream( make_span( _requestBuffer.data(), _requestBuffer.size() ) );
+	stream << request;
+
+	result.status = sendRequest( _requestBuffer.data(), _requestBuffer.size() );
+	if (result.status != RequestStatus::Success)
+	{
+		return result;
+	}
+
+	receiveChanges( result, sensorIDs.size() );
+	return result;
+}
+
+ChangedSensorsResult Client::waitForChangedSensors( const std::vector< std::string > & sensorIDs, uint32_t ifNewerThan, std::chrono::milliseconds timeout ) noexcept
+{
+	ChangedSensorsResult result = { RequestStatus::UnexpectedError, 0, {} };
+
+	if (sensorIDs.size() > maxBatchSize || timeout.count() < 0 || uint64_t( timeout.count() ) > maxWaitTimeout_ms)
+	{
+		return result;
+	}
+
+	WaitRequest request( sensorIDs, ifNewerThan, uint32_t( timeout.count() ) );
+	_requestBuffer.resize( request.size() );
+	BinaryOutputStream stream( make_span( _requestBuffer.data(), _requestBuffer.size() ) );
+	stream << request;
+
+	result.status = sendRequest( _requestBuffer.data(), _requestBuffer.size() );
+	if (result.status != RequestStatus::Success)
 	{
-		if (response.code == ResponseCode::InvalidRequest)
-			result.status = RequestStatus::UnexpectedError;
-		else if (response.code == ResponseCode::SensorNotFound)
-			result.status = RequestStatus::SensorNotFound;
-		else if (response.code == ResponseCode::SensorNotMonitored)
-			result.status = RequestStatus::SensorNotMonitored;
-		else if (response.code == ResponseCode::SensorFailed)
-			result.status = RequestStatus::SensorFailed;
 		return result;
 	}
 
-	result.status = RequestStatus::Success;
-	result.sensorValue = response.value;
+	// the server holds the request for up to the timeout, so the receive must not give up earlier
+	_socket->setTimeout( timeout + _timeout );
+	receiveChanges( result, sensorIDs.size() );
+	_socket->setTimeout( _timeout );
+
 	return result;
 }
 
+SensorListResult Client::listSensors( std::string_view prefix, std::string_view startAfter, uint32_t maxCount ) noexcept
+{
+	SensorListResult result = { RequestStatus::UnexpectedError, {}, false };
+
+	ListRequest request( std::string( prefix ), std::string( startAfter ), maxCount );
+	_requestBuffer.resize( request.size() );
+	BinaryOutputStream stream( make_span( _requestBuffer.data(), _requestBuffer.size() ) );
+	stream << request;
+
+	result.status = sendRequest( _requestBuffer.data(), _requestBuffer.size() );
+	if (result.status != RequestStatus::Success)
+	{
+		return result;
+	}
+
+	// IDs are rarely longer than 100 characters, anything this long is garbage
+	size_t responseSize = 0;
+	result.status = receiveSizedResponse( ListResponse::headerSize(), maxListCount * 1024, responseSize );
+	if (result.status != RequestStatus::Success)
+	{
+		return result;
+	}
+
+	ListResponse response;
+	if (!own::fromBytes( make_span( _responseBuffer.data(), responseSize ), response ))
+	{
+		result.status = RequestStatus::InvalidReply;
+		return result;
+	}
+
+	result.status = toRequestStatus( response.code );
+	if (response.code == ResponseCode::Success)
+	{
+		result.hasMore = response.hasMore != 0;
+		result.sensors.resize( response.ids.size() );
+		for (size_t i = 0; i < response.ids.size(); ++i)
+		{
+			ListedSensor & sensor = result.sensors[i];
+			sensor.id = std::move( response.ids[i] );
+			sensor.name = std::move( response.names[i] );
+			sensor.category = std::move( response.categories[i] );
+			sensor.state = toRequestStatus( response.states[i] );
+		}
+	}
+	return result;
+}
+
+AlertsResult Client::waitForAlerts( uint32_t afterEvent, std::chrono::milliseconds timeout ) noexcept
+{
+	AlertsResult result = { RequestStatus::UnexpectedError, 0, false, {} };
+
+	if (timeout.count() < 0 || uint64_t( timeout.count() ) > maxWaitTimeout_ms)
+	{
+		return result;
+	}
+
+	AlertsRequest request( afterEvent, uint32_t( timeout.count() ) );
+	_requestBuffer.resize( request.size() );
+	BinaryOutputStream stream( make_span( _requestBuffer.data(), _requestBuffer.size() ) );
+	stream << request;
+
+	result.status = sendRequest( _requestBuffer.data(), _requestBuffer.size() );
+	if (result.status != RequestStatus::Success)
+	{
+		return result;
+	}
+
+	// the server holds the request for up to the timeout, so the receive must not give up earlier
+	size_t responseSize = 0;
+	_socket->setTimeout( timeout + _timeout );
+	result.status = receiveSizedResponse( AlertsResponse::headerSize(), maxAlertEvents * 1024, responseSize );
+	_socket->setTimeout( _timeout );
+	if (result.status != RequestStatus::Success)
+	{
+		return result;
+	}
+
+	AlertsResponse response;
+	if (!own::fromBytes( make_span( _responseBuffer.data(), responseSize ), response ))
+	{
+		result.status = RequestStatus::InvalidReply;
+		return result;
+	}
+
+	result.status = toRequestStatus( response.code );
+	if (response.code == ResponseCode::Success)
+	{
+		result.lastEvent = response.lastEvent;
+		result.isSnapshot = response.isSnapshot != 0;
+		result.events.resize( response.numbers.size() );
+		for (size_t i = 0; i < response.numbers.size(); ++i)
+		{
+			AlertEvent & event = result.events[i];
+			event.number = response.numbers[i];
+			event.rule = response.rules[i];
+			event.raised = response.states[i] == AlertState::Raised;
+			event.sensorValue = response.values[i];
+			event.timestamp_us = response.timestamps_us[i];
+			event.sensorID = std::move( response.sensorIDs[i] );
+		}
+	}
+
+	return result;
+}
+
+RequestStatus Client::receiveSizedResponse( size_t headerSize, size_t maxPayloadSize, size_t & responseSize ) noexcept
+{
+	// the strings have variable length, so the header ends with the number of bytes that follow it
+	responseSize = sizeof(ResponseCode);
+
+	RequestStatus status = receiveResponseCode();
+	if (status == RequestStatus::Success && responseCodeAt( _responseBuffer.data() ) == ResponseCode::Success)
+	{
+		status = receiveResponse( sizeof(ResponseCode), headerSize - sizeof(ResponseCode) );
+		if (status == RequestStatus::Success)
+		{
+			size_t payloadSize = bigEndian32At( _responseBuffer.data() + headerSize - sizeof(uint32_t) );
+			if (payloadSize > maxPayloadSize)
+			{
+				return RequestStatus::InvalidReply;
+			}
+			responseSize = headerSize + payloadSize;
+			status = receiveResponse( headerSize, payloadSize );
+		}
+	}
+	return status;
+}
+
+void Client::receiveChanges( ChangedSensorsResult & result, size_t maxCount ) noexcept
+{
+	// code, then seq and count, then the columns whose length is given by the count
+	const size_t headerSize = sizeof(ResponseCode) + 2 * sizeof(uint32_t);
+	const size_t entrySize = sizeof(uint32_t) + sizeof(ResponseCode) + sizeof(float) + sizeof(uint32_t) + sizeof(uint64_t);
+	size_t responseSize = sizeof(ResponseCode);
+
+	result.status = receiveResponseCode();
+	if (result.status == RequestStatus::Success && responseCodeAt( _responseBuffer.data() ) == ResponseCode::Success)
+	{
+		result.status = receiveResponse( sizeof(ResponseCode), headerSize - sizeof(ResponseCode) );
+		if (result.status == RequestStatus::Success)
+		{
+			const uint8_t * countBytes = _responseBuffer.data() + headerSize - sizeof(uint32_t);
+			uint32_t count = uint32_t(countBytes[0]) << 24 | uint32_t(countBytes[1]) << 16 | uint32_t(countBytes[2]) << 8 | uint32_t(countBytes[3]);
+			if (count > maxCount)
+			{
+				result.status = RequestStatus::InvalidReply;
+				return;
+			}
+			responseSize = headerSize + count * entrySize;
+			result.status = receiveResponse( headerSize, responseSize - headerSize );
+		}
+	}
+	if (result.status != RequestStatus::Success)
+	{
+		return;
+	}
+
+	ChangesResponse response;
+	if (!own::fromBytes( make_span( _responseBuffer.data(), responseSize ), response ))
+	{
+		result.status = RequestStatus::InvalidReply;
+		return;
+	}
+
+	result.status = toRequestStatus( response.code );
+	result.seq = response.seq;
+	result.sensors.resize( response.indexes.size() );
+	for (size_t i = 0; i < response.indexes.size(); ++i)
+	{
+		ChangedSensor & sensor = result.sensors[i];
+		sensor.index = response.indexes[i];
+		sensor.status = toRequestStatus( response.codes[i] );
+		sensor.sensorValue = response.values[i];
+		sensor.seq = response.seqs[i];
+		sensor.timestamp_us = response.timestamps_us[i];
+	}
+}
+
+RequestStatus Client::sendRequest( const uint8_t * requestData, size_t requestSize ) noexcept
+{
+	if (!_socket->isConnected())
+	{
+		return RequestStatus::NotConnected;
+	}
+
+	auto sendRes = _socket->send( make_span( requestData, requestSize ) );
+	if (sendRes != SocketError::Success)
+	{
+		return RequestStatus::SendRequestFailed;
+	}
+
+	_lastRequestData = requestData;
+	_lastRequestSize = requestSize;
+	return RequestStatus::Success;
+}
+
+RequestStatus Client::receiveResponseCode() noexcept
+{
+	for (unsigned retry = 0; ; ++retry)
+	{
+		RequestStatus status = receiveResponse( 0, sizeof(ResponseCode) );
+		if (status != RequestStatus::Success || responseCodeAt( _responseBuffer.data() ) != ResponseCode::Busy)
+		{
+			return status;
+		}
+
+		// unlike the other codes, Busy is followed by the time to wait, it must not be left in the socket
+		status = receiveResponse( sizeof(ResponseCode), BusyResponse::size() - sizeof(ResponseCode) );
+		if (status != RequestStatus::Success)
+		{
+			return status;
+		}
+		_retryAfter = milliseconds( bigEndian32At( _responseBuffer.data() + sizeof(ResponseCode) ) );
+		if (retry >= _busyRetries)
+		{
+			return RequestStatus::Success;  // the code in the buffer makes the caller report Busy
+		}
+
+		std::this_thread::sleep_for( _retryAfter );
+		status = sendRequest( _lastRequestData, _lastRequestSize );
+		if (status != RequestStatus::Success)
+		{
+			return status;
+		}
+	}
+}
+
+RequestStatus Client::receiveResponse( size_t offset, size_t size ) noexcept
+{
+	if (_responseBuffer.size() < offset + size)
+	{
+		_responseBuffer.resize( offset + size );
+	}
+
+	// the response may arrive split into more parts
+	size_t receivedTotal = 0;
+	while (receivedTotal < size)
+	{
+		size_t received = 0;
+		SocketError recvStatus = _socket->receiveOnce( make_span( _responseBuffer.data() + offset + receivedTotal, size - receivedTotal ), received );
+		if (recvStatus != SocketError::Success)
+		{
+			if (recvStatus == SocketError::ConnectionClosed)
+				return RequestStatus::ConnectionClosed;
+			else if (recvStatus == SocketError::Timeout)
+				return RequestStatus::NoReply;
+			else
+				return RequestStatus::ReceiveError;
+		}
+		receivedTotal += received;
+	}
+
+	return RequestStatus::Success;
+}
+
 system_error_t Client::getLastSystemError() const noexcept
 {
 	return _socket->getLastSystemError();
@@ -0,0 +1,349 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: local copy of a set of sensors, kept up to date by a background thread
+//======================================================================================================================
+
+#include <HwMonitorMirror.hpp>
+#include <CppUtils-Essential/Essential.hpp>
+
+#include "../../../src/Protocol.hpp"  // maxBatchSize
+
+#include <string>
+using std::string;
+using std::string_view;
+#include <vector>
+using std::vector;
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <system_error>
+#include <algorithm>
+#include <random>
+#include <climits>
+#include <chrono>
+using std::chrono::milliseconds;
+using std::chrono::microseconds;
+
+using Clock = std::chrono::steady_clock;
+
+
+namespace hwmon {
+
+
+//======================================================================================================================
+//  Mirror: internal state
+
+// The service holds the wait request at most this long, so that stop() doesn't have to wait for a whole cycle.
+static const milliseconds waitTimeout( 250 );
+// how often to ask for the changes when the service doesn't serve the wait request on this address
+static const milliseconds pollInterval( 100 );
+
+static int64_t localTime_us() noexcept
+{
+	return std::chrono::duration_cast< microseconds >( Clock::now().time_since_epoch() ).count();
+}
+
+/// One mirrored sensor, written only by the background thread and read by any thread.
+/** The fields are guarded by a sequence lock: the writer makes the version odd before it changes them and even
+  * again after that, a reader that sees an odd version or a different version after reading them reads them again.
+  * The writer stores a few numbers once per cycle, so the readers practically never have to retry. */
+struct Slot
+{
+	std::atomic< uint32_t > version { 0 };
+	std::atomic< RequestStatus > status { RequestStatus::NotConnected };
+	std::atomic< float > value { 0.0f };
+	std::atomic< uint32_t > seq { 0 };
+	std::atomic< int64_t > sampledAt_us { 0 };  ///< local steady clock, 0 if not known
+};
+
+struct Mirror::Impl
+{
+	vector< string > sensorIDs;
+	vector< std::pair< string_view, size_t > > sortedIDs;  ///< for indexOf(), the views point into sensorIDs
+	vector< vector< string > > groups;  ///< sensorIDs split into requests of at most maxBatchSize sensors
+	std::unique_ptr< Slot[] > slots;
+
+	std::atomic< bool > connected { false };
+	std::atomic< uint32_t > lastCycle { 0 };
+	std::atomic< milliseconds > firstBackoff { milliseconds( 100 ) };
+	std::atomic< milliseconds > maxBackoff { milliseconds( 10000 ) };
+
+	// control of the background thread
+	string host;
+	uint16_t port = defaultPort;
+	std::thread thread;
+	std::mutex stopMtx;
+	std::condition_variable stopSignal;
+	std::atomic< bool > stopRequested { false };
+
+	Impl( vector< string > && sensorIDs );
+	~Impl() noexcept  { stop(); }
+
+	void stop() noexcept;
+
+	/// Waits for the given time, returns false if stop() has been called meanwhile.
+	bool sleepUnlessStopped( milliseconds duration ) noexcept;
+
+	/// Body of the background thread, connects again and again until stopped.
+	void run() noexcept;
+	/// Keeps the values in sync until the connection fails or stop() is called, returns whether anything has been received.
+	bool syncUntilFailure( Client & client ) noexcept;
+	void store( size_t firstIndex, const ChangedSensorsResult & result, int64_t & clockOffset_us ) noexcept;
+};
+
+Mirror::Impl::Impl( vector< string > && ids )
+	: sensorIDs( std::move( ids ) ), slots( new Slot [sensorIDs.size()] )
+{
+	sortedIDs.reserve( sensorIDs.size() );
+	for (size_t i = 0; i < sensorIDs.size(); ++i)
+		sortedIDs.emplace_back( sensorIDs[i], i );
+	std::sort( sortedIDs.begin(), sortedIDs.end() );
+
+	for (size_t i = 0; i < sensorIDs.size(); i += maxBatchSize)
+		groups.emplace_back( sensorIDs.begin() + i, sensorIDs.begin() + std::min( i + maxBatchSize, sensorIDs.size() ) );
+}
+
+void Mirror::Impl::stop() noexcept
+{
+	if (!thread.joinable())
+		return;
+
+	{
+		std::lock_guard< std::mutex > lock( stopMtx );
+		stopRequested = true;
+	}
+	stopSignal.notify_all();
+	thread.join();
+	stopRequested = false;
+}
+
+bool Mirror::Impl::sleepUnlessStopped( milliseconds duration ) noexcept
+{
+	std::unique_lock< std::mutex > lock( stopMtx );
+	return !stopSignal.wait_for( lock, duration, [this]() { return stopRequested.load(); } );
+}
+
+
+//======================================================================================================================
+//  Mirror: background thread
+
+void Mirror::Impl::run() noexcept
+{
+	Client client;
+	// many clients of a restarted service would otherwise all come back at the same moment
+	std::minstd_rand random( unsigned( Clock::now().time_since_epoch().count() ) );
+	milliseconds backoff = firstBackoff;
+
+	while (!stopRequested)
+	{
+		bool synced = false;
+		if (client.connect( host, port ) == ConnectStatus::Success)
+		{
+			connected = true;
+			synced = syncUntilFailure( client );
+			connected = false;
+			client.disconnect();
+		}
+
+		// a service that accepts the connection and closes it right away is not hammered either
+		if (synced)
+			backoff = firstBackoff;
+		const milliseconds delay = backoff / 2 + milliseconds( random() % uint64_t( backoff.count() / 2 + 1 ) );
+		backoff = std::min( backoff * 2, maxBackoff.load() );
+		if (!sleepUnlessStopped( delay ))
+			break;
+	}
+}
+
+bool Mirror::Impl::syncUntilFailure( Client & client ) noexcept
+{
+	vector< uint32_t > groupSeqs( groups.size(), 0 );
+	// local time minus the service's time, the smallest one seen is the closest to the truth,
+	// it comes from the response that has taken the shortest time
+	int64_t clockOffset_us = INT64_MAX;
+	bool synced = false;
+	bool canWait = true;
+
+	for (bool first = true; !stopRequested; first = false)
+	{
+		// The first request of a connection reads all the sensors, including those that haven't changed for long.
+		// Then only the first group waits for the next cycle, the others are read right after it, they have changed by then too.
+		if (!first && !canWait && !sleepUnlessStopped( pollInterval ))
+			break;
+
+		for (size_t g = 0; g < groups.size(); ++g)
+		{
+			ChangedSensorsResult result = g == 0 && !first && canWait
+				? client.waitForChangedSensors( groups[g], groupSeqs[g], waitTimeout )
+				: client.requestChangedSensors( groups[g], groupSeqs[g] );
+
+			if (result.status == RequestStatus::UnexpectedError && g == 0 && !first && canWait)
+			{
+				// the service has refused the wait request, a critical listener serves only the plain reads
+				canWait = false;
+				break;
+			}
+			else if (result.status == RequestStatus::Busy)
+			{
+				if (!sleepUnlessStopped( client.getRetryAfter() ))
+					return synced;
+				break;
+			}
+			else if (result.status == RequestStatus::NotModified)
+			{
+				continue;
+			}
+			else if (result.status != RequestStatus::Success)
+			{
+				return synced;
+			}
+
+			synced = true;
+			groupSeqs[g] = result.seq;
+			store( g * maxBatchSize, result, clockOffset_us );
+		}
+
+		lastCycle = groupSeqs[0];
+	}
+
+	return synced;
+}
+
+void Mirror::Impl::store( size_t firstIndex, const ChangedSensorsResult & result, int64_t & clockOffset_us ) noexcept
+{
+	const int64_t now_us = localTime_us();
+	for (const ChangedSensor & sensor : result.sensors)
+		if (sensor.timestamp_us != 0)
+			clockOffset_us = std::min( clockOffset_us, now_us - int64_t( sensor.timestamp_us ) );
+
+	const size_t groupSize = std::min( sensorIDs.size() - firstIndex, size_t( maxBatchSize ) );
+	for (const ChangedSensor & sensor : result.sensors)
+	{
+		if (sensor.index >= groupSize)
+			continue;  // the service would never send this
+
+		// the values the service has loaded from its cache have no timestamp
+		const int64_t sampledAt_us = sensor.timestamp_us != 0 ? int64_t( sensor.timestamp_us ) + clockOffset_us : 0;
+
+		Slot & slot = slots[ firstIndex + sensor.index ];
+		const uint32_t version = slot.version.load( std::memory_order_relaxed );
+		slot.version.store( version + 1, std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_release );
+		slot.status.store( sensor.status, std::memory_order_relaxed );
+		slot.value.store( sensor.sensorValue, std::memory_order_relaxed );
+		slot.seq.store( sensor.seq, std::memory_order_relaxed );
+		slot.sampledAt_us.store( sampledAt_us, std::memory_order_relaxed );
+		slot.version.store( version + 2, std::memory_order_release );
+	}
+}
+
+
+//======================================================================================================================
+//  Mirror: main API
+
+Mirror::Mirror( vector< string > sensorIDs ) : _impl( new Impl( std::move( sensorIDs ) ) ) {}
+
+// the Impl stops the thread when it's destroyed
+Mirror::~Mirror() noexcept = default;
+
+Mirror::Mirror( Mirror && other ) noexcept = default;
+Mirror & Mirror::operator=( Mirror && other ) noexcept = default;
+
+bool Mirror::start( const std::string & host, uint16_t port ) noexcept
+{
+	Impl & impl = *_impl;
+
+	if (impl.thread.joinable())
+	{
+		return false;
+	}
+
+	impl.host = host;
+	impl.port = port;
+	try
+	{
+		impl.thread = std::thread( &Impl::run, &impl );
+	}
+	catch (const std::system_error &)
+	{
+		return false;
+	}
+	return true;
+}
+
+void Mirror::stop() noexcept
+{
+	_impl->stop();
+}
+
+void Mirror::setReconnectBackoff( milliseconds first, milliseconds max ) noexcept
+{
+	_impl->firstBackoff = std::max( first, milliseconds( 1 ) );
+	_impl->maxBackoff = std::max( max, first );
+}
+
+bool Mirror::isConnected() const noexcept
+{
+	return _impl->connected;
+}
+
+uint32_t Mirror::lastCycle() const noexcept
+{
+	return _impl->lastCycle;
+}
+
+size_t Mirror::sensorCount() const noexcept
+{
+	return _impl->sensorIDs.size();
+}
+
+size_t Mirror::indexOf( string_view sensorID ) const noexcept
+{
+	const auto & sortedIDs = _impl->sortedIDs;
+	auto iter = std::lower_bound( sortedIDs.begin(), sortedIDs.end(), sensorID,
+		[]( const std::pair< string_view, size_t > & entry, string_view id ) { return entry.first < id; }
+	);
+	return iter != sortedIDs.end() && iter->first == sensorID ? iter->second : npos;
+}
+
+MirroredValue Mirror::read( size_t index ) const noexcept
+{
+	if (index >= _impl->sensorIDs.size())
+	{
+		return { RequestStatus::SensorNotMonitored, 0.0f, 0, microseconds::max() };
+	}
+
+	const Slot & slot = _impl->slots[ index ];
+	MirroredValue result;
+	int64_t sampledAt_us;
+	while (true)
+	{
+		const uint32_t version = slot.version.load( std::memory_order_acquire );
+		if (version & 1)
+			continue;  // the background thread is in the middle of writing it, that takes a few nanoseconds
+		result.status = slot.status.load( std::memory_order_relaxed );
+		result.sensorValue = slot.value.load( std::memory_order_relaxed );
+		result.seq = slot.seq.load( std::memory_order_relaxed );
+		sampledAt_us = slot.sampledAt_us.load( std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if (slot.version.load( std::memory_order_relaxed ) == version)
+			break;
+	}
+
+	result.age = sampledAt_us != 0 ? microseconds( localTime_us() - sampledAt_us ) : microseconds::max();
+	return result;
+}
+
+MirroredValue Mirror::read( string_view sensorID ) const noexcept
+{
+	return read( indexOf( sensorID ) );
+}
+
+
+//======================================================================================================================
+
+
+} // namespace hwmon
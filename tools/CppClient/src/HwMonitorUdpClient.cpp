@@ -0,0 +1,397 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: connectionless client sending the requests to the UDP endpoint of the HwMonitorService
+//======================================================================================================================
+
+#include <HwMonitorUdpClient.hpp>
+#include <CppUtils-Essential/Essential.hpp>
+
+#include "../../../src/Protocol.hpp"
+#include "ClientUtils.hpp"
+
+#include <CppUtils-Network/SystemErrorInfo.hpp>
+using own::getErrorString;
+
+#include <CppUtils-Essential/BinaryStream.hpp>
+#include <CppUtils-Essential/ContainerUtils.hpp>
+using own::make_span;
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	using socket_t = SOCKET;
+	static const socket_t invalidSocket = INVALID_SOCKET;
+#else
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+	#include <netdb.h>
+	#include <poll.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+	using socket_t = int;
+	static const socket_t invalidSocket = -1;
+#endif
+
+#include <cstring>
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+#include <chrono>
+using std::chrono::milliseconds;
+
+using Clock = std::chrono::steady_clock;
+
+
+namespace hwmon {
+
+
+//======================================================================================================================
+//  platform
+
+static bool initNetworking() noexcept
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	return WSAStartup( MAKEWORD(2, 2), &wsaData ) == 0;
+#else
+	return true;
+#endif
+}
+
+static void cleanupNetworking() noexcept
+{
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+static void closeSocket( socket_t sock ) noexcept
+{
+#ifdef _WIN32
+	closesocket( sock );
+#else
+	::close( sock );
+#endif
+}
+
+static bool setNonBlocking( socket_t sock ) noexcept
+{
+#ifdef _WIN32
+	u_long enabled = 1;
+	return ioctlsocket( sock, FIONBIO, &enabled ) == 0;
+#else
+	int flags = fcntl( sock, F_GETFL, 0 );
+	return flags >= 0 && fcntl( sock, F_SETFL, flags | O_NONBLOCK ) == 0;
+#endif
+}
+
+static system_error_t lastSocketError() noexcept
+{
+#ifdef _WIN32
+	return system_error_t( WSAGetLastError() );
+#else
+	return errno;
+#endif
+}
+
+static bool isWouldBlock( system_error_t error ) noexcept
+{
+#ifdef _WIN32
+	return error == WSAEWOULDBLOCK;
+#else
+	return error == EWOULDBLOCK || error == EAGAIN;
+#endif
+}
+
+/// Waits until a datagram arrives or the timeout expires, returns false on timeout or error.
+static bool waitForDatagram( socket_t sock, milliseconds timeout ) noexcept
+{
+	pollfd pollFd;
+	pollFd.fd = sock;
+	pollFd.events = POLLIN;
+	pollFd.revents = 0;
+#ifdef _WIN32
+	return WSAPoll( &pollFd, 1, int( timeout.count() ) ) > 0;
+#else
+	return ::poll( &pollFd, 1, int( timeout.count() ) ) > 0;
+#endif
+}
+
+
+//======================================================================================================================
+//  UdpClient: internal state
+
+// A batch response for maxBatchSize sensors is about 8 kB, this leaves space for any future extension.
+static const size_t maxReplySize = 64 * 1024;
+
+struct UdpClient::Impl
+{
+	bool networkingInitialized = false;
+	socket_t sock = invalidSocket;
+	milliseconds timeout = milliseconds( 100 );
+	unsigned retries = 2;
+	system_error_t lastSystemError = 0;
+
+	// reused by all requests, so that we don't allocate new ones every time
+	vector< uint8_t > requestBuffer;
+	vector< uint8_t > datagramBuffer;  ///< the request followed by its ID
+	vector< uint8_t > replyBuffer = vector< uint8_t >( maxReplySize );
+
+	/// The service copies it to the end of the reply, the retries of a request send the same one.
+	uint32_t lastRequestID = 0;
+
+	/// Sends the request and receives the reply into replyBuffer, sends it again if the reply doesn't come in time.
+	/** replySize doesn't include the request ID at the end of the reply. */
+	RequestStatus exchange( const uint8_t * requestData, size_t requestSize, size_t & replySize ) noexcept;
+	SensorReadResult exchangeSensor( const uint8_t * requestData, size_t requestSize ) noexcept;
+};
+
+RequestStatus UdpClient::Impl::exchange( const uint8_t * requestData, size_t requestSize, size_t & replySize ) noexcept
+{
+	replySize = 0;
+	if (sock == invalidSocket)
+	{
+		return RequestStatus::NotConnected;
+	}
+	if (requestSize + datagramRequestIDSize > maxDatagramSize)
+	{
+		return RequestStatus::SendRequestFailed;
+	}
+
+	// grows only when a longer request comes
+	const uint32_t requestID = ++lastRequestID;
+	datagramBuffer.resize( requestSize + datagramRequestIDSize );
+	memcpy( datagramBuffer.data(), requestData, requestSize );
+	memcpy( datagramBuffer.data() + requestSize, &requestID, datagramRequestIDSize );
+
+	for (unsigned attempt = 0; attempt <= retries; ++attempt)
+	{
+		if (send( sock, (const char *)datagramBuffer.data(), int( datagramBuffer.size() ), 0 ) < 0)
+		{
+			lastSystemError = lastSocketError();
+			return RequestStatus::SendRequestFailed;
+		}
+
+		const auto deadline = Clock::now() + timeout;
+		for (auto now = Clock::now(); now < deadline; now = Clock::now())
+		{
+			if (!waitForDatagram( sock, std::chrono::duration_cast< milliseconds >( deadline - now ) + milliseconds( 1 ) ))
+				break;  // timeout, send it again
+
+			auto received = recv( sock, (char *)replyBuffer.data(), int( replyBuffer.size() ), 0 );
+			if (received >= 0)
+			{
+				// a reply to any attempt of this request will do, a late one to an earlier request must not
+				if (size_t( received ) < datagramRequestIDSize
+				 || memcmp( replyBuffer.data() + received - datagramRequestIDSize, &requestID, datagramRequestIDSize ) != 0)
+					continue;
+				replySize = size_t( received ) - datagramRequestIDSize;
+				// sending it again right away would only add to the overload
+				if (replySize >= sizeof(ResponseCode) && responseCodeAt( replyBuffer.data() ) == ResponseCode::Busy)
+					return RequestStatus::Busy;
+				return RequestStatus::Success;
+			}
+			lastSystemError = lastSocketError();
+			if (!isWouldBlock( lastSystemError ))
+			{
+				// most likely nothing listens on the port and the system got an ICMP message about it
+				return RequestStatus::ReceiveError;
+			}
+		}
+	}
+
+	return RequestStatus::NoReply;
+}
+
+
+//======================================================================================================================
+//  UdpClient: main API
+
+UdpClient::UdpClient() noexcept : _impl( new Impl )
+{
+	_impl->networkingInitialized = initNetworking();
+}
+
+UdpClient::~UdpClient() noexcept
+{
+	if (!_impl)  // moved from
+		return;
+
+	close();
+
+	if (_impl->networkingInitialized)
+		cleanupNetworking();
+}
+
+UdpClient::UdpClient( UdpClient && other ) noexcept = default;
+UdpClient & UdpClient::operator=( UdpClient && other ) noexcept = default;
+
+ConnectStatus UdpClient::open( const std::string & host, uint16_t port ) noexcept
+{
+	Impl & impl = *_impl;
+
+	if (impl.sock != invalidSocket)
+	{
+		return ConnectStatus::AlreadyConnected;
+	}
+	if (!impl.networkingInitialized)
+	{
+		impl.networkingInitialized = initNetworking();
+		if (!impl.networkingInitialized)
+		{
+			impl.lastSystemError = lastSocketError();
+			return ConnectStatus::NetworkingInitFailed;
+		}
+	}
+
+	addrinfo hints;
+	memset( &hints, 0, sizeof(hints) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+	addrinfo * addresses = nullptr;
+	if (getaddrinfo( host.c_str(), std::to_string( port ).c_str(), &hints, &addresses ) != 0 || !addresses)
+	{
+		impl.lastSystemError = lastSocketError();
+		return ConnectStatus::HostNotResolved;
+	}
+
+	socket_t sock = socket( addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol );
+	if (sock == invalidSocket || !setNonBlocking( sock ))
+	{
+		impl.lastSystemError = lastSocketError();
+		freeaddrinfo( addresses );
+		if (sock != invalidSocket)
+			closeSocket( sock );
+		return ConnectStatus::OtherSystemError;
+	}
+
+	// This only sets the default destination and makes the system drop the datagrams coming from anywhere else.
+	int connectRes = ::connect( sock, addresses->ai_addr, socklen_t( addresses->ai_addrlen ) );
+	freeaddrinfo( addresses );
+	if (connectRes != 0)
+	{
+		impl.lastSystemError = lastSocketError();
+		closeSocket( sock );
+		return ConnectStatus::OtherSystemError;
+	}
+
+	impl.sock = sock;
+	return ConnectStatus::Success;
+}
+
+void UdpClient::close() noexcept
+{
+	if (_impl->sock != invalidSocket)
+	{
+		closeSocket( _impl->sock );
+		_impl->sock = invalidSocket;
+	}
+}
+
+bool UdpClient::isOpen() const noexcept
+{
+	return _impl->sock != invalidSocket;
+}
+
+void UdpClient::setRetryPolicy( milliseconds timeout, unsigned retries ) noexcept
+{
+	_impl->timeout = timeout;
+	_impl->retries = retries;
+}
+
+SensorReadResult UdpClient::requestSensorReading( std::string_view sensorID ) noexcept
+{
+	// the buffer only grows when a longer ID comes, so reading the same sensors again doesn't allocate
+	_impl->requestBuffer.resize( SensorRequest::size( sensorID ) );
+	SensorRequest::encode( sensorID, _impl->requestBuffer.data() );
+
+	return _impl->exchangeSensor( _impl->requestBuffer.data(), _impl->requestBuffer.size() );
+}
+
+SensorReadResult UdpClient::requestSensorReading( const PreparedRequest & request ) noexcept
+{
+	return _impl->exchangeSensor( request.bytes().data(), request.bytes().size() );
+}
+
+SensorReadResult UdpClient::Impl::exchangeSensor( const uint8_t * requestData, size_t requestSize ) noexcept
+{
+	size_t replySize = 0;
+	RequestStatus status = exchange( requestData, requestSize, replySize );
+	if (status != RequestStatus::Success)
+	{
+		return { status, 0.0f };
+	}
+
+	SensorResponse response;
+	if (!own::fromBytes( make_span( replyBuffer.data(), replySize ), response ))
+	{
+		return { RequestStatus::InvalidReply, 0.0f };
+	}
+	return { toRequestStatus( response.code ), response.code == ResponseCode::Success ? response.value : 0.0f };
+}
+
+BatchReadResult UdpClient::requestSensorReadings( const std::vector< std::string > & sensorIDs ) noexcept
+{
+	BatchReadResult result = { RequestStatus::UnexpectedError, {} };
+
+	if (sensorIDs.size() > maxBatchSize)
+	{
+		return result;
+	}
+
+	const BatchRequest request( sensorIDs );
+	_impl->requestBuffer.resize( request.size() );
+	own::BinaryOutputStream stream( make_span( _impl->requestBuffer.data(), _impl->requestBuffer.size() ) );
+	stream << request;
+
+	size_t replySize = 0;
+	result.status = _impl->exchange( _impl->requestBuffer.data(), _impl->requestBuffer.size(), replySize );
+	if (result.status != RequestStatus::Success)
+	{
+		return result;
+	}
+
+	BatchResponse response;
+	if (!own::fromBytes( make_span( _impl->replyBuffer.data(), replySize ), response )
+	 || (response.code == ResponseCode::Success && response.codes.size() != sensorIDs.size()))
+	{
+		// a reply to some other batch can't be taken for this one, at least if the number of sensors differs
+		result.status = RequestStatus::InvalidReply;
+		return result;
+	}
+	if (response.code != ResponseCode::Success)
+	{
+		result.status = toRequestStatus( response.code );
+		return result;
+	}
+
+	result.sensors.resize( sensorIDs.size() );
+	for (size_t i = 0; i < sensorIDs.size(); ++i)
+	{
+		result.sensors[i].status = toRequestStatus( response.codes[i] );
+		result.sensors[i].sensorValue = response.values[i];
+	}
+	return result;
+}
+
+system_error_t UdpClient::getLastSystemError() const noexcept
+{
+	return _impl->lastSystemError;
+}
+
+string UdpClient::getLastSystemErrorStr() const noexcept
+{
+	return getErrorString( getLastSystemError() );
+}
+
+
+//======================================================================================================================
+
+
+} // namespace hwmon
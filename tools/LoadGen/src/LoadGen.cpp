@@ -0,0 +1,1081 @@
+//======================================================================================================================
+// Project: HwMonitorService
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: open-loop load generator measuring throughput and tail latency of the service
+//======================================================================================================================
+
+#include "../../../src/Protocol.hpp"
+
+#include <CppUtils-Essential/BinaryStream.hpp>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	using socket_t = SOCKET;
+	static const socket_t invalidSocket = INVALID_SOCKET;
+	#define poll WSAPoll
+#else
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <arpa/inet.h>
+	#include <poll.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+	using socket_t = int;
+	static const socket_t invalidSocket = -1;
+#endif
+
+#ifdef MSG_NOSIGNAL
+	static const int sendFlags = MSG_NOSIGNAL;  // report a broken connection by return value, not by SIGPIPE
+#else
+	static const int sendFlags = 0;
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <chrono>
+#include <random>
+#include <algorithm>
+using std::string;
+using std::vector;
+
+using Clock = std::chrono::steady_clock;
+
+
+//======================================================================================================================
+//  platform
+
+static bool initNetworking()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	return WSAStartup( MAKEWORD(2, 2), &wsaData ) == 0;
+#else
+	return true;
+#endif
+}
+
+static void closeSocket( socket_t sock )
+{
+#ifdef _WIN32
+	closesocket( sock );
+#else
+	close( sock );
+#endif
+}
+
+static bool setNonBlocking( socket_t sock )
+{
+#ifdef _WIN32
+	u_long enabled = 1;
+	return ioctlsocket( sock, FIONBIO, &enabled ) == 0;
+#else
+	int flags = fcntl( sock, F_GETFL, 0 );
+	return flags >= 0 && fcntl( sock, F_SETFL, flags | O_NONBLOCK ) == 0;
+#endif
+}
+
+static bool lastErrorWasWouldBlock()
+{
+#ifdef _WIN32
+	int error = WSAGetLastError();
+	return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+#else
+	return errno == EWOULDBLOCK || errno == EAGAIN || errno == EINPROGRESS;
+#endif
+}
+
+static bool connectFinishedSuccessfully( socket_t sock )
+{
+	int error = 0;
+	socklen_t length = sizeof(error);
+	return getsockopt( sock, SOL_SOCKET, SO_ERROR, (char *)&error, &length ) == 0 && error == 0;
+}
+
+
+//======================================================================================================================
+//  configuration
+
+enum class Kind
+{
+	Single,   ///< SensorRequest of a random sensor
+	Batch,    ///< BatchRequest of random sensors
+	Invalid,  ///< garbage that the server must reject, the server then closes the connection
+	Churn,    ///< reconnect and then send a SensorRequest, measures connection setup
+};
+static const size_t KindCount = 4;
+static const char * const KindNames [KindCount] = { "single", "batch", "invalid", "churn" };
+
+struct Options
+{
+	string host = "127.0.0.1";
+	uint16_t port = 17748;
+	unsigned connections = 100;
+	unsigned stalled = 0;         ///< extra connections that send requests but never read the responses
+	unsigned flooders = 0;        ///< extra connections that send requests as fast as the service takes them
+	unsigned bulk = 0;            ///< extra connections that keep the service busy with history requests
+	uint16_t bulkPort = 0;        ///< where the bulk connections connect to, the same port as the others if 0
+	double rate = 10000.0;        ///< requests per second across all connections
+	double duration_s = 10.0;
+	double warmup_s = 1.0;        ///< requests scheduled during warmup are not counted
+	unsigned timeout_ms = 1000;
+	unsigned batchSize = 16;
+	unsigned sensorCount = 256;   ///< number of sensors of the simulated provider to use
+	vector< string > sensorIDs;   ///< explicit sensor IDs, overrides sensorCount
+	std::array< double, KindCount > mix = {{ 1.0, 0.0, 0.0, 0.0 }};
+	string label;                 ///< copied to the output to identify the build being measured
+	string outputFile;            ///< stdout if empty
+};
+
+static void printUsage()
+{
+	printf(
+		"Usage: loadgen [options]\n"
+		"  --host <ip>            address of the service (default 127.0.0.1)\n"
+		"  --port <port>          port of the service (default 17748)\n"
+		"  --connections <n>      number of concurrent connections (default 100)\n"
+		"  --stalled <n>          extra connections that keep requesting /metrics and never read (default 0)\n"
+		"  --flooders <n>         extra connections that send sensor requests as fast as they can (default 0)\n"
+		"  --bulk <n>             extra connections that keep requesting the longest history of sensors (default 0)\n"
+		"  --bulk-port <port>     port the bulk connections connect to (default the same as --port)\n"
+		"  --rate <n>             requests per second, open loop (default 10000)\n"
+		"  --duration <s>         length of the measurement in seconds (default 10)\n"
+		"  --warmup <s>           requests in the first seconds are not counted (default 1)\n"
+		"  --timeout <ms>         a request without reply after this time counts as timed out (default 1000)\n"
+		"  --mix <kind=weight,..> request mix, kinds are single, batch, invalid, churn (default single=1)\n"
+		"  --batch-size <n>       number of sensors in a batch request (default 16)\n"
+		"  --sensor-count <n>     use sensors /simulated/<n/16>/temperature/<n%%16> (default 256)\n"
+		"  --sensors <id,id,..>   use these sensor IDs instead of the simulated ones\n"
+		"  --label <text>         label identifying the measured build, copied to the output\n"
+		"  --output <file>        write the JSON report to a file instead of stdout\n"
+	);
+}
+
+static vector< string > split( const string & str, char separator )
+{
+	vector< string > parts;
+	size_t start = 0;
+	while (start <= str.size())
+	{
+		size_t end = str.find( separator, start );
+		if (end == string::npos)
+			end = str.size();
+		if (end > start)
+			parts.push_back( str.substr( start, end - start ) );
+		start = end + 1;
+	}
+	return parts;
+}
+
+static bool parseMix( const string & str, std::array< double, KindCount > & mix )
+{
+	mix.fill( 0.0 );
+	for (const string & part : split( str, ',' ))
+	{
+		size_t eqPos = part.find( '=' );
+		string name = part.substr( 0, eqPos );
+		double weight = eqPos != string::npos ? atof( part.c_str() + eqPos + 1 ) : 1.0;
+		auto nameIter = std::find_if( std::begin(KindNames), std::end(KindNames), [&]( const char * n ) { return name == n; } );
+		if (nameIter == std::end(KindNames) || weight < 0.0)
+			return false;
+		mix[ size_t( nameIter - std::begin(KindNames) ) ] = weight;
+	}
+	return std::any_of( mix.begin(), mix.end(), []( double w ) { return w > 0.0; } );
+}
+
+static bool parseOptions( int argc, char * argv [], Options & opts )
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		if (arg == "--help" || arg == "-h" || i + 1 >= argc)
+			return false;
+		const char * value = argv[++i];
+
+		if      (arg == "--host")          opts.host = value;
+		else if (arg == "--port")          opts.port = uint16_t( atoi( value ) );
+		else if (arg == "--connections")   opts.connections = unsigned( atoi( value ) );
+		else if (arg == "--stalled")       opts.stalled = unsigned( atoi( value ) );
+		else if (arg == "--flooders")      opts.flooders = unsigned( atoi( value ) );
+		else if (arg == "--bulk")          opts.bulk = unsigned( atoi( value ) );
+		else if (arg == "--bulk-port")     opts.bulkPort = uint16_t( atoi( value ) );
+		else if (arg == "--rate")          opts.rate = atof( value );
+		else if (arg == "--duration")      opts.duration_s = atof( value );
+		else if (arg == "--warmup")        opts.warmup_s = atof( value );
+		else if (arg == "--timeout")       opts.timeout_ms = unsigned( atoi( value ) );
+		else if (arg == "--batch-size")    opts.batchSize = unsigned( atoi( value ) );
+		else if (arg == "--sensor-count")  opts.sensorCount = unsigned( atoi( value ) );
+		else if (arg == "--sensors")       opts.sensorIDs = split( value, ',' );
+		else if (arg == "--label")         opts.label = value;
+		else if (arg == "--output")        opts.outputFile = value;
+		else if (arg == "--mix")
+		{
+			if (!parseMix( value, opts.mix ))
+			{
+				fprintf( stderr, "invalid mix \"%s\"\n", value );
+				return false;
+			}
+		}
+		else
+		{
+			fprintf( stderr, "unknown option %s\n", arg.c_str() );
+			return false;
+		}
+	}
+
+	if (opts.connections == 0 || opts.rate <= 0.0 || opts.duration_s <= 0.0
+	 || opts.batchSize == 0 || opts.batchSize > maxBatchSize || (opts.sensorIDs.empty() && opts.sensorCount == 0))
+	{
+		fprintf( stderr, "invalid option values\n" );
+		return false;
+	}
+
+	if (opts.sensorIDs.empty())
+	{
+		for (unsigned i = 0; i < opts.sensorCount; ++i)
+		{
+			opts.sensorIDs.push_back( "/simulated/" + std::to_string( i / 16 ) + "/temperature/" + std::to_string( i % 16 ) );
+		}
+	}
+
+	return true;
+}
+
+
+//======================================================================================================================
+//  statistics
+
+struct Stats
+{
+	vector< uint64_t > latencies_ns;
+	uint64_t completed = 0;
+	uint64_t errorResponses = 0;   ///< responses with a code that was not expected for the kind of request
+	uint64_t busyResponses = 0;    ///< requests the server refused to process, they count as completed, not as errors
+	uint64_t timeouts = 0;
+	uint64_t connectionErrors = 0;
+};
+
+/// Statistics of the connections that don't read their responses.
+struct StalledStats
+{
+	uint64_t sentBytes = 0;      ///< how much the server accepted from them before it stopped reading
+	uint64_t disconnected = 0;   ///< how many of them the server has closed
+};
+
+/// Statistics of the connections that keep many requests on the way, the flooders and the bulk ones.
+struct FlooderStats
+{
+	uint64_t served = 0;         ///< requests answered with a value or an error
+	uint64_t busy = 0;           ///< requests answered with Busy
+	uint64_t disconnected = 0;   ///< how many of them the server has closed
+};
+
+// Flooders keep this many requests on the way, enough to keep the server busy, but they still read all the responses.
+static const unsigned floodDepth = 64;
+// The history responses are 16 kB each, so a few of them are enough to keep the server busy.
+static const unsigned bulkDepth = 8;
+
+static uint64_t percentile( const vector< uint64_t > & sorted, double p )
+{
+	if (sorted.empty())
+		return 0;
+	size_t idx = size_t( std::ceil( p * double( sorted.size() ) ) );
+	return sorted[ std::min( idx > 0 ? idx - 1 : 0, sorted.size() - 1 ) ];
+}
+
+static void printLatencies( FILE * out, vector< uint64_t > & latencies )
+{
+	std::sort( latencies.begin(), latencies.end() );
+	double sum = 0.0;
+	for (uint64_t latency : latencies)
+		sum += double( latency );
+	double mean = latencies.empty() ? 0.0 : sum / double( latencies.size() );
+
+	fprintf( out, "{ \"mean\": %.1f, \"p50\": %.1f, \"p99\": %.1f, \"p99.9\": %.1f, \"max\": %.1f }",
+		mean / 1000.0,
+		double( percentile( latencies, 0.5 ) ) / 1000.0,
+		double( percentile( latencies, 0.99 ) ) / 1000.0,
+		double( percentile( latencies, 0.999 ) ) / 1000.0,
+		double( latencies.empty() ? 0 : latencies.back() ) / 1000.0
+	);
+}
+
+
+//======================================================================================================================
+//  connections
+
+struct Scheduled
+{
+	Kind kind;
+	Clock::time_point intended;  ///< when the request should have been sent according to the open-loop schedule
+};
+
+struct Conn
+{
+	enum class State
+	{
+		Disconnected,
+		Connecting,
+		Idle,
+		Busy,
+	};
+
+	socket_t sock = invalidSocket;
+	State state = State::Disconnected;
+	bool hasRequest = false;           ///< a request is assigned to this connection and waiting to be sent or answered
+	Scheduled request;
+	Clock::time_point deadline;
+	Clock::time_point reconnectAt;
+	const vector< uint8_t > * requestData = nullptr;
+	size_t sent = 0;
+	vector< uint8_t > reply;
+	size_t received = 0;
+	unsigned outstanding = 0;          ///< only flooders have more than one request on the way
+};
+
+class LoadGenerator
+{
+ public:
+
+	LoadGenerator( const Options & opts ) : opts( opts ), random( 12345 ), kindDist( opts.mix.begin(), opts.mix.end() )
+	{
+		conns.resize( opts.connections );
+		stalledConns.resize( opts.stalled );
+		flooderConns.resize( opts.flooders );
+		bulkConns.resize( opts.bulk );
+		for (Conn & conn : conns)
+			conn.reply.resize( 8 + opts.batchSize * 8 );
+		for (Conn & conn : flooderConns)
+			conn.reply.resize( 4096 );
+		for (Conn & conn : bulkConns)
+			conn.reply.resize( 64 * 1024 );
+
+		// Encode all the requests in advance, so that we don't measure our own allocations.
+		for (const string & sensorID : opts.sensorIDs)
+		{
+			singleRequests.push_back( own::toByteVector( SensorRequest( sensorID ) ) );
+		}
+		for (size_t i = 0; i < std::max< size_t >( opts.sensorIDs.size(), 64 ); ++i)
+		{
+			vector< string > ids;
+			for (unsigned j = 0; j < opts.batchSize; ++j)
+				ids.push_back( opts.sensorIDs[ (i * opts.batchSize + j) % opts.sensorIDs.size() ] );
+			batchRequests.push_back( own::toByteVector( BatchRequest( ids ) ) );
+		}
+		for (const string & sensorID : opts.sensorIDs)
+		{
+			historyRequests.push_back( own::toByteVector( HistoryRequest( sensorID, maxHistoryWindow_s, maxHistoryPoints ) ) );
+		}
+		invalidRequest = { 'J', 'U', 'N', 'K', 'x', '\0' };
+		// the largest response for the smallest request, so that the stalled connections fill up their buffers quickly
+		const string metrics = "GET /metrics HTTP/1.1\r\nHost: loadgen\r\n\r\n";
+		metricsRequest.assign( metrics.begin(), metrics.end() );
+
+		memset( &serverAddr, 0, sizeof(serverAddr) );
+		serverAddr.sin_family = AF_INET;
+		serverAddr.sin_port = htons( opts.port );
+		inet_pton( AF_INET, opts.host.c_str(), &serverAddr.sin_addr );
+		bulkAddr = serverAddr;
+		if (opts.bulkPort != 0)
+			bulkAddr.sin_port = htons( opts.bulkPort );
+	}
+
+	bool connectAll()
+	{
+		auto now = Clock::now();
+		for (Conn & conn : conns)
+			startConnect( conn, now );
+		for (Conn & conn : stalledConns)
+			startConnect( conn, now );
+		for (Conn & conn : flooderConns)
+			startConnect( conn, now );
+		for (Conn & conn : bulkConns)
+			startConnect( conn, now );
+
+		// wait until all the connections are established, so that the setup doesn't pollute the measurement
+		auto giveUp = now + std::chrono::seconds( 10 );
+		while (Clock::now() < giveUp)
+		{
+			pollOnce( std::chrono::milliseconds( 10 ) );
+			size_t ready = size_t( std::count_if( conns.begin(), conns.end(), []( const Conn & c ) { return c.state == Conn::State::Idle; } ) );
+			// the server may disconnect the stalled ones right away, depending on its slow_client_policy
+			size_t stalledReady = size_t( std::count_if( stalledConns.begin(), stalledConns.end(), []( const Conn & c ) { return c.state != Conn::State::Connecting; } ) );
+			size_t floodersReady = size_t( std::count_if( flooderConns.begin(), flooderConns.end(), []( const Conn & c ) { return c.state != Conn::State::Connecting; } ) );
+			size_t bulkReady = size_t( std::count_if( bulkConns.begin(), bulkConns.end(), []( const Conn & c ) { return c.state != Conn::State::Connecting; } ) );
+			if (ready == conns.size() && stalledReady == stalledConns.size() && floodersReady == flooderConns.size() && bulkReady == bulkConns.size())
+				return true;
+		}
+		return false;
+	}
+
+	void run()
+	{
+		using namespace std::chrono;
+
+		const auto interval = duration_cast< Clock::duration >( duration< double >( 1.0 / opts.rate ) );
+		start = Clock::now();
+		measureFrom = start + duration_cast< Clock::duration >( duration< double >( opts.warmup_s ) );
+		measureTo = measureFrom + duration_cast< Clock::duration >( duration< double >( opts.duration_s ) );
+		const auto drainUntil = measureTo + milliseconds( opts.timeout_ms );
+
+		auto nextIntended = start;
+		auto nextTimeoutCheck = start;
+		Clock::time_point now;
+		while ((now = Clock::now()) < drainUntil)
+		{
+			// open loop: the schedule doesn't care whether the previous requests have been answered
+			while (nextIntended <= now && nextIntended < measureTo)
+			{
+				backlog.push_back({ Kind( kindDist( random ) ), nextIntended });
+				nextIntended += interval;
+			}
+
+			while (!backlog.empty() && !idle.empty())
+			{
+				// the longest idle first, so that every connection gets its share and none goes over the per-client limit
+				Conn & conn = conns[ idle.front() ];
+				idle.pop_front();
+				dispatch( conn, backlog.front(), now );
+				backlog.pop_front();
+			}
+
+			if (now >= nextTimeoutCheck)
+			{
+				checkTimeouts( now );
+				nextTimeoutCheck = now + milliseconds( 10 );
+			}
+
+			if (nextIntended >= measureTo && backlog.empty() && std::none_of( conns.begin(), conns.end(), []( const Conn & c ) { return c.hasRequest; } ))
+				break;
+
+			auto untilNext = nextIntended > now ? duration_cast< milliseconds >( nextIntended - now ) : milliseconds( 0 );
+			pollOnce( std::min( untilNext, milliseconds( 1 ) ) );
+		}
+		end = Clock::now();
+
+		// whatever remained unsent didn't make it in time
+		for (const Scheduled & scheduled : backlog)
+			if (isMeasured( scheduled ))
+				stats[ size_t( scheduled.kind ) ].timeouts++;
+	}
+
+	void report( FILE * out )
+	{
+		double measured_s = std::chrono::duration< double >( std::min( end, measureTo ) - measureFrom ).count();
+
+		Stats total;
+		for (Stats & kindStats : stats)
+		{
+			total.latencies_ns.insert( total.latencies_ns.end(), kindStats.latencies_ns.begin(), kindStats.latencies_ns.end() );
+			total.completed += kindStats.completed;
+			total.errorResponses += kindStats.errorResponses;
+			total.busyResponses += kindStats.busyResponses;
+			total.timeouts += kindStats.timeouts;
+			total.connectionErrors += kindStats.connectionErrors;
+		}
+
+		fprintf( out, "{\n" );
+		fprintf( out, "  \"label\": \"%s\",\n", opts.label.c_str() );
+		fprintf( out, "  \"config\": { \"connections\": %u, \"stalled\": %u, \"flooders\": %u, \"bulk\": %u, \"rate\": %.0f, \"duration_s\": %.1f, \"batch_size\": %u, \"sensors\": %zu,"
+		              " \"mix\": { \"single\": %g, \"batch\": %g, \"invalid\": %g, \"churn\": %g } },\n",
+			opts.connections, opts.stalled, opts.flooders, opts.bulk, opts.rate, opts.duration_s, opts.batchSize, opts.sensorIDs.size(),
+			opts.mix[0], opts.mix[1], opts.mix[2], opts.mix[3] );
+		fprintf( out, "  \"completed\": %llu,\n", (unsigned long long)total.completed );
+		fprintf( out, "  \"throughput_rps\": %.1f,\n", measured_s > 0.0 ? double( total.completed ) / measured_s : 0.0 );
+		fprintf( out, "  \"error_responses\": %llu,\n", (unsigned long long)total.errorResponses );
+		fprintf( out, "  \"busy_responses\": %llu,\n", (unsigned long long)total.busyResponses );
+		fprintf( out, "  \"timeouts\": %llu,\n", (unsigned long long)total.timeouts );
+		fprintf( out, "  \"connection_errors\": %llu,\n", (unsigned long long)total.connectionErrors );
+		if (opts.stalled > 0)
+		{
+			fprintf( out, "  \"stalled\": { \"sent_bytes\": %llu, \"disconnected\": %llu },\n",
+				(unsigned long long)stalledStats.sentBytes, (unsigned long long)stalledStats.disconnected );
+		}
+		if (opts.flooders > 0)
+		{
+			double flooded_s = std::chrono::duration< double >( end - start ).count();
+			fprintf( out, "  \"flooders\": { \"served_rps\": %.1f, \"busy_rps\": %.1f, \"disconnected\": %llu },\n",
+				flooded_s > 0.0 ? double( flooderStats.served ) / flooded_s : 0.0, flooded_s > 0.0 ? double( flooderStats.busy ) / flooded_s : 0.0,
+				(unsigned long long)flooderStats.disconnected );
+		}
+		if (opts.bulk > 0)
+		{
+			double bulk_s = std::chrono::duration< double >( end - start ).count();
+			fprintf( out, "  \"bulk\": { \"served_rps\": %.1f, \"busy_rps\": %.1f, \"disconnected\": %llu },\n",
+				bulk_s > 0.0 ? double( bulkStats.served ) / bulk_s : 0.0, bulk_s > 0.0 ? double( bulkStats.busy ) / bulk_s : 0.0,
+				(unsigned long long)bulkStats.disconnected );
+		}
+		fprintf( out, "  \"latency_us\": " );
+		printLatencies( out, total.latencies_ns );
+		fprintf( out, ",\n  \"kinds\": {\n" );
+		bool first = true;
+		for (size_t kind = 0; kind < KindCount; ++kind)
+		{
+			if (opts.mix[ kind ] <= 0.0)
+				continue;
+			fprintf( out, "%s    \"%s\": { \"completed\": %llu, \"error_responses\": %llu, \"busy_responses\": %llu, \"timeouts\": %llu, \"latency_us\": ",
+				first ? "" : ",\n", KindNames[ kind ], (unsigned long long)stats[ kind ].completed, (unsigned long long)stats[ kind ].errorResponses,
+				(unsigned long long)stats[ kind ].busyResponses, (unsigned long long)stats[ kind ].timeouts );
+			printLatencies( out, stats[ kind ].latencies_ns );
+			fprintf( out, " }" );
+			first = false;
+		}
+		fprintf( out, "\n  }\n}\n" );
+	}
+
+ private:
+
+	bool isMeasured( const Scheduled & scheduled ) const
+	{
+		return scheduled.intended >= measureFrom && scheduled.intended < measureTo;
+	}
+
+	void startConnect( Conn & conn, Clock::time_point now )
+	{
+		conn.sock = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+		if (conn.sock == invalidSocket || !setNonBlocking( conn.sock ))
+		{
+			failConnect( conn, now );
+			return;
+		}
+		int noDelay = 1;
+		setsockopt( conn.sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay) );
+
+		const sockaddr_in & addr = isBulk( conn ) ? bulkAddr : serverAddr;
+		if (::connect( conn.sock, (const sockaddr *)&addr, sizeof(addr) ) == 0)
+			onConnected( conn, now );
+		else if (lastErrorWasWouldBlock())
+			conn.state = Conn::State::Connecting;
+		else
+			failConnect( conn, now );
+	}
+
+	void failConnect( Conn & conn, Clock::time_point now )
+	{
+		if (isStalled( conn ) || isPipelined( conn ))
+		{
+			// the server is allowed to disconnect them, don't connect them again
+			if (conn.sock != invalidSocket)
+				closeSocket( conn.sock );
+			conn.sock = invalidSocket;
+			conn.state = Conn::State::Disconnected;
+			if (isStalled( conn ))
+				stalledStats.disconnected++;
+			else
+				pipelinedStats( conn ).disconnected++;
+			return;
+		}
+
+		if (conn.sock != invalidSocket)
+			closeSocket( conn.sock );
+		conn.sock = invalidSocket;
+		conn.state = Conn::State::Disconnected;
+		conn.reconnectAt = now + std::chrono::milliseconds( 100 );
+		if (conn.hasRequest && isMeasured( conn.request ))
+			stats[ size_t( conn.request.kind ) ].connectionErrors++;
+		conn.hasRequest = false;
+	}
+
+	bool isStalled( const Conn & conn ) const
+	{
+		return &conn >= stalledConns.data() && &conn < stalledConns.data() + stalledConns.size();
+	}
+
+	bool isFlooder( const Conn & conn ) const
+	{
+		return &conn >= flooderConns.data() && &conn < flooderConns.data() + flooderConns.size();
+	}
+
+	bool isBulk( const Conn & conn ) const
+	{
+		return &conn >= bulkConns.data() && &conn < bulkConns.data() + bulkConns.size();
+	}
+
+	/// The connections that keep many requests on the way and don't measure their latency.
+	bool isPipelined( const Conn & conn ) const
+	{
+		return isFlooder( conn ) || isBulk( conn );
+	}
+
+	FlooderStats & pipelinedStats( const Conn & conn )
+	{
+		return isBulk( conn ) ? bulkStats : flooderStats;
+	}
+
+	void onConnected( Conn & conn, Clock::time_point now )
+	{
+		if (isStalled( conn ))
+		{
+			// always busy sending, never receiving
+			conn.state = Conn::State::Busy;
+			conn.requestData = &metricsRequest;
+			conn.sent = 0;
+			flood( conn );
+		}
+		else if (isPipelined( conn ))
+		{
+			conn.state = Conn::State::Busy;
+			conn.requestData = isBulk( conn )
+				? &historyRequests[ size_t( &conn - bulkConns.data() ) % historyRequests.size() ]
+				: &singleRequests[ size_t( &conn - flooderConns.data() ) % singleRequests.size() ];
+			conn.sent = 0;
+			conn.received = 0;
+			conn.outstanding = 0;
+			floodPipelined( conn );
+		}
+		else if (conn.hasRequest)  // churn: the request was waiting for the new connection
+		{
+			conn.state = Conn::State::Busy;
+			sendPending( conn, now );
+		}
+		else
+		{
+			conn.state = Conn::State::Idle;
+			idle.push_back( size_t( &conn - conns.data() ) );
+		}
+	}
+
+	void reconnect( Conn & conn, Clock::time_point now )
+	{
+		closeSocket( conn.sock );
+		conn.sock = invalidSocket;
+		startConnect( conn, now );
+	}
+
+	void dispatch( Conn & conn, const Scheduled & scheduled, Clock::time_point now )
+	{
+		conn.hasRequest = true;
+		conn.request = scheduled;
+		conn.deadline = now + std::chrono::milliseconds( opts.timeout_ms );
+		conn.sent = 0;
+		conn.received = 0;
+
+		switch (scheduled.kind)
+		{
+			case Kind::Single:
+			case Kind::Churn:
+				conn.requestData = &singleRequests[ random() % singleRequests.size() ];
+				break;
+			case Kind::Batch:
+				conn.requestData = &batchRequests[ random() % batchRequests.size() ];
+				break;
+			case Kind::Invalid:
+				conn.requestData = &invalidRequest;
+				break;
+		}
+
+		if (scheduled.kind == Kind::Churn)
+		{
+			reconnect( conn, now );
+		}
+		else
+		{
+			conn.state = Conn::State::Busy;
+			sendPending( conn, now );
+		}
+	}
+
+	void sendPending( Conn & conn, Clock::time_point now )
+	{
+		const vector< uint8_t > & data = *conn.requestData;
+		while (conn.sent < data.size())
+		{
+			auto sent = send( conn.sock, (const char *)data.data() + conn.sent, int( data.size() - conn.sent ), sendFlags );
+			if (sent > 0)
+			{
+				conn.sent += size_t( sent );
+			}
+			else if (sent < 0 && lastErrorWasWouldBlock())
+			{
+				return;  // wait until writable
+			}
+			else
+			{
+				failConnect( conn, now );
+				startConnect( conn, now );
+				return;
+			}
+		}
+	}
+
+	/// Sends the same request over and over, until the system buffer is full because the server stopped reading.
+	void flood( Conn & conn )
+	{
+		const vector< uint8_t > & data = *conn.requestData;
+		while (true)
+		{
+			auto sent = send( conn.sock, (const char *)data.data() + conn.sent, int( data.size() - conn.sent ), sendFlags );
+			if (sent > 0)
+			{
+				stalledStats.sentBytes += uint64_t( sent );
+				conn.sent = (conn.sent + size_t( sent )) % data.size();
+			}
+			else if (sent < 0 && lastErrorWasWouldBlock())
+			{
+				return;  // wait until writable
+			}
+			else
+			{
+				failConnect( conn, Clock::now() );
+				return;
+			}
+		}
+	}
+
+	/// Keeps floodDepth or bulkDepth requests on the way and counts the responses, ignoring when the server asks to wait.
+	void floodPipelined( Conn & conn )
+	{
+		FlooderStats & pipelined = pipelinedStats( conn );
+		const unsigned depth = isBulk( conn ) ? bulkDepth : floodDepth;
+		while (true)
+		{
+			auto received = recv( conn.sock, (char *)conn.reply.data() + conn.received, int( conn.reply.size() - conn.received ), 0 );
+			if (received > 0)
+			{
+				conn.received += size_t( received );
+				size_t offset = 0;
+				while (conn.received - offset >= 4)
+				{
+					const uint8_t * data = conn.reply.data() + offset;
+					uint32_t code = uint32_t( data[0] ) << 24 | uint32_t( data[1] ) << 16 | uint32_t( data[2] ) << 8 | data[3];
+					// the responses to single requests are 8 bytes with a value or Busy, 4 bytes with an error,
+					// the history responses tell their number of points
+					size_t length = code == uint32_t( ResponseCode::Busy ) ? BusyResponse::size() : 4;
+					if (code == uint32_t( ResponseCode::Success ) && !isBulk( conn ))
+					{
+						length = 8;
+					}
+					else if (code == uint32_t( ResponseCode::Success ))
+					{
+						if (conn.received - offset < HistoryResponse::headerSize())
+							break;
+						const uint8_t * countData = data + HistoryResponse::headerSize() - 4;
+						uint32_t pointCount = uint32_t( countData[0] ) << 24 | uint32_t( countData[1] ) << 16 | uint32_t( countData[2] ) << 8 | countData[3];
+						length = HistoryResponse::headerSize() + pointCount * HistoryResponse::pointSize();
+					}
+					if (conn.received - offset < length)
+						break;
+					if (code == uint32_t( ResponseCode::Busy ))
+						pipelined.busy++;
+					else
+						pipelined.served++;
+					conn.outstanding--;
+					offset += length;
+				}
+				memmove( conn.reply.data(), conn.reply.data() + offset, conn.received - offset );
+				conn.received -= offset;
+			}
+			else if (received < 0 && lastErrorWasWouldBlock())
+			{
+				break;
+			}
+			else
+			{
+				failConnect( conn, Clock::now() );
+				return;
+			}
+		}
+
+		const vector< uint8_t > & data = *conn.requestData;
+		while (conn.outstanding < depth)
+		{
+			auto sent = send( conn.sock, (const char *)data.data() + conn.sent, int( data.size() - conn.sent ), sendFlags );
+			if (sent > 0)
+			{
+				conn.sent += size_t( sent );
+				if (conn.sent == data.size())
+				{
+					conn.sent = 0;
+					conn.outstanding++;
+				}
+			}
+			else if (sent < 0 && lastErrorWasWouldBlock())
+			{
+				return;  // wait until writable
+			}
+			else
+			{
+				failConnect( conn, Clock::now() );
+				return;
+			}
+		}
+	}
+
+	/// Returns how many bytes of the reply we need in total, given how many we have so far.
+	size_t expectedReplyLength( const Conn & conn ) const
+	{
+		if (conn.received < 4)
+			return 4;
+		uint32_t code = uint32_t( conn.reply[0] ) << 24 | uint32_t( conn.reply[1] ) << 16 | uint32_t( conn.reply[2] ) << 8 | conn.reply[3];
+		if (code == uint32_t( ResponseCode::Busy ))
+			return BusyResponse::size();
+		if (code != uint32_t( ResponseCode::Success ))
+			return 4;
+		if (conn.request.kind != Kind::Batch)
+			return 8;
+		if (conn.received < 8)
+			return 8;
+		uint32_t count = uint32_t( conn.reply[4] ) << 24 | uint32_t( conn.reply[5] ) << 16 | uint32_t( conn.reply[6] ) << 8 | conn.reply[7];
+		return 8 + size_t( std::min( count, opts.batchSize ) ) * 8;
+	}
+
+	void receivePending( Conn & conn, Clock::time_point now )
+	{
+		while (true)
+		{
+			size_t expected = expectedReplyLength( conn );
+			if (conn.received >= expected)
+				break;
+
+			auto received = recv( conn.sock, (char *)conn.reply.data() + conn.received, int( expected - conn.received ), 0 );
+			if (received > 0)
+			{
+				conn.received += size_t( received );
+			}
+			else if (received < 0 && lastErrorWasWouldBlock())
+			{
+				return;  // wait for the rest
+			}
+			else
+			{
+				// closed or broken - that's expected after an invalid request, otherwise it's an error
+				if (conn.request.kind != Kind::Invalid && isMeasured( conn.request ))
+					stats[ size_t( conn.request.kind ) ].connectionErrors++;
+				conn.hasRequest = false;
+				reconnect( conn, now );
+				return;
+			}
+		}
+
+		complete( conn, now );
+	}
+
+	void complete( Conn & conn, Clock::time_point now )
+	{
+		uint32_t code = uint32_t( conn.reply[0] ) << 24 | uint32_t( conn.reply[1] ) << 16 | uint32_t( conn.reply[2] ) << 8 | conn.reply[3];
+		ResponseCode expectedCode = conn.request.kind == Kind::Invalid ? ResponseCode::InvalidRequest : ResponseCode::Success;
+
+		if (isMeasured( conn.request ))
+		{
+			Stats & kindStats = stats[ size_t( conn.request.kind ) ];
+			kindStats.completed++;
+			kindStats.latencies_ns.push_back( uint64_t( std::chrono::duration_cast< std::chrono::nanoseconds >( now - conn.request.intended ).count() ) );
+			if (code == uint32_t( ResponseCode::Busy ))
+				kindStats.busyResponses++;
+			else if (code != uint32_t( expectedCode ))
+				kindStats.errorResponses++;
+		}
+
+		conn.hasRequest = false;
+		if (conn.request.kind == Kind::Invalid)
+		{
+			reconnect( conn, now );  // the server closes the connection after an invalid request
+		}
+		else
+		{
+			conn.state = Conn::State::Idle;
+			idle.push_back( size_t( &conn - conns.data() ) );
+		}
+	}
+
+	void checkTimeouts( Clock::time_point now )
+	{
+		for (Conn & conn : conns)
+		{
+			if (conn.hasRequest && now >= conn.deadline)
+			{
+				if (isMeasured( conn.request ))
+					stats[ size_t( conn.request.kind ) ].timeouts++;
+				conn.hasRequest = false;
+				// the reply might still arrive and would confuse the next request
+				reconnect( conn, now );
+			}
+			else if (conn.state == Conn::State::Disconnected && now >= conn.reconnectAt)
+			{
+				startConnect( conn, now );
+			}
+		}
+	}
+
+	void pollOnce( std::chrono::milliseconds timeout )
+	{
+		pollFds.clear();
+		pollConns.clear();
+		for (Conn & conn : conns)
+		{
+			short events = 0;
+			if (conn.state == Conn::State::Connecting)
+				events = POLLOUT;
+			else if (conn.state == Conn::State::Busy)
+				events = conn.sent < conn.requestData->size() ? POLLOUT : POLLIN;
+			if (events)
+			{
+				pollfd pfd;
+				pfd.fd = conn.sock;
+				pfd.events = events;
+				pfd.revents = 0;
+				pollFds.push_back( pfd );
+				pollConns.push_back( &conn );
+			}
+		}
+
+		for (Conn & conn : stalledConns)
+		{
+			if (conn.state == Conn::State::Connecting || conn.state == Conn::State::Busy)
+			{
+				pollfd pfd;
+				pfd.fd = conn.sock;
+				pfd.events = POLLOUT;
+				pfd.revents = 0;
+				pollFds.push_back( pfd );
+				pollConns.push_back( &conn );
+			}
+		}
+
+		for (vector< Conn > * pipelinedConns : { &flooderConns, &bulkConns })
+		{
+			for (Conn & conn : *pipelinedConns)
+			{
+				if (conn.state == Conn::State::Connecting || conn.state == Conn::State::Busy)
+				{
+					const unsigned depth = isBulk( conn ) ? bulkDepth : floodDepth;
+					pollfd pfd;
+					pfd.fd = conn.sock;
+					pfd.events = short( conn.state == Conn::State::Connecting || conn.outstanding < depth ? POLLOUT | POLLIN : POLLIN );
+					pfd.revents = 0;
+					pollFds.push_back( pfd );
+					pollConns.push_back( &conn );
+				}
+			}
+		}
+
+		if (pollFds.empty())
+			return;
+
+		int ready = poll( pollFds.data(), (unsigned long)pollFds.size(), int( timeout.count() ) );
+		if (ready <= 0)
+			return;
+
+		auto now = Clock::now();
+		for (size_t i = 0; i < pollFds.size(); ++i)
+		{
+			if (pollFds[i].revents == 0)
+				continue;
+			Conn & conn = *pollConns[i];
+
+			if (conn.state == Conn::State::Connecting)
+			{
+				if (connectFinishedSuccessfully( conn.sock ))
+					onConnected( conn, now );
+				else
+					failConnect( conn, now );
+			}
+			else if (isStalled( conn ))
+			{
+				flood( conn );
+			}
+			else if (isPipelined( conn ))
+			{
+				floodPipelined( conn );
+			}
+			else if (conn.state == Conn::State::Busy)
+			{
+				if (conn.sent < conn.requestData->size())
+					sendPending( conn, now );
+				else
+					receivePending( conn, now );
+			}
+		}
+	}
+
+ private:
+
+	const Options & opts;
+
+	std::mt19937 random;
+	std::discrete_distribution< int > kindDist;
+
+	sockaddr_in serverAddr;
+	sockaddr_in bulkAddr;
+
+	vector< vector< uint8_t > > singleRequests;
+	vector< vector< uint8_t > > batchRequests;
+	vector< uint8_t > invalidRequest;
+	vector< uint8_t > metricsRequest;
+	vector< vector< uint8_t > > historyRequests;
+
+	vector< Conn > conns;
+	vector< Conn > stalledConns;
+	StalledStats stalledStats;
+	vector< Conn > flooderConns;
+	FlooderStats flooderStats;
+	vector< Conn > bulkConns;
+	FlooderStats bulkStats;
+	std::deque< size_t > idle;
+	std::deque< Scheduled > backlog;
+
+	vector< pollfd > pollFds;
+	vector< Conn * > pollConns;
+
+	Clock::time_point start, measureFrom, measureTo, end;
+	std::array< Stats, KindCount > stats;
+};
+
+
+//======================================================================================================================
+
+int main( int argc, char * argv [] )
+{
+	Options opts;
+	if (!parseOptions( argc, argv, opts ))
+	{
+		printUsage();
+		return 1;
+	}
+
+	if (!initNetworking())
+	{
+		fprintf( stderr, "Failed to initialize networking\n" );
+		return 2;
+	}
+
+	LoadGenerator generator( opts );
+
+	fprintf( stderr, "Connecting %u clients (+ %u stalled, %u flooders, %u bulk) to %s:%u\n",
+		opts.connections, opts.stalled, opts.flooders, opts.bulk, opts.host.c_str(), unsigned( opts.port ) );
+	if (!generator.connectAll())
+	{
+		fprintf( stderr, "Failed to establish all connections, is max_connected_clients high enough?\n" );
+		return 3;
+	}
+
+	fprintf( stderr, "Running %.0f requests/s for %.1f s (+ %.1f s warmup)\n", opts.rate, opts.duration_s, opts.warmup_s );
+	generator.run();
+
+	FILE * out = stdout;
+	if (!opts.outputFile.empty())
+	{
+		out = fopen( opts.outputFile.c_str(), "w" );
+		if (!out)
+		{
+			fprintf( stderr, "Failed to open %s\n", opts.outputFile.c_str() );
+			return 4;
+		}
+	}
+	generator.report( out );
+	if (out != stdout)
+		fclose( out );
+
+	return 0;
+}